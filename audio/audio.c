@@ -28,6 +28,7 @@
 #include "common/common.h"
 #include "fmt-conversion.h"
 #include "audio.h"
+#include "convert.h"
 
 static void update_redundant_info(struct mp_audio *mpa)
 {
@@ -230,15 +231,8 @@ void mp_audio_copy(struct mp_audio *dst, int dst_offset,
                    struct mp_audio *src, int src_offset, int length)
 {
     assert(mp_audio_config_equals(dst, src));
-    assert(length >= 0);
-    assert(dst_offset >= 0 && dst_offset + length <= dst->samples);
-    assert(src_offset >= 0 && src_offset + length <= src->samples);
-
-    for (int n = 0; n < dst->num_planes; n++) {
-        memmove((char *)dst->planes[n] + dst_offset * dst->sstride,
-                (char *)src->planes[n] + src_offset * src->sstride,
-                length * dst->sstride);
-    }
+    // With equal formats, this is a memmove() (buffers can overlap).
+    mp_audio_convert(dst, dst_offset, src, src_offset, length);
 }
 
 // Copy fields that describe characteristics of the audio frame, but which are
@@ -23,6 +23,7 @@
 
 #include "audio_buffer.h"
 #include "audio.h"
+#include "convert.h"
 #include "format.h"
 
 struct mp_audio_buffer {
@@ -99,13 +100,14 @@ void mp_audio_buffer_finish_write(struct mp_audio_buffer *ab, int samples)
 
 // Append data to the end of the buffer.
 // If the buffer is not large enough, it is transparently resized.
-// For now always copies the data.
+// For now always copies the data. mpa can use a different sample format than
+// the buffer (it's converted), but must have the same channel layout.
 void mp_audio_buffer_append(struct mp_audio_buffer *ab, struct mp_audio *mpa)
 {
     int offset = ab->buffer->samples;
     ab->buffer->samples += mpa->samples;
     mp_audio_realloc_min(ab->buffer, ab->buffer->samples);
-    mp_audio_copy(ab->buffer, offset, mpa, 0, mpa->samples);
+    mp_audio_convert(ab->buffer, offset, mpa, 0, mpa->samples);
 }
 
 // Prepend silence to the start of the buffer.
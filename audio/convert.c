@@ -0,0 +1,385 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "osdep/endian.h"
+
+#include "audio.h"
+#include "format.h"
+#include "convert.h"
+
+// Samples per channel converted in one go. Strided (interleaved) and S24 data
+// go through temporary buffers of this size on the stack.
+#define BLOCK 256
+
+// The inner loops work on CHUNK samples with a constant trip count and
+// non-aliasing pointers, which is what compilers need to vectorize them at
+// the default optimization level. The remainder is done by the same
+// expression in a plain loop.
+#define CHUNK 16
+
+enum {
+    T_U8,
+    T_S16,
+    T_S32,
+    T_FLOAT,
+    T_DOUBLE,
+    T_COUNT
+};
+
+// Round to nearest with the default FPU rounding mode: adding and subtracting
+// 1.5*2^23 (1.5*2^52) drops the fraction bits. This is exact for values that
+// fit into the target integer type, and unlike lrintf() it can be vectorized.
+#define ROUNDF(x) (((x) + 12582912.0f) - 12582912.0f)
+#define ROUNDD(x) (((x) + 6755399441055744.0) - 6755399441055744.0)
+
+// Clipping in two separate steps (instead of MPCLAMP) compiles to min/max
+// instructions without branches.
+static inline float clipf(float x, float min, float max)
+{
+    x = x < min ? min : x;
+    return x > max ? max : x;
+}
+
+static inline double clipd(double x, double min, double max)
+{
+    x = x < min ? min : x;
+    return x > max ? max : x;
+}
+
+// Rounding before clipping gives the same result (the limits are integers),
+// but unlike the other way around, gcc manages to vectorize it.
+#define F2I(x, scale, type) \
+    ((type)clipf(ROUNDF((x) * (scale)), -(scale), (scale) - 1.0f))
+#define D2I(x, scale, type) \
+    ((type)clipd(ROUNDD((x) * (scale)), -(scale), (scale) - 1.0))
+
+typedef void (*conv_fn)(void *dst, const void *src, int n);
+
+#define CONV(name, dst_t, src_t, expr)                                      \
+    static void name##_chunk(dst_t *restrict dst,                          \
+                             const src_t *restrict src)                    \
+    {                                                                      \
+        for (int i = 0; i < CHUNK; i++) {                                  \
+            src_t x = src[i];                                              \
+            dst[i] = (expr);                                               \
+        }                                                                  \
+    }                                                                      \
+    static void name(void *dstp, const void *srcp, int n)                  \
+    {                                                                      \
+        dst_t *dst = dstp;                                                 \
+        const src_t *src = srcp;                                           \
+        int i = 0;                                                         \
+        for (; i + CHUNK <= n; i += CHUNK)                                 \
+            name##_chunk(dst + i, src + i);                                \
+        for (; i < n; i++) {                                               \
+            src_t x = src[i];                                              \
+            dst[i] = (expr);                                               \
+        }                                                                  \
+    }
+
+CONV(u8_u8,   uint8_t, uint8_t, x)
+CONV(s16_u8,  int16_t, uint8_t, (int16_t)((x - 128) * 256))
+CONV(s32_u8,  int32_t, uint8_t, (int32_t)((uint32_t)(x - 128) << 24))
+CONV(flt_u8,  float,   uint8_t, (x - 128) * (1.0f / 128))
+CONV(dbl_u8,  double,  uint8_t, (x - 128) * (1.0 / 128))
+
+CONV(u8_s16,  uint8_t, int16_t, (uint8_t)((x >> 8) + 128))
+CONV(s16_s16, int16_t, int16_t, x)
+CONV(s32_s16, int32_t, int16_t, (int32_t)((uint32_t)x << 16))
+CONV(flt_s16, float,   int16_t, x * (1.0f / 32768))
+CONV(dbl_s16, double,  int16_t, x * (1.0 / 32768))
+
+CONV(u8_s32,  uint8_t, int32_t, (uint8_t)((x >> 24) + 128))
+CONV(s16_s32, int16_t, int32_t, (int16_t)(x >> 16))
+CONV(s32_s32, int32_t, int32_t, x)
+CONV(flt_s32, float,   int32_t, x * (1.0f / 2147483648.0f))
+CONV(dbl_s32, double,  int32_t, x * (1.0 / 2147483648.0))
+
+CONV(u8_flt,  uint8_t, float, (uint8_t)(F2I(x, 128.0f, int32_t) + 128))
+CONV(s16_flt, int16_t, float, F2I(x, 32768.0f, int16_t))
+CONV(s32_flt, int32_t, float, D2I((double)x, 2147483648.0, int32_t))
+CONV(flt_flt, float,   float, x)
+CONV(dbl_flt, double,  float, x)
+
+CONV(u8_dbl,  uint8_t, double, (uint8_t)(D2I(x, 128.0, int32_t) + 128))
+CONV(s16_dbl, int16_t, double, D2I(x, 32768.0, int16_t))
+CONV(s32_dbl, int32_t, double, D2I(x, 2147483648.0, int32_t))
+CONV(flt_dbl, float,   double, (float)x)
+CONV(dbl_dbl, double,  double, x)
+
+// conv_fns[dst][src]
+static const conv_fn conv_fns[T_COUNT][T_COUNT] = {
+    [T_U8]     = {u8_u8,  u8_s16,  u8_s32,  u8_flt,  u8_dbl},
+    [T_S16]    = {s16_u8, s16_s16, s16_s32, s16_flt, s16_dbl},
+    [T_S32]    = {s32_u8, s32_s16, s32_s32, s32_flt, s32_dbl},
+    [T_FLOAT]  = {flt_u8, flt_s16, flt_s32, flt_flt, flt_dbl},
+    [T_DOUBLE] = {dbl_u8, dbl_s16, dbl_s32, dbl_flt, dbl_dbl},
+};
+
+// Return the T_ type the samples are converted as (S24 is unpacked to S32),
+// or -1 if unsupported.
+static int get_type(int format)
+{
+    switch (af_fmt_from_planar(format)) {
+    case AF_FORMAT_U8:      return T_U8;
+    case AF_FORMAT_S16:     return T_S16;
+    case AF_FORMAT_S24:
+    case AF_FORMAT_S32:     return T_S32;
+    case AF_FORMAT_FLOAT:   return T_FLOAT;
+    case AF_FORMAT_DOUBLE:  return T_DOUBLE;
+    }
+    return -1;
+}
+
+static const int type_size[T_COUNT] = {1, 2, 4, 4, 8};
+
+// S24 is packed into 3 bytes; these are the upper 3 bytes of a S32 sample.
+// The LSB is always ignored.
+#if BYTE_ORDER == BIG_ENDIAN
+#define SHIFT24(x) ((3-(x))*8)
+#else
+#define SHIFT24(x) (((x)+1)*8)
+#endif
+
+// stride is in samples (3 bytes each).
+static void pack_s24_strided(uint8_t *restrict dst, int stride,
+                             const uint32_t *restrict src, int n)
+{
+    for (int i = 0; i < n; i++) {
+        uint8_t *ptr = dst + i * stride * 3;
+        ptr[0] = src[i] >> SHIFT24(0);
+        ptr[1] = src[i] >> SHIFT24(1);
+        ptr[2] = src[i] >> SHIFT24(2);
+    }
+}
+
+static void unpack_s24_strided(uint32_t *restrict dst,
+                               const uint8_t *restrict src, int stride, int n)
+{
+    for (int i = 0; i < n; i++) {
+        const uint8_t *ptr = src + i * stride * 3;
+        dst[i] = ((uint32_t)ptr[0] << SHIFT24(0)) |
+                 ((uint32_t)ptr[1] << SHIFT24(1)) |
+                 ((uint32_t)ptr[2] << SHIFT24(2));
+    }
+}
+
+#define STRIDED(type)                                                       \
+    static void gather_##type(type *restrict dst, const type *restrict src, \
+                              int stride, int n)                            \
+    {                                                                       \
+        for (int i = 0; i < n; i++)                                         \
+            dst[i] = src[i * stride];                                       \
+    }                                                                       \
+    static void scatter_##type(type *restrict dst, int stride,              \
+                               const type *restrict src, int n)             \
+    {                                                                       \
+        for (int i = 0; i < n; i++)                                         \
+            dst[i * stride] = src[i];                                       \
+    }
+
+STRIDED(uint8_t)
+STRIDED(uint16_t)
+STRIDED(uint32_t)
+STRIDED(uint64_t)
+
+static void gather(void *dst, const void *src, int stride, int n, int size)
+{
+    switch (size) {
+    case 1: gather_uint8_t(dst, src, stride, n); break;
+    case 2: gather_uint16_t(dst, src, stride, n); break;
+    case 4: gather_uint32_t(dst, src, stride, n); break;
+    case 8: gather_uint64_t(dst, src, stride, n); break;
+    default: abort();
+    }
+}
+
+static void scatter(void *dst, int stride, const void *src, int n, int size)
+{
+    switch (size) {
+    case 1: scatter_uint8_t(dst, stride, src, n); break;
+    case 2: scatter_uint16_t(dst, stride, src, n); break;
+    case 4: scatter_uint32_t(dst, stride, src, n); break;
+    case 8: scatter_uint64_t(dst, stride, src, n); break;
+    default: abort();
+    }
+}
+
+struct conv {
+    conv_fn fn;
+    int src_size, dst_size;     // bytes per (unpacked) sample
+    bool src_s24, dst_s24;
+};
+
+// Convert n samples. The strides are in samples. Contiguous data without S24
+// is converted directly; everything else goes through the block buffers.
+static void convert_run(const struct conv *cv, void *dst, int dst_stride,
+                        const void *src, int src_stride, int n)
+{
+    uint64_t tmp_in[BLOCK], tmp_out[BLOCK];
+    int dst_bytes = cv->dst_s24 ? 3 : cv->dst_size;
+    int src_bytes = cv->src_s24 ? 3 : cv->src_size;
+
+    for (int pos = 0; pos < n; pos += BLOCK) {
+        int len = MPMIN(BLOCK, n - pos);
+        const void *s = (const char *)src + pos * src_stride * src_bytes;
+        void *d = (char *)dst + pos * dst_stride * dst_bytes;
+
+        const void *in = s;
+        if (cv->src_s24) {
+            unpack_s24_strided((void *)tmp_in, s, src_stride, len);
+            in = tmp_in;
+        } else if (src_stride != 1) {
+            gather(tmp_in, s, src_stride, len, cv->src_size);
+            in = tmp_in;
+        }
+
+        bool direct_out = !cv->dst_s24 && dst_stride == 1;
+        cv->fn(direct_out ? d : (void *)tmp_out, in, len);
+
+        if (cv->dst_s24) {
+            pack_s24_strided(d, dst_stride, (void *)tmp_out, len);
+        } else if (!direct_out) {
+            scatter(d, dst_stride, tmp_out, len, cv->dst_size);
+        }
+    }
+}
+
+static void fill_silence(void *dst, int stride, int n, int format)
+{
+    int size = af_fmt_to_bytes(format);
+    if (stride == 1) {
+        af_fill_silence(dst, n * size, format);
+        return;
+    }
+    for (int i = 0; i < n; i++)
+        af_fill_silence((char *)dst + i * stride * size, size, format);
+}
+
+// Whether mp_audio_convert() can convert from src_format to dst_format.
+bool mp_audio_convert_supported(int dst_format, int src_format)
+{
+    if (dst_format == src_format)
+        return true;
+    return get_type(dst_format) >= 0 && get_type(src_format) >= 0;
+}
+
+static bool is_identity(const int *reorder, int num)
+{
+    if (!reorder)
+        return true;
+    for (int n = 0; n < num; n++) {
+        if (reorder[n] != n)
+            return false;
+    }
+    return true;
+}
+
+// Copy length samples from src (starting at src_offset) to dst (starting at
+// dst_offset), converting the sample format and/or between planar and
+// interleaved layout as needed. Integer formats are scaled to the full range,
+// float to integer conversion rounds and clips. Both must have the same
+// rate, and mp_audio_convert_supported() must be true for the formats.
+// dst channel n is taken from src channel reorder[n] (or silence if -1), which
+// also allows src to have a different number of channels. reorder can be NULL
+// (no reordering; then the number of channels must be the same).
+// Unless the formats are equal and reorder is NULL or the identity (which
+// behaves like memmove), the buffers must not overlap.
+void mp_audio_convert_reorder(struct mp_audio *dst, int dst_offset,
+                              struct mp_audio *src, int src_offset, int length,
+                              const int *reorder)
+{
+    assert(length >= 0);
+    assert(dst->rate == src->rate);
+    assert(reorder || dst->nch == src->nch);
+    assert(dst_offset >= 0 && dst_offset + length <= dst->samples);
+    assert(src_offset >= 0 && src_offset + length <= src->samples);
+
+    bool identity = dst->nch == src->nch && is_identity(reorder, dst->nch);
+
+    if (dst->format == src->format && identity) {
+        // Also used with non-PCM formats (spdif), which must not be touched.
+        for (int n = 0; n < dst->num_planes; n++) {
+            memmove((char *)dst->planes[n] + dst_offset * dst->sstride,
+                    (char *)src->planes[n] + src_offset * src->sstride,
+                    length * dst->sstride);
+        }
+        return;
+    }
+
+    int dst_type = get_type(dst->format);
+    int src_type = get_type(src->format);
+    assert(dst_type >= 0 && src_type >= 0);
+
+    struct conv cv = {
+        .fn = conv_fns[dst_type][src_type],
+        .src_size = type_size[src_type],
+        .dst_size = type_size[dst_type],
+        .src_s24 = af_fmt_from_planar(src->format) == AF_FORMAT_S24,
+        .dst_s24 = af_fmt_from_planar(dst->format) == AF_FORMAT_S24,
+    };
+    bool src_planar = af_fmt_is_planar(src->format);
+    bool dst_planar = af_fmt_is_planar(dst->format);
+    int src_bytes = af_fmt_to_bytes(src->format);
+    int dst_bytes = af_fmt_to_bytes(dst->format);
+    int dst_nch = dst->nch, src_nch = src->nch;
+
+    if (!src_planar && !dst_planar && identity) {
+        // Interleaved on both sides: all channels are one contiguous run.
+        convert_run(&cv, (char *)dst->planes[0] + dst_offset * dst->sstride, 1,
+                    (char *)src->planes[0] + src_offset * src->sstride, 1,
+                    length * dst_nch);
+        return;
+    }
+
+    // Walk through the data in blocks, so that interleaved data is read or
+    // written once, while it's still in the cache.
+    for (int pos = 0; pos < length; pos += BLOCK) {
+        int len = MPMIN(BLOCK, length - pos);
+        for (int c = 0; c < dst_nch; c++) {
+            int sc = reorder ? reorder[c] : c;
+            assert(sc >= -1 && sc < src_nch);
+            char *d = dst_planar
+                ? (char *)dst->planes[c] + (dst_offset + pos) * dst_bytes
+                : (char *)dst->planes[0] +
+                  ((dst_offset + pos) * dst_nch + c) * dst_bytes;
+            int d_stride = dst_planar ? 1 : dst_nch;
+            if (sc < 0) {
+                fill_silence(d, d_stride, len, dst->format);
+                continue;
+            }
+            char *s = src_planar
+                ? (char *)src->planes[sc] + (src_offset + pos) * src_bytes
+                : (char *)src->planes[0] +
+                  ((src_offset + pos) * src_nch + sc) * src_bytes;
+            convert_run(&cv, d, d_stride, s, src_planar ? 1 : src_nch, len);
+        }
+    }
+}
+
+// Like mp_audio_convert_reorder() without reordering.
+void mp_audio_convert(struct mp_audio *dst, int dst_offset,
+                      struct mp_audio *src, int src_offset, int length)
+{
+    mp_audio_convert_reorder(dst, dst_offset, src, src_offset, length, NULL);
+}
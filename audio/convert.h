@@ -0,0 +1,15 @@
+#ifndef MP_AUDIO_CONVERT_H
+#define MP_AUDIO_CONVERT_H
+
+#include <stdbool.h>
+
+struct mp_audio;
+
+bool mp_audio_convert_supported(int dst_format, int src_format);
+void mp_audio_convert(struct mp_audio *dst, int dst_offset,
+                      struct mp_audio *src, int src_offset, int length);
+void mp_audio_convert_reorder(struct mp_audio *dst, int dst_offset,
+                              struct mp_audio *src, int src_offset, int length,
+                              const int *reorder);
+
+#endif
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavutil/mem.h>
 
@@ -50,8 +51,70 @@ static const struct ad_functions * const ad_drivers[] = {
     NULL
 };
 
+// A decoded frame, queued by the decoder thread.
+struct queued_frame {
+    struct mp_audio *mpa;
+    // Decoder PTS state after this frame was decoded (see dec_audio.pts)
+    double pts;
+    int pts_offset;
+};
+
+// State for decoding in a separate thread (see audio_start_decode_thread()).
+struct dec_audio_queue {
+    pthread_t thread;
+    // Protects all fields below.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_cb_ctx;
+
+    double max_secs;
+
+    struct queued_frame *frames;
+    int num_frames;
+    double secs;        // duration of all queued frames
+
+    // If <0, the decoder returned this (AD_WAIT, AD_EOF, AD_ERR), and the
+    // thread is idle until the player picks it up. 0 means keep decoding.
+    int status;
+    bool busy;          // decoder thread is inside decode_packet()
+    bool terminate;
+};
+
+// Must be called with q->lock held. Waits until the decoder thread is idle,
+// and keeps it idle until the player requests new data.
+static void queue_flush(struct dec_audio_queue *q)
+{
+    q->status = AD_WAIT;
+    while (q->busy)
+        pthread_cond_wait(&q->wakeup, &q->lock);
+    for (int n = 0; n < q->num_frames; n++)
+        talloc_free(q->frames[n].mpa);
+    q->num_frames = 0;
+    q->secs = 0;
+}
+
+static void stop_decode_thread(struct dec_audio *d_audio)
+{
+    struct dec_audio_queue *q = d_audio->queue;
+    if (!q)
+        return;
+    pthread_mutex_lock(&q->lock);
+    q->terminate = true;
+    pthread_cond_broadcast(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+    pthread_join(q->thread, NULL);
+    queue_flush(q);
+    pthread_cond_destroy(&q->wakeup);
+    pthread_mutex_destroy(&q->lock);
+    talloc_free(q);
+    d_audio->queue = NULL;
+}
+
 static void uninit_decoder(struct dec_audio *d_audio)
 {
+    stop_decode_thread(d_audio);
     audio_reset_decoding(d_audio);
     if (d_audio->ad_driver) {
         MP_VERBOSE(d_audio, "Uninit audio decoder.\n");
@@ -163,18 +226,110 @@ void audio_uninit(struct dec_audio *d_audio)
     talloc_free(d_audio);
 }
 
+// Run the decoder once, and update the decoder PTS state.
+static int decode_packet(struct dec_audio *da, struct mp_audio **out)
+{
+    int ret = da->ad_driver->decode_packet(da, out);
+    if (ret < 0)
+        return ret;
+
+    if (da->pts == MP_NOPTS_VALUE && da->header->missing_timestamps)
+        da->pts = 0;
+
+    if (*out)
+        da->pts_offset += (*out)->samples;
+    return AD_OK;
+}
+
+static void *decode_thread(void *p)
+{
+    struct dec_audio *da = p;
+    struct dec_audio_queue *q = da->queue;
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->terminate) {
+        if (q->status < 0 || q->secs >= q->max_secs) {
+            pthread_cond_wait(&q->wakeup, &q->lock);
+            continue;
+        }
+
+        q->busy = true;
+        pthread_mutex_unlock(&q->lock);
+
+        struct mp_audio *mpa = NULL;
+        int ret = decode_packet(da, &mpa);
+
+        pthread_mutex_lock(&q->lock);
+        q->busy = false;
+        if (mpa) {
+            struct queued_frame f = {mpa, da->pts, da->pts_offset};
+            MP_TARRAY_APPEND(q, q->frames, q->num_frames, f);
+            if (mpa->rate > 0)
+                q->secs += mpa->samples / (double)mpa->rate;
+        }
+        if (ret < 0)
+            q->status = ret;
+        pthread_cond_broadcast(&q->wakeup);
+        pthread_mutex_unlock(&q->lock);
+
+        if (q->wakeup_cb)
+            q->wakeup_cb(q->wakeup_cb_ctx);
+
+        pthread_mutex_lock(&q->lock);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+// Return the next frame decoded by the decoder thread.
+static int queue_get_frame(struct dec_audio *da, struct mp_audio **out)
+{
+    struct dec_audio_queue *q = da->queue;
+    int r = AD_WAIT;
+    pthread_mutex_lock(&q->lock);
+    // If the thread stopped because it ran out of packets (or at EOF), restart
+    // it as soon as there is something to decode, even if frames are still
+    // queued, so that it keeps reading ahead.
+    if ((q->status == AD_WAIT || q->status == AD_EOF) &&
+        demux_has_packet(da->header))
+        q->status = 0;
+    if (q->num_frames) {
+        struct queued_frame f = q->frames[0];
+        MP_TARRAY_REMOVE_AT(q->frames, q->num_frames, 0);
+        if (f.mpa->rate > 0)
+            q->secs -= f.mpa->samples / (double)f.mpa->rate;
+        if (!q->num_frames)
+            q->secs = 0;
+        *out = f.mpa;
+        da->out_pts = f.pts;
+        da->out_pts_offset = f.pts_offset;
+        r = AD_OK;
+    } else if (q->status < 0) {
+        r = q->status;
+        // Errors are reported once, like with synchronous decoding.
+        if (r == AD_ERR)
+            q->status = 0;
+    }
+    pthread_cond_broadcast(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
 static int decode_new_frame(struct dec_audio *da)
 {
     while (!da->waiting) {
-        int ret = da->ad_driver->decode_packet(da, &da->waiting);
+        int ret;
+        if (da->queue) {
+            ret = queue_get_frame(da, &da->waiting);
+        } else {
+            ret = decode_packet(da, &da->waiting);
+            da->out_pts = da->pts;
+            da->out_pts_offset = da->pts_offset;
+        }
         if (ret < 0)
             return ret;
 
-        if (da->pts == MP_NOPTS_VALUE && da->header->missing_timestamps)
-            da->pts = 0;
-
         if (da->waiting) {
-            da->pts_offset += da->waiting->samples;
             da->decode_format = *da->waiting;
             mp_audio_set_null_data(&da->decode_format);
         }
@@ -182,6 +337,53 @@ static int decode_new_frame(struct dec_audio *da)
     return mp_audio_config_valid(da->waiting) ? AD_OK : AD_ERR;
 }
 
+// Move decoding to a separate thread, which decodes up to max_secs of audio
+// ahead. Filtering still happens in audio_decode(), on the playback thread:
+// the mixer, speed changes and the af/af-command commands access the filter
+// chain from there without any locking. wakeup_cb is called from the decoder
+// thread whenever it has made progress. The demuxer must be threaded, because
+// the decoder thread reads packets on its own.
+bool audio_start_decode_thread(struct dec_audio *d_audio, double max_secs,
+                               void (*wakeup_cb)(void *ctx), void *ctx)
+{
+    assert(!d_audio->queue);
+    assert(d_audio->ad_driver);
+
+    struct dec_audio_queue *q = talloc_zero(NULL, struct dec_audio_queue);
+    *q = (struct dec_audio_queue){
+        .wakeup_cb = wakeup_cb,
+        .wakeup_cb_ctx = ctx,
+        .max_secs = max_secs,
+    };
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->wakeup, NULL);
+    d_audio->queue = q;
+
+    if (pthread_create(&q->thread, NULL, decode_thread, d_audio)) {
+        pthread_cond_destroy(&q->wakeup);
+        pthread_mutex_destroy(&q->lock);
+        talloc_free(q);
+        d_audio->queue = NULL;
+        return false;
+    }
+
+    MP_VERBOSE(d_audio, "Decoding in a separate thread (%f seconds ahead).\n",
+               max_secs);
+    return true;
+}
+
+// Seconds of decoded audio waiting in the queue, or -1 if not threaded.
+double audio_queue_get_fill(struct dec_audio *d_audio)
+{
+    struct dec_audio_queue *q = d_audio->queue;
+    if (!q)
+        return -1;
+    pthread_mutex_lock(&q->lock);
+    double r = q->secs;
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
 /* Decode packets until we know the audio format. Then reinit the buffer.
  * Returns AD_OK on success, negative AD_* code otherwise.
  * Also returns AD_OK if already initialized (and does nothing).
@@ -254,11 +456,19 @@ int audio_decode(struct dec_audio *da, struct mp_audio_buffer *outbuf,
 
 void audio_reset_decoding(struct dec_audio *d_audio)
 {
+    struct dec_audio_queue *q = d_audio->queue;
+    if (q) {
+        pthread_mutex_lock(&q->lock);
+        queue_flush(q);
+        pthread_mutex_unlock(&q->lock);
+    }
     if (d_audio->ad_driver)
         d_audio->ad_driver->control(d_audio, ADCTRL_RESET, NULL);
     af_seek_reset(d_audio->afilter);
     d_audio->pts = MP_NOPTS_VALUE;
     d_audio->pts_offset = 0;
+    d_audio->out_pts = MP_NOPTS_VALUE;
+    d_audio->out_pts_offset = 0;
     if (d_audio->waiting) {
         talloc_free(d_audio->waiting);
         d_audio->waiting = NULL;
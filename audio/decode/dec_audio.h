@@ -25,6 +25,7 @@
 
 struct mp_audio_buffer;
 struct mp_decoder_list;
+struct dec_audio_queue;
 
 struct dec_audio {
     struct mp_log *log;
@@ -45,6 +46,12 @@ struct dec_audio {
     double pts;
     // number of samples output by decoder after last known pts
     int pts_offset;
+    // pts/pts_offset as of the last frame returned to the player. Differs
+    // from the fields above if the decoder thread is decoding ahead.
+    double out_pts;
+    int out_pts_offset;
+    // Non-NULL if decoding runs in a separate thread
+    struct dec_audio_queue *queue;
     // For free use by the ad_driver
     void *priv;
 };
@@ -63,6 +70,9 @@ int audio_decode(struct dec_audio *d_audio, struct mp_audio_buffer *outbuf,
                  int minsamples);
 int initial_audio_decode(struct dec_audio *d_audio);
 void audio_reset_decoding(struct dec_audio *d_audio);
+bool audio_start_decode_thread(struct dec_audio *d_audio, double max_secs,
+                               void (*wakeup_cb)(void *ctx), void *ctx);
+double audio_queue_get_fill(struct dec_audio *d_audio);
 void audio_uninit(struct dec_audio *d_audio);
 
 #endif /* MPLAYER_DEC_AUDIO_H */
@@ -29,6 +29,7 @@
 
 #include "audio/audio_buffer.h"
 #include "af.h"
+#include "sample_op.h"
 
 // Static list of filters
 extern const struct af_info af_info_dummy;
@@ -38,6 +39,7 @@ extern const struct af_info af_info_format;
 extern const struct af_info af_info_force;
 extern const struct af_info af_info_volume;
 extern const struct af_info af_info_equalizer;
+extern const struct af_info af_info_peq;
 extern const struct af_info af_info_pan;
 extern const struct af_info af_info_surround;
 extern const struct af_info af_info_sub;
@@ -48,6 +50,7 @@ extern const struct af_info af_info_lavcac3enc;
 extern const struct af_info af_info_lavrresample;
 extern const struct af_info af_info_sweep;
 extern const struct af_info af_info_hrtf;
+extern const struct af_info af_info_convolve;
 extern const struct af_info af_info_ladspa;
 extern const struct af_info af_info_center;
 extern const struct af_info af_info_sinesuppress;
@@ -64,6 +67,7 @@ static const struct af_info *const filter_list[] = {
     &af_info_format,
     &af_info_volume,
     &af_info_equalizer,
+    &af_info_peq,
     &af_info_pan,
     &af_info_surround,
     &af_info_sub,
@@ -74,6 +78,7 @@ static const struct af_info *const filter_list[] = {
     &af_info_lavrresample,
     &af_info_sweep,
     &af_info_hrtf,
+    &af_info_convolve,
 #if HAVE_LADSPA
     &af_info_ladspa,
 #endif
@@ -207,6 +212,7 @@ static struct af_instance *af_create(struct af_stream *s, char *name,
         .info = info,
         .data = talloc_zero(af, struct mp_audio),
         .log = mp_log_new(af, s->log, name),
+        .global = s->global,
         .replaygain_data = s->replaygain_data,
         .out_pool = mp_audio_pool_create(af),
     };
@@ -580,7 +586,9 @@ struct af_stream *af_new(struct mpv_global *global)
 
     s->first->next = s->last;
     s->last->prev = s->first;
+    s->global = global;
     s->opts = global->opts;
+    s->sample_prog = af_sample_prog_create(s);
     return s;
 }
 
@@ -760,11 +768,63 @@ static void read_remaining(struct af_instance *af)
     } while (num_frames != af->num_out_queued);
 }
 
-static int af_do_filter(struct af_instance *af, struct mp_audio *frame)
+static bool af_can_fuse(struct af_instance *af)
+{
+    // Frames still queued in the filter would be output after the frames
+    // produced by the merged run.
+    return af && af->get_sample_op && !af->num_out_queued &&
+           af_sample_op_format_ok(af->fmt_in.format) &&
+           af_sample_op_format_ok(af->fmt_out.format);
+}
+
+// Run af and the filters following it as a single pass over the frame data,
+// if they all support it. Returns false if the frame wasn't processed (af must
+// be run normally), otherwise sets *out_r to the filter result.
+static bool af_do_fused(struct af_stream *s, struct af_instance *af,
+                        struct mp_audio *frame, int *out_r)
+{
+    if (!s->opts->af_fuse || !frame || !af_can_fuse(af))
+        return false;
+
+    struct af_sample_op ops[AF_SAMPLE_PROG_MAX_OPS];
+    struct af_instance *tail = af;
+    int num_ops = 1;
+    while (num_ops < AF_SAMPLE_PROG_MAX_OPS && af_can_fuse(tail->next) &&
+           tail->next->get_sample_op(tail->next, NULL, &ops[num_ops]))
+    {
+        tail = tail->next;
+        num_ops++;
+    }
+    // A single filter is just as fast on its own.
+    if (num_ops < 2 || !af->get_sample_op(af, frame, &ops[0]))
+        return false;
+
+    struct af_sample_prog *prog = s->sample_prog;
+    af_sample_prog_begin(prog, &af->fmt_in);
+    struct af_instance *cur = af;
+    for (int n = 0; n < num_ops; n++) {
+        af_sample_prog_add(prog, &ops[n], &cur->fmt_out);
+        cur = cur->next;
+    }
+
+    struct mp_audio *out =
+        af_sample_prog_run(prog, tail->out_pool, frame, &tail->fmt_out);
+    if (out)
+        af_add_output_frame(tail, out);
+    *out_r = out ? 0 : -1;
+    s->fused_frames++;
+    s->fused_ops = num_ops;
+    return true;
+}
+
+static int af_do_filter(struct af_stream *s, struct af_instance *af,
+                        struct mp_audio *frame)
 {
     if (frame)
         assert(mp_audio_config_equals(&af->fmt_in, frame));
-    int r = af->filter_frame(af, frame);
+    int r;
+    if (!af_do_fused(s, af, frame, &r))
+        r = af->filter_frame(af, frame);
     if (r < 0)
         MP_ERR(af, "Error filtering frame.\n");
     return r;
@@ -779,7 +839,7 @@ int af_filter_frame(struct af_stream *s, struct mp_audio *frame)
         talloc_free(frame);
         return -1;
     }
-    return af_do_filter(s->first, frame);
+    return af_do_filter(s, s->first, frame);
 }
 
 // Output the next queued frame (if any) from the full filter chain.
@@ -800,7 +860,7 @@ int af_output_frame(struct af_stream *s, bool eof)
             // filters have been flushed (i.e. they have no more output).
             if (eof && !last) {
                 read_remaining(cur);
-                int r = af_do_filter(cur, NULL);
+                int r = af_do_filter(s, cur, NULL);
                 if (r < 0)
                     return r;
             }
@@ -811,7 +871,7 @@ int af_output_frame(struct af_stream *s, bool eof)
             return 0;
         if (!last->next)
             return 1;
-        int r = af_do_filter(last->next, af_dequeue_output_frame(last));
+        int r = af_do_filter(s, last->next, af_dequeue_output_frame(last));
         if (r < 0)
             return r;
     }
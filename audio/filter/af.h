@@ -29,6 +29,8 @@
 #include "common/msg.h"
 
 struct af_instance;
+struct af_sample_op;
+struct af_sample_prog;
 struct mpv_global;
 
 // Number of channels
@@ -57,6 +59,7 @@ struct af_info {
 struct af_instance {
     const struct af_info *info;
     struct mp_log *log;
+    struct mpv_global *global;
     struct replaygain_data *replaygain_data;
     int (*control)(struct af_instance *af, int cmd, void *arg);
     void (*uninit)(struct af_instance *af);
@@ -67,6 +70,17 @@ struct af_instance {
      */
     int (*filter_frame)(struct af_instance *af, struct mp_audio *frame);
     int (*filter_out)(struct af_instance *af);
+    /* Optional. If the filter does only simple per-sample processing (see
+     * struct af_sample_op), describe it in op and return true. af.c then
+     * merges it with adjacent filters into a single pass over the frame
+     * data, and doesn't call filter_frame for that frame.
+     * frame is the input frame if the filter comes first in the merged run
+     * (the filter can use it to compute op, like with filter_frame), and
+     * NULL otherwise; return false if the frame is needed.
+     * Filters which buffer data can't use this.
+     */
+    bool (*get_sample_op)(struct af_instance *af, struct mp_audio *frame,
+                          struct af_sample_op *op);
     void *priv;
     struct mp_audio *data; // configuration and buffer for outgoing data stream
 
@@ -99,8 +113,15 @@ struct af_stream {
     struct mp_audio filter_output;
 
     struct mp_log *log;
+    struct mpv_global *global;
     struct MPOpts *opts;
     struct replaygain_data *replaygain_data;
+
+    struct af_sample_prog *sample_prog; // for filters merged with --af-fuse
+    // Number of frames run through merged filters, and how many filters were
+    // merged for the last of them. For tests and benchmarks.
+    int64_t fused_frames;
+    int fused_ops;
 };
 
 // Return values
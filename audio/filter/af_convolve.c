@@ -0,0 +1,302 @@
+/*
+ * Convolve the audio with impulse responses loaded from a WAV file, e.g. for
+ * room correction or binaural rendering.
+ *
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/common.h>
+#include <libavutil/intfloat.h>
+#include <libavutil/intreadwrite.h>
+
+#include "common/common.h"
+#include "stream/stream.h"
+#include "af.h"
+#include "convolver.h"
+
+// Refuse to load larger files.
+#define MAX_FILE_SIZE (256 * 1024 * 1024)
+
+struct priv {
+    // impulse responses from the file
+    float **ir;
+    int ir_nch, ir_len, ir_rate;
+
+    struct af_convolver *conv;
+    int block;
+    // The input is collected in in_buf, and the output of the previous block
+    // is returned from out_buf, so the latency is one block.
+    float *in_buf[MP_NUM_CHANNELS], *out_buf[MP_NUM_CHANNELS];
+    int pos;
+
+    // command line options
+    char *opt_file;
+    int opt_size;
+    int opt_binaural;
+};
+
+// WAVE format tags
+#define WAV_PCM     1
+#define WAV_FLOAT   3
+
+static bool sample_format_ok(int tag, int bits)
+{
+    return (tag == WAV_PCM && (bits == 8 || bits == 16 || bits == 24 ||
+                               bits == 32)) ||
+           (tag == WAV_FLOAT && (bits == 32 || bits == 64));
+}
+
+static float read_sample(const uint8_t *src, int tag, int bits)
+{
+    if (tag == WAV_FLOAT)
+        return bits == 32 ? av_int2float(AV_RL32(src))
+                          : av_int2double(AV_RL64(src));
+    switch (bits) {
+    case 8:  return (src[0] - 128) / 128.0f;
+    case 16: return (int16_t)AV_RL16(src) / 32768.0f;
+    case 24: return (int32_t)(AV_RL24(src) << 8) / 2147483648.0f;
+    case 32: return (int32_t)AV_RL32(src) / 2147483648.0f;
+    }
+    return 0;
+}
+
+// Load the impulse responses from a RIFF WAVE file with PCM or float samples.
+static bool load_ir(struct af_instance *af, const char *filename)
+{
+    struct priv *p = af->priv;
+    void *tmp = talloc_new(NULL);
+    bool ok = false;
+
+    bstr data = stream_read_file(filename, tmp, af->global, MAX_FILE_SIZE);
+    if (!data.len) {
+        MP_ERR(af, "Could not read '%s'.\n", filename);
+        goto done;
+    }
+    if (data.len < 12 || memcmp(data.start, "RIFF", 4) != 0 ||
+        memcmp(data.start + 8, "WAVE", 4) != 0)
+    {
+        MP_ERR(af, "'%s' is not a WAV file.\n", filename);
+        goto done;
+    }
+
+    int tag = 0, nch = 0, rate = 0, bits = 0;
+    bstr samples = {0};
+    bstr chunks = bstr_cut(data, 12);
+    while (chunks.len >= 8) {
+        bstr id = bstr_splice(chunks, 0, 4);
+        size_t size = AV_RL32(chunks.start + 4);
+        chunks = bstr_cut(chunks, 8);
+        bstr chunk = bstr_splice(chunks, 0, MPMIN(size, chunks.len));
+        if (bstr_equals0(id, "fmt ") && chunk.len >= 16) {
+            tag = AV_RL16(chunk.start);
+            nch = AV_RL16(chunk.start + 2);
+            rate = AV_RL32(chunk.start + 4);
+            bits = AV_RL16(chunk.start + 14);
+            // WAVE_FORMAT_EXTENSIBLE: the real tag is in the subformat GUID
+            if (tag == 0xFFFE && chunk.len >= 26)
+                tag = AV_RL16(chunk.start + 24);
+        } else if (bstr_equals0(id, "data")) {
+            samples = chunk;
+        }
+        chunks = bstr_cut(chunks, MPMIN(size + (size & 1), chunks.len));
+    }
+
+    if (nch < 1 || nch > 2 * MP_NUM_CHANNELS || rate < 1 ||
+        !sample_format_ok(tag, bits))
+    {
+        MP_ERR(af, "Unsupported WAV format in '%s' (format %d, %d channels, "
+               "%d bits).\n", filename, tag, nch, bits);
+        goto done;
+    }
+    int frame_size = nch * bits / 8;
+    int len = samples.len / frame_size;
+    if (len < 1) {
+        MP_ERR(af, "No samples in '%s'.\n", filename);
+        goto done;
+    }
+
+    p->ir = talloc_zero_array(af, float *, nch);
+    for (int c = 0; c < nch; c++) {
+        p->ir[c] = talloc_array(af, float, len);
+        for (int n = 0; n < len; n++) {
+            p->ir[c][n] = read_sample(samples.start + n * frame_size +
+                                      c * bits / 8, tag, bits);
+        }
+    }
+    p->ir_nch = nch;
+    p->ir_len = len;
+    p->ir_rate = rate;
+    MP_VERBOSE(af, "Loaded %d channels with %d samples at %d Hz.\n",
+               nch, len, rate);
+    ok = true;
+
+done:
+    talloc_free(tmp);
+    return ok;
+}
+
+static int control(struct af_instance *af, int cmd, void *arg)
+{
+    struct priv *p = af->priv;
+
+    switch (cmd) {
+    case AF_CONTROL_REINIT: {
+        struct mp_audio *in = arg;
+        struct mp_audio orig_in = *in;
+        struct mp_audio *out = af->data;
+
+        // With a single impulse response, each channel is filtered with it.
+        // Otherwise there is one impulse response per input channel, or one
+        // per input channel and ear (left first) in binaural mode.
+        int nch = p->ir_nch;
+        if (p->opt_binaural) {
+            if (nch % 2) {
+                MP_ERR(af, "Binaural mode needs an even number of impulse "
+                       "responses.\n");
+                return AF_ERROR;
+            }
+            nch /= 2;
+        } else if (nch == 1) {
+            nch = in->nch;
+        }
+        if (nch > MP_NUM_CHANNELS) {
+            MP_ERR(af, "Too many impulse responses.\n");
+            return AF_ERROR;
+        }
+
+        mp_audio_set_format(in, AF_FORMAT_FLOATP);
+        in->rate = p->ir_rate;
+        if (in->nch != nch)
+            mp_audio_set_num_channels(in, nch);
+        mp_audio_copy_config(out, in);
+        if (p->opt_binaural)
+            mp_audio_set_num_channels(out, 2);
+
+        talloc_free(p->conv);
+        p->conv = af_convolver_create(af, av_log2(p->block), nch, out->nch);
+        if (!p->conv)
+            return AF_ERROR;
+        for (int c = 0; c < nch; c++) {
+            if (p->opt_binaural) {
+                for (int ear = 0; ear < 2; ear++) {
+                    af_convolver_set_ir(p->conv, c, ear, p->ir[c * 2 + ear],
+                                        p->ir_len, 1);
+                }
+            } else {
+                af_convolver_set_ir(p->conv, c, c, p->ir[MPMIN(c, p->ir_nch - 1)],
+                                    p->ir_len, 1);
+            }
+        }
+        control(af, AF_CONTROL_RESET, NULL);
+        af->delay = p->block / (double)out->rate;
+
+        return mp_audio_config_equals(in, &orig_in) ? AF_OK : AF_FALSE;
+    }
+    case AF_CONTROL_RESET:
+        if (p->conv)
+            af_convolver_reset(p->conv);
+        for (int c = 0; c < MP_NUM_CHANNELS; c++) {
+            memset(p->in_buf[c], 0, p->block * sizeof(float));
+            memset(p->out_buf[c], 0, p->block * sizeof(float));
+        }
+        p->pos = 0;
+        return AF_OK;
+    }
+    return AF_UNKNOWN;
+}
+
+static int filter(struct af_instance *af, struct mp_audio *data)
+{
+    struct priv *p = af->priv;
+
+    if (!data)
+        return 0;
+    struct mp_audio *out =
+        mp_audio_pool_get(af->out_pool, af->data, data->samples);
+    if (!out) {
+        talloc_free(data);
+        return -1;
+    }
+    mp_audio_copy_attributes(out, data);
+
+    for (int n = 0; n < data->samples;) {
+        int len = MPMIN(data->samples - n, p->block - p->pos);
+        for (int c = 0; c < data->nch; c++) {
+            memcpy(p->in_buf[c] + p->pos, (float *)data->planes[c] + n,
+                   len * sizeof(float));
+        }
+        for (int c = 0; c < out->nch; c++) {
+            memcpy((float *)out->planes[c] + n, p->out_buf[c] + p->pos,
+                   len * sizeof(float));
+        }
+        p->pos += len;
+        n += len;
+        if (p->pos == p->block) {
+            af_convolver_process(p->conv, p->in_buf, p->out_buf);
+            p->pos = 0;
+        }
+    }
+
+    talloc_free(data);
+    af_add_output_frame(af, out);
+    return 0;
+}
+
+static int af_open(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+
+    af->control = control;
+    af->filter_frame = filter;
+
+    if (!p->opt_file || !p->opt_file[0]) {
+        MP_ERR(af, "No impulse response file given.\n");
+        return AF_ERROR;
+    }
+    if (p->opt_size & (p->opt_size - 1)) {
+        MP_ERR(af, "The block size must be a power of 2.\n");
+        return AF_ERROR;
+    }
+    if (!load_ir(af, p->opt_file))
+        return AF_ERROR;
+
+    p->block = p->opt_size;
+    for (int c = 0; c < MP_NUM_CHANNELS; c++) {
+        p->in_buf[c] = talloc_zero_array(af, float, p->block);
+        p->out_buf[c] = talloc_zero_array(af, float, p->block);
+    }
+    return AF_OK;
+}
+
+#define OPT_BASE_STRUCT struct priv
+const struct af_info af_info_convolve = {
+    .info = "Convolution with impulse responses from a file",
+    .name = "convolve",
+    .open = af_open,
+    .priv_size = sizeof(struct priv),
+    .priv_defaults = &(const struct priv) {
+        .opt_size = 256,
+    },
+    .options = (const struct m_option[]) {
+        OPT_STRING("file", opt_file, 0),
+        OPT_INTRANGE("size", opt_size, 0, 16, 32768),
+        OPT_FLAG("binaural", opt_binaural, 0),
+        {0}
+    },
+};
@@ -27,6 +27,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "sample_op.h"
 
 // Methods:
 // 1: uses a 1 value memory and coefficients new=a*old+b*cur (with a+b=1)
@@ -96,78 +97,44 @@ static int control(struct af_instance* af, int cmd, void* arg)
   return AF_UNKNOWN;
 }
 
-static void method1_int16(af_drc_t *s, struct mp_audio *c)
+// Root mean square of the samples, in units of the sample format
+static float get_avg(struct mp_audio *c)
 {
-  register int i = 0;
-  int16_t *data = (int16_t*)c->planes[0];       // Audio data
   int len = c->samples*c->nch;          // Number of samples
-  float curavg = 0.0, newavg, neededmul;
-  int tmp;
+  float curavg = 0.0;
 
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
-
-  // Evaluate an adequate 'mul' coefficient based on previous state, current
-  // samples level, etc
-
-  if (curavg > SIL_S16)
-  {
-    neededmul = s->mid_s16 / (curavg * s->mul);
-    s->mul = (1.0 - SMOOTH_MUL) * s->mul + SMOOTH_MUL * neededmul;
-
-    // clamp the mul coefficient
-    s->mul = MPCLAMP(s->mul, MUL_MIN, MUL_MAX);
-  }
-
-  // Scale & clamp the samples
-  for (i = 0; i < len; i++)
-  {
-    tmp = s->mul * data[i];
-    tmp = MPCLAMP(tmp, SHRT_MIN, SHRT_MAX);
-    data[i] = tmp;
+  if (c->format == AF_FORMAT_S16) {
+    int16_t *data = (int16_t*)c->planes[0];
+    for (int i = 0; i < len; i++) {
+      int tmp = data[i];
+      curavg += tmp * tmp;
+    }
+  } else {
+    float *data = (float*)c->planes[0];
+    for (int i = 0; i < len; i++) {
+      float tmp = data[i];
+      curavg += tmp * tmp;
+    }
   }
-
-  // Evaluation of newavg (not 100% accurate because of values clamping)
-  newavg = s->mul * curavg;
-
-  // Stores computed values for future smoothing
-  s->lastavg = (1.0 - SMOOTH_LASTAVG) * s->lastavg + SMOOTH_LASTAVG * newavg;
+  return sqrt(curavg / (float) len);
 }
 
-static void method1_float(af_drc_t *s, struct mp_audio *c)
+static void method1(af_drc_t *s, float curavg, float sil, float mid)
 {
-  register int i = 0;
-  float *data = (float*)c->planes[0];   // Audio data
-  int len = c->samples*c->nch;          // Number of samples
-  float curavg = 0.0, newavg, neededmul, tmp;
-
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
+  float newavg, neededmul;
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
 
-  if (curavg > SIL_FLOAT) // FIXME
+  if (curavg > sil) // FIXME
   {
-    neededmul = s->mid_float / (curavg * s->mul);
+    neededmul = mid / (curavg * s->mul);
     s->mul = (1.0 - SMOOTH_MUL) * s->mul + SMOOTH_MUL * neededmul;
 
     // clamp the mul coefficient
     s->mul = MPCLAMP(s->mul, MUL_MIN, MUL_MAX);
   }
 
-  // Scale & clamp the samples
-  for (i = 0; i < len; i++)
-    data[i] *= s->mul;
-
   // Evaluation of newavg (not 100% accurate because of values clamping)
   newavg = s->mul * curavg;
 
@@ -175,24 +142,14 @@ static void method1_float(af_drc_t *s, struct mp_audio *c)
   s->lastavg = (1.0 - SMOOTH_LASTAVG) * s->lastavg + SMOOTH_LASTAVG * newavg;
 }
 
-static void method2_int16(af_drc_t *s, struct mp_audio *c)
+static void method2(af_drc_t *s, float curavg, int len, float sil, float mid)
 {
-  register int i = 0;
-  int16_t *data = (int16_t*)c->planes[0];       // Audio data
-  int len = c->samples*c->nch;          // Number of samples
-  float curavg = 0.0, newavg, avg = 0.0;
-  int tmp, totallen = 0;
-
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
+  float newavg, avg = 0.0;
+  int totallen = 0;
 
   // Evaluate an adequate 'mul' coefficient based on previous state, current
   // samples level, etc
-  for (i = 0; i < NSAMPLES; i++)
+  for (int i = 0; i < NSAMPLES; i++)
   {
     avg += s->mem[i].avg * (float)s->mem[i].len;
     totallen += s->mem[i].len;
@@ -201,21 +158,13 @@ static void method2_int16(af_drc_t *s, struct mp_audio *c)
   if (totallen > MIN_SAMPLE_SIZE)
   {
     avg /= (float)totallen;
-    if (avg >= SIL_S16)
+    if (avg >= sil)
     {
-        s->mul = s->mid_s16 / avg;
+        s->mul = mid / avg;
         s->mul = MPCLAMP(s->mul, MUL_MIN, MUL_MAX);
     }
   }
 
-  // Scale & clamp the samples
-  for (i = 0; i < len; i++)
-  {
-    tmp = s->mul * data[i];
-    tmp = MPCLAMP(tmp, SHRT_MIN, SHRT_MAX);
-    data[i] = tmp;
-  }
-
   // Evaluation of newavg (not 100% accurate because of values clamping)
   newavg = s->mul * curavg;
 
@@ -225,50 +174,18 @@ static void method2_int16(af_drc_t *s, struct mp_audio *c)
   s->idx = (s->idx + 1) % NSAMPLES;
 }
 
-static void method2_float(af_drc_t *s, struct mp_audio *c)
+// Measure the frame, and update s->mul for it.
+static void update_mul(af_drc_t *s, struct mp_audio *c)
 {
-  register int i = 0;
-  float *data = (float*)c->planes[0];   // Audio data
-  int len = c->samples*c->nch;          // Number of samples
-  float curavg = 0.0, newavg, avg = 0.0, tmp;
-  int totallen = 0;
-
-  for (i = 0; i < len; i++)
-  {
-    tmp = data[i];
-    curavg += tmp * tmp;
-  }
-  curavg = sqrt(curavg / (float) len);
-
-  // Evaluate an adequate 'mul' coefficient based on previous state, current
-  // samples level, etc
-  for (i = 0; i < NSAMPLES; i++)
-  {
-    avg += s->mem[i].avg * (float)s->mem[i].len;
-    totallen += s->mem[i].len;
-  }
-
-  if (totallen > MIN_SAMPLE_SIZE)
-  {
-    avg /= (float)totallen;
-    if (avg >= SIL_FLOAT)
-    {
-        s->mul = s->mid_float / avg;
-        s->mul = MPCLAMP(s->mul, MUL_MIN, MUL_MAX);
-    }
-  }
-
-  // Scale & clamp the samples
-  for (i = 0; i < len; i++)
-    data[i] *= s->mul;
-
-  // Evaluation of newavg (not 100% accurate because of values clamping)
-  newavg = s->mul * curavg;
-
-  // Stores computed values for future smoothing
-  s->mem[s->idx].len = len;
-  s->mem[s->idx].avg = newavg;
-  s->idx = (s->idx + 1) % NSAMPLES;
+  bool is_s16 = c->format == AF_FORMAT_S16;
+  float sil = is_s16 ? SIL_S16 : SIL_FLOAT;
+  float mid = is_s16 ? s->mid_s16 : s->mid_float;
+  float curavg = get_avg(c);
+
+  if (s->method == 2)
+    method2(s, curavg, c->samples * c->nch, sil, mid);
+  else
+    method1(s, curavg, sil, mid);
 }
 
 static int filter(struct af_instance *af, struct mp_audio *data)
@@ -283,29 +200,50 @@ static int filter(struct af_instance *af, struct mp_audio *data)
     return -1;
   }
 
+  int len = data->samples*data->nch;
+
+  // Scale & clamp the samples
   if(af->data->format == (AF_FORMAT_S16))
   {
-    if (s->method == 2)
-        method2_int16(s, data);
-    else
-        method1_int16(s, data);
+    update_mul(s, data);
+    int16_t *a = (int16_t*)data->planes[0];
+    for (int i = 0; i < len; i++)
+    {
+      int tmp = s->mul * a[i];
+      a[i] = MPCLAMP(tmp, SHRT_MIN, SHRT_MAX);
+    }
   }
   else if(af->data->format == (AF_FORMAT_FLOAT))
   {
-    if (s->method == 2)
-        method2_float(s, data);
-    else
-        method1_float(s, data);
+    update_mul(s, data);
+    float *a = (float*)data->planes[0];
+    for (int i = 0; i < len; i++)
+      a[i] *= s->mul;
   }
   af_add_output_frame(af, data);
   return 0;
 }
 
+static bool get_sample_op(struct af_instance *af, struct mp_audio *data,
+                          struct af_sample_op *op)
+{
+  af_drc_t *s = af->priv;
+
+  // The gain depends on the input level.
+  if (!data)
+    return false;
+
+  update_mul(s, data);
+  af_sample_op_init(op, s->mul);
+  return true;
+}
+
 // Allocate memory and set function pointers
 static int af_open(struct af_instance* af){
   int i = 0;
   af->control=control;
   af->filter_frame = filter;
+  af->get_sample_op = get_sample_op;
   af_drc_t *priv = af->priv;
 
   priv->mul = MUL_INIT;
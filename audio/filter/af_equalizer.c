@@ -1,8 +1,8 @@
 /*
  * Equalizer filter, implementation of a 10 band time domain graphic
- * equalizer using IIR filters. The IIR filters are implemented using a
- * Direct Form II approach, but has been modified (b1 == 0 always) to
- * save computation.
+ * equalizer using IIR filters. Each band adds the output of a band-pass
+ * filter (b1 == 0 always) times the band gain to its input, which is
+ * expressed as a single biquad per band, run by the biquad cascade engine.
  *
  * Copyright (C) 2001 Anders Johansson ajh@atri.curtin.edu.au
  *
@@ -30,6 +30,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "biquad.h"
 
 #define L       2      // Storage for filter taps
 #define KM      10     // Max number of bands
@@ -62,7 +63,7 @@ typedef struct af_equalizer_s
 {
   float   a[KM][L];             // A weights
   float   b[KM][L];             // B weights
-  float   wq[AF_NCH][KM][L];    // Circular buffer for W data
+  struct af_biquad_bank *bank;  // K stages for each channel
   float   g[AF_NCH][KM];        // Gain factor for each channel and band
   int     K;                    // Number of used eq bands
   int     channels;             // Number of channels
@@ -113,9 +114,6 @@ static int control(struct af_instance* af, int cmd, void* arg)
     for(k=0;k<s->K;k++)
       bp2(s->a[k],s->b[k],F[k]/((float)af->data->rate),Q);
 
-    // Calculate how much this plugin adds to the overall time delay
-    af->delay = 2.0 / (double)af->data->rate;
-
     // Calculate gain factor to prevent clipping at output
     for(k=0;k<AF_NCH;k++)
     {
@@ -134,54 +132,53 @@ static int control(struct af_instance* af, int cmd, void* arg)
         s->gain_factor=1;
     }
 
+    // The band-pass output w = x*b0 + w[-1]*a0 + w[-2]*a1 is added to the
+    // input as y = x + (w + w[-2]*b1)*g, which is the same as the biquad
+    // below. The gain factor is folded into the last stage.
+    talloc_free(s->bank);
+    s->bank = af_biquad_bank_create(af, s->K, af->data->nch);
+    for(i=0;i<af->data->nch;i++){
+      for(k=0;k<s->K;k++){
+        double g = s->g[i][k];
+        double f = k == s->K - 1 ? s->gain_factor : 1;
+        struct af_biquad c = {
+          .b0 = (1 + g*s->b[k][0]) * f,
+          .b1 = -s->a[k][0] * f,
+          .b2 = (-s->a[k][1] + g*s->b[k][0]*s->b[k][1]) * f,
+          .a1 = -s->a[k][0],
+          .a2 = -s->a[k][1],
+        };
+        af_biquad_bank_set(s->bank, k, i, &c);
+      }
+    }
+
+    // Calculate how much this plugin adds to the overall time delay
+    af->delay = af_biquad_bank_delay(s->bank) / (double)af->data->rate;
+
     return af_test_output(af,arg);
   }
+  case AF_CONTROL_RESET:
+    if(s->bank)
+      af_biquad_bank_reset(s->bank);
+    return AF_OK;
   }
   return AF_UNKNOWN;
 }
 
 static int filter(struct af_instance* af, struct mp_audio* data)
 {
-  struct mp_audio*       c      = data;                         // Current working data
-  if (!c)
-    return 0;
   af_equalizer_t*  s    = (af_equalizer_t*)af->priv;    // Setup
-  uint32_t         ci   = af->data->nch;                // Index for channels
-  uint32_t         nch  = af->data->nch;                // Number of channels
+
+  if (!data)
+    return 0;
 
   if (af_make_writeable(af, data) < 0) {
     talloc_free(data);
     return -1;
   }
 
-  while(ci--){
-    float*      g   = s->g[ci];      // Gain factor
-    float*      in  = ((float*)c->planes[0])+ci;
-    float*      out = ((float*)c->planes[0])+ci;
-    float*      end = in + c->samples*c->nch; // Block loop end
-
-    while(in < end){
-      register int      k  = 0;         // Frequency band index
-      register float    yt = *in;       // Current input sample
-      in+=nch;
-
-      // Run the filters
-      for(;k<s->K;k++){
-        // Pointer to circular buffer wq
-        register float* wq = s->wq[ci][k];
-        // Calculate output from AR part of current filter
-        register float w=yt*s->b[k][0] + wq[0]*s->a[k][0] + wq[1]*s->a[k][1];
-        // Calculate output form MA part of current filter
-        yt+=(w + wq[1]*s->b[k][1])*g[k];
-        // Update circular buffer
-        wq[1] = wq[0];
-        wq[0] = w;
-      }
-      // Calculate output
-      *out=yt*s->gain_factor;
-      out+=nch;
-    }
-  }
+  af_biquad_bank_process(s->bank, data->planes[0], data->samples);
+
   af_add_output_frame(af, data);
   return 0;
 }
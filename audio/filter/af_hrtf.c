@@ -31,16 +31,28 @@
 
 #include "af.h"
 #include "dsp.h"
+#include "convolver.h"
 
 /* HRTF filter coefficients and adjustable parameters */
 #include "af_hrtf.h"
 
+/* Inputs of the convolver: the decoded channels, the bass compensation
+   channels, and LFE */
+enum {
+    SRC_LF, SRC_RF, SRC_LR, SRC_RR, SRC_CF, SRC_CR,
+    SRC_BA_L, SRC_BA_R, SRC_LFE,
+    NUM_SRC
+};
+
+/* Convolver block size (log2) */
+#define CONVBLOCKBITS   7
+
 typedef struct af_hrtf_s {
     /* Lengths */
     int dlbuflen, hrflen, basslen;
     /* L, C, R, Ls, Rs channels */
     float *lf, *rf, *lr, *rr, *cf, *cr;
-    const float *cf_ir, *af_ir, *of_ir, *ar_ir, *or_ir, *cr_ir;
+    /* Offsets of the HRTF filter start (see pulse_detect()) */
     int cf_o, af_o, of_o, ar_o, or_o, cr_o;
     /* Bass */
     float *ba_l, *ba_r;
@@ -69,30 +81,16 @@ typedef struct af_hrtf_s {
     float adapt_lrprr_gain, adapt_lrmrr_gain;
     /* Cyclic position on the ring buffer */
     int cyc_pos;
+    /* The HRTF and bass filters are applied by the convolver, one block
+       at a time. The output lags the input by one block. */
+    struct af_convolver *conv;
+    float *conv_in[NUM_SRC], *conv_out[2];
+    int conv_pos;
+    int in_nch;
     int print_flag;
     int mode;
 } af_hrtf_t;
 
-/* Convolution on a ring buffer
- *    nx:       length of the ring buffer
- *    nk:       length of the convolution kernel
- *    sx:       ring buffer
- *    sk:       convolution kernel
- *    offset:   offset on the ring buffer, can be
- */
-static float conv(const int nx, const int nk, const float *sx, const float *sk,
-                  const int offset)
-{
-    /* k = reminder of offset / nx */
-    int k = offset >= 0 ? offset % nx : nx + (offset % nx);
-
-    if(nk + k <= nx)
-        return af_filter_fir(nk, sx + k, sk);
-    else
-        return af_filter_fir(nk + k - nx, sx, sk + nx - k) +
-            af_filter_fir(nx - k, sx + k, sk);
-}
-
 /* Detect when the impulse response starts (significantly) */
 static int pulse_detect(const float *sx)
 {
@@ -293,6 +291,64 @@ static void clear_coeff(af_hrtf_t *s, float *c)
     memset(c, 0, s->dlbuflen * sizeof(float));
 }
 
+/* Set the HRTF filter from the convolver input src to output out. The
+   samples before offset (see pulse_detect()) are skipped. */
+static void set_hrtf_ir(af_hrtf_t *s, int src, int out, const float *filt,
+                        int offset, float gain)
+{
+    float ir[128];
+
+    memset(ir, 0, offset * sizeof(float));
+    memcpy(ir + offset, filt + offset, s->hrflen * sizeof(float));
+    af_convolver_set_ir(s->conv, src, out, ir, offset + s->hrflen, gain);
+}
+
+/* Set up the convolver for the current decode mode. Output 0 is left, 1 is
+   right; the right ear filters are the mirrored left ear filters. */
+static void setup_conv(af_hrtf_t *s)
+{
+    for(int src = 0; src < NUM_SRC; src++)
+        for(int out = 0; out < 2; out++)
+            af_convolver_set_ir(s->conv, src, out, NULL, 0, 0);
+
+    for(int out = 0; out < 2; out++) {
+        int l = out == 0 ? SRC_LF : SRC_RF, r = out == 0 ? SRC_RF : SRC_LF;
+        int lr = out == 0 ? SRC_LR : SRC_RR, rr = out == 0 ? SRC_RR : SRC_LR;
+        int ba_l = out == 0 ? SRC_BA_L : SRC_BA_R;
+        int ba_r = out == 0 ? SRC_BA_R : SRC_BA_L;
+
+        set_hrtf_ir(s, l, out, af_filt, s->af_o, 1);
+        set_hrtf_ir(s, r, out, of_filt, s->of_o, 1);
+        if(s->decode_mode != HRTF_MIX_STEREO) {
+            /* In matrix decoding mode, the rear channel gain must be
+               renormalized, as there is an additional channel. */
+            float rear_gain = s->matrix_mode ? M1_76DB : 1;
+            set_hrtf_ir(s, lr, out, ar_filt, s->ar_o, rear_gain);
+            set_hrtf_ir(s, rr, out, or_filt, s->or_o, rear_gain);
+            set_hrtf_ir(s, SRC_CF, out, cf_filt, s->cf_o, 1);
+            if(s->matrix_mode)
+                set_hrtf_ir(s, SRC_CR, out, cr_filt, s->cr_o, M1_76DB);
+        }
+
+        /* Bass compensation for the lower frequency cut of the HRTF.  A
+           cross talk of the left and right channel is introduced to
+           match the directional characteristics of higher frequencies.
+           The bass will not have any real 3D perception, but that is
+           OK (note at 180 Hz, the wavelength is about 2 m, and any
+           spatial perception is impossible). */
+        af_convolver_set_ir(s->conv, ba_l, out, s->ba_ir, s->basslen,
+                            1 - BASSCROSS);
+        af_convolver_set_ir(s->conv, ba_r, out, s->ba_ir, s->basslen,
+                            BASSCROSS);
+
+        /* Also mix the LFE channel (if available) */
+        if(s->in_nch >= 6) {
+            const float unit = 1;
+            af_convolver_set_ir(s->conv, SRC_LFE, out, &unit, 1, M3_01DB);
+        }
+    }
+}
+
 static void reset(af_hrtf_t *s)
 {
     clear_coeff(s, s->lf);
@@ -307,6 +363,12 @@ static void reset(af_hrtf_t *s)
     clear_coeff(s, s->fwrbuf_r);
     clear_coeff(s, s->fwrbuf_lr);
     clear_coeff(s, s->fwrbuf_rr);
+    af_convolver_reset(s->conv);
+    for(int i = 0; i < NUM_SRC; i++)
+        memset(s->conv_in[i], 0, af_convolver_block_size(s->conv) * sizeof(float));
+    for(int i = 0; i < 2; i++)
+        memset(s->conv_out[i], 0, af_convolver_block_size(s->conv) * sizeof(float));
+    s->conv_pos = 0;
 }
 
 /* Initialization and runtime control */
@@ -331,8 +393,11 @@ static int control(struct af_instance *af, int cmd, void* arg)
         }
         mp_audio_set_format(af->data, AF_FORMAT_S16);
         test_output_res = af_test_output(af, (struct mp_audio*)arg);
+        s->in_nch = af->data->nch;
         // after testing input set the real output format
         mp_audio_set_num_channels(af->data, 2);
+        setup_conv(s);
+        af->delay = af_convolver_block_size(s->conv) / (double)af->data->rate;
         s->print_flag = 1;
         return test_output_res;
     case AF_CONTROL_RESET:
@@ -391,8 +456,7 @@ static int filter(struct af_instance *af, struct mp_audio *data)
     short *in = data->planes[0]; // Input audio data
     short *out = outframe->planes[0]; // Output audio data
     short *end = in + data->samples * data->nch; // Loop end
-    float common, left, right, diff, left_b, right_b;
-    const int dblen = s->dlbuflen, hlen = s->hrflen, blen = s->basslen;
+    float left, right, diff;
 
     if(s->print_flag) {
         s->print_flag = 0;
@@ -440,6 +504,7 @@ static int filter(struct af_instance *af, struct mp_audio *data)
 
     while(in < end) {
         const int k = s->cyc_pos;
+        const int pos = s->conv_pos;
 
         update_ch(s, in, k);
 
@@ -450,80 +515,30 @@ static int filter(struct af_instance *af, struct mp_audio *data)
         s->lf[k] += CFECHOAMPL * s->cf[(k + CFECHODELAY) % s->dlbuflen];
         s->rf[k] += CFECHOAMPL * s->cf[(k + CFECHODELAY) % s->dlbuflen];
 
-        switch (s->decode_mode) {
-        case HRTF_MIX_51:
-        case HRTF_MIX_MATRIX2CH:
-           /* Mixer filter matrix */
-           common = conv(dblen, hlen, s->cf, s->cf_ir, k + s->cf_o);
-           if(s->matrix_mode) {
-              /* In matrix decoding mode, the rear channel gain must be
-                 renormalized, as there is an additional channel. */
-              matrix_decode(in, k, 2, 3, 0, s->dlbuflen,
-                            s->lr_fwr, s->rr_fwr,
-                            s->lrprr_fwr, s->lrmrr_fwr,
-                            &(s->adapt_lr_gain), &(s->adapt_rr_gain),
-                            &(s->adapt_lrprr_gain), &(s->adapt_lrmrr_gain),
-                            s->lr, s->rr, NULL, NULL, s->cr);
-              common +=
-                 conv(dblen, hlen, s->cr, s->cr_ir, k + s->cr_o) *
-                 M1_76DB;
-              left    =
-                 ( conv(dblen, hlen, s->lf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->rf, s->of_ir, k + s->of_o) +
-                   (conv(dblen, hlen, s->lr, s->ar_ir, k + s->ar_o) +
-                    conv(dblen, hlen, s->rr, s->or_ir, k + s->or_o)) *
-                   M1_76DB + common);
-              right   =
-                 ( conv(dblen, hlen, s->rf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->lf, s->of_ir, k + s->of_o) +
-                   (conv(dblen, hlen, s->rr, s->ar_ir, k + s->ar_o) +
-                    conv(dblen, hlen, s->lr, s->or_ir, k + s->or_o)) *
-                   M1_76DB + common);
-           } else {
-              left    =
-                 ( conv(dblen, hlen, s->lf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->rf, s->of_ir, k + s->of_o) +
-                   conv(dblen, hlen, s->lr, s->ar_ir, k + s->ar_o) +
-                   conv(dblen, hlen, s->rr, s->or_ir, k + s->or_o) +
-                   common);
-              right   =
-                 ( conv(dblen, hlen, s->rf, s->af_ir, k + s->af_o) +
-                   conv(dblen, hlen, s->lf, s->of_ir, k + s->of_o) +
-                   conv(dblen, hlen, s->rr, s->ar_ir, k + s->ar_o) +
-                   conv(dblen, hlen, s->lr, s->or_ir, k + s->or_o) +
-                   common);
-           }
-           break;
-        case HRTF_MIX_STEREO:
-           left    =
-              ( conv(dblen, hlen, s->lf, s->af_ir, k + s->af_o) +
-                conv(dblen, hlen, s->rf, s->of_ir, k + s->of_o));
-           right   =
-              ( conv(dblen, hlen, s->rf, s->af_ir, k + s->af_o) +
-                conv(dblen, hlen, s->lf, s->of_ir, k + s->of_o));
-           break;
-        default:
-            /* make gcc happy */
-            left = 0.0;
-            right = 0.0;
-            break;
+        if(s->matrix_mode && s->decode_mode != HRTF_MIX_STEREO) {
+            matrix_decode(in, k, 2, 3, 0, s->dlbuflen,
+                          s->lr_fwr, s->rr_fwr,
+                          s->lrprr_fwr, s->lrmrr_fwr,
+                          &(s->adapt_lr_gain), &(s->adapt_rr_gain),
+                          &(s->adapt_lrprr_gain), &(s->adapt_lrmrr_gain),
+                          s->lr, s->rr, NULL, NULL, s->cr);
         }
 
-        /* Bass compensation for the lower frequency cut of the HRTF.  A
-           cross talk of the left and right channel is introduced to
-           match the directional characteristics of higher frequencies.
-           The bass will not have any real 3D perception, but that is
-           OK (note at 180 Hz, the wavelength is about 2 m, and any
-           spatial perception is impossible). */
-        left_b  = conv(dblen, blen, s->ba_l, s->ba_ir, k);
-        right_b = conv(dblen, blen, s->ba_r, s->ba_ir, k);
-        left  += (1 - BASSCROSS) * left_b  + BASSCROSS * right_b;
-        right += (1 - BASSCROSS) * right_b + BASSCROSS * left_b;
-        /* Also mix the LFE channel (if available) */
-        if(data->nch >= 6) {
-            left  += in[5] * M3_01DB;
-            right += in[5] * M3_01DB;
-        }
+        /* Feed the mixer filter matrix (see setup_conv()). The HRTF
+           taps don't reach back as far as MATREARDELAY, so the ring
+           buffer samples don't change after this point. */
+        s->conv_in[SRC_LF][pos] = s->lf[k];
+        s->conv_in[SRC_RF][pos] = s->rf[k];
+        s->conv_in[SRC_LR][pos] = s->lr[k];
+        s->conv_in[SRC_RR][pos] = s->rr[k];
+        s->conv_in[SRC_CF][pos] = s->cf[k];
+        s->conv_in[SRC_CR][pos] = s->cr[k];
+        s->conv_in[SRC_BA_L][pos] = s->ba_l[k];
+        s->conv_in[SRC_BA_R][pos] = s->ba_r[k];
+        s->conv_in[SRC_LFE][pos] = data->nch >= 6 ? in[5] : 0;
+
+        left  = s->conv_out[0][pos];
+        right = s->conv_out[1][pos];
 
         /* Amplitude renormalization. */
         left  *= AMPLNORM;
@@ -554,7 +569,11 @@ static int filter(struct af_instance *af, struct mp_audio *data)
         out = &out[af->data->nch];
         (s->cyc_pos)--;
         if(s->cyc_pos < 0)
-            s->cyc_pos += dblen;
+            s->cyc_pos += s->dlbuflen;
+        if(++s->conv_pos == af_convolver_block_size(s->conv)) {
+            af_convolver_process(s->conv, s->conv_in, s->conv_out);
+            s->conv_pos = 0;
+        }
     }
 
     talloc_free(data);
@@ -633,12 +652,12 @@ static int af_open(struct af_instance* af)
     s->lr_fwr =
         s->rr_fwr = 0;
 
-    s->cf_ir = cf_filt + (s->cf_o = pulse_detect(cf_filt));
-    s->af_ir = af_filt + (s->af_o = pulse_detect(af_filt));
-    s->of_ir = of_filt + (s->of_o = pulse_detect(of_filt));
-    s->ar_ir = ar_filt + (s->ar_o = pulse_detect(ar_filt));
-    s->or_ir = or_filt + (s->or_o = pulse_detect(or_filt));
-    s->cr_ir = cr_filt + (s->cr_o = pulse_detect(cr_filt));
+    s->cf_o = pulse_detect(cf_filt);
+    s->af_o = pulse_detect(af_filt);
+    s->of_o = pulse_detect(of_filt);
+    s->ar_o = pulse_detect(ar_filt);
+    s->or_o = pulse_detect(or_filt);
+    s->cr_o = pulse_detect(cr_filt);
 
     if((s->ba_ir = malloc(s->basslen * sizeof(float))) == NULL) {
         MP_ERR(af, "Memory allocation error.\n");
@@ -654,6 +673,16 @@ static int af_open(struct af_instance* af)
     for(i = 0; i < s->basslen; i++)
         s->ba_ir[i] *= BASSGAIN;
 
+    s->conv = af_convolver_create(af, CONVBLOCKBITS, NUM_SRC, 2);
+    if(!s->conv) {
+        MP_ERR(af, "Could not create convolver.\n");
+        return AF_ERROR;
+    }
+    for(i = 0; i < NUM_SRC; i++)
+        s->conv_in[i] = talloc_zero_array(af, float, 1 << CONVBLOCKBITS);
+    for(i = 0; i < 2; i++)
+        s->conv_out[i] = talloc_zero_array(af, float, 1 << CONVBLOCKBITS);
+
     return AF_OK;
 }
 
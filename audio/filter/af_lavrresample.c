@@ -56,9 +56,10 @@
 #include "common/av_common.h"
 #include "common/msg.h"
 #include "options/m_option.h"
+#include "audio/convert.h"
 #include "audio/filter/af.h"
+#include "audio/filter/sample_op.h"
 #include "audio/fmt-conversion.h"
-#include "osdep/endian.h"
 
 struct af_resample_opts {
     int filter_size;
@@ -81,9 +82,6 @@ struct af_resample {
     double playback_speed;
     struct AVAudioResampleContext *avrctx;
     struct mp_audio avrctx_fmt; // output format of avrctx
-    struct mp_audio pool_fmt; // format used to allocate frames for avrctx output
-    struct mp_audio pre_out_fmt; // format before final conversion (S24)
-    struct AVAudioResampleContext *avrctx_out; // for output channel reordering
     struct af_resample_opts ctx;   // opts in the context
     struct af_resample_opts opts;  // opts requested by the user
     // At least libswresample keeps a pointer around for this:
@@ -134,9 +132,6 @@ static void close_lavrr(struct af_instance *af)
     if (s->avrctx)
         avresample_close(s->avrctx);
     avresample_free(&s->avrctx);
-    if (s->avrctx_out)
-        avresample_close(s->avrctx_out);
-    avresample_free(&s->avrctx_out);
 }
 
 static int resample_frame(struct AVAudioResampleContext *r,
@@ -219,8 +214,7 @@ static int configure_lavrr(struct af_instance *af, struct mp_audio *in,
     close_lavrr(af);
 
     s->avrctx = avresample_alloc_context();
-    s->avrctx_out = avresample_alloc_context();
-    if (!s->avrctx || !s->avrctx_out)
+    if (!s->avrctx)
         goto error;
 
     enum AVSampleFormat in_samplefmt = af_to_avformat(in->format);
@@ -299,18 +293,8 @@ static int configure_lavrr(struct af_instance *af, struct mp_audio *in,
     mp_audio_set_channels(&s->avrctx_fmt, &out_lavc);
     mp_audio_set_format(&s->avrctx_fmt, af_from_avformat(out_samplefmtp));
 
-    s->pre_out_fmt = *out;
-    mp_audio_set_format(&s->pre_out_fmt, af_from_avformat(out_samplefmt));
-
-    // If there are NA channels, the final output will have more channels than
-    // the avrctx output. Also, avrctx will output planar (out_samplefmtp was
-    // not overwritten). Allocate the output frame with more channels, so the
-    // NA channels can be trivially added.
-    s->pool_fmt = s->avrctx_fmt;
-    if (map_out.num > out_lavc.num)
-        mp_audio_set_channels(&s->pool_fmt, &map_out);
-
-    // Real conversion; output is input to avrctx_out.
+    // If the avrctx output is not the final format (reordered channels, NA
+    // channels, S24), mp_audio_convert_reorder() does the rest.
     av_opt_set_int(s->avrctx, "in_channel_layout",  in_ch_layout, 0);
     av_opt_set_int(s->avrctx, "out_channel_layout", out_ch_layout, 0);
     av_opt_set_int(s->avrctx, "in_sample_rate",     s->ctx.in_rate, 0);
@@ -318,27 +302,12 @@ static int configure_lavrr(struct af_instance *af, struct mp_audio *in,
     av_opt_set_int(s->avrctx, "in_sample_fmt",      in_samplefmt, 0);
     av_opt_set_int(s->avrctx, "out_sample_fmt",     out_samplefmtp, 0);
 
-    // Just needs the correct number of channels.
-    int fake_out_ch_layout = av_get_default_channel_layout(map_out.num);
-    if (!fake_out_ch_layout)
-        goto error;
-
-    // Deplanarize if needed.
-    av_opt_set_int(s->avrctx_out, "in_channel_layout",  fake_out_ch_layout, 0);
-    av_opt_set_int(s->avrctx_out, "out_channel_layout", fake_out_ch_layout, 0);
-    av_opt_set_int(s->avrctx_out, "in_sample_fmt",      out_samplefmtp, 0);
-    av_opt_set_int(s->avrctx_out, "out_sample_fmt",     out_samplefmt, 0);
-    av_opt_set_int(s->avrctx_out, "in_sample_rate",     s->ctx.out_rate, 0);
-    av_opt_set_int(s->avrctx_out, "out_sample_rate",    s->ctx.out_rate, 0);
-
     // API has weird requirements, quoting avresample.h:
     //  * This function can only be called when the allocated context is not open.
     //  * Also, the input channel layout must have already been set.
     avresample_set_channel_mapping(s->avrctx, s->reorder_in);
 
-    if (avresample_open(s->avrctx) < 0 ||
-        avresample_open(s->avrctx_out) < 0)
-    {
+    if (avresample_open(s->avrctx) < 0) {
         MP_ERR(af, "Cannot open Libavresample Context. \n");
         goto error;
     }
@@ -425,60 +394,14 @@ static void uninit(struct af_instance *af)
     close_lavrr(af);
 }
 
-// The LSB is always ignored.
-#if BYTE_ORDER == BIG_ENDIAN
-#define SHIFT24(x) ((3-(x))*8)
-#else
-#define SHIFT24(x) (((x)+1)*8)
-#endif
-
-static void extra_output_conversion(struct af_instance *af, struct mp_audio *mpa)
-{
-    if (mpa->format == AF_FORMAT_S32 && af->data->format == AF_FORMAT_S24) {
-        size_t len = mp_audio_psize(mpa) / mpa->bps;
-        for (int s = 0; s < len; s++) {
-            uint32_t val = *((uint32_t *)mpa->planes[0] + s);
-            uint8_t *ptr = (uint8_t *)mpa->planes[0] + s * 3;
-            ptr[0] = val >> SHIFT24(0);
-            ptr[1] = val >> SHIFT24(1);
-            ptr[2] = val >> SHIFT24(2);
-        }
-        mp_audio_set_format(mpa, AF_FORMAT_S24);
-    }
-}
-
-// This relies on the tricky way mpa was allocated.
-static void reorder_planes(struct mp_audio *mpa, int *reorder,
-                           struct mp_chmap *newmap)
-{
-    struct mp_audio prev = *mpa;
-    mp_audio_set_channels(mpa, newmap);
-
-    // The trailing planes were never written by avrctx, they're the NA channels.
-    int next_na = prev.num_planes;
-
-    for (int n = 0; n < mpa->num_planes; n++) {
-        int src = reorder[n];
-        assert(src >= -1 && src < prev.num_planes);
-        if (src >= 0) {
-            mpa->planes[n] = prev.planes[src];
-        } else {
-            assert(next_na < mpa->num_planes);
-            mpa->planes[n] = prev.planes[next_na++];
-            af_fill_silence(mpa->planes[n], mpa->sstride * mpa->samples,
-                            mpa->format);
-        }
-    }
-}
-
 static int filter(struct af_instance *af, struct mp_audio *in)
 {
     struct af_resample *s = af->priv;
 
     int samples = get_out_samples(s, in ? in->samples : 0);
 
-    struct mp_audio out_format = s->pool_fmt;
-    struct mp_audio *out = mp_audio_pool_get(af->out_pool, &out_format, samples);
+    struct mp_audio *out = mp_audio_pool_get(af->out_pool, &s->avrctx_fmt,
+                                             samples);
     if (!out)
         goto error;
     if (in)
@@ -493,29 +416,18 @@ static int filter(struct af_instance *af, struct mp_audio *in)
             goto error;
     }
 
-    struct mp_audio real_out = *out;
-    mp_audio_copy_config(out, &s->avrctx_fmt);
-
-    if (out->samples && !mp_audio_config_equals(out, &s->pre_out_fmt)) {
-        assert(af_fmt_is_planar(out->format) && out->format == real_out.format);
-        reorder_planes(out, s->reorder_out, &s->pool_fmt.channels);
-        if (!mp_audio_config_equals(out, &s->pre_out_fmt)) {
-            struct mp_audio *new = mp_audio_pool_get(s->reorder_buffer,
-                                                     &s->pre_out_fmt,
-                                                     out->samples);
-            if (!new)
-                goto error;
-            mp_audio_copy_attributes(new, out);
-            int out_samples = resample_frame(s->avrctx_out, new, out);
-            talloc_free(out);
-            out = new;
-            if (out_samples != new->samples)
-                goto error;
-        }
+    // Reorder channels, add NA channels, interleave, and/or pack S24.
+    if (out->samples && !mp_audio_config_equals(out, af->data)) {
+        struct mp_audio *new = mp_audio_pool_get(s->reorder_buffer, af->data,
+                                                 out->samples);
+        if (!new)
+            goto error;
+        mp_audio_copy_attributes(new, out);
+        mp_audio_convert_reorder(new, 0, out, 0, out->samples, s->reorder_out);
+        talloc_free(out);
+        out = new;
     }
 
-    extra_output_conversion(af, out);
-
     talloc_free(in);
     if (out->samples) {
         af_add_output_frame(af, out);
@@ -532,6 +444,21 @@ error:
     return -1;
 }
 
+// Only a plain sample format conversion can be merged with other filters.
+static bool get_sample_op(struct af_instance *af, struct mp_audio *in,
+                          struct af_sample_op *op)
+{
+    struct af_resample *s = af->priv;
+
+    if (!s->avrctx || s->avopts || s->ctx.in_rate != s->ctx.out_rate ||
+        af->delay != 0 ||
+        !mp_chmap_equals(&af->fmt_in.channels, &af->fmt_out.channels))
+        return false;
+
+    af_sample_op_init(op, 1.0);
+    return true;
+}
+
 static int af_open(struct af_instance *af)
 {
     struct af_resample *s = af->priv;
@@ -539,6 +466,7 @@ static int af_open(struct af_instance *af)
     af->control = control;
     af->uninit  = uninit;
     af->filter_frame = filter;
+    af->get_sample_op = get_sample_op;
 
     if (s->opts.cutoff <= 0.0)
         s->opts.cutoff = af_resample_default_cutoff(s->opts.filter_size);
@@ -26,6 +26,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "sample_op.h"
 
 // Data for specific instances of this filter
 typedef struct af_pan_s
@@ -145,10 +146,23 @@ static int filter_frame(struct af_instance *af, struct mp_audio *c)
   return 0;
 }
 
+static bool get_sample_op(struct af_instance *af, struct mp_audio *c,
+                          struct af_sample_op *op)
+{
+  af_pan_t *s = af->priv;
+  *op = (struct af_sample_op){ .use_matrix = true };
+  for (int j = 0; j < af->fmt_out.nch; j++) {
+    for (int k = 0; k < af->fmt_in.nch; k++)
+      op->matrix[j][k] = s->level[j][k];
+  }
+  return true;
+}
+
 // Allocate memory and set function pointers
 static int af_open(struct af_instance* af){
     af->control=control;
     af->filter_frame = filter_frame;
+    af->get_sample_op = get_sample_op;
     af_pan_t *s = af->priv;
     int   n = 0;
     int   j,k;
@@ -0,0 +1,189 @@
+/*
+ * Parametric equalizer: any number of peak, shelf and pass filters, run as a
+ * biquad cascade.
+ *
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "misc/bstr.h"
+#include "af.h"
+#include "biquad.h"
+
+struct band {
+    int type;
+    double freq, gain, q;
+};
+
+struct priv {
+    struct band *bands;
+    int num_bands;
+    struct af_biquad_bank *bank;
+
+    // command line options
+    char **opt_bands;
+};
+
+static const struct {
+    const char *name;
+    int type;
+} band_types[] = {
+    {"peak",        AF_BIQUAD_PEAK},
+    {"lowshelf",    AF_BIQUAD_LOWSHELF},
+    {"highshelf",   AF_BIQUAD_HIGHSHELF},
+    {"lowpass",     AF_BIQUAD_LOWPASS},
+    {"highpass",    AF_BIQUAD_HIGHPASS},
+    {"bandpass",    AF_BIQUAD_BANDPASS},
+    {"notch",       AF_BIQUAD_NOTCH},
+};
+
+// Parse a number, which must be all of s.
+static bool parse_num(bstr s, double *out)
+{
+    bstr rest;
+    double v = bstrtod(s, &rest);
+    if (!s.len || rest.len)
+        return false;
+    *out = v;
+    return true;
+}
+
+// Parse "type/freq[/gain[/q]]".
+static bool parse_band(struct af_instance *af, const char *str, struct band *b)
+{
+    bstr name, rest;
+    bool more = bstr_split_tok(bstr0(str), "/", &name, &rest);
+
+    *b = (struct band){.type = -1, .q = M_SQRT1_2};
+    for (int n = 0; n < MP_ARRAY_SIZE(band_types); n++) {
+        if (bstr_equals0(name, band_types[n].name))
+            b->type = band_types[n].type;
+    }
+    if (b->type < 0) {
+        MP_ERR(af, "Unknown band type in '%s'.\n", str);
+        return false;
+    }
+
+    double *fields[] = {&b->freq, &b->gain, &b->q};
+    int num_fields = 0;
+    while (more) {
+        bstr field;
+        more = bstr_split_tok(rest, "/", &field, &rest);
+        if (num_fields == MP_ARRAY_SIZE(fields) ||
+            !parse_num(field, fields[num_fields]))
+        {
+            MP_ERR(af, "Invalid band '%s'.\n", str);
+            return false;
+        }
+        num_fields++;
+    }
+    if (num_fields < 1 || b->freq <= 0 || b->q <= 0) {
+        MP_ERR(af, "Band '%s' needs a frequency > 0 and a Q > 0.\n", str);
+        return false;
+    }
+    return true;
+}
+
+static int control(struct af_instance *af, int cmd, void *arg)
+{
+    struct priv *p = af->priv;
+
+    switch (cmd) {
+    case AF_CONTROL_REINIT: {
+        struct mp_audio *in = arg;
+
+        mp_audio_copy_config(af->data, in);
+        mp_audio_set_format(af->data, AF_FORMAT_FLOAT);
+
+        talloc_free(p->bank);
+        p->bank = af_biquad_bank_create(af, p->num_bands, af->data->nch);
+        for (int n = 0; n < p->num_bands; n++) {
+            struct band *b = &p->bands[n];
+            double freq = b->freq / af->data->rate;
+            if (freq >= 0.5) {
+                MP_WARN(af, "Band %d (%g Hz) is above the Nyquist frequency, "
+                        "ignoring it.\n", n, b->freq);
+                continue;
+            }
+            struct af_biquad c;
+            af_biquad_design(&c, b->type, freq, b->q, b->gain);
+            for (int ch = 0; ch < af->data->nch; ch++)
+                af_biquad_bank_set(p->bank, n, ch, &c);
+        }
+        af->delay = af_biquad_bank_delay(p->bank) / (double)af->data->rate;
+
+        return af_test_output(af, in);
+    }
+    case AF_CONTROL_RESET:
+        if (p->bank)
+            af_biquad_bank_reset(p->bank);
+        return AF_OK;
+    }
+    return AF_UNKNOWN;
+}
+
+static int filter(struct af_instance *af, struct mp_audio *data)
+{
+    struct priv *p = af->priv;
+
+    if (!data)
+        return 0;
+    if (af_make_writeable(af, data) < 0) {
+        talloc_free(data);
+        return -1;
+    }
+
+    af_biquad_bank_process(p->bank, data->planes[0], data->samples);
+
+    af_add_output_frame(af, data);
+    return 0;
+}
+
+static int af_open(struct af_instance *af)
+{
+    struct priv *p = af->priv;
+
+    af->control = control;
+    af->filter_frame = filter;
+
+    for (int n = 0; p->opt_bands && p->opt_bands[n]; n++) {
+        struct band b;
+        if (!parse_band(af, p->opt_bands[n], &b))
+            return AF_ERROR;
+        MP_TARRAY_APPEND(af, p->bands, p->num_bands, b);
+    }
+    if (!p->num_bands) {
+        MP_ERR(af, "No bands given.\n");
+        return AF_ERROR;
+    }
+    return AF_OK;
+}
+
+#define OPT_BASE_STRUCT struct priv
+const struct af_info af_info_peq = {
+    .info = "Parametric equalizer",
+    .name = "peq",
+    .open = af_open,
+    .priv_size = sizeof(struct priv),
+    .options = (const struct m_option[]) {
+        OPT_STRINGLIST("bands", opt_bands, 0),
+        {0}
+    },
+};
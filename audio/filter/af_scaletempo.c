@@ -35,6 +35,9 @@
 #include <limits.h>
 #include <assert.h>
 
+#include <libavcodec/avfft.h>
+#include <libavutil/mem.h>
+
 #include "common/common.h"
 
 #include "af.h"
@@ -70,6 +73,11 @@ typedef struct af_scaletempo_s
     void *buf_pre_corr;
     void *table_window;
     int (*best_overlap_offset)(struct af_scaletempo_s *s);
+    // FFT based best overlap (float only)
+    int fft_bits;
+    RDFTContext *rdft, *irdft;
+    float *fft_pre_corr;
+    float *fft_search;
     // command line
     float scale_nominal;
     float ms_stride;
@@ -78,6 +86,7 @@ typedef struct af_scaletempo_s
 #define SCALE_TEMPO 1
 #define SCALE_PITCH 2
     int speed_opt;
+    int fft_opt;
 } af_scaletempo_t;
 
 static int fill_queue(struct af_instance *af, struct mp_audio *data, int offset)
@@ -117,25 +126,47 @@ static int fill_queue(struct af_instance *af, struct mp_audio *data, int offset)
 
 #define UNROLL_PADDING (4 * 4)
 
+// Several independent sums are used, because the compiler must not reorder
+// float additions on its own. This lets gcc vectorize the loop at -O2.
+static float dot_float(const float *restrict a, const float *restrict b, int n)
+{
+    float sum[8] = {0};
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        for (int j = 0; j < 8; j++)
+            sum[j] += a[i + j] * b[i + j];
+    }
+    for (; i < n; i++)
+        sum[0] += a[i] * b[i];
+    return ((sum[0] + sum[1]) + (sum[2] + sum[3])) +
+           ((sum[4] + sum[5]) + (sum[6] + sum[7]));
+}
+
+static int64_t dot_s16(const int32_t *restrict a, const int16_t *restrict b,
+                       int n)
+{
+    int64_t sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
 static int best_overlap_offset_float(af_scaletempo_t *s)
 {
     float best_corr = INT_MIN;
     int best_off = 0;
+    int n = s->samples_overlap - s->num_channels;
 
     float *pw  = s->table_window;
     float *po  = s->buf_overlap;
     po += s->num_channels;
     float *ppc = s->buf_pre_corr;
-    for (int i = s->num_channels; i < s->samples_overlap; i++)
-        *ppc++ = *pw++ **po++;
+    for (int i = 0; i < n; i++)
+        ppc[i] = pw[i] * po[i];
 
     float *search_start = (float *)s->buf_queue + s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        float corr = 0;
-        float *ps = search_start;
-        ppc = s->buf_pre_corr;
-        for (int i = s->num_channels; i < s->samples_overlap; i++)
-            corr += *ppc++ **ps++;
+        float corr = dot_float(ppc, search_start, n);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
@@ -146,33 +177,73 @@ static int best_overlap_offset_float(af_scaletempo_t *s)
     return best_off * 4 * s->num_channels;
 }
 
+// Same as best_overlap_offset_float(), but computes the correlation for all
+// offsets at once as IDFT(conj(DFT(pre_corr)) * DFT(search)). This is
+// O(n log n) instead of O(search * overlap), which matters with many channels
+// or large search windows.
+static int best_overlap_offset_fft(af_scaletempo_t *s)
+{
+    int nch = s->num_channels;
+    int n = s->samples_overlap - nch;
+    int size = 1 << s->fft_bits;
+    float *a = s->fft_pre_corr;
+    float *b = s->fft_search;
+
+    float *pw = s->table_window;
+    float *po = (float *)s->buf_overlap + nch;
+    for (int i = 0; i < n; i++)
+        a[i] = pw[i] * po[i];
+    memset(a + n, 0, (size - n) * sizeof(float));
+
+    int search_len = n + (s->frames_search - 1) * nch;
+    memcpy(b, (float *)s->buf_queue + nch, search_len * sizeof(float));
+    memset(b + search_len, 0, (size - search_len) * sizeof(float));
+
+    av_rdft_calc(s->rdft, a);
+    av_rdft_calc(s->rdft, b);
+
+    // Packed format: DC and Nyquist (both real) first, then complex pairs.
+    b[0] *= a[0];
+    b[1] *= a[1];
+    for (int i = 2; i < size; i += 2) {
+        float re = a[i] * b[i]     + a[i + 1] * b[i + 1];
+        float im = a[i] * b[i + 1] - a[i + 1] * b[i];
+        b[i]     = re;
+        b[i + 1] = im;
+    }
+
+    av_rdft_calc(s->irdft, b);
+
+    // b[k] is now the correlation for lag k (scaled, which doesn't matter).
+    float best_corr = b[0];
+    int best_off = 0;
+    for (int off = 1; off < s->frames_search; off++) {
+        float corr = b[off * nch];
+        if (corr > best_corr) {
+            best_corr = corr;
+            best_off  = off;
+        }
+    }
+
+    return best_off * 4 * nch;
+}
+
 static int best_overlap_offset_s16(af_scaletempo_t *s)
 {
     int64_t best_corr = INT64_MIN;
     int best_off = 0;
+    int n = s->samples_overlap - s->num_channels;
 
     int32_t *pw  = s->table_window;
     int16_t *po  = s->buf_overlap;
     po += s->num_channels;
     int32_t *ppc = s->buf_pre_corr;
-    for (long i = s->num_channels; i < s->samples_overlap; i++)
-        *ppc++ = (*pw++ **po++) >> 15;
+    for (int i = 0; i < n; i++)
+        ppc[i] = (pw[i] * po[i]) >> 15;
 
     int16_t *search_start = (int16_t *)s->buf_queue + s->num_channels;
     for (int off = 0; off < s->frames_search; off++) {
-        int64_t corr = 0;
-        int16_t *ps = search_start;
-        ppc = s->buf_pre_corr;
-        ppc += s->samples_overlap - s->num_channels;
-        ps  += s->samples_overlap - s->num_channels;
-        long i  = -(s->samples_overlap - s->num_channels);
-        do {
-            corr += ppc[i + 0] * ps[i + 0];
-            corr += ppc[i + 1] * ps[i + 1];
-            corr += ppc[i + 2] * ps[i + 2];
-            corr += ppc[i + 3] * ps[i + 3];
-            i += 4;
-        } while (i < 0);
+        int64_t corr = dot_s16(ppc, search_start, n);
         if (corr > best_corr) {
             best_corr = corr;
             best_off  = off;
@@ -291,6 +362,59 @@ static void update_speed(struct af_instance *af, float speed)
                s->speed, s->scale_nominal, s->scale);
 }
 
+static void uninit_fft(af_scaletempo_t *s)
+{
+    av_rdft_end(s->rdft);
+    av_rdft_end(s->irdft);
+    s->rdft = s->irdft = NULL;
+    av_freep(&s->fft_pre_corr);
+    av_freep(&s->fft_search);
+    s->fft_bits = 0;
+}
+
+// Cost of one FFT point per bit of the FFT size, relative to one multiply-add
+// of the direct search. Includes the forward and inverse transforms. This is
+// a guess, which is why fft=auto is not the default.
+#define FFT_COST 8
+
+// Switch to best_overlap_offset_fft() if requested, or if it's likely faster.
+static int init_fft(struct af_instance *af, int frames_overlap)
+{
+    af_scaletempo_t *s = af->priv;
+    int nch = af->data->nch;
+
+    uninit_fft(s);
+
+    int samples = (frames_overlap - 1 + s->frames_search - 1) * nch;
+    int bits = 4;
+    while ((1 << bits) < samples)
+        bits++;
+    if (bits > 16 || s->fft_opt == 0)
+        return 0;
+    if (s->fft_opt < 0) {
+        // Rough estimate of the work for the direct search (multiply-adds)
+        // vs. 3 FFTs (FFT_COST per point and bit). test/bench/scaletempo.c
+        // compares the actual times.
+        int64_t direct = (int64_t)s->frames_search * (frames_overlap - 1) * nch;
+        int64_t fft = FFT_COST * (int64_t)(1 << bits) * bits;
+        if (direct < fft)
+            return 0;
+    }
+
+    s->fft_bits = bits;
+    s->rdft = av_rdft_init(bits, DFT_R2C);
+    s->irdft = av_rdft_init(bits, IDFT_C2R);
+    s->fft_pre_corr = av_malloc_array(1 << bits, sizeof(float));
+    s->fft_search = av_malloc_array(1 << bits, sizeof(float));
+    if (!s->rdft || !s->irdft || !s->fft_pre_corr || !s->fft_search) {
+        MP_FATAL(af, "Out of memory\n");
+        uninit_fft(s);
+        return -1;
+    }
+    s->best_overlap_offset = best_overlap_offset_fft;
+    return 0;
+}
+
 // Initialization and runtime control
 static int control(struct af_instance *af, int cmd, void *arg)
 {
@@ -396,6 +520,8 @@ static int control(struct af_instance *af, int cmd, void *arg)
                         *pw++ = v;
                 }
                 s->best_overlap_offset = best_overlap_offset_float;
+                if (init_fft(af, frames_overlap) < 0)
+                    return AF_ERROR;
             }
         }
 
@@ -415,14 +541,15 @@ static int control(struct af_instance *af, int cmd, void *arg)
 
         MP_DBG(af, ""
                "%.2f stride_in, %i stride_out, %i standing, "
-               "%i overlap, %i search, %i queue, %s mode\n",
+               "%i overlap, %i search, %i queue, %s mode%s\n",
                s->frames_stride_scaled,
                (int)(s->bytes_stride / nch / bps),
                (int)(s->bytes_standing / nch / bps),
                (int)(s->bytes_overlap / nch / bps),
                s->frames_search,
                (int)(s->bytes_queue / nch / bps),
-               (use_int ? "s16" : "float"));
+               (use_int ? "s16" : "float"),
+               (s->best_overlap_offset == best_overlap_offset_fft ? " (FFT)" : ""));
 
         return af_test_output(af, (struct mp_audio *)arg);
     }
@@ -456,6 +583,7 @@ static void uninit(struct af_instance *af)
     free(s->buf_pre_corr);
     free(s->table_blend);
     free(s->table_window);
+    uninit_fft(s);
 }
 
 // Allocate memory and set function pointers
@@ -479,6 +607,7 @@ const struct af_info af_info_scaletempo = {
         .percent_overlap = .20,
         .ms_search = 14,
         .speed_opt = SCALE_TEMPO,
+        .fft_opt = 0,
         .speed = 1.0,
         .scale_nominal = 1.0,
     },
@@ -492,6 +621,10 @@ const struct af_info af_info_scaletempo = {
                     {"tempo", SCALE_TEMPO},
                     {"none", 0},
                     {"both", SCALE_TEMPO | SCALE_PITCH})),
+        OPT_CHOICE("fft", fft_opt, 0,
+                   ({"auto", -1},
+                    {"no", 0},
+                    {"yes", 1})),
         {0}
     },
 };
@@ -27,6 +27,7 @@
 
 #include "common/common.h"
 #include "af.h"
+#include "sample_op.h"
 #include "demux/demux.h"
 
 struct priv {
@@ -143,6 +144,22 @@ static void filter_plane(struct af_instance *af, struct mp_audio *data, int p)
     }
 }
 
+static bool get_sample_op(struct af_instance *af, struct mp_audio *data,
+                          struct af_sample_op *op)
+{
+    struct priv *s = af->priv;
+
+    // The s16 code uses fixed-point math.
+    if (af_fmt_from_planar(af->data->format) != AF_FORMAT_FLOAT)
+        return false;
+
+    float level = s->level * s->rgain;
+    af_sample_op_init(op, level);
+    if (level != 1.0)
+        op->clip = s->soft ? AF_CLIP_SOFT : AF_CLIP_HARD;
+    return true;
+}
+
 static int filter(struct af_instance *af, struct mp_audio *data)
 {
     if (data) {
@@ -158,6 +175,7 @@ static int af_open(struct af_instance *af)
     struct priv *s = af->priv;
     af->control = control;
     af->filter_frame = filter;
+    af->get_sample_op = get_sample_op;
     s->level = from_dB(s->cfg_volume, 20.0, -200.0, 60.0);
     return AF_OK;
 }
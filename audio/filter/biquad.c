@@ -0,0 +1,255 @@
+/*
+ * Cascades of biquad (2nd order IIR) filters.
+ *
+ * Each channel runs through the same number of stages. A cascade is serial
+ * per sample, so the stages are pipelined instead: at every step, stage k
+ * processes the sample that stage k-1 processed in the previous step. All
+ * stages of all channels are then independent of each other, and are run
+ * as one loop over "lanes" (lane = stage * nch + channel) with the filter
+ * state in separate arrays (one entry per lane). The cost is a delay of
+ * (stages - 1) samples.
+ *
+ * The lane loop is written so that gcc vectorizes it at -O2 (see step()).
+ *
+ * Coefficients and state are double: with float, the rounding of the
+ * coefficients of low frequency filters (poles close to 1) changes their
+ * response audibly.
+ *
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "talloc.h"
+
+#include "common/common.h"
+#include "biquad.h"
+
+// Filter states are checked for denormals after this many samples.
+#define FLUSH_INTERVAL 256
+
+// States below this are set to 0. With decaying input, the states of
+// filters with poles close to 1 (low frequencies) would take a long time to
+// reach 0, and would be denormal numbers for most of it, which is very slow
+// on some CPUs. This is far below the noise floor of any audio.
+#define DENORMAL_THRESHOLD 1e-15
+
+// The number of lanes run by step() is rounded up to a multiple of this
+// (2 doubles per SSE2 vector). The extra lanes pass their input through, and
+// their output is never used.
+#define LANE_ALIGN 2
+
+struct af_biquad_bank {
+    int num_stages, nch, lanes;
+    int step_lanes;             // lanes rounded up to LANE_ALIGN
+    // Per lane (step_lanes entries)
+    double *b0, *b1, *b2, *a1, *a2;
+    double *z1, *z2;            // transposed direct form II state
+    // Lane inputs for the current step, and outputs. Both have
+    // nch + step_lanes entries: the new samples go to in[0..nch), and the
+    // output of lane j goes to out[nch + j], so out[0..lanes) is the input for
+    // the next step (after swapping), and out[lanes..lanes + nch) the output
+    // samples.
+    double *in, *out;
+    int flush_count;            // samples since the last flush_denormals()
+};
+
+// Set c to a filter from the Audio EQ Cookbook by Robert Bristow-Johnson.
+// freq is the center or corner frequency divided by the sample rate, and
+// must be below 0.5. gain_db is used by peak and shelf filters only.
+void af_biquad_design(struct af_biquad *c, int type, double freq, double q,
+                      double gain_db)
+{
+    double A = pow(10, gain_db / 40);
+    double w0 = 2 * M_PI * freq;
+    double cw = cos(w0);
+    double alpha = sin(w0) / (2 * q);
+    double sa = 2 * sqrt(A) * alpha;
+    double b0, b1, b2, a0, a1, a2;
+
+    switch (type) {
+    case AF_BIQUAD_PEAK:
+        b0 = 1 + alpha * A;
+        b1 = -2 * cw;
+        b2 = 1 - alpha * A;
+        a0 = 1 + alpha / A;
+        a1 = -2 * cw;
+        a2 = 1 - alpha / A;
+        break;
+    case AF_BIQUAD_LOWSHELF:
+        b0 = A * ((A + 1) - (A - 1) * cw + sa);
+        b1 = 2 * A * ((A - 1) - (A + 1) * cw);
+        b2 = A * ((A + 1) - (A - 1) * cw - sa);
+        a0 = (A + 1) + (A - 1) * cw + sa;
+        a1 = -2 * ((A - 1) + (A + 1) * cw);
+        a2 = (A + 1) + (A - 1) * cw - sa;
+        break;
+    case AF_BIQUAD_HIGHSHELF:
+        b0 = A * ((A + 1) + (A - 1) * cw + sa);
+        b1 = -2 * A * ((A - 1) + (A + 1) * cw);
+        b2 = A * ((A + 1) + (A - 1) * cw - sa);
+        a0 = (A + 1) - (A - 1) * cw + sa;
+        a1 = 2 * ((A - 1) - (A + 1) * cw);
+        a2 = (A + 1) - (A - 1) * cw - sa;
+        break;
+    case AF_BIQUAD_LOWPASS:
+        b0 = (1 - cw) / 2;
+        b1 = 1 - cw;
+        b2 = (1 - cw) / 2;
+        a0 = 1 + alpha;
+        a1 = -2 * cw;
+        a2 = 1 - alpha;
+        break;
+    case AF_BIQUAD_HIGHPASS:
+        b0 = (1 + cw) / 2;
+        b1 = -(1 + cw);
+        b2 = (1 + cw) / 2;
+        a0 = 1 + alpha;
+        a1 = -2 * cw;
+        a2 = 1 - alpha;
+        break;
+    case AF_BIQUAD_BANDPASS:
+        b0 = alpha;
+        b1 = 0;
+        b2 = -alpha;
+        a0 = 1 + alpha;
+        a1 = -2 * cw;
+        a2 = 1 - alpha;
+        break;
+    case AF_BIQUAD_NOTCH:
+        b0 = 1;
+        b1 = -2 * cw;
+        b2 = 1;
+        a0 = 1 + alpha;
+        a1 = -2 * cw;
+        a2 = 1 - alpha;
+        break;
+    default:
+        abort();
+    }
+
+    *c = (struct af_biquad){
+        .b0 = b0 / a0, .b1 = b1 / a0, .b2 = b2 / a0,
+        .a1 = a1 / a0, .a2 = a2 / a0,
+    };
+}
+
+// Create a bank of nch channels with num_stages biquads each. All stages are
+// initially set to pass the signal unchanged.
+struct af_biquad_bank *af_biquad_bank_create(void *ta_parent, int num_stages,
+                                             int nch)
+{
+    struct af_biquad_bank *b = talloc_zero(ta_parent, struct af_biquad_bank);
+    b->num_stages = num_stages;
+    b->nch = nch;
+    b->lanes = num_stages * nch;
+    b->step_lanes = MP_ALIGN_UP(b->lanes, LANE_ALIGN);
+    double **arrays[] = {&b->b0, &b->b1, &b->b2, &b->a1, &b->a2,
+                         &b->z1, &b->z2};
+    for (int n = 0; n < MP_ARRAY_SIZE(arrays); n++)
+        *arrays[n] = talloc_zero_array(b, double, b->step_lanes);
+    b->in = talloc_zero_array(b, double, b->step_lanes + nch);
+    b->out = talloc_zero_array(b, double, b->step_lanes + nch);
+    for (int n = 0; n < b->step_lanes; n++)
+        b->b0[n] = 1;
+    return b;
+}
+
+void af_biquad_bank_set(struct af_biquad_bank *b, int stage, int ch,
+                        const struct af_biquad *c)
+{
+    assert(stage >= 0 && stage < b->num_stages && ch >= 0 && ch < b->nch);
+    int n = stage * b->nch + ch;
+    b->b0[n] = c->b0;
+    b->b1[n] = c->b1;
+    b->b2[n] = c->b2;
+    b->a1[n] = c->a1;
+    b->a2[n] = c->a2;
+}
+
+// Number of samples the output lags behind the input.
+int af_biquad_bank_delay(struct af_biquad_bank *b)
+{
+    return MPMAX(b->num_stages - 1, 0);
+}
+
+void af_biquad_bank_reset(struct af_biquad_bank *b)
+{
+    memset(b->z1, 0, b->step_lanes * sizeof(double));
+    memset(b->z2, 0, b->step_lanes * sizeof(double));
+    memset(b->in, 0, (b->step_lanes + b->nch) * sizeof(double));
+    memset(b->out, 0, (b->step_lanes + b->nch) * sizeof(double));
+    b->flush_count = 0;
+}
+
+// lanes must be a multiple of LANE_ALIGN. gcc -O2 only vectorizes loops if
+// it doesn't need a scalar loop for the remainder, and doesn't need to check
+// for overlapping arrays at runtime. The inner loop with a constant count and
+// the restrict parameters (restrict on local variables is not enough) give
+// it both.
+static void step(int lanes, const double *restrict in, double *restrict out,
+                 const double *restrict b0, const double *restrict b1,
+                 const double *restrict b2, const double *restrict a1,
+                 const double *restrict a2, double *restrict z1,
+                 double *restrict z2)
+{
+    for (int i = 0; i < lanes; i += LANE_ALIGN) {
+        for (int n = i; n < i + LANE_ALIGN; n++) {
+            double x = in[n];
+            double y = b0[n] * x + z1[n];
+            z1[n] = b1[n] * x - a1[n] * y + z2[n];
+            z2[n] = b2[n] * x - a2[n] * y;
+            out[n] = y;
+        }
+    }
+}
+
+static void flush_denormals(struct af_biquad_bank *b)
+{
+    for (int n = 0; n < b->step_lanes; n++) {
+        if (fabs(b->z1[n]) < DENORMAL_THRESHOLD)
+            b->z1[n] = 0;
+        if (fabs(b->z2[n]) < DENORMAL_THRESHOLD)
+            b->z2[n] = 0;
+    }
+}
+
+// Filter interleaved float data in-place (see af_biquad_bank_delay()).
+void af_biquad_bank_process(struct af_biquad_bank *b, float *data, int samples)
+{
+    int nch = b->nch;
+
+    if (!b->lanes)
+        return;
+
+    for (int n = 0; n < samples; n++) {
+        float *x = data + n * nch;
+        for (int c = 0; c < nch; c++)
+            b->in[c] = x[c];
+        step(b->step_lanes, b->in, b->out + nch, b->b0, b->b1, b->b2,
+             b->a1, b->a2, b->z1, b->z2);
+        for (int c = 0; c < nch; c++)
+            x[c] = b->out[b->lanes + c];
+        MPSWAP(double *, b->in, b->out);
+        if (++b->flush_count == FLUSH_INTERVAL) {
+            b->flush_count = 0;
+            flush_denormals(b);
+        }
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef MP_AF_BIQUAD_H
+#define MP_AF_BIQUAD_H
+
+// Coefficients of y = b0*x + b1*x[-1] + b2*x[-2] - a1*y[-1] - a2*y[-2]
+struct af_biquad {
+    double b0, b1, b2, a1, a2;
+};
+
+enum af_biquad_type {
+    AF_BIQUAD_PEAK,
+    AF_BIQUAD_LOWSHELF,
+    AF_BIQUAD_HIGHSHELF,
+    AF_BIQUAD_LOWPASS,
+    AF_BIQUAD_HIGHPASS,
+    AF_BIQUAD_BANDPASS,
+    AF_BIQUAD_NOTCH,
+};
+
+void af_biquad_design(struct af_biquad *c, int type, double freq, double q,
+                      double gain_db);
+
+struct af_biquad_bank;
+
+struct af_biquad_bank *af_biquad_bank_create(void *ta_parent, int num_stages,
+                                             int nch);
+void af_biquad_bank_set(struct af_biquad_bank *b, int stage, int ch,
+                        const struct af_biquad *c);
+int af_biquad_bank_delay(struct af_biquad_bank *b);
+void af_biquad_bank_reset(struct af_biquad_bank *b);
+void af_biquad_bank_process(struct af_biquad_bank *b, float *data, int samples);
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * Uniformly partitioned FFT convolution (overlap-save).
+ *
+ * The impulse responses are cut into partitions of one block each. Every
+ * block of input is transformed once, and kept in a frequency domain delay
+ * line (FDL). The output block is the inverse transform of the sum of
+ * products of the last FDL entries with the partitions. The latency is one
+ * block, and the CPU time per block is constant, independent of how long the
+ * impulse responses are (only the number of multiply-adds grows).
+ *
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include <libavcodec/avfft.h>
+#include <libavutil/mem.h>
+
+#include "talloc.h"
+
+#include "common/common.h"
+#include "convolver.h"
+
+// Spectra are stored with real and imaginary parts in separate arrays of
+// block + 1 entries (DC to Nyquist). DC and Nyquist have imaginary part 0.
+struct ir_filter {
+    int num_parts;
+    float *spectra;             // num_parts spectra
+};
+
+struct af_convolver {
+    int block;                  // samples per partition; FFT size is 2 * block
+    int stride;                 // floats per spectrum (2 * (block + 1))
+    int num_in, num_out;
+    RDFTContext *rdft, *irdft;
+    float *fft_buf;             // 2 * block, av_malloc'ed (needs alignment)
+    float **in_buf;             // per input: the last 2 * block samples
+    float **fdl;                // per input: num_parts spectra (ring buffer)
+    int fdl_pos;                // index of the most recent FDL entry
+    int num_parts;              // max. num_parts of all filters
+    float *acc;                 // one spectrum
+    struct ir_filter **filters; // [in * num_out + out], NULL if unset
+};
+
+static void destroy(void *ptr)
+{
+    struct af_convolver *c = ptr;
+    av_rdft_end(c->rdft);
+    av_rdft_end(c->irdft);
+    av_free(c->fft_buf);
+}
+
+// Create a convolver with num_in input and num_out output channels. Each
+// output is the sum of the inputs, each convolved with the impulse response
+// set with af_convolver_set_ir() (or 0 if not set). Data is processed in
+// blocks of 1 << block_bits samples. Returns NULL on error.
+struct af_convolver *af_convolver_create(void *ta_parent, int block_bits,
+                                         int num_in, int num_out)
+{
+    if (block_bits < 4 || block_bits > 15)
+        return NULL;
+    struct af_convolver *c = talloc_zero(ta_parent, struct af_convolver);
+    talloc_set_destructor(c, destroy);
+    c->block = 1 << block_bits;
+    c->stride = 2 * (c->block + 1);
+    c->num_in = num_in;
+    c->num_out = num_out;
+    c->rdft = av_rdft_init(block_bits + 1, DFT_R2C);
+    c->irdft = av_rdft_init(block_bits + 1, IDFT_C2R);
+    c->fft_buf = av_malloc_array(2 * c->block, sizeof(float));
+    if (!c->rdft || !c->irdft || !c->fft_buf) {
+        talloc_free(c);
+        return NULL;
+    }
+    c->in_buf = talloc_zero_array(c, float *, num_in);
+    c->fdl = talloc_zero_array(c, float *, num_in);
+    for (int i = 0; i < num_in; i++)
+        c->in_buf[i] = talloc_zero_array(c, float, 2 * c->block);
+    c->acc = talloc_zero_array(c, float, c->stride);
+    c->filters = talloc_zero_array(c, struct ir_filter *, num_in * num_out);
+    return c;
+}
+
+int af_convolver_block_size(struct af_convolver *c)
+{
+    return c->block;
+}
+
+// Packed av_rdft output to split format.
+static void to_split(float *restrict dst, const float *restrict src, int n)
+{
+    float *re = dst, *im = dst + n + 1;
+    re[0] = src[0];
+    im[0] = 0;
+    re[n] = src[1];
+    im[n] = 0;
+    for (int k = 1; k < n; k++) {
+        re[k] = src[k * 2];
+        im[k] = src[k * 2 + 1];
+    }
+}
+
+static void from_split(float *restrict dst, const float *restrict src, int n)
+{
+    const float *re = src, *im = src + n + 1;
+    dst[0] = re[0];
+    dst[1] = re[n];
+    for (int k = 1; k < n; k++) {
+        dst[k * 2]     = re[k];
+        dst[k * 2 + 1] = im[k];
+    }
+}
+
+// acc += x * h (complex, element-wise). This is a plain scalar loop; gcc -O2
+// doesn't vectorize it.
+static void mul_add(float *restrict acc, const float *restrict x,
+                    const float *restrict h, int n)
+{
+    float *restrict acc_re = acc, *restrict acc_im = acc + n;
+    const float *x_re = x, *x_im = x + n;
+    const float *h_re = h, *h_im = h + n;
+    for (int k = 0; k < n; k++) {
+        acc_re[k] += x_re[k] * h_re[k] - x_im[k] * h_im[k];
+        acc_im[k] += x_re[k] * h_im[k] + x_im[k] * h_re[k];
+    }
+}
+
+static bool input_used(struct af_convolver *c, int in)
+{
+    for (int o = 0; o < c->num_out; o++) {
+        if (c->filters[in * c->num_out + o])
+            return true;
+    }
+    return false;
+}
+
+static void reset_input(struct af_convolver *c, int in)
+{
+    memset(c->in_buf[in], 0, 2 * c->block * sizeof(float));
+    if (c->fdl[in])
+        memset(c->fdl[in], 0, c->num_parts * c->stride * sizeof(float));
+}
+
+// Set the impulse response (of len samples, multiplied with gain) used to
+// filter input channel in into output channel out. len can be 0 to remove
+// it. If the impulse response is longer than all previous ones, the state is
+// reset (see af_convolver_reset()).
+void af_convolver_set_ir(struct af_convolver *c, int in, int out,
+                         const float *ir, int len, float gain)
+{
+    assert(in >= 0 && in < c->num_in && out >= 0 && out < c->num_out);
+    int block = c->block;
+    struct ir_filter **pf = &c->filters[in * c->num_out + out];
+
+    talloc_free(*pf);
+    *pf = NULL;
+    if (len <= 0)
+        return;
+
+    // Unused inputs are not transformed, so their history is stale.
+    if (!input_used(c, in))
+        reset_input(c, in);
+
+    struct ir_filter *f = talloc_zero(c, struct ir_filter);
+    f->num_parts = (len + block - 1) / block;
+    f->spectra = talloc_array(f, float, f->num_parts * c->stride);
+    // The inverse transform scales the result by 2 * block / 2.
+    float scale = gain / block;
+    for (int p = 0; p < f->num_parts; p++) {
+        int n = MPMIN(block, len - p * block);
+        for (int i = 0; i < n; i++)
+            c->fft_buf[i] = ir[p * block + i] * scale;
+        memset(c->fft_buf + n, 0, (2 * block - n) * sizeof(float));
+        av_rdft_calc(c->rdft, c->fft_buf);
+        to_split(f->spectra + p * c->stride, c->fft_buf, block);
+    }
+    *pf = f;
+
+    if (f->num_parts > c->num_parts) {
+        c->num_parts = f->num_parts;
+        for (int i = 0; i < c->num_in; i++) {
+            c->fdl[i] = talloc_realloc(c, c->fdl[i], float,
+                                       c->num_parts * c->stride);
+        }
+        af_convolver_reset(c);
+    }
+}
+
+// Filter one block: in[i] and out[o] point to af_convolver_block_size()
+// samples for each input and output channel. out can point to the same
+// memory as in.
+void af_convolver_process(struct af_convolver *c, float **in, float **out)
+{
+    int block = c->block;
+
+    if (!c->num_parts) {
+        for (int o = 0; o < c->num_out; o++)
+            memset(out[o], 0, block * sizeof(float));
+        return;
+    }
+
+    for (int i = 0; i < c->num_in; i++) {
+        if (!input_used(c, i))
+            continue;
+        float *buf = c->in_buf[i];
+        memcpy(buf, buf + block, block * sizeof(float));
+        memcpy(buf + block, in[i], block * sizeof(float));
+        memcpy(c->fft_buf, buf, 2 * block * sizeof(float));
+        av_rdft_calc(c->rdft, c->fft_buf);
+        to_split(c->fdl[i] + c->fdl_pos * c->stride, c->fft_buf, block);
+    }
+
+    for (int o = 0; o < c->num_out; o++) {
+        memset(c->acc, 0, c->stride * sizeof(float));
+        for (int i = 0; i < c->num_in; i++) {
+            struct ir_filter *f = c->filters[i * c->num_out + o];
+            if (!f)
+                continue;
+            for (int p = 0; p < f->num_parts; p++) {
+                int pos = (c->fdl_pos - p + c->num_parts) % c->num_parts;
+                mul_add(c->acc, c->fdl[i] + pos * c->stride,
+                        f->spectra + p * c->stride, block + 1);
+            }
+        }
+        from_split(c->fft_buf, c->acc, block);
+        av_rdft_calc(c->irdft, c->fft_buf);
+        // The first half is the part wrapped around by the circular
+        // convolution, the second half is the new output.
+        memcpy(out[o], c->fft_buf + block, block * sizeof(float));
+    }
+
+    c->fdl_pos = (c->fdl_pos + 1) % c->num_parts;
+}
+
+// Clear the input history.
+void af_convolver_reset(struct af_convolver *c)
+{
+    for (int i = 0; i < c->num_in; i++)
+        reset_input(c, i);
+    c->fdl_pos = 0;
+}
@@ -0,0 +1,14 @@
+#ifndef MP_AF_CONVOLVER_H
+#define MP_AF_CONVOLVER_H
+
+struct af_convolver;
+
+struct af_convolver *af_convolver_create(void *ta_parent, int block_bits,
+                                         int num_in, int num_out);
+int af_convolver_block_size(struct af_convolver *c);
+void af_convolver_set_ir(struct af_convolver *c, int in, int out,
+                         const float *ir, int len, float gain);
+void af_convolver_process(struct af_convolver *c, float **in, float **out);
+void af_convolver_reset(struct af_convolver *c);
+
+#endif
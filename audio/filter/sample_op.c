@@ -0,0 +1,356 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "talloc.h"
+
+#include "common/common.h"
+#include "audio/audio.h"
+#include "af.h"
+#include "sample_op.h"
+
+// Samples per channel processed at once. The block is converted to planar
+// float, run through all stages while it's in the L1 cache, and then written
+// back, so that the frame data is read and written only once.
+#define BLOCK 256
+
+// One channel of a block.
+typedef float block_t[BLOCK];
+
+#define MAX_STAGES (AF_SAMPLE_PROG_MAX_OPS * 2 + 1)
+
+enum {
+    STAGE_GAIN,
+    STAGE_MATRIX,
+    STAGE_CLIP,
+};
+
+struct stage {
+    int type;
+    int nch_in, nch_out;
+    int clip;
+    float gain[MP_NUM_CHANNELS];
+    float matrix[MP_NUM_CHANNELS][MP_NUM_CHANNELS];
+};
+
+struct af_sample_prog {
+    int nch;                // channel count at the end of the program
+    // Linear operations not yet emitted as stage. They are multiplied
+    // together, so that gain and mixing filters cost one stage.
+    int lin_nch_in;
+    bool lin_diag;          // lin[][] has non-0 entries on the diagonal only
+    float lin[MP_NUM_CHANNELS][MP_NUM_CHANNELS];
+    int last_clip;          // last stage is a clip stage of this type
+    bool quantize;          // previous op outputs integer samples
+    struct stage stages[MAX_STAGES];
+    int num_stages;
+    block_t buf[2][MP_NUM_CHANNELS];
+};
+
+// Set op to a per-channel gain without clipping.
+void af_sample_op_init(struct af_sample_op *op, float gain)
+{
+    *op = (struct af_sample_op){ .clip = AF_CLIP_NONE };
+    for (int c = 0; c < MP_NUM_CHANNELS; c++)
+        op->gain[c] = gain;
+}
+
+// Whether af_sample_prog_run() can read and write this format.
+bool af_sample_op_format_ok(int format)
+{
+    return format == AF_FORMAT_S16 || format == AF_FORMAT_S16P ||
+           format == AF_FORMAT_FLOAT || format == AF_FORMAT_FLOATP;
+}
+
+struct af_sample_prog *af_sample_prog_create(void *ta_parent)
+{
+    return talloc_zero(ta_parent, struct af_sample_prog);
+}
+
+static void reset_linear(struct af_sample_prog *p)
+{
+    p->lin_nch_in = p->nch;
+    p->lin_diag = true;
+    memset(p->lin, 0, sizeof(p->lin));
+    for (int c = 0; c < p->nch; c++)
+        p->lin[c][c] = 1.0f;
+}
+
+static bool linear_is_identity(struct af_sample_prog *p)
+{
+    if (!p->lin_diag || p->lin_nch_in != p->nch)
+        return false;
+    for (int c = 0; c < p->nch; c++) {
+        if (p->lin[c][c] != 1.0f)
+            return false;
+    }
+    return true;
+}
+
+static struct stage *add_stage(struct af_sample_prog *p, int type)
+{
+    assert(p->num_stages < MAX_STAGES);
+    struct stage *st = &p->stages[p->num_stages++];
+    *st = (struct stage){ .type = type, .nch_in = p->nch, .nch_out = p->nch };
+    return st;
+}
+
+static void flush_linear(struct af_sample_prog *p)
+{
+    if (linear_is_identity(p))
+        return;
+    if (p->lin_diag) {
+        struct stage *st = add_stage(p, STAGE_GAIN);
+        for (int c = 0; c < p->nch; c++)
+            st->gain[c] = p->lin[c][c];
+    } else {
+        struct stage *st = add_stage(p, STAGE_MATRIX);
+        st->nch_in = p->lin_nch_in;
+        memcpy(st->matrix, p->lin, sizeof(st->matrix));
+    }
+    p->last_clip = AF_CLIP_NONE;
+    reset_linear(p);
+}
+
+static void add_clip(struct af_sample_prog *p, int clip)
+{
+    flush_linear(p);
+    // Clamping twice does nothing.
+    if (clip == AF_CLIP_HARD && p->last_clip == AF_CLIP_HARD)
+        return;
+    struct stage *st = add_stage(p, STAGE_CLIP);
+    st->clip = clip;
+    p->last_clip = clip;
+}
+
+// Start a new program, which takes audio in the given format.
+void af_sample_prog_begin(struct af_sample_prog *p, struct mp_audio *in_fmt)
+{
+    p->nch = in_fmt->nch;
+    p->num_stages = 0;
+    p->last_clip = AF_CLIP_NONE;
+    p->quantize = false;
+    reset_linear(p);
+}
+
+// Append op, which outputs audio in the given format. The input format of the
+// op must be the output format of the previous op.
+void af_sample_prog_add(struct af_sample_prog *p, struct af_sample_op *op,
+                        struct mp_audio *out_fmt)
+{
+    // Conversion to integer samples clips; keep that (but not the loss of
+    // precision).
+    if (p->quantize)
+        add_clip(p, AF_CLIP_HARD);
+
+    if (op->use_matrix) {
+        float res[MP_NUM_CHANNELS][MP_NUM_CHANNELS] = {{0}};
+        for (int c = 0; c < out_fmt->nch; c++) {
+            for (int i = 0; i < p->lin_nch_in; i++) {
+                float sum = 0;
+                for (int k = 0; k < p->nch; k++)
+                    sum += op->matrix[c][k] * p->lin[k][i];
+                res[c][i] = sum;
+            }
+        }
+        memcpy(p->lin, res, sizeof(p->lin));
+        p->lin_diag = false;
+        p->nch = out_fmt->nch;
+    } else {
+        assert(out_fmt->nch == p->nch);
+        for (int c = 0; c < p->nch; c++) {
+            for (int i = 0; i < p->lin_nch_in; i++)
+                p->lin[c][i] *= op->gain[c];
+        }
+    }
+
+    if (op->clip != AF_CLIP_NONE)
+        add_clip(p, op->clip);
+
+    p->quantize = af_fmt_from_planar(out_fmt->format) == AF_FORMAT_S16;
+}
+
+static void load(struct mp_audio *in, int pos, int len,
+                 block_t *buf)
+{
+    int nch = in->nch;
+    for (int c = 0; c < nch; c++) {
+        float *restrict dst = buf[c];
+        switch (in->format) {
+        case AF_FORMAT_FLOAT: {
+            const float *restrict src = (float *)in->planes[0] + pos * nch + c;
+            for (int i = 0; i < len; i++)
+                dst[i] = src[i * nch];
+            break;
+        }
+        case AF_FORMAT_FLOATP:
+            memcpy(dst, (float *)in->planes[c] + pos, len * sizeof(float));
+            break;
+        case AF_FORMAT_S16: {
+            const int16_t *restrict src = (int16_t *)in->planes[0] + pos * nch + c;
+            for (int i = 0; i < len; i++)
+                dst[i] = src[i * nch] * (1.0f / 32768);
+            break;
+        }
+        case AF_FORMAT_S16P: {
+            const int16_t *restrict src = (int16_t *)in->planes[c] + pos;
+            for (int i = 0; i < len; i++)
+                dst[i] = src[i] * (1.0f / 32768);
+            break;
+        }
+        default:
+            abort();
+        }
+    }
+}
+
+static inline int16_t to_s16(float v)
+{
+    return lrintf(MPCLAMP(v * 32768.0f, -32768.0f, 32767.0f));
+}
+
+static void store(struct mp_audio *out, int pos, int len,
+                  block_t *buf)
+{
+    int nch = out->nch;
+    for (int c = 0; c < nch; c++) {
+        const float *restrict src = buf[c];
+        switch (out->format) {
+        case AF_FORMAT_FLOAT: {
+            float *restrict dst = (float *)out->planes[0] + pos * nch + c;
+            for (int i = 0; i < len; i++)
+                dst[i * nch] = src[i];
+            break;
+        }
+        case AF_FORMAT_FLOATP:
+            memcpy((float *)out->planes[c] + pos, src, len * sizeof(float));
+            break;
+        case AF_FORMAT_S16: {
+            int16_t *restrict dst = (int16_t *)out->planes[0] + pos * nch + c;
+            for (int i = 0; i < len; i++)
+                dst[i * nch] = to_s16(src[i]);
+            break;
+        }
+        case AF_FORMAT_S16P: {
+            int16_t *restrict dst = (int16_t *)out->planes[c] + pos;
+            for (int i = 0; i < len; i++)
+                dst[i] = to_s16(src[i]);
+            break;
+        }
+        default:
+            abort();
+        }
+    }
+}
+
+static void run_gain(struct stage *st, block_t *buf, int len)
+{
+    for (int c = 0; c < st->nch_out; c++) {
+        float *restrict x = buf[c];
+        float g = st->gain[c];
+        if (g == 1.0f)
+            continue;
+        for (int i = 0; i < len; i++)
+            x[i] *= g;
+    }
+}
+
+static void run_matrix(struct stage *st, block_t *src,
+                       block_t *dst, int len)
+{
+    for (int c = 0; c < st->nch_out; c++) {
+        float *restrict o = dst[c];
+        for (int i = 0; i < len; i++)
+            o[i] = 0;
+        for (int k = 0; k < st->nch_in; k++) {
+            float w = st->matrix[c][k];
+            if (w == 0)
+                continue;
+            const float *restrict x = src[k];
+            for (int i = 0; i < len; i++)
+                o[i] += w * x[i];
+        }
+    }
+}
+
+static void run_clip(struct stage *st, block_t *buf, int len)
+{
+    for (int c = 0; c < st->nch_out; c++) {
+        float *restrict x = buf[c];
+        if (st->clip == AF_CLIP_SOFT) {
+            for (int i = 0; i < len; i++)
+                x[i] = af_softclip(x[i]);
+        } else {
+            for (int i = 0; i < len; i++)
+                x[i] = MPCLAMP(x[i], -1.0f, 1.0f);
+        }
+    }
+}
+
+// Run the program on the frame in, and return the result in the format
+// out_fmt (which must be the output format of the last op). Takes ownership
+// of in. The frame is processed in-place if possible. Returns NULL on OOM.
+struct mp_audio *af_sample_prog_run(struct af_sample_prog *p,
+                                    struct mp_audio_pool *pool,
+                                    struct mp_audio *in,
+                                    struct mp_audio *out_fmt)
+{
+    flush_linear(p);
+    assert(out_fmt->nch == p->nch);
+
+    struct mp_audio *out = in;
+    if (!mp_audio_config_equals(in, out_fmt) || !mp_audio_is_writeable(in)) {
+        out = mp_audio_pool_get(pool, out_fmt, in->samples);
+        if (!out) {
+            talloc_free(in);
+            return NULL;
+        }
+        mp_audio_copy_attributes(out, in);
+    }
+
+    for (int pos = 0; pos < in->samples; pos += BLOCK) {
+        int len = MPMIN(BLOCK, in->samples - pos);
+        block_t *a = p->buf[0];
+        block_t *b = p->buf[1];
+        load(in, pos, len, a);
+        for (int n = 0; n < p->num_stages; n++) {
+            struct stage *st = &p->stages[n];
+            switch (st->type) {
+            case STAGE_GAIN:
+                run_gain(st, a, len);
+                break;
+            case STAGE_MATRIX:
+                run_matrix(st, a, b, len);
+                MPSWAP(block_t *, a, b);
+                break;
+            case STAGE_CLIP:
+                run_clip(st, a, len);
+                break;
+            }
+        }
+        store(out, pos, len, a);
+    }
+
+    if (out != in)
+        talloc_free(in);
+    return out;
+}
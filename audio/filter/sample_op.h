@@ -0,0 +1,46 @@
+#ifndef MP_AF_SAMPLE_OP_H
+#define MP_AF_SAMPLE_OP_H
+
+#include <stdbool.h>
+
+#include "audio/chmap.h"
+
+struct mp_audio;
+struct mp_audio_pool;
+
+enum af_clip {
+    AF_CLIP_NONE = 0,
+    AF_CLIP_HARD,       // clamp to [-1, 1]
+    AF_CLIP_SOFT,       // af_softclip()
+};
+
+// Describes what a filter does to each sample, if it's a simple linear
+// operation followed by optional clipping, without any state that depends on
+// previous samples. See af_instance.get_sample_op.
+struct af_sample_op {
+    // If set, out[c] = sum(matrix[c][i] * in[i]) for i < in->nch.
+    // Otherwise, out[c] = gain[c] * in[c] (and the channel count stays).
+    bool use_matrix;
+    float matrix[MP_NUM_CHANNELS][MP_NUM_CHANNELS];
+    float gain[MP_NUM_CHANNELS];
+    int clip;   // enum af_clip; applied after the matrix/gain
+};
+
+void af_sample_op_init(struct af_sample_op *op, float gain);
+bool af_sample_op_format_ok(int format);
+
+// Maximum number of operations that can be merged into one pass.
+#define AF_SAMPLE_PROG_MAX_OPS 8
+
+struct af_sample_prog;
+
+struct af_sample_prog *af_sample_prog_create(void *ta_parent);
+void af_sample_prog_begin(struct af_sample_prog *p, struct mp_audio *in_fmt);
+void af_sample_prog_add(struct af_sample_prog *p, struct af_sample_op *op,
+                        struct mp_audio *out_fmt);
+struct mp_audio *af_sample_prog_run(struct af_sample_prog *p,
+                                    struct mp_audio_pool *pool,
+                                    struct mp_audio *in,
+                                    struct mp_audio *out_fmt);
+
+#endif
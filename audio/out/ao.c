@@ -26,6 +26,7 @@
 #include "ao.h"
 #include "internal.h"
 #include "audio/format.h"
+#include "audio/convert.h"
 #include "audio/audio.h"
 
 #include "input/input.h"
@@ -196,6 +197,18 @@ static struct ao *ao_init(bool probing, struct mpv_global *global,
         goto fail;
     }
 
+    // If the device doesn't accept the requested sample format, convert it
+    // while copying the data into the AO buffer (in push.c/pull.c), instead
+    // of making the filter chain output the device format.
+    ao->input_format = ao->format;
+    if (af_fmt_is_pcm(format) && af_fmt_is_pcm(ao->format) &&
+        mp_audio_convert_supported(ao->format, format))
+        ao->input_format = format;
+    if (ao->input_format != ao->format) {
+        MP_VERBOSE(ao, "converting %s to %s.\n", af_fmt_to_str(ao->input_format),
+                   af_fmt_to_str(ao->format));
+    }
+
     ao->sstride = af_fmt_to_bytes(ao->format);
     ao->num_planes = 1;
     if (af_fmt_is_planar(ao->format)) {
@@ -437,7 +450,7 @@ bool ao_chmap_sel_get_def(struct ao *ao, const struct mp_chmap_sel *s,
 void ao_get_format(struct ao *ao, struct mp_audio *format)
 {
     *format = (struct mp_audio){0};
-    mp_audio_set_format(format, ao->format);
+    mp_audio_set_format(format, ao->input_format);
     mp_audio_set_channels(format, &ao->channels);
     format->rate = ao->samplerate;
 }
@@ -30,6 +30,7 @@
 #include "config.h"
 #include "options/options.h"
 #include "common/common.h"
+#include "audio/audio.h"
 #include "audio/format.h"
 #include "audio/fmt-conversion.h"
 #include "talloc.h"
@@ -352,20 +353,23 @@ static int play(struct ao *ao, void **data, int samples, int flags)
 
     size_t num_planes = af_fmt_is_planar(ao->format) ? ao->channels.num : 1;
 
-    void *tempdata = NULL;
-    void *padded[MP_NUM_CHANNELS];
+    struct mp_audio *padded = NULL;
 
     if ((flags & AOPLAY_FINAL_CHUNK) && (samples % ac->aframesize)) {
-       tempdata = talloc_new(NULL);
-       size_t bytelen = samples * ao->sstride;
-       size_t extralen = (ac->aframesize - 1) * ao->sstride;
-       for (int n = 0; n < num_planes; n++) {
-           padded[n] = talloc_size(tempdata, bytelen + extralen);
-           memcpy(padded[n], data[n], bytelen);
-           af_fill_silence((char *)padded[n] + bytelen, extralen, ao->format);
-       }
-       data = padded;
-       samples = (bytelen + extralen) / ao->sstride;
+       struct mp_audio in;
+       ao_get_format(ao, &in);
+       mp_audio_set_format(&in, ao->format); // after conversion by push.c
+       for (int n = 0; n < num_planes; n++)
+           in.planes[n] = data[n];
+       in.samples = samples;
+       padded = talloc_zero(NULL, struct mp_audio);
+       mp_audio_copy_config(padded, &in);
+       mp_audio_realloc(padded, samples + ac->aframesize - 1);
+       padded->samples = samples + ac->aframesize - 1;
+       mp_audio_copy(padded, 0, &in, 0, samples);
+       mp_audio_fill_silence(padded, samples, padded->samples - samples);
+       data = padded->planes;
+       samples = padded->samples;
     }
 
     if (pts == MP_NOPTS_VALUE) {
@@ -455,7 +459,7 @@ static int play(struct ao *ao, void **data, int samples, int flags)
             ectx->next_in_pts = nextpts;
     }
 
-    talloc_free(tempdata);
+    talloc_free(padded);
 
     int taken = FFMIN(bufpos, orig_samples);
     ectx->samples_since_last_pts += taken;
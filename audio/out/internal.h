@@ -29,6 +29,8 @@ struct ao {
     int samplerate;
     struct mp_chmap channels;
     int format;                 // one of AF_FORMAT_...
+    int input_format;           // format of the data passed to ao_play()
+                                // (converted to format by push.c/pull.c)
     int bps;                    // bytes per second (per plane)
     int sstride;                // size of a sample on each plane
                                 // (format_size*num_channels/num_planes)
@@ -21,6 +21,8 @@
 
 #include "ao.h"
 #include "internal.h"
+#include "audio/audio.h"
+#include "audio/convert.h"
 #include "audio/format.h"
 
 #include "common/msg.h"
@@ -57,8 +59,13 @@ struct ao_pull_state {
 
     // Device delay of the last written sample, in realtime.
     atomic_llong end_time_us;
+
+    // For converting ao->input_format to ao->format (CONVERT_SAMPLES samples).
+    void *convert_buf;
 };
 
+#define CONVERT_SAMPLES 256
+
 static void set_state(struct ao *ao, int new_state)
 {
     struct ao_pull_state *p = ao->api_priv;
@@ -82,6 +89,44 @@ static int get_space(struct ao *ao)
     return mp_ring_available(p->buffers[ao->num_planes - 1]) / ao->sstride;
 }
 
+// Write starting from the last plane - this way, the first plane will
+// always contain the minimum amount of data readable across all planes
+// (assumes the reader starts with the first plane).
+static void write_planes(struct ao *ao, void **data, int samples)
+{
+    struct ao_pull_state *p = ao->api_priv;
+    int write_bytes = samples * ao->sstride;
+    for (int n = ao->num_planes - 1; n >= 0; n--) {
+        int r = mp_ring_write(p->buffers[n], data[n], write_bytes);
+        assert(r == write_bytes);
+    }
+}
+
+// Convert to the device format in small pieces, which stay in the cache
+// until they're copied to the ring buffers.
+static void write_converted(struct ao *ao, void **data, int samples)
+{
+    struct ao_pull_state *p = ao->api_priv;
+
+    struct mp_audio in, tmp;
+    ao_get_format(ao, &in);
+    for (int n = 0; n < in.num_planes; n++)
+        in.planes[n] = data[n];
+    in.samples = samples;
+
+    tmp = in;
+    mp_audio_set_format(&tmp, ao->format);
+    for (int n = 0; n < tmp.num_planes; n++)
+        tmp.planes[n] = (char *)p->convert_buf + n * CONVERT_SAMPLES * tmp.sstride;
+    tmp.samples = CONVERT_SAMPLES;
+
+    for (int pos = 0; pos < samples; pos += CONVERT_SAMPLES) {
+        int len = MPMIN(CONVERT_SAMPLES, samples - pos);
+        mp_audio_convert(&tmp, 0, &in, pos, len);
+        write_planes(ao, tmp.planes, len);
+    }
+}
+
 static int play(struct ao *ao, void **data, int samples, int flags)
 {
     struct ao_pull_state *p = ao->api_priv;
@@ -89,13 +134,10 @@ static int play(struct ao *ao, void **data, int samples, int flags)
     int write_samples = get_space(ao);
     write_samples = MPMIN(write_samples, samples);
 
-    // Write starting from the last plane - this way, the first plane will
-    // always contain the minimum amount of data readable across all planes
-    // (assumes the reader starts with the first plane).
-    int write_bytes = write_samples * ao->sstride;
-    for (int n = ao->num_planes - 1; n >= 0; n--) {
-        int r = mp_ring_write(p->buffers[n], data[n], write_bytes);
-        assert(r == write_bytes);
+    if (ao->input_format != ao->format) {
+        write_converted(ao, data, write_samples);
+    } else {
+        write_planes(ao, data, write_samples);
     }
 
     int state = atomic_load(&p->state);
@@ -242,6 +284,10 @@ static int init(struct ao *ao)
     struct ao_pull_state *p = ao->api_priv;
     for (int n = 0; n < ao->num_planes; n++)
         p->buffers[n] = mp_ring_new(ao, ao->buffer * ao->sstride);
+    if (ao->input_format != ao->format) {
+        p->convert_buf = talloc_size(ao, CONVERT_SAMPLES * ao->sstride *
+                                         ao->num_planes);
+    }
     atomic_store(&p->state, AO_STATE_NONE);
     assert(ao->driver->resume);
     return 0;
@@ -223,9 +223,10 @@ static int play(struct ao *ao, void **data, int samples, int flags)
         flags = flags & ~AOPLAY_FINAL_CHUNK;
     bool is_final = flags & AOPLAY_FINAL_CHUNK;
 
+    // This converts the data to the device format, if needed.
     struct mp_audio audio;
-    mp_audio_buffer_get_format(p->buffer, &audio);
-    for (int n = 0; n < ao->num_planes; n++)
+    ao_get_format(ao, &audio);
+    for (int n = 0; n < audio.num_planes; n++)
         audio.planes[n] = data[n];
     audio.samples = write_samples;
     mp_audio_buffer_append(p->buffer, &audio);
@@ -29,6 +29,7 @@ struct encode_opts {
     int video_first;
     int audio_first;
     int metadata;
+    int queue;
 };
 
 // interface for mplayer.c
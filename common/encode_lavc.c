@@ -19,6 +19,8 @@
  * with mpv.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <assert.h>
+
 #include <libavutil/avutil.h>
 
 #include "encode_lavc.h"
@@ -54,6 +56,7 @@ const struct m_sub_options encode_config = {
         OPT_FLAG("ovfirst", video_first, CONF_GLOBAL),
         OPT_FLAG("oafirst", audio_first, CONF_GLOBAL),
         OPT_FLAG("ometadata", metadata, CONF_GLOBAL),
+        OPT_INTRANGE("oqueue", queue, CONF_GLOBAL, 0, 64),
         {0}
     },
     .size = sizeof(struct encode_opts),
@@ -280,6 +283,77 @@ void encode_lavc_set_metadata(struct encode_lavc_context *ctx,
         ctx->metadata = metadata;
 }
 
+// Maximum number of packets queued for the muxer thread.
+#define MUX_QUEUE_MAX 256
+
+static void *mux_thread(void *p)
+{
+    struct encode_lavc_context *ctx = p;
+
+    pthread_mutex_lock(&ctx->mux_lock);
+    while (1) {
+        if (ctx->num_mux_queue) {
+            AVPacket *packet = ctx->mux_queue[0];
+            MP_TARRAY_REMOVE_AT(ctx->mux_queue, ctx->num_mux_queue, 0);
+            pthread_cond_broadcast(&ctx->mux_wakeup);
+            pthread_mutex_unlock(&ctx->mux_lock);
+
+            int r = av_interleaved_write_frame(ctx->avc, packet);
+            av_packet_unref(packet);
+            av_free(packet);
+
+            int64_t written = avio_tell(ctx->avc->pb);
+
+            pthread_mutex_lock(&ctx->mux_lock);
+            if (r < 0 && !ctx->mux_error)
+                ctx->mux_error = r;
+            ctx->mux_written = written;
+            continue;
+        }
+        if (ctx->mux_terminate)
+            break;
+        pthread_cond_wait(&ctx->mux_wakeup, &ctx->mux_lock);
+    }
+    pthread_mutex_unlock(&ctx->mux_lock);
+    return NULL;
+}
+
+static void start_mux_thread(struct encode_lavc_context *ctx)
+{
+    pthread_mutex_init(&ctx->mux_lock, NULL);
+    pthread_cond_init(&ctx->mux_wakeup, NULL);
+    ctx->mux_terminate = false;
+    ctx->mux_error = 0;
+    ctx->mux_written = ctx->avc->pb ? avio_tell(ctx->avc->pb) : 0;
+    if (pthread_create(&ctx->mux_thread, NULL, mux_thread, ctx)) {
+        pthread_cond_destroy(&ctx->mux_wakeup);
+        pthread_mutex_destroy(&ctx->mux_lock);
+        MP_WARN(ctx, "could not start muxer thread\n");
+        return;
+    }
+    ctx->mux_threaded = true;
+}
+
+// Write all queued packets and stop the muxer thread.
+static void stop_mux_thread(struct encode_lavc_context *ctx)
+{
+    if (!ctx->mux_threaded)
+        return;
+    pthread_mutex_lock(&ctx->mux_lock);
+    ctx->mux_terminate = true;
+    pthread_cond_broadcast(&ctx->mux_wakeup);
+    pthread_mutex_unlock(&ctx->mux_lock);
+    pthread_join(ctx->mux_thread, NULL);
+    assert(!ctx->num_mux_queue);
+    talloc_free(ctx->mux_queue);
+    ctx->mux_queue = NULL;
+    pthread_cond_destroy(&ctx->mux_wakeup);
+    pthread_mutex_destroy(&ctx->mux_lock);
+    ctx->mux_threaded = false;
+    if (ctx->mux_error < 0)
+        MP_ERR(ctx, "error writing packets\n");
+}
+
 int encode_lavc_start(struct encode_lavc_context *ctx)
 {
     AVDictionaryEntry *de;
@@ -356,6 +430,13 @@ int encode_lavc_start(struct encode_lavc_context *ctx)
         MP_WARN(ctx, "ofopts: key '%s' not found.\n", de->key);
     av_dict_free(&ctx->foptions);
 
+    // With AVFMT_RAWPICTURE, video packets contain an AVPicture that points
+    // into the VO's last image, which doesn't stay valid until the muxer
+    // thread writes the packet. (See vo_lavc.c.)
+    if (ctx->options->queue > 0 &&
+        !(ctx->avc->oformat->flags & AVFMT_RAWPICTURE))
+        start_mux_thread(ctx);
+
     ctx->header_written = 1;
     return 1;
 }
@@ -384,6 +465,8 @@ void encode_lavc_finish(struct encode_lavc_context *ctx)
         return;
 
     if (ctx->avc) {
+        stop_mux_thread(ctx);
+
         if (ctx->header_written > 0)
             av_write_trailer(ctx->avc);  // this is allowed to fail
 
@@ -818,6 +901,33 @@ int encode_lavc_write_frame(struct encode_lavc_context *ctx, AVPacket *packet)
         break;
     }
 
+    if (ctx->mux_threaded) {
+        // The packet data is usually owned by the caller, so make a copy.
+        AVPacket *copy = av_malloc(sizeof(*copy));
+        if (!copy)
+            return -1;
+        av_init_packet(copy);
+        if (av_packet_ref(copy, packet) < 0) {
+            av_free(copy);
+            return -1;
+        }
+        pthread_mutex_lock(&ctx->mux_lock);
+        while (ctx->num_mux_queue >= MUX_QUEUE_MAX && !ctx->mux_error)
+            pthread_cond_wait(&ctx->mux_wakeup, &ctx->mux_lock);
+        r = ctx->mux_error;
+        if (r >= 0) {
+            MP_TARRAY_APPEND(ctx, ctx->mux_queue, ctx->num_mux_queue, copy);
+            pthread_cond_broadcast(&ctx->mux_wakeup);
+            copy = NULL;
+        }
+        pthread_mutex_unlock(&ctx->mux_lock);
+        if (copy) {
+            av_packet_unref(copy);
+            av_free(copy);
+        }
+        return r;
+    }
+
     r = av_interleaved_write_frame(ctx->avc, packet);
 
     return r;
@@ -1091,8 +1201,18 @@ int encode_lavc_getstatus(struct encode_lavc_context *ctx,
 
     CHECK_FAIL_UNLOCK(ctx, -1);
 
+    // With the muxer thread, the AVIOContext belongs to it.
+    int64_t written = 0;
+    if (ctx->mux_threaded) {
+        pthread_mutex_lock(&ctx->mux_lock);
+        written = ctx->mux_written;
+        pthread_mutex_unlock(&ctx->mux_lock);
+    } else if (ctx->avc->pb) {
+        written = avio_size(ctx->avc->pb);
+    }
+
     minutes = (now - ctx->t0) / 60.0 * (1 - f) / f;
-    megabytes = ctx->avc->pb ? (avio_size(ctx->avc->pb) / 1048576.0 / f) : 0;
+    megabytes = written / 1048576.0 / f;
     fps = ctx->frames / (now - ctx->t0);
     x = ctx->audioseconds / (now - ctx->t0);
     if (ctx->frames)
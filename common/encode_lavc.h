@@ -85,6 +85,18 @@ struct encode_lavc_context {
     // has encoding failed?
     bool failed;
     bool finished;
+
+    // Muxer thread (--oqueue). Packets passed to encode_lavc_write_frame()
+    // are copied to mux_queue, and written by the thread.
+    bool mux_threaded;
+    pthread_t mux_thread;
+    pthread_mutex_t mux_lock; // protects the fields below
+    pthread_cond_t mux_wakeup;
+    AVPacket **mux_queue;
+    int num_mux_queue;
+    bool mux_terminate;
+    int mux_error;
+    int64_t mux_written; // bytes written to avc->pb so far
 };
 
 // interface for vo/ao drivers
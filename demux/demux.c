@@ -32,7 +32,11 @@
 #include "talloc.h"
 #include "common/msg.h"
 #include "common/global.h"
+#include "misc/ctype.h"
+#include "options/path.h"
+#include "osdep/atomics.h"
 #include "osdep/threads.h"
+#include "osdep/timer.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -107,6 +111,7 @@ struct demux_internal {
     void *wakeup_cb_ctx;
 
     bool warned_queue_overflow;
+    bool warned_share;
     bool last_eof;              // last actual global EOF status
     bool eof;                   // whether we're in EOF state (reset for retry)
     bool idle;
@@ -114,6 +119,8 @@ struct demux_internal {
     double min_secs;
     int min_packs;
     int min_bytes;
+    int max_back_bytes;
+    int max_bytes;
 
     bool tracks_switched;       // thread needs to inform demuxer of this
 
@@ -133,6 +140,8 @@ struct demux_internal {
     int64_t stream_cache_size;
     int64_t stream_cache_fill;
     int stream_cache_idle;
+    bool has_stream_read_latency;
+    struct stream_read_latency stream_read_latency;
     // Updated during init only.
     char *stream_base_filename;
 };
@@ -147,16 +156,27 @@ struct demux_stream {
                             // read (like subtitles)
     bool eof;               // end of demuxed stream? (true if all buffer empty)
     bool refreshing;
-    size_t packs;           // number of packets in buffer
-    size_t bytes;           // total bytes of packets in buffer
+    bool over_share;        // queued bytes exceed its share of max_bytes
+                            // (updated by read_packet())
+    size_t packs;           // number of packets in buffer (after reader_head)
+    size_t bytes;           // total bytes of packets in buffer (same)
+    size_t back_bytes;      // total bytes of already returned packets
+    atomic_int num_queued;  // mirrors packs, but can be read without lock
     double base_ts;         // timestamp of the last packet returned to decoder
     double last_ts;         // timestamp of the last packet added to queue
     double last_br_ts;      // timestamp of last packet bitrate was calculated
     size_t last_br_bytes;   // summed packet sizes since last bitrate calculation
     double bitrate;
     int64_t last_pos;
+    // Packet queue. Packets from head up to (excluding) reader_head were
+    // already returned to the decoder, and are kept only for seeking
+    // (see --demuxer-backbuffer-bytes). reader_head is the next packet
+    // demux_read_packet() returns, or NULL if no packet is queued.
+    // back_tail is the last packet before reader_head (NULL if none).
     struct demux_packet *head;
     struct demux_packet *tail;
+    struct demux_packet *reader_head;
+    struct demux_packet *back_tail;
 };
 
 // Return "a", or if that is NOPTS, return "def".
@@ -178,9 +198,11 @@ static void ds_flush(struct demux_stream *ds)
         free_demux_packet(dp);
         dp = dn;
     }
-    ds->head = ds->tail = NULL;
+    ds->head = ds->tail = ds->reader_head = ds->back_tail = NULL;
     ds->packs = 0;
+    atomic_store(&ds->num_queued, 0);
     ds->bytes = 0;
+    ds->back_bytes = 0;
     ds->last_ts = ds->base_ts = ds->last_br_ts = MP_NOPTS_VALUE;
     ds->last_br_bytes = 0;
     ds->bitrate = -1;
@@ -245,6 +267,7 @@ void free_demuxer(demuxer_t *demuxer)
     pthread_cond_destroy(&in->wakeup);
     talloc_free(in->nav_event);
     talloc_free(demuxer);
+    demux_packet_pool_unref();
 }
 
 void free_demuxer_and_stream(struct demuxer *demuxer)
@@ -285,6 +308,13 @@ void demux_stop_thread(struct demuxer *demuxer)
     }
 }
 
+// Whether packets for this stream are read by the demuxer thread. If true,
+// demux_read_packet_async() can be called from any thread.
+bool demux_stream_is_threaded(struct sh_stream *sh)
+{
+    return sh && sh->ds && sh->ds->in->threading;
+}
+
 // The demuxer thread will call cb(ctx) if there's a new packet, or EOF is reached.
 void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *ctx)
 {
@@ -337,6 +367,7 @@ int demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
     ds->last_pos = dp->pos;
     ds->packs++;
     ds->bytes += dp->len;
+    atomic_store(&ds->num_queued, ds->packs);
     if (ds->tail) {
         // next packet in stream
         ds->tail->next = dp;
@@ -345,6 +376,8 @@ int demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
         // first packet in stream
         ds->head = ds->tail = dp;
     }
+    if (!ds->reader_head)
+        ds->reader_head = dp;
 
     // obviously not true anymore
     ds->eof = false;
@@ -365,9 +398,16 @@ int demux_add_packet(struct sh_stream *stream, demux_packet_t *dp)
            "[num=%zd size=%zd]\n", stream_type_name(stream->type),
            dp->len, dp->pts, dp->dts, dp->pos, ds->packs, ds->bytes);
 
-    if (ds->in->wakeup_cb && !ds->head->next)
-        ds->in->wakeup_cb(ds->in->wakeup_cb_ctx);
-    pthread_cond_signal(&in->wakeup);
+    // Readers wait only if the queue was empty, so wake them up only if this
+    // is the first packet, instead of once per packet. Since this is not done
+    // for every packet, all waiters must be woken up: in->wakeup is shared by
+    // the readers of all streams and the demuxer thread, and a single signal
+    // could wake up a thread that isn't waiting for this stream.
+    if (ds->reader_head == dp) {
+        if (in->wakeup_cb)
+            in->wakeup_cb(in->wakeup_cb_ctx);
+        pthread_cond_broadcast(&in->wakeup);
+    }
     pthread_mutex_unlock(&in->lock);
     return 1;
 }
@@ -383,19 +423,58 @@ static bool read_packet(struct demux_internal *in)
     // safe-guards against packet queue overflow.
     bool active = false, read_more = false;
     size_t packs = 0, bytes = 0;
+    int num_active = 0;
     for (int n = 0; n < in->d_buffer->num_streams; n++) {
         struct demux_stream *ds = in->d_buffer->streams[n]->ds;
-        active |= ds->active;
-        read_more |= ds->active && !ds->head;
+        num_active += ds->active;
         packs += ds->packs;
         bytes += ds->bytes;
-        if (ds->active && ds->last_ts != MP_NOPTS_VALUE && in->min_secs > 0 &&
-            ds->last_ts >= ds->base_ts)
+    }
+    // Streams using more than their share of the byte budget.
+    size_t share = in->max_bytes / MPMAX(num_active, 1);
+    bool over_share = false;
+    for (int n = 0; n < in->d_buffer->num_streams; n++) {
+        struct demux_stream *ds = in->d_buffer->streams[n]->ds;
+        ds->over_share = ds->active && ds->bytes > share;
+        over_share |= ds->over_share;
+    }
+    for (int n = 0; n < in->d_buffer->num_streams; n++) {
+        struct demux_stream *ds = in->d_buffer->streams[n]->ds;
+        active |= ds->active;
+        if (ds->active && !ds->reader_head) {
+            if (over_share && ds->type == STREAM_SUB) {
+                // Subtitles are sparse; don't make the reader wait for them.
+                // Audio and video keep reading up to the total limit below,
+                // because they're probably just badly interleaved.
+                if (!in->warned_share) {
+                    in->warned_share = true;
+                    MP_WARN(in, "%s/%d has no packets, while these streams "
+                            "exceed their share of --demuxer-max-bytes:\n",
+                            stream_type_name(ds->type), n);
+                    for (int i = 0; i < in->d_buffer->num_streams; i++) {
+                        struct demux_stream *o = in->d_buffer->streams[i]->ds;
+                        if (o->over_share) {
+                            MP_WARN(in, "  %s/%d: %zd bytes\n",
+                                    stream_type_name(o->type), i, o->bytes);
+                        }
+                    }
+                }
+                if (!ds->eof) {
+                    ds->eof = true;
+                    pthread_cond_broadcast(&in->wakeup);
+                }
+            } else {
+                read_more = true;
+            }
+        }
+        // Streams over their share don't need to read ahead any further.
+        if (ds->active && !ds->over_share && ds->last_ts != MP_NOPTS_VALUE &&
+            in->min_secs > 0 && ds->last_ts >= ds->base_ts)
             read_more |= ds->last_ts - ds->base_ts < in->min_secs;
     }
     MP_DBG(in, "packets=%zd, bytes=%zd, active=%d, more=%d\n",
            packs, bytes, active, read_more);
-    if (packs >= MAX_PACKS || bytes >= MAX_PACK_BYTES) {
+    if (packs >= MAX_PACKS || bytes >= (size_t)in->max_bytes) {
         if (!in->warned_queue_overflow) {
             in->warned_queue_overflow = true;
             MP_ERR(in, "Too many packets in the demuxer packet queues:\n");
@@ -409,9 +488,9 @@ static bool read_packet(struct demux_internal *in)
         }
         for (int n = 0; n < in->d_buffer->num_streams; n++) {
             struct demux_stream *ds = in->d_buffer->streams[n]->ds;
-            ds->eof |= !ds->head;
+            ds->eof |= !ds->reader_head;
         }
-        pthread_cond_signal(&in->wakeup);
+        pthread_cond_broadcast(&in->wakeup);
         return false;
     }
     if (packs < in->min_packs && bytes < in->min_bytes)
@@ -454,7 +533,7 @@ static void ds_get_packets(struct demux_stream *ds)
     MP_DBG(in, "reading packet for %s\n", t);
     in->eof = false; // force retry
     ds->eof = false;
-    while (ds->selected && !ds->head && !ds->eof) {
+    while (ds->selected && !ds->reader_head && !ds->eof) {
         ds->active = true;
         // Note: the following code marks EOF if it can't continue
         if (in->threading) {
@@ -575,17 +654,70 @@ static void *demux_thread(void *pctx)
     return NULL;
 }
 
-static struct demux_packet *dequeue_packet(struct demux_stream *ds)
+// Free already returned packets until the back buffer fits into the
+// configured size. Always removes whole keyframe ranges, so that the
+// remaining back buffer starts with a keyframe (if it was before).
+static void prune_back_buffer(struct demux_stream *ds)
 {
-    if (!ds->head)
-        return NULL;
-    struct demux_packet *pkt = ds->head;
-    ds->head = pkt->next;
-    pkt->next = NULL;
+    size_t max_bytes = ds->in->max_back_bytes;
+    while (ds->head != ds->reader_head && ds->back_bytes > max_bytes) {
+        do {
+            struct demux_packet *dp = ds->head;
+            ds->head = dp->next;
+            ds->back_bytes -= dp->len;
+            free_demux_packet(dp);
+        } while (ds->head != ds->reader_head && !ds->head->keyframe);
+    }
+    if (ds->head == ds->reader_head)
+        ds->back_tail = NULL;
     if (!ds->head)
         ds->tail = NULL;
+}
+
+// Unlink the packet at reader_head from the queue, and return it. The packet
+// is not copied: the caller owns it, and must free it with talloc_free().
+// With the back buffer enabled, a new reference to the packet data (see
+// demux_ref_packet()) is left in the queue in its place.
+static struct demux_packet *dequeue_packet(struct demux_stream *ds)
+{
+    if (!ds->reader_head)
+        return NULL;
+    struct demux_packet *pkt = ds->reader_head;
+    ds->reader_head = pkt->next;
     ds->bytes -= pkt->len;
     ds->packs--;
+    atomic_store(&ds->num_queued, ds->packs);
+
+    struct demux_packet *ref = NULL;
+    if (ds->in->max_back_bytes > 0)
+        ref = demux_ref_packet(pkt);
+    if (ref) {
+        ref->next = pkt->next;
+        if (ds->back_tail) {
+            ds->back_tail->next = ref;
+        } else {
+            ds->head = ref;
+        }
+        if (ds->tail == pkt)
+            ds->tail = ref;
+        ds->back_tail = ref;
+        ds->back_bytes += ref->len;
+        prune_back_buffer(ds);
+    } else {
+        // Packets whose data can't be shared end the back buffer, because
+        // it must not have holes.
+        while (ds->head != pkt) {
+            struct demux_packet *dp = ds->head;
+            ds->head = dp->next;
+            free_demux_packet(dp);
+        }
+        ds->back_bytes = 0;
+        ds->back_tail = NULL;
+        ds->head = pkt->next;
+        if (!ds->head)
+            ds->tail = NULL;
+    }
+    pkt->next = NULL;
 
     double ts = pkt->dts == MP_NOPTS_VALUE ? pkt->pts : pkt->dts;
     if (ts != MP_NOPTS_VALUE)
@@ -671,23 +803,18 @@ double demux_get_next_pts(struct sh_stream *sh)
     if (sh) {
         pthread_mutex_lock(&sh->ds->in->lock);
         ds_get_packets(sh->ds);
-        if (sh->ds->head)
-            res = sh->ds->head->pts;
+        if (sh->ds->reader_head)
+            res = sh->ds->reader_head->pts;
         pthread_mutex_unlock(&sh->ds->in->lock);
     }
     return res;
 }
 
 // Return whether a packet is queued. Never blocks, never forces any reads.
+// Doesn't lock, so this is cheap enough to be polled.
 bool demux_has_packet(struct sh_stream *sh)
 {
-    bool has_packet = false;
-    if (sh) {
-        pthread_mutex_lock(&sh->ds->in->lock);
-        has_packet = sh->ds->head;
-        pthread_mutex_unlock(&sh->ds->in->lock);
-    }
-    return has_packet;
+    return sh && atomic_load(&sh->ds->num_queued) > 0;
 }
 
 // Read and return any packet we find.
@@ -955,9 +1082,12 @@ static struct demuxer *open_given_type(struct mpv_global *global,
         .min_secs = demuxer->opts->demuxer_min_secs,
         .min_packs = demuxer->opts->demuxer_min_packs,
         .min_bytes = demuxer->opts->demuxer_min_bytes,
+        .max_back_bytes = demuxer->opts->demuxer_max_back_bytes,
+        .max_bytes = demuxer->opts->demuxer_max_bytes,
     };
     pthread_mutex_init(&in->lock, NULL);
     pthread_cond_init(&in->wakeup, NULL);
+    demux_packet_pool_ref();
 
     if (stream->uncached_stream)
         in->min_secs = MPMAX(in->min_secs, demuxer->opts->demuxer_min_secs_cache);
@@ -1007,6 +1137,84 @@ static struct demuxer *open_given_type(struct mpv_global *global,
     return NULL;
 }
 
+// Remembers which demuxer opened the last file with a given extension and
+// file signature (used with --demuxer-fast-open). The signature (the first
+// bytes of the file) keeps a file with the wrong extension, which is opened
+// by another demuxer, from changing the demuxer tried first for the files of
+// that type. Only demuxers which accept a file in the first probing pass
+// (DEMUX_CHECK_NORMAL) are remembered, so that a damaged file, which only a
+// fallback demuxer opens with a less strict check, doesn't change it either.
+#define PROBE_CACHE_SIZE 16
+#define PROBE_MAGIC_SIZE 4
+#define PROBE_KEY_SIZE (16 + 2 * PROBE_MAGIC_SIZE)
+
+struct probe_cache_entry {
+    char key[PROBE_KEY_SIZE];
+    const struct demuxer_desc *desc;
+};
+
+static pthread_mutex_t probe_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct probe_cache_entry probe_cache[PROBE_CACHE_SIZE];
+static int probe_cache_next;
+
+// Returns false if the file can't be cached.
+static bool get_probe_cache_key(struct stream *stream, char key[PROBE_KEY_SIZE])
+{
+    char *ext = stream->url ? mp_splitext(stream->url, NULL) : NULL;
+    if (!ext || !ext[0] || strlen(ext) >= 16 || strchr(ext, '/'))
+        return false;
+    bstr magic = stream_peek(stream, PROBE_MAGIC_SIZE);
+    if (magic.len < PROBE_MAGIC_SIZE)
+        return false;
+    int len = 0;
+    for (int n = 0; ext[n]; n++)
+        key[len++] = mp_tolower(ext[n]);
+    for (int n = 0; n < PROBE_MAGIC_SIZE; n++)
+        len += snprintf(key + len, PROBE_KEY_SIZE - len, "%02x", magic.start[n]);
+    key[len] = '\0';
+    return true;
+}
+
+static const struct demuxer_desc *probe_cache_lookup(const char *key)
+{
+    const struct demuxer_desc *desc = NULL;
+    pthread_mutex_lock(&probe_cache_lock);
+    for (int n = 0; n < PROBE_CACHE_SIZE; n++) {
+        if (probe_cache[n].desc && strcmp(probe_cache[n].key, key) == 0)
+            desc = probe_cache[n].desc;
+    }
+    pthread_mutex_unlock(&probe_cache_lock);
+    return desc;
+}
+
+static void probe_cache_add(const char *key, const struct demuxer_desc *desc)
+{
+    pthread_mutex_lock(&probe_cache_lock);
+    int index = -1;
+    for (int n = 0; n < PROBE_CACHE_SIZE; n++) {
+        if (probe_cache[n].desc && strcmp(probe_cache[n].key, key) == 0)
+            index = n;
+    }
+    if (index < 0) {
+        index = probe_cache_next;
+        probe_cache_next = (probe_cache_next + 1) % PROBE_CACHE_SIZE;
+    }
+    snprintf(probe_cache[index].key, sizeof(probe_cache[index].key), "%s", key);
+    probe_cache[index].desc = desc;
+    pthread_mutex_unlock(&probe_cache_lock);
+}
+
+// Remove the entry for key, if it still refers to desc.
+static void probe_cache_remove(const char *key, const struct demuxer_desc *desc)
+{
+    pthread_mutex_lock(&probe_cache_lock);
+    for (int n = 0; n < PROBE_CACHE_SIZE; n++) {
+        if (probe_cache[n].desc == desc && strcmp(probe_cache[n].key, key) == 0)
+            probe_cache[n].desc = NULL;
+    }
+    pthread_mutex_unlock(&probe_cache_lock);
+}
+
 static const int d_normal[]  = {DEMUX_CHECK_NORMAL, DEMUX_CHECK_UNSAFE, -1};
 static const int d_request[] = {DEMUX_CHECK_REQUEST, -1};
 static const int d_force[]   = {DEMUX_CHECK_FORCE, -1};
@@ -1040,21 +1248,54 @@ struct demuxer *demux_open(struct stream *stream, struct demuxer_params *params,
         }
     }
 
+    int64_t start_time = mp_time_us();
+    int probes = 0;
+
+    // Try the demuxer that opened the previous file with the same extension
+    // and signature. The key is read before probing moves the stream.
+    const struct demuxer_desc *cached_desc = NULL;
+    char cache_key[PROBE_KEY_SIZE];
+    bool use_cache = global->opts->demuxer_fast_open && !check_desc &&
+                     get_probe_cache_key(stream, cache_key);
+    if (use_cache) {
+        cached_desc = probe_cache_lookup(cache_key);
+        if (cached_desc) {
+            probes++;
+            demuxer = open_given_type(global, log, cached_desc, stream, params,
+                                      DEMUX_CHECK_NORMAL);
+            if (demuxer) {
+                demuxer->probe_cache_hit = true;
+                goto opened;
+            }
+            probe_cache_remove(cache_key, cached_desc);
+        }
+    }
+
     // Test demuxers from first to last, one pass for each check_levels[] entry
     for (int pass = 0; check_levels[pass] != -1; pass++) {
         enum demux_check level = check_levels[pass];
         for (int n = 0; demuxer_list[n]; n++) {
             const struct demuxer_desc *desc = demuxer_list[n];
+            if (desc == cached_desc && level == DEMUX_CHECK_NORMAL)
+                continue; // already tried
             if (!check_desc || desc == check_desc) {
+                probes++;
                 demuxer = open_given_type(global, log, desc, stream, params, level);
                 if (demuxer) {
-                    talloc_steal(demuxer, log);
-                    log = NULL;
-                    goto done;
+                    if (use_cache && level == DEMUX_CHECK_NORMAL)
+                        probe_cache_add(cache_key, demuxer->desc);
+                    goto opened;
                 }
             }
         }
     }
+    goto done;
+
+opened:
+    mp_verbose(log, "Opening took %.1f ms (%d demuxers tried).\n",
+               (mp_time_us() - start_time) / 1000.0, probes);
+    talloc_steal(demuxer, log);
+    log = NULL;
 
 done:
     talloc_free(log);
@@ -1086,6 +1327,7 @@ static void flush_locked(demuxer_t *demuxer)
     for (int n = 0; n < demuxer->num_streams; n++)
         ds_flush(demuxer->streams[n]->ds);
     demuxer->in->warned_queue_overflow = false;
+    demuxer->in->warned_share = false;
     demuxer->in->eof = false;
     demuxer->in->last_eof = false;
     demuxer->in->idle = true;
@@ -1100,6 +1342,113 @@ void demux_flush(demuxer_t *demuxer)
     pthread_mutex_unlock(&demuxer->in->lock);
 }
 
+static double packet_ts(struct demux_packet *dp)
+{
+    return PTS_OR_DEF(dp->pts, dp->dts);
+}
+
+// Find the packet a seek to pts within the packet queue of this stream would
+// start with. Returns NULL if the packets in the queue don't cover pts.
+static struct demux_packet *find_seek_target(struct demux_stream *ds,
+                                             double pts, int flags)
+{
+    struct demux_packet *target = NULL;
+    bool covered = ds->eof;
+    for (struct demux_packet *dp = ds->head; dp; dp = dp->next) {
+        double ts = packet_ts(dp);
+        if (ts == MP_NOPTS_VALUE)
+            continue;
+        if (ts >= pts)
+            covered = true;
+        if (!dp->keyframe)
+            continue;
+        if (ts <= pts) {
+            target = dp;
+        } else if (flags & SEEK_FORWARD) {
+            // Use the first keyframe after pts, but only if there's a
+            // keyframe before pts (i.e. the range starts before pts).
+            if (target)
+                target = dp;
+            break;
+        } else {
+            break;
+        }
+    }
+    return covered ? target : NULL;
+}
+
+// Set the reader position to the given packet, which must be part of the
+// queue.
+static void ds_set_reader_head(struct demux_stream *ds,
+                               struct demux_packet *target)
+{
+    ds->reader_head = target;
+    ds->back_tail = NULL;
+    ds->packs = ds->bytes = ds->back_bytes = 0;
+    bool back = true;
+    for (struct demux_packet *dp = ds->head; dp; dp = dp->next) {
+        back &= dp != target;
+        if (back) {
+            ds->back_tail = dp;
+            ds->back_bytes += dp->len;
+        } else {
+            ds->packs++;
+            ds->bytes += dp->len;
+        }
+    }
+    atomic_store(&ds->num_queued, ds->packs);
+    ds->base_ts = target ? packet_ts(target) : ds->last_ts;
+    ds->last_br_ts = MP_NOPTS_VALUE;
+    ds->last_br_bytes = 0;
+}
+
+// Try to perform the seek by repositioning the reader within the already
+// demuxed packets (including the back buffer), without seeking the actual
+// demuxer. Returns false if not all selected audio/video streams cover the
+// seek target.
+// must be called locked
+static bool try_seek_cache(struct demux_internal *in, double pts, int flags)
+{
+    struct demuxer *demux = in->d_buffer;
+
+    if (in->max_back_bytes <= 0 || in->seeking || (flags & SEEK_FACTOR) ||
+        !(flags & SEEK_ABSOLUTE) || pts == MP_NOPTS_VALUE)
+        return false;
+
+    bool any = false;
+    for (int n = 0; n < demux->num_streams; n++) {
+        struct demux_stream *ds = demux->streams[n]->ds;
+        if (ds->selected && (ds->type == STREAM_VIDEO ||
+                             ds->type == STREAM_AUDIO))
+        {
+            if (!find_seek_target(ds, pts, flags))
+                return false;
+            any = true;
+        }
+    }
+    if (!any)
+        return false;
+
+    for (int n = 0; n < demux->num_streams; n++) {
+        struct demux_stream *ds = demux->streams[n]->ds;
+        if (!ds->selected)
+            continue;
+        struct demux_packet *target = find_seek_target(ds, pts, flags);
+        // Sparse streams (subtitles) are not required to cover the target.
+        if (!target) {
+            target = ds->head;
+            for (struct demux_packet *dp = ds->head; dp; dp = dp->next) {
+                double ts = packet_ts(dp);
+                if (ts != MP_NOPTS_VALUE && ts <= pts)
+                    target = dp;
+            }
+        }
+        ds_set_reader_head(ds, target);
+    }
+    in->d_user->filepos = -1;
+    return true;
+}
+
 int demux_seek(demuxer_t *demuxer, double rel_seek_secs, int flags)
 {
     struct demux_internal *in = demuxer->in;
@@ -1128,6 +1477,13 @@ int demux_seek(demuxer_t *demuxer, double rel_seek_secs, int flags)
 
     pthread_mutex_lock(&in->lock);
 
+    if (try_seek_cache(in, rel_seek_secs, flags)) {
+        MP_VERBOSE(in, "in-cache seek to %f\n", rel_seek_secs);
+        pthread_cond_signal(&in->wakeup);
+        pthread_mutex_unlock(&in->lock);
+        return 1;
+    }
+
     MP_VERBOSE(in, "queuing seek to %f%s\n", rel_seek_secs,
                in->seeking ? " (cascade)" : "");
 
@@ -1288,6 +1644,7 @@ static void update_cache(struct demux_internal *in)
     int64_t stream_cache_size = -1;
     int64_t stream_cache_fill = -1;
     int stream_cache_idle = -1;
+    struct stream_read_latency read_latency;
     struct mp_nav_event *nav_event = NULL;
 
     pthread_mutex_lock(&in->lock);
@@ -1306,6 +1663,9 @@ static void update_cache(struct demux_internal *in)
     stream_control(stream, STREAM_CTRL_GET_CACHE_SIZE, &stream_cache_size);
     stream_control(stream, STREAM_CTRL_GET_CACHE_FILL, &stream_cache_fill);
     stream_control(stream, STREAM_CTRL_GET_CACHE_IDLE, &stream_cache_idle);
+    bool has_read_latency =
+        stream_control(stream, STREAM_CTRL_GET_READ_LATENCY, &read_latency)
+            == STREAM_OK;
 
     pthread_mutex_lock(&in->lock);
     in->time_length = time_length;
@@ -1313,6 +1673,9 @@ static void update_cache(struct demux_internal *in)
     in->stream_cache_size = stream_cache_size;
     in->stream_cache_fill = stream_cache_fill;
     in->stream_cache_idle = stream_cache_idle;
+    in->has_stream_read_latency = has_read_latency;
+    if (has_read_latency)
+        in->stream_read_latency = read_latency;
     if (stream_metadata) {
         talloc_free(in->stream_metadata);
         in->stream_metadata = talloc_steal(in, stream_metadata);
@@ -1347,6 +1710,11 @@ static int cached_stream_control(struct demux_internal *in, int cmd, void *arg)
             return STREAM_UNSUPPORTED;
         *(int *)arg = in->stream_cache_idle;
         return STREAM_OK;
+    case STREAM_CTRL_GET_READ_LATENCY:
+        if (!in->has_stream_read_latency)
+            return STREAM_UNSUPPORTED;
+        *(struct stream_read_latency *)arg = in->stream_read_latency;
+        return STREAM_OK;
     case STREAM_CTRL_GET_SIZE:
         if (in->stream_size < 0)
             return STREAM_UNSUPPORTED;
@@ -1403,10 +1771,11 @@ static int cached_demux_control(struct demux_internal *in, int cmd, void *arg)
         for (int n = 0; n < in->d_user->num_streams; n++) {
             struct demux_stream *ds = in->d_user->streams[n]->ds;
             if (ds->active) {
-                r->underrun |= !ds->head && !ds->eof;
+                r->underrun |= !ds->reader_head && !ds->eof;
                 r->ts_range[0] = MP_PTS_MAX(r->ts_range[0], ds->base_ts);
                 r->ts_range[1] = MP_PTS_MIN(r->ts_range[1], ds->last_ts);
                 num_packets += ds->packs;
+                r->fw_bytes += ds->bytes;
             }
         }
         r->idle = (in->idle && !r->underrun) || r->eof;
@@ -55,6 +55,7 @@ struct demux_ctrl_reader_state {
     bool eof, underrun, idle;
     double ts_range[2]; // start, end
     double ts_duration;
+    int64_t fw_bytes;   // total bytes of packets queued ahead
 };
 
 struct demux_ctrl_stream_ctrl {
@@ -197,6 +198,8 @@ typedef struct demuxer {
     // packets is not slow either (unlike e.g. libavdevice pseudo-demuxers).
     // Typical examples: text subtitles, playlists
     bool fully_read;
+    // Opened by the demuxer remembered for --demuxer-fast-open.
+    bool probe_cache_hit;
 
     // Bitmask of DEMUX_EVENT_*
     int events;
@@ -266,6 +269,7 @@ struct demuxer *demux_open_url(const char *url,
 
 void demux_start_thread(struct demuxer *demuxer);
 void demux_stop_thread(struct demuxer *demuxer);
+bool demux_stream_is_threaded(struct sh_stream *sh);
 void demux_set_wakeup_cb(struct demuxer *demuxer, void (*cb)(void *ctx), void *ctx);
 
 bool demux_cancel_test(struct demuxer *demuxer);
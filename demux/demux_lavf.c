@@ -40,6 +40,7 @@
 #include "common/tags.h"
 #include "common/av_common.h"
 #include "misc/bstr.h"
+#include "osdep/timer.h"
 
 #include "stream/stream.h"
 #include "demux.h"
@@ -691,6 +692,38 @@ static int interrupt_cb(void *ctx)
     return mp_cancel_test(demuxer->stream->cancel);
 }
 
+// Whether the file headers describe all streams well enough to skip
+// avformat_find_stream_info() (with --demuxer-fast-open). Besides the codec
+// parameters, find_stream_info also determines the file duration, the start
+// time and the video frame rate, so require the header to provide them too.
+static bool header_info_complete(AVFormatContext *avfc)
+{
+    if (!avfc->nb_streams || (avfc->ctx_flags & AVFMTCTX_NOHEADER))
+        return false;
+    if (avfc->duration == AV_NOPTS_VALUE || avfc->duration <= 0 ||
+        avfc->start_time == AV_NOPTS_VALUE)
+        return false;
+    for (int n = 0; n < avfc->nb_streams; n++) {
+        AVStream *st = avfc->streams[n];
+        AVCodecContext *codec = st->codec;
+        if (codec->codec_id == AV_CODEC_ID_NONE)
+            return false;
+        switch (codec->codec_type) {
+        case AVMEDIA_TYPE_VIDEO:
+            if (codec->width <= 0 || codec->height <= 0)
+                return false;
+            if (st->avg_frame_rate.num <= 0 || st->avg_frame_rate.den <= 0)
+                return false;
+            break;
+        case AVMEDIA_TYPE_AUDIO:
+            if (codec->sample_rate <= 0 || codec->channels <= 0)
+                return false;
+            break;
+        }
+    }
+    return true;
+}
+
 static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
 {
     struct MPOpts *opts = demuxer->opts;
@@ -798,13 +831,19 @@ static int demux_open_lavf(demuxer_t *demuxer, enum demux_check check)
     av_dict_free(&dopts);
 
     priv->avfc = avfc;
-    if (avformat_find_stream_info(avfc, NULL) < 0) {
-        MP_ERR(demuxer, "av_find_stream_info() failed\n");
-        return -1;
-    }
+    if (opts->demuxer_fast_open && header_info_complete(avfc)) {
+        MP_VERBOSE(demuxer, "Skipping avformat_find_stream_info().\n");
+    } else {
+        int64_t start = mp_time_us();
+        if (avformat_find_stream_info(avfc, NULL) < 0) {
+            MP_ERR(demuxer, "av_find_stream_info() failed\n");
+            return -1;
+        }
 
-    MP_VERBOSE(demuxer, "avformat_find_stream_info() finished after %"PRId64
-               " bytes.\n", stream_tell(demuxer->stream));
+        MP_VERBOSE(demuxer, "avformat_find_stream_info() finished after %"PRId64
+                   " bytes (%.1f ms).\n", stream_tell(demuxer->stream),
+                   (mp_time_us() - start) / 1000.0);
+    }
 
     for (i = 0; i < avfc->nb_chapters; i++) {
         AVChapter *c = avfc->chapters[i];
@@ -26,11 +26,16 @@
 #include <stdbool.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <libavutil/common.h>
 #include <libavutil/lzo.h>
 #include <libavutil/intreadwrite.h>
 #include <libavutil/avstring.h>
+#include <libavutil/md5.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavcodec/version.h>
@@ -45,7 +50,10 @@
 #include "common/av_common.h"
 #include "options/options.h"
 #include "options/m_option.h"
+#include "options/path.h"
 #include "misc/bstr.h"
+#include "osdep/io.h"
+#include "osdep/threads.h"
 #include "stream/stream.h"
 #include "video/csputils.h"
 #include "demux.h"
@@ -182,6 +190,14 @@ typedef struct mkv_demuxer {
 
     bool index_has_durations;
 
+    // LZO decompression needs input padding, which prevents reading block
+    // data in place.
+    bool has_lzo_tracks;
+
+    // Persistent index cache (--demuxer-mkv-index-cache)
+    char *index_cache_file;     // NULL if disabled or not applicable
+    struct index_scan *index_scan; // background index creation, or NULL
+
     bool eof_warning;
 } mkv_demuxer_t;
 
@@ -191,6 +207,8 @@ struct demux_mkv_opts {
     double subtitle_preroll_secs;
     int probe_duration;
     int fix_timestamps;
+    int index_cache;
+    int index_scan;
 };
 
 const struct m_sub_options demux_mkv_conf = {
@@ -200,6 +218,8 @@ const struct m_sub_options demux_mkv_conf = {
                    M_OPT_MIN, .min = 0),
         OPT_FLAG("probe-video-duration", probe_duration, 0),
         OPT_FLAG("fix-timestamps", fix_timestamps, 0),
+        OPT_FLAG("index-cache", index_cache, 0),
+        OPT_FLAG("index-scan", index_scan, 0),
         {0}
     },
     .size = sizeof(struct demux_mkv_opts),
@@ -414,6 +434,7 @@ static void parse_trackencodings(struct demuxer *demuxer,
                                  struct mkv_track *track,
                                  struct ebml_content_encodings *encodings)
 {
+    mkv_demuxer_t *mkv_d = demuxer->priv;
     // initial allocation to be a non-NULL context before realloc
     mkv_content_encoding_t *ce = talloc_size(track, 1);
 
@@ -453,6 +474,8 @@ static void parse_trackencodings(struct demuxer *demuxer,
                     "an unknown/unsupported compression\n"
                     "algorithm (%" PRIu64 "). Skipping track.\n",
                     track->tnum, e.comp_algo);
+        } else if (e.comp_algo == 2) {
+            mkv_d->has_lzo_tracks = true;
         }
 #if !HAVE_ZLIB
         else if (e.comp_algo == 0) {
@@ -1128,20 +1151,474 @@ static int read_deferred_element(struct demuxer *demuxer,
     return read_header_element(demuxer, elem->id, elem->pos);
 }
 
-static void read_deferred_cues(demuxer_t *demuxer)
+#define INDEX_CACHE_DIR "mkv-index"
+#define INDEX_CACHE_HEADER "mpv-mkv-index 1"
+// Amount of data at the start of the file included in the cache key.
+#define INDEX_CACHE_HASH_BYTES (1024 * 1024)
+
+// Return the path of the opened file, or NULL if it's not a local regular
+// file. The index scan and the index cache open the file a second time by
+// name, which must not be done for stdin ("-" is fd 0, whose file position
+// would be shared with the demuxer), or for network streams (which would be
+// downloaded twice).
+static char *get_local_file_path(void *talloc_ctx, struct demuxer *demuxer,
+                                 struct stat *st)
+{
+    char *path = mp_file_get_path(talloc_ctx, bstr0(demuxer->stream->url));
+    if (!path || strcmp(path, "-") == 0 || stat(path, st) != 0 ||
+        !S_ISREG(st->st_mode))
+    {
+        talloc_free(path);
+        return NULL;
+    }
+    return path;
+}
+
+// Return the filename of the index cache file for the opened file, or NULL
+// if the file is not a local file. The key is made of the file size, the
+// modification time, and the first INDEX_CACHE_HASH_BYTES of the file.
+static char *get_index_cache_filename(struct demuxer *demuxer)
+{
+    char *res = NULL;
+    void *tmp = talloc_new(NULL);
+    struct stat st;
+    char *path = get_local_file_path(tmp, demuxer, &st);
+    if (!path)
+        goto done;
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        goto done;
+    char *data = talloc_size(tmp, INDEX_CACHE_HASH_BYTES);
+    size_t data_len = fread(data, 1, INDEX_CACHE_HASH_BYTES, f);
+    fclose(f);
+
+    struct AVMD5 *md5 = av_md5_alloc();
+    if (!md5)
+        goto done;
+    char *ident = talloc_asprintf(tmp, "%"PRId64" %"PRId64,
+                                  (int64_t)st.st_size, (int64_t)st.st_mtime);
+    av_md5_init(md5);
+    av_md5_update(md5, ident, strlen(ident));
+    av_md5_update(md5, data, data_len);
+    uint8_t hash[16];
+    av_md5_final(md5, hash);
+    av_free(md5);
+
+    char *name = talloc_strdup(tmp, "");
+    for (int i = 0; i < 16; i++)
+        name = talloc_asprintf_append(name, "%02X", hash[i]);
+
+    char *dir = mp_find_user_config_file(tmp, demuxer->global, INDEX_CACHE_DIR);
+    if (dir)
+        res = mp_path_join(NULL, dir, name);
+
+done:
+    talloc_free(tmp);
+    return res;
+}
+
+static bool load_index_cache(struct demuxer *demuxer, const char *filename)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    FILE *f = fopen(filename, "r");
+    if (!f)
+        return false;
+
+    bool ok = false;
+    mkv_index_t *indexes = NULL;
+    char line[80];
+    uint64_t tc_scale, num;
+    if (!fgets(line, sizeof(line), f) ||
+        strcmp(line, INDEX_CACHE_HEADER "\n") != 0 ||
+        fscanf(f, "%"SCNu64" %"SCNu64"\n", &tc_scale, &num) != 2 ||
+        tc_scale != mkv_d->tc_scale || num > INT_MAX / sizeof(mkv_index_t))
+        goto done;
+
+    indexes = talloc_array(mkv_d, mkv_index_t, num);
+    for (uint64_t n = 0; n < num; n++) {
+        mkv_index_t *idx = &indexes[n];
+        if (fscanf(f, "%d %"SCNu64" %"SCNu64" %"SCNu64"\n", &idx->tnum,
+                   &idx->filepos, &idx->timecode, &idx->duration) != 4)
+            goto done;
+        if (idx->filepos < mkv_d->segment_start ||
+            (mkv_d->segment_end > 0 && idx->filepos >= mkv_d->segment_end))
+            goto done;
+    }
+
+    talloc_free(mkv_d->indexes);
+    mkv_d->indexes = indexes;
+    mkv_d->num_indexes = num;
+    mkv_d->index_complete = true;
+    mkv_d->index_has_durations = true;
+    indexes = NULL;
+    ok = true;
+    MP_VERBOSE(demuxer, "Loaded index from %s.\n", filename);
+
+done:
+    fclose(f);
+    talloc_free(indexes);
+    if (!ok)
+        MP_WARN(demuxer, "Ignoring invalid index cache file %s.\n", filename);
+    return ok;
+}
+
+static void write_index_cache(struct mpv_global *global, struct mp_log *log,
+                              const char *filename, uint64_t tc_scale,
+                              mkv_index_t *indexes, size_t num_indexes)
+{
+    mp_mk_config_dir(global, INDEX_CACHE_DIR);
+    char *tmpname = talloc_asprintf(NULL, "%s.tmp", filename);
+    FILE *f = fopen(tmpname, "w");
+    if (!f) {
+        mp_warn(log, "Can't write index cache file %s.\n", tmpname);
+        goto done;
+    }
+    fprintf(f, INDEX_CACHE_HEADER "\n%"PRIu64" %zu\n", tc_scale, num_indexes);
+    for (size_t n = 0; n < num_indexes; n++) {
+        mkv_index_t *idx = &indexes[n];
+        fprintf(f, "%d %"PRIu64" %"PRIu64" %"PRIu64"\n", idx->tnum,
+                idx->filepos, idx->timecode, idx->duration);
+    }
+    bool ok = !ferror(f);
+    ok &= fclose(f) == 0;
+    // Rename it into place, so that concurrent readers never see a partially
+    // written file.
+    if (ok && rename(tmpname, filename) == 0) {
+        mp_verbose(log, "Wrote index cache file %s.\n", filename);
+    } else {
+        mp_warn(log, "Can't write index cache file %s.\n", filename);
+        unlink(tmpname);
+    }
+done:
+    talloc_free(tmpname);
+}
+
+// Write the index cache file, if the index is complete. The file is written
+// only from here, on the demuxer thread; the index scan thread only hands its
+// result over (see update_index_scan()).
+static void save_index_cache(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    if (!mkv_d->index_cache_file || !mkv_d->index_complete)
+        return;
+    write_index_cache(demuxer->global, demuxer->log, mkv_d->index_cache_file,
+                      mkv_d->tc_scale, mkv_d->indexes, mkv_d->num_indexes);
+    // Write it only once.
+    talloc_free(mkv_d->index_cache_file);
+    mkv_d->index_cache_file = NULL;
+}
+
+// State of the background thread, which creates a full index for files
+// without Cues by scanning all clusters with a separate stream.
+struct index_scan {
+    pthread_t thread;
+    struct mp_cancel *cancel;
+    struct mp_log *log;
+    struct mpv_global *global;
+    char *url;
+    uint64_t tc_scale;
+    int64_t start_pos, end_pos; // range of clusters to scan
+    int *tnums;                 // all track numbers
+    uint64_t *last_tc;          // per tnums entry: last indexed timecode
+    int num_tracks;
+
+    pthread_mutex_t lock;
+    // -- protected by lock
+    bool done;                  // thread exited
+    bool success;               // full index available in indexes
+    mkv_index_t *indexes;
+    size_t num_indexes;
+};
+
+// Add the block starting at the current stream position to the index, if it
+// is a keyframe with a later timecode than the last one indexed for its track.
+// Like Cues entries, the entry points to the start of the cluster, so there
+// can be several entries with the same position.
+static void index_scan_block(struct index_scan *scan, stream_t *s,
+                             uint64_t len, uint64_t cluster_tc,
+                             int64_t cluster_pos, bool simple,
+                             bool keyframe, uint64_t duration)
+{
+    bstr hdr = stream_peek(s, MPMIN(len, 16));
+    uint64_t num = ebml_read_vlen_uint(&hdr);
+    if (num == EBML_UINT_INVALID || hdr.len < 3)
+        return;
+    int16_t time = hdr.start[0] << 8 | hdr.start[1];
+    if (simple)
+        keyframe = hdr.start[2] & 0x80;
+    if (!keyframe)
+        return;
+    uint64_t tc = time < 0 && -time > cluster_tc ? 0 : cluster_tc + time;
+    for (int n = 0; n < scan->num_tracks; n++) {
+        if (scan->tnums[n] == num) {
+            if (scan->last_tc[n] != (uint64_t)-1 && scan->last_tc[n] >= tc)
+                return;
+            scan->last_tc[n] = tc;
+            MP_TARRAY_APPEND(scan, scan->indexes, scan->num_indexes,
+                (mkv_index_t){
+                    .tnum = num,
+                    .filepos = cluster_pos,
+                    .timecode = tc,
+                    .duration = duration,
+                });
+            return;
+        }
+    }
+}
+
+// Returns false on errors.
+static bool index_scan_cluster(struct index_scan *scan, stream_t *s,
+                               int64_t cluster_pos, int64_t cluster_end)
+{
+    uint64_t cluster_tc = 0;
+    while (stream_tell(s) < cluster_end) {
+        uint32_t id = ebml_read_id(s);
+        switch (id) {
+        case MATROSKA_ID_TIMECODE:
+            cluster_tc = ebml_read_uint(s);
+            if (cluster_tc == EBML_UINT_INVALID)
+                return false;
+            break;
+        case MATROSKA_ID_SIMPLEBLOCK: {
+            uint64_t len = ebml_read_length(s);
+            if (len == EBML_UINT_INVALID || stream_tell(s) + len > cluster_end)
+                return false;
+            int64_t end = stream_tell(s) + len;
+            index_scan_block(scan, s, len, cluster_tc, cluster_pos, true, 0, 0);
+            if (!stream_seek(s, end))
+                return false;
+            break;
+        }
+        case MATROSKA_ID_BLOCKGROUP: {
+            uint64_t len = ebml_read_length(s);
+            if (len == EBML_UINT_INVALID || stream_tell(s) + len > cluster_end)
+                return false;
+            int64_t end = stream_tell(s) + len;
+            int64_t block_pos = -1;
+            uint64_t block_len = 0, duration = 0;
+            bool keyframe = true;
+            while (stream_tell(s) < end) {
+                switch (ebml_read_id(s)) {
+                case MATROSKA_ID_BLOCK:
+                    block_len = ebml_read_length(s);
+                    if (block_len == EBML_UINT_INVALID)
+                        return false;
+                    block_pos = stream_tell(s);
+                    if (!stream_skip(s, block_len))
+                        return false;
+                    break;
+                case MATROSKA_ID_BLOCKDURATION:
+                    duration = ebml_read_uint(s);
+                    if (duration == EBML_UINT_INVALID)
+                        return false;
+                    break;
+                case MATROSKA_ID_REFERENCEBLOCK:
+                    if (ebml_read_int(s) == EBML_INT_INVALID)
+                        return false;
+                    keyframe = false;
+                    break;
+                case EBML_ID_INVALID:
+                    return false;
+                default:
+                    if (ebml_read_skip(scan->log, end, s) != 0)
+                        return false;
+                }
+            }
+            if (block_pos >= 0 && keyframe) {
+                if (!stream_seek(s, block_pos))
+                    return false;
+                index_scan_block(scan, s, block_len, cluster_tc, cluster_pos,
+                                 false, true, duration);
+            }
+            if (!stream_seek(s, end))
+                return false;
+            break;
+        }
+        case EBML_ID_INVALID:
+            return false;
+        default:
+            if (ebml_read_skip(scan->log, cluster_end, s) != 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+static void *index_scan_thread(void *p)
+{
+    struct index_scan *scan = p;
+    mpthread_set_name("mkv-index");
+
+    bool success = false;
+    stream_t *s = stream_create(scan->url, STREAM_READ, scan->cancel,
+                                scan->global);
+    if (!s || !stream_seek(s, scan->start_pos))
+        goto done;
+
+    MP_VERBOSE(scan, "Scanning file for index...\n");
+    while (!mp_cancel_test(scan->cancel)) {
+        int64_t cluster_pos = stream_tell(s);
+        if (cluster_pos >= scan->end_pos) {
+            success = true;
+            break;
+        }
+        uint32_t id = ebml_read_id(s);
+        if (s->eof) {
+            success = true;
+            break;
+        }
+        if (id == MATROSKA_ID_CLUSTER) {
+            uint64_t len = ebml_read_length(s);
+            // Clusters with unknown size are not supported.
+            if (len == EBML_UINT_INVALID)
+                break;
+            int64_t cluster_end = stream_tell(s) + len;
+            if (!index_scan_cluster(scan, s, cluster_pos, cluster_end) ||
+                !stream_seek(s, cluster_end))
+                break;
+        } else if (!ebml_is_mkv_level1_id(id) ||
+                   ebml_read_skip(scan->log, -1, s) != 0)
+        {
+            break;
+        }
+    }
+    MP_VERBOSE(scan, "Index scan %s (%zu entries).\n",
+               success ? "done" : "failed", scan->num_indexes);
+
+done:
+    free_stream(s);
+    pthread_mutex_lock(&scan->lock);
+    scan->done = true;
+    scan->success = success;
+    pthread_mutex_unlock(&scan->lock);
+    return NULL;
+}
+
+static void start_index_scan(struct demuxer *demuxer, int64_t first_cluster)
 {
-    struct MPOpts *opts = demuxer->opts;
     mkv_demuxer_t *mkv_d = demuxer->priv;
 
-    if (mkv_d->index_complete || opts->index_mode != 1)
+    struct index_scan *scan = talloc_ptrtype(NULL, scan);
+    *scan = (struct index_scan){
+        .cancel = mp_cancel_new(scan),
+        .log = mp_log_new(scan, demuxer->log, "index"),
+        .global = demuxer->global,
+        .url = talloc_strdup(scan, demuxer->stream->url),
+        .tc_scale = mkv_d->tc_scale,
+        .start_pos = first_cluster,
+        .end_pos = mkv_d->segment_end > 0 ? mkv_d->segment_end : INT64_MAX,
+        .num_tracks = mkv_d->num_tracks,
+        .tnums = talloc_array(scan, int, mkv_d->num_tracks),
+        .last_tc = talloc_array(scan, uint64_t, mkv_d->num_tracks),
+    };
+    for (int n = 0; n < mkv_d->num_tracks; n++) {
+        scan->tnums[n] = mkv_d->tracks[n]->tnum;
+        scan->last_tc[n] = -1;
+    }
+    pthread_mutex_init(&scan->lock, NULL);
+    if (pthread_create(&scan->thread, NULL, index_scan_thread, scan)) {
+        pthread_mutex_destroy(&scan->lock);
+        talloc_free(scan);
         return;
+    }
+    mkv_d->index_scan = scan;
+}
+
+static void stop_index_scan(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    struct index_scan *scan = mkv_d->index_scan;
+    if (!scan)
+        return;
+    mp_cancel_trigger(scan->cancel);
+    pthread_join(scan->thread, NULL);
+    pthread_mutex_destroy(&scan->lock);
+    talloc_free(scan);
+    mkv_d->index_scan = NULL;
+}
+
+// If the background index scan finished, replace the index with its result.
+static void update_index_scan(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+    struct index_scan *scan = mkv_d->index_scan;
+    if (!scan)
+        return;
+    pthread_mutex_lock(&scan->lock);
+    bool done = scan->done;
+    pthread_mutex_unlock(&scan->lock);
+    if (!done)
+        return;
+    if (scan->success && !mkv_d->index_complete) {
+        talloc_free(mkv_d->indexes);
+        mkv_d->indexes = talloc_steal(mkv_d, scan->indexes);
+        mkv_d->num_indexes = scan->num_indexes;
+        mkv_d->index_complete = true;
+        mkv_d->index_has_durations = true;
+        scan->indexes = NULL;
+    }
+    stop_index_scan(demuxer);
+}
 
+static bool has_deferred_cues(struct demuxer *demuxer)
+{
+    mkv_demuxer_t *mkv_d = demuxer->priv;
     for (int n = 0; n < mkv_d->num_headers; n++) {
-        struct header_elem *elem = &mkv_d->headers[n];
+        if (mkv_d->headers[n].id == MATROSKA_ID_CUES)
+            return true;
+    }
+    return false;
+}
 
-        if (elem->id == MATROSKA_ID_CUES)
-            read_deferred_element(demuxer, elem);
+// Called after the headers were read. Load the index from the index cache, or
+// start creating it in the background.
+static void init_index_cache(struct demuxer *demuxer, int64_t first_cluster)
+{
+    struct MPOpts *opts = demuxer->opts;
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    if (mkv_d->index_complete || opts->index_mode != 1 || !demuxer->seekable)
+        return;
+
+    struct stat st;
+    char *path = get_local_file_path(NULL, demuxer, &st);
+    if (!path)
+        return;
+    talloc_free(path);
+
+    if (opts->demux_mkv->index_cache) {
+        char *filename = get_index_cache_filename(demuxer);
+        if (filename && mp_path_exists(filename) &&
+            load_index_cache(demuxer, filename))
+        {
+            talloc_free(filename);
+            return;
+        }
+        mkv_d->index_cache_file = talloc_steal(mkv_d, filename);
     }
+
+    if (opts->demux_mkv->index_scan && !has_deferred_cues(demuxer))
+        start_index_scan(demuxer, first_cluster);
+}
+
+static void read_deferred_cues(demuxer_t *demuxer)
+{
+    struct MPOpts *opts = demuxer->opts;
+    mkv_demuxer_t *mkv_d = demuxer->priv;
+
+    update_index_scan(demuxer);
+
+    if (!mkv_d->index_complete && opts->index_mode == 1) {
+        for (int n = 0; n < mkv_d->num_headers; n++) {
+            struct header_elem *elem = &mkv_d->headers[n];
+
+            if (elem->id == MATROSKA_ID_CUES)
+                read_deferred_element(demuxer, elem);
+        }
+    }
+
+    save_index_cache(demuxer);
 }
 
 static void add_coverart(struct demuxer *demuxer)
@@ -1804,6 +2281,8 @@ static int demux_mkv_open(demuxer_t *demuxer, enum demux_check check)
     if (opts->demux_mkv->probe_duration)
         probe_last_timestamp(demuxer);
 
+    init_index_cache(demuxer, start_pos);
+
     return 0;
 }
 
@@ -2225,13 +2704,21 @@ static int read_block(demuxer_t *demuxer, int64_t end, struct block_info *block)
     length = ebml_read_length(s);
     if (length > 500000000 || stream_tell(s) + length > (uint64_t)end)
         goto exit;
-    block->alloc = malloc(length + AV_LZO_INPUT_PADDING);
-    if (!block->alloc)
-        goto exit;
-    block->data = (bstr){block->alloc, length};
     block->filepos = stream_tell(s);
-    if (stream_read(s, block->data.start, block->data.len) != block->data.len)
+    // SimpleBlocks are passed to handle_block() before the stream is accessed
+    // again, so the data can be used in place instead of copying it.
+    if (block->simple && !mkv_d->has_lzo_tracks)
+        block->data = stream_read_borrow(s, length);
+    if (!block->data.start) {
+        block->alloc = malloc(length + AV_LZO_INPUT_PADDING);
+        if (!block->alloc)
+            goto exit;
+        block->data = (bstr){block->alloc, length};
+        if (stream_read(s, block->data.start, block->data.len) != block->data.len)
+            goto exit;
+    } else if (block->data.len != length) {
         goto exit;
+    }
 
     // Parse header of the Block element
     /* first byte(s): track num */
@@ -2848,6 +3335,10 @@ static void mkv_free(struct demuxer *demuxer)
     struct mkv_demuxer *mkv_d = demuxer->priv;
     if (!mkv_d)
         return;
+    // Use the result of a finished index scan for the index cache.
+    update_index_scan(demuxer);
+    stop_index_scan(demuxer);
+    save_index_cache(demuxer);
     mkv_seek_reset(demuxer);
     for (int i = 0; i < mkv_d->num_tracks; i++)
         demux_mkv_free_trackentry(mkv_d->tracks[i]);
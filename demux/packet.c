@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavutil/intreadwrite.h>
@@ -29,6 +30,125 @@
 
 #include "packet.h"
 
+// Payloads allocated by new_demux_packet() are recycled through lists of free
+// buffers, one for each power-of-2 size class. The buffers are normal
+// refcounted AVBufferRefs, whose free callback puts the memory back on the
+// list (unless the lists already hold POOL_MAX_BYTES). The lists are kept only
+// while at least one demuxer exists (see demux_packet_pool_ref()).
+#define POOL_MIN_SHIFT 10   // 1 KiB
+#define POOL_MAX_SHIFT 22   // 4 MiB
+#define POOL_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+#define POOL_MAX_BYTES (16 * 1024 * 1024)
+
+struct pool_entry {
+    struct pool_entry *next;
+};
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pool_entry *pool_free[POOL_CLASSES];
+static struct demux_packet_pool_stats pool_stats;
+static int pool_users;
+
+static void pool_release(void *opaque, uint8_t *data)
+{
+    int size_class = (intptr_t)opaque;
+    size_t size = (size_t)1 << (size_class + POOL_MIN_SHIFT);
+    pthread_mutex_lock(&pool_lock);
+    if (pool_users && pool_stats.free_bytes + size <= POOL_MAX_BYTES) {
+        struct pool_entry *e = (void *)data;
+        e->next = pool_free[size_class];
+        pool_free[size_class] = e;
+        pool_stats.free_bytes += size;
+        data = NULL;
+    }
+    pthread_mutex_unlock(&pool_lock);
+    av_free(data);
+}
+
+// Like av_new_packet(), but use a pooled buffer if possible.
+static int pool_new_packet(AVPacket *pkt, int size)
+{
+    size_t alloc = (size_t)size + FF_INPUT_BUFFER_PADDING_SIZE;
+    int size_class = 0;
+    while (((size_t)1 << (size_class + POOL_MIN_SHIFT)) < alloc)
+        size_class++;
+    if (size_class >= POOL_CLASSES)
+        return av_new_packet(pkt, size);
+    size_t class_size = (size_t)1 << (size_class + POOL_MIN_SHIFT);
+
+    pthread_mutex_lock(&pool_lock);
+    uint8_t *data = (void *)pool_free[size_class];
+    if (data) {
+        pool_free[size_class] = pool_free[size_class]->next;
+        pool_stats.free_bytes -= class_size;
+        pool_stats.reused++;
+    }
+    pool_stats.allocs++;
+    pthread_mutex_unlock(&pool_lock);
+
+    if (!data)
+        data = av_malloc(class_size);
+    if (!data)
+        return -1;
+    pkt->buf = av_buffer_create(data, class_size, pool_release,
+                                (void *)(intptr_t)size_class, 0);
+    if (!pkt->buf) {
+        av_free(data);
+        return -1;
+    }
+    pkt->data = data;
+    pkt->size = size;
+    memset(pkt->data + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    return 0;
+}
+
+// Register a user of the pool (normally a demuxer).
+void demux_packet_pool_ref(void)
+{
+    pthread_mutex_lock(&pool_lock);
+    pool_users++;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// Unregister a user. When the last one is gone, the memory held in the free
+// lists is released, and packets freed afterwards aren't kept.
+void demux_packet_pool_unref(void)
+{
+    struct pool_entry *lists[POOL_CLASSES] = {0};
+    pthread_mutex_lock(&pool_lock);
+    assert(pool_users > 0);
+    pool_users--;
+    if (!pool_users) {
+        for (int n = 0; n < POOL_CLASSES; n++) {
+            lists[n] = pool_free[n];
+            pool_free[n] = NULL;
+        }
+        pool_stats.free_bytes = 0;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    for (int n = 0; n < POOL_CLASSES; n++) {
+        while (lists[n]) {
+            struct pool_entry *e = lists[n];
+            lists[n] = e->next;
+            av_free(e);
+        }
+    }
+}
+
+void demux_packet_pool_get_stats(struct demux_packet_pool_stats *stats)
+{
+    pthread_mutex_lock(&pool_lock);
+    *stats = pool_stats;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// The packet and its AVPacket are allocated together.
+struct packet_alloc {
+    struct demux_packet dp;
+    AVPacket avpacket;
+};
+
 static void packet_destroy(void *ptr)
 {
     struct demux_packet *dp = ptr;
@@ -42,24 +162,27 @@ struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt)
 {
     if (avpkt->size > 1000000000)
         return NULL;
-    struct demux_packet *dp = talloc(NULL, struct demux_packet);
-    talloc_set_destructor(dp, packet_destroy);
+    struct packet_alloc *alloc = talloc(NULL, struct packet_alloc);
+    struct demux_packet *dp = &alloc->dp;
+    talloc_set_destructor(alloc, packet_destroy);
     *dp = (struct demux_packet) {
         .pts = MP_NOPTS_VALUE,
         .dts = MP_NOPTS_VALUE,
         .duration = -1,
         .pos = -1,
         .stream = -1,
-        .avpacket = talloc_zero(dp, AVPacket),
+        .avpacket = &alloc->avpacket,
     };
     av_init_packet(dp->avpacket);
+    dp->avpacket->data = NULL;
+    dp->avpacket->size = 0;
     int r = -1;
     if (avpkt->data) {
         // We hope that this function won't need/access AVPacket input padding,
         // because otherwise new_demux_packet_from() wouldn't work.
         r = av_packet_ref(dp->avpacket, avpkt);
     } else {
-        r = av_new_packet(dp->avpacket, avpkt->size);
+        r = pool_new_packet(dp->avpacket, avpkt->size);
     }
     if (r < 0) {
         *dp->avpacket = (AVPacket){0};
@@ -92,6 +215,8 @@ void demux_packet_shorten(struct demux_packet *dp, size_t len)
 {
     assert(len <= dp->len);
     dp->len = len;
+    if (dp->avpacket)
+        dp->avpacket->size = len; // keep demux_copy_packet() consistent
     memset(dp->buffer + dp->len, 0, FF_INPUT_BUFFER_PADDING_SIZE);
 }
 
@@ -125,6 +250,20 @@ struct demux_packet *demux_copy_packet(struct demux_packet *dp)
     return new;
 }
 
+// Return a new packet sharing dp's data (only the reference count of the data
+// buffer is incremented). Returns NULL if the data is not reference counted,
+// and could be shared only by copying it.
+struct demux_packet *demux_ref_packet(struct demux_packet *dp)
+{
+    if (!dp->avpacket || !dp->avpacket->buf || !dp->avpacket->data)
+        return NULL;
+    struct demux_packet *new = new_demux_packet_from_avpacket(dp->avpacket);
+    if (!new)
+        return NULL;
+    demux_packet_copy_attribs(new, dp);
+    return new;
+}
+
 int demux_packet_set_padding(struct demux_packet *dp, int start, int end)
 {
 #if HAVE_AVFRAME_SKIP_SAMPLES
@@ -36,15 +36,26 @@ typedef struct demux_packet {
     struct AVPacket *avpacket;   // keep the buffer allocation
 } demux_packet_t;
 
+struct demux_packet_pool_stats {
+    int64_t free_bytes;     // memory held in free lists
+    int64_t allocs;         // number of pooled allocations
+    int64_t reused;         // number of allocations served from free lists
+};
+
 struct demux_packet *new_demux_packet(size_t len);
 struct demux_packet *new_demux_packet_from_avpacket(struct AVPacket *avpkt);
 struct demux_packet *new_demux_packet_from(void *data, size_t len);
 void demux_packet_shorten(struct demux_packet *dp, size_t len);
 void free_demux_packet(struct demux_packet *dp);
 struct demux_packet *demux_copy_packet(struct demux_packet *dp);
+struct demux_packet *demux_ref_packet(struct demux_packet *dp);
 
 void demux_packet_copy_attribs(struct demux_packet *dst, struct demux_packet *src);
 
 int demux_packet_set_padding(struct demux_packet *dp, int start, int end);
 
+void demux_packet_pool_ref(void);
+void demux_packet_pool_unref(void);
+void demux_packet_pool_get_stats(struct demux_packet_pool_stats *stats);
+
 #endif /* MPLAYER_DEMUX_PACKET_H */
@@ -114,6 +114,11 @@ extern "C" {
  * - If a X11 based VO is used, mpv will set the xlib error handler. This error
  *   handler is process-wide, and there's no proper way to share it with other
  *   xlib users within the same process. This might confuse GUI toolkits.
+ * - If a X11 based VO is used, mpv will call XInitThreads(). Xlib requires
+ *   this to be the first Xlib call in the process, so if your program uses
+ *   Xlib itself (or a toolkit using it), it must call XInitThreads() before
+ *   any other Xlib function. This is required with --vd-lavc-dr and --vo=xv,
+ *   where the decoder threads call into Xlib.
  * - mpv uses some other libraries that are not library-safe, such as Fribidi
  *   (used through libass), ALSA, FFmpeg, and possibly more.
  * - The FPU precision must be set at least to double precision.
@@ -0,0 +1,143 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "common/common.h"
+#include "talloc.h"
+
+#include "thread_pool.h"
+
+struct mp_thread_pool {
+    pthread_t *threads;
+    int num_threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;  // signaled when a job is started or terminating
+    pthread_cond_t done;    // signaled when a job has finished
+
+    // Current job; fn==NULL if none.
+    void (*fn)(void *ctx, int n);
+    void *ctx;
+    int next;               // next index to process
+    int num;                // total number of indexes
+    int remaining;          // number of indexes not finished yet
+
+    bool terminate;
+};
+
+// Process indexes of the current job until all are taken. Call with lock held.
+static void run_job(struct mp_thread_pool *pool)
+{
+    while (pool->fn && pool->next < pool->num) {
+        int n = pool->next++;
+        void (*fn)(void *ctx, int n) = pool->fn;
+        void *ctx = pool->ctx;
+        pthread_mutex_unlock(&pool->lock);
+        fn(ctx, n);
+        pthread_mutex_lock(&pool->lock);
+        pool->remaining--;
+        if (!pool->remaining)
+            pthread_cond_broadcast(&pool->done);
+    }
+}
+
+static void *worker_thread(void *p)
+{
+    struct mp_thread_pool *pool = p;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->terminate) {
+        if (pool->fn && pool->next < pool->num) {
+            run_job(pool);
+        } else {
+            pthread_cond_wait(&pool->wakeup, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void destroy_pool(void *p)
+{
+    struct mp_thread_pool *pool = p;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->terminate = true;
+    pthread_cond_broadcast(&pool->wakeup);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int n = 0; n < pool->num_threads; n++)
+        pthread_join(pool->threads[n], NULL);
+
+    pthread_cond_destroy(&pool->wakeup);
+    pthread_cond_destroy(&pool->done);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+// Create a pool which runs jobs with up to the given number of threads. The
+// thread calling mp_thread_pool_run() participates, so threads-1 worker
+// threads are created. Free the pool with talloc_free().
+struct mp_thread_pool *mp_thread_pool_create(void *ta_parent, int threads)
+{
+    struct mp_thread_pool *pool = talloc_zero(ta_parent, struct mp_thread_pool);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wakeup, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    talloc_set_destructor(pool, destroy_pool);
+
+    pool->threads = talloc_array(pool, pthread_t, MPMAX(threads - 1, 0));
+    for (int n = 0; n < threads - 1; n++) {
+        if (pthread_create(&pool->threads[n], NULL, worker_thread, pool))
+            break;
+        pool->num_threads++;
+    }
+    return pool;
+}
+
+// Number of threads that can work on a job (including the caller).
+int mp_thread_pool_get_threads(struct mp_thread_pool *pool)
+{
+    return pool->num_threads + 1;
+}
+
+// Call fn(ctx, n) for each n in [0, num), distributed over the pool threads,
+// and return when all calls have finished. Concurrent calls from different
+// threads are serialized.
+void mp_thread_pool_run(struct mp_thread_pool *pool, int num,
+                        void (*fn)(void *ctx, int n), void *ctx)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->fn)
+        pthread_cond_wait(&pool->done, &pool->lock);
+
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->next = 0;
+    pool->num = num;
+    pool->remaining = num;
+    pthread_cond_broadcast(&pool->wakeup);
+
+    run_job(pool);
+    while (pool->remaining)
+        pthread_cond_wait(&pool->done, &pool->lock);
+
+    pool->fn = NULL;
+    pthread_cond_broadcast(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -145,6 +145,7 @@ const m_option_t mp_opts[] = {
     OPT_INTRANGE("cache-seek-min", stream_cache.seek_min, 0, 0, 0x7fffffff),
     OPT_STRING("cache-file", stream_cache.file, M_OPT_FILE),
     OPT_INTRANGE("cache-file-size", stream_cache.file_max, 0, 0, 0x7fffffff),
+    OPT_INTRANGE("cache-connections", stream_cache.connections, 0, 1, 16),
 
 #if HAVE_DVDREAD || HAVE_DVDNAV
     OPT_STRING("dvd-device", dvd_device, M_OPT_FILE),
@@ -226,9 +227,14 @@ const m_option_t mp_opts[] = {
     OPT_STRING("audio-demuxer", audio_demuxer_name, 0),
     OPT_STRING("sub-demuxer", sub_demuxer_name, 0),
     OPT_FLAG("demuxer-thread", demuxer_thread, 0),
+    OPT_FLAG("demuxer-fast-open", demuxer_fast_open, 0),
     OPT_DOUBLE("demuxer-readahead-secs", demuxer_min_secs, M_OPT_MIN, .min = 0),
     OPT_INTRANGE("demuxer-readahead-packets", demuxer_min_packs, 0, 0, MAX_PACKS),
     OPT_INTRANGE("demuxer-readahead-bytes", demuxer_min_bytes, 0, 0, MAX_PACK_BYTES),
+    OPT_INTRANGE("demuxer-backbuffer-bytes", demuxer_max_back_bytes, 0, 0,
+                 MAX_PACK_BYTES),
+    OPT_INTRANGE("demuxer-max-bytes", demuxer_max_bytes, 0, 1024 * 1024,
+                 MAX_PACK_BYTES),
 
     OPT_DOUBLE("cache-secs", demuxer_min_secs_cache, M_OPT_MIN, .min = 0),
     OPT_FLAG("cache-pause", cache_pausing, 0),
@@ -267,8 +273,15 @@ const m_option_t mp_opts[] = {
 // ------------------------- codec/vfilter options --------------------
 
     OPT_SETTINGSLIST("af-defaults", af_defs, 0, &af_obj_list),
+    OPT_FLAG("af-fuse", af_fuse, 0),
     OPT_SETTINGSLIST("af*", af_settings, 0, &af_obj_list),
     OPT_SETTINGSLIST("vf-defaults", vf_defs, 0, &vf_obj_list),
+    OPT_INTRANGE("vf-threads", vf_threads, 0, 1, 64),
+    OPT_FLAG("vf-pipeline", vf_pipeline, 0),
+    OPT_CHOICE("video-hugepages", video_hugepages, 0,
+               ({"no", 0},
+                {"transparent", 1},
+                {"explicit", 2})),
     OPT_SETTINGSLIST("vf*", vf_settings, 0, &vf_obj_list),
 
     OPT_CHOICE("deinterlace", deinterlace, 0,
@@ -277,7 +290,9 @@ const m_option_t mp_opts[] = {
                 {"yes", 1})),
 
     OPT_STRING("ad", audio_decoders, 0),
+    OPT_DOUBLE("ad-queue-secs", ad_queue_secs, M_OPT_MIN, .min = 0),
     OPT_STRING("vd", video_decoders, 0),
+    OPT_INTRANGE("vd-queue", vd_queue, 0, 0, 32),
 
     OPT_STRING("audio-spdif", audio_spdif, 0),
 
@@ -474,6 +489,8 @@ const m_option_t mp_opts[] = {
 
     OPT_STRING("stream-capture", stream_capture, M_OPT_FILE),
     OPT_STRING("stream-dump", stream_dump, M_OPT_FILE),
+    OPT_FLAG("stream-mmap", stream_mmap, 0),
+    OPT_INTRANGE("stream-readahead", stream_readahead, 0, 0, 1024 * 1024),
 
     OPT_FLAG("stop-playback-on-init-failure", stop_playback_on_init_failure, 0),
 
@@ -643,6 +660,7 @@ const struct MPOpts mp_default_opts = {
     .audio_driver_list = NULL,
     .audio_decoders = "lavc:libdcadec,-spdif:*", // never select spdif by default
     .video_decoders = NULL,
+    .vf_threads = 1,
     .deinterlace = -1,
     .softvol = SOFTVOL_AUTO,
     .softvol_max = 130,
@@ -707,10 +725,13 @@ const struct MPOpts mp_default_opts = {
         .initial = 0,
         .seek_min = 500,
         .file_max = 1024 * 1024,
+        .connections = 1,
     },
     .demuxer_thread = 1,
     .demuxer_min_packs = 0,
     .demuxer_min_bytes = 0,
+    .demuxer_max_back_bytes = 0,
+    .demuxer_max_bytes = MAX_PACK_BYTES,
     .demuxer_min_secs = 1.0,
     .network_rtsp_transport = 2,
     .network_timeout = 0.0,
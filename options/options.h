@@ -52,6 +52,7 @@ struct mp_cache_opts {
     int seek_min;
     char *file;
     int file_max;
+    int connections;
 };
 
 typedef struct MPOpts {
@@ -108,7 +109,9 @@ typedef struct MPOpts {
     int video_stereo_mode;
 
     char *audio_decoders;
+    double ad_queue_secs;
     char *video_decoders;
+    int vd_queue;
     char *audio_spdif;
 
     int osd_level;
@@ -117,6 +120,8 @@ typedef struct MPOpts {
     int untimed;
     char *stream_capture;
     char *stream_dump;
+    int stream_mmap;
+    int stream_readahead;
     int stop_playback_on_init_failure;
     int loop_times;
     int loop_file;
@@ -191,8 +196,11 @@ typedef struct MPOpts {
     char **audio_files;
     char *demuxer_name;
     int demuxer_thread;
+    int demuxer_fast_open;
     int demuxer_min_packs;
     int demuxer_min_bytes;
+    int demuxer_max_back_bytes;
+    int demuxer_max_bytes;
     double demuxer_min_secs;
     char *audio_demuxer_name;
     char *sub_demuxer_name;
@@ -214,7 +222,11 @@ typedef struct MPOpts {
     double playback_speed;
     int pitch_correction;
     struct m_obj_settings *vf_settings, *vf_defs;
+    int vf_threads;
+    int vf_pipeline;
+    int video_hugepages;
     struct m_obj_settings *af_settings, *af_defs;
+    int af_fuse;
     int deinterlace;
     float movie_aspect;
     int field_dominance;
@@ -305,6 +305,15 @@ void reinit_audio_chain(struct MPContext *mpctx)
 
     set_playback_speed(mpctx, opts->playback_speed);
 
+    struct dec_audio *d_audio = mpctx->d_audio;
+    if (opts->ad_queue_secs > 0 && !d_audio->queue &&
+        demux_stream_is_threaded(d_audio->header))
+    {
+        if (!audio_start_decode_thread(d_audio, opts->ad_queue_secs,
+                                       wakeup_playloop, mpctx))
+            MP_WARN(mpctx, "Could not start audio decoder thread.\n");
+    }
+
     return;
 
 init_error:
@@ -329,14 +338,15 @@ double written_audio_pts(struct MPContext *mpctx)
         return MP_NOPTS_VALUE;
 
     // first calculate the end pts of audio that has been output by decoder
-    double a_pts = d_audio->pts;
+    double a_pts = d_audio->out_pts;
     if (a_pts == MP_NOPTS_VALUE)
         return MP_NOPTS_VALUE;
 
-    // d_audio->pts is the timestamp of the latest input packet with
-    // known pts that the decoder has decoded. d_audio->pts_bytes is
-    // the amount of bytes the decoder has written after that timestamp.
-    a_pts += d_audio->pts_offset / (double)in_format.rate;
+    // d_audio->out_pts is the timestamp of the latest input packet with
+    // known pts that the decoder has decoded. d_audio->out_pts_offset is
+    // the amount of samples the decoder has written after that timestamp.
+    // (Frames queued by a decoder thread are not included.)
+    a_pts += d_audio->out_pts_offset / (double)in_format.rate;
 
     // Now a_pts hopefully holds the pts for end of audio from decoder.
     // Subtract data in buffers between decoder and audio out.
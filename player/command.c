@@ -52,6 +52,7 @@
 #include "video/decode/vd.h"
 #include "video/out/vo.h"
 #include "video/csputils.h"
+#include "video/image_alloc.h"
 #include "audio/mixer.h"
 #include "audio/audio_buffer.h"
 #include "audio/out/ao.h"
@@ -535,6 +536,49 @@ static int mp_property_drop_frame_cnt(void *ctx, struct m_property *prop,
     return m_property_int_ro(action, arg, mpctx->dropped_frames_total);
 }
 
+/// Seconds of audio buffered by the audio decoder thread
+static int mp_property_ad_queue_fill(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->d_audio)
+        return M_PROPERTY_UNAVAILABLE;
+    double fill = audio_queue_get_fill(mpctx->d_audio);
+    if (fill < 0)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_double_ro(action, arg, fill);
+}
+
+/// Number of frames buffered by the video decoder thread
+static int mp_property_vd_queue_fill(void *ctx, struct m_property *prop,
+                                     int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->d_video)
+        return M_PROPERTY_UNAVAILABLE;
+    int fill = video_queue_get_fill(mpctx->d_video);
+    if (fill < 0)
+        return M_PROPERTY_UNAVAILABLE;
+    return m_property_int_ro(action, arg, fill);
+}
+
+static int mp_property_video_alloc(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    struct mp_image_alloc_stats st;
+    mp_image_alloc_get_stats(&st);
+    struct m_sub_property props[] = {
+        {"allocs",      SUB_PROP_INT(MPMIN(st.allocs, INT_MAX))},
+        {"huge-allocs", SUB_PROP_INT(MPMIN(st.huge_allocs, INT_MAX))},
+        {"faults",      SUB_PROP_INT(MPMIN(st.faults, INT_MAX))},
+        {"used",        SUB_PROP_INT(st.live_bytes / 1024)},
+        {"copies",      SUB_PROP_INT(MPMIN(st.copies, INT_MAX))},
+        {"direct",      SUB_PROP_INT(MPMIN(st.direct, INT_MAX))},
+        {0}
+    };
+    return m_property_read_sub(props, action, arg);
+}
+
 static int mp_property_vo_drop_frame_count(void *ctx, struct m_property *prop,
                                            int action, void *arg)
 {
@@ -1415,6 +1459,56 @@ static int mp_property_demuxer_cache_idle(void *ctx, struct m_property *prop,
     return m_property_flag_ro(action, arg, s.idle);
 }
 
+static int mp_property_demuxer_cache_bytes(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer)
+        return M_PROPERTY_UNAVAILABLE;
+
+    struct demux_ctrl_reader_state s;
+    if (demux_control(mpctx->demuxer, DEMUXER_CTRL_GET_READER_STATE, &s) < 1)
+        return M_PROPERTY_UNAVAILABLE;
+
+    return m_property_int64_ro(action, arg, s.fw_bytes);
+}
+
+static int mp_property_packet_pool(void *ctx, struct m_property *prop,
+                                   int action, void *arg)
+{
+    struct demux_packet_pool_stats st;
+    demux_packet_pool_get_stats(&st);
+    struct m_sub_property props[] = {
+        {"free",        SUB_PROP_INT(st.free_bytes / 1024)},
+        {"allocs",      SUB_PROP_INT(MPMIN(st.allocs, INT_MAX))},
+        {"reused",      SUB_PROP_INT(MPMIN(st.reused, INT_MAX))},
+        {0}
+    };
+    return m_property_read_sub(props, action, arg);
+}
+
+static int mp_property_stream_read_latency(void *ctx, struct m_property *prop,
+                                           int action, void *arg)
+{
+    MPContext *mpctx = ctx;
+    if (!mpctx->demuxer)
+        return M_PROPERTY_UNAVAILABLE;
+    struct stream_read_latency lat;
+    if (demux_stream_control(mpctx->demuxer, STREAM_CTRL_GET_READ_LATENCY,
+                             &lat) != STREAM_OK)
+        return M_PROPERTY_UNAVAILABLE;
+    int64_t *r = lat.reads;
+    struct m_sub_property props[] = {
+        {"below-100us", SUB_PROP_INT(MPMIN(r[0], INT_MAX))},
+        {"below-1ms",   SUB_PROP_INT(MPMIN(r[1], INT_MAX))},
+        {"below-10ms",  SUB_PROP_INT(MPMIN(r[2], INT_MAX))},
+        {"below-100ms", SUB_PROP_INT(MPMIN(r[3], INT_MAX))},
+        {"slower",      SUB_PROP_INT(MPMIN(r[4], INT_MAX))},
+        {0}
+    };
+    return m_property_read_sub(props, action, arg);
+}
+
 static int mp_property_paused_for_cache(void *ctx, struct m_property *prop,
                                         int action, void *arg)
 {
@@ -3316,6 +3410,9 @@ static const struct m_property mp_properties[] = {
     {"total-avsync-change", mp_property_total_avsync_change},
     {"drop-frame-count", mp_property_drop_frame_cnt},
     {"vo-drop-frame-count", mp_property_vo_drop_frame_count},
+    {"ad-queue-fill", mp_property_ad_queue_fill},
+    {"vd-queue-fill", mp_property_vd_queue_fill},
+    {"video-alloc", mp_property_video_alloc},
     {"percent-pos", mp_property_percent_pos},
     {"time-start", mp_property_time_start},
     {"time-pos", mp_property_time_pos},
@@ -3348,6 +3445,9 @@ static const struct m_property mp_properties[] = {
     {"demuxer-cache-duration", mp_property_demuxer_cache_duration},
     {"demuxer-cache-time", mp_property_demuxer_cache_time},
     {"demuxer-cache-idle", mp_property_demuxer_cache_idle},
+    {"demuxer-cache-bytes", mp_property_demuxer_cache_bytes},
+    {"packet-pool", mp_property_packet_pool},
+    {"stream-read-latency", mp_property_stream_read_latency},
     {"cache-buffering-state", mp_property_cache_buffering},
     {"paused-for-cache", mp_property_paused_for_cache},
     {"pts-association-mode", mp_property_generic_option},
@@ -3548,7 +3648,7 @@ static const char *const *const mp_event_property_change[] = {
     E(MPV_EVENT_CHAPTER_CHANGE, "chapter", "chapter-metadata"),
     E(MP_EVENT_CACHE_UPDATE, "cache", "cache-free", "cache-used", "cache-idle",
       "demuxer-cache-duration", "demuxer-cache-idle", "paused-for-cache",
-      "demuxer-cache-time"),
+      "demuxer-cache-time", "demuxer-cache-bytes"),
     E(MP_EVENT_WIN_RESIZE, "window-scale"),
     E(MP_EVENT_WIN_STATE, "window-minimized", "display-names", "display-fps"),
 };
@@ -243,6 +243,12 @@ static int mp_seek(MPContext *mpctx, struct seek_params seek,
 
     if (hr_seek)
         demuxer_amount -= hr_seek_offset;
+
+    // Stop the audio decoder thread, so it can't read (and lose) packets
+    // from after the seek. reset_playback_state() below resets it again.
+    if (mpctx->d_audio)
+        audio_reset_decoding(mpctx->d_audio);
+
     demux_seek(mpctx->demuxer, demuxer_amount, demuxer_style);
 
     // Seek external, extra files too:
@@ -306,6 +306,19 @@ int reinit_video_chain(struct MPContext *mpctx)
     if (d_video->header->attached_picture && !decode_coverart(d_video))
         goto err_out;
 
+    if (opts->vd_queue > 0 && !d_video->header->attached_picture) {
+        int hwdec = 0;
+        video_vd_control(d_video, VDCTRL_GET_HWDEC, &hwdec);
+        // Hardware decoding interacts with the VO; keep it on the playloop.
+        if (hwdec) {
+            MP_VERBOSE(mpctx, "Not using a decoder thread with hwdec.\n");
+        } else if (!video_start_decode_thread(d_video, opts->vd_queue,
+                                              wakeup_playloop, mpctx))
+        {
+            MP_WARN(mpctx, "Could not start video decoder thread.\n");
+        }
+    }
+
     bool saver_state = opts->pause || !opts->stop_screensaver;
     vo_control(mpctx->video_out, saver_state ? VOCTRL_RESTORE_SCREENSAVER
                                              : VOCTRL_KILL_SCREENSAVER, NULL);
@@ -378,6 +391,57 @@ static bool decode_coverart(struct dec_video *d_video)
     return !!d_video->cover_art_mpi;
 }
 
+// Adjust packet timestamps, and return the framedrop mode for it.
+static int prepare_packet(struct MPContext *mpctx, struct demux_packet *pkt)
+{
+    struct dec_video *d_video = mpctx->d_video;
+
+    if (pkt && pkt->pts != MP_NOPTS_VALUE)
+        pkt->pts += mpctx->video_offset;
+    if (pkt && pkt->dts != MP_NOPTS_VALUE)
+        pkt->dts += mpctx->video_offset;
+    if ((pkt && pkt->pts >= mpctx->hrseek_pts - .005) ||
+        video_has_broken_packet_pts(d_video) ||
+        !mpctx->opts->hr_seek_framedrop)
+    {
+        mpctx->hrseek_framedrop = false;
+    }
+    bool hrseek = mpctx->hrseek_active && mpctx->video_status == STATUS_SYNCING;
+    return hrseek && mpctx->hrseek_framedrop ? 2 : check_framedrop(mpctx);
+}
+
+static void add_dropped_frames(struct MPContext *mpctx, int num)
+{
+    if (num && mpctx->video_status == STATUS_PLAYING &&
+        (mpctx->opts->frame_dropping & 2))
+    {
+        mpctx->dropped_frames_total += num;
+        mpctx->dropped_frames += num;
+    }
+}
+
+// Like decode_image(), but with the decoder running in its own thread.
+static int decode_image_async(struct MPContext *mpctx)
+{
+    struct dec_video *d_video = mpctx->d_video;
+
+    while (video_queue_wants_packet(d_video)) {
+        struct demux_packet *pkt;
+        if (demux_read_packet_async(d_video->header, &pkt) == 0)
+            break;
+        int framedrop_type = prepare_packet(mpctx, pkt);
+        video_queue_packet(d_video, pkt, framedrop_type);
+    }
+
+    add_dropped_frames(mpctx, video_queue_take_dropped(d_video));
+
+    switch (video_queue_get_frame(d_video, &d_video->waiting_decoded_mpi)) {
+    case 1:  return VD_PROGRESS;
+    case -1: return VD_EOF;
+    default: return VD_WAIT;
+    }
+}
+
 // Read a packet, store decoded image into d_video->waiting_decoded_mpi
 // returns VD_* code
 static int decode_image(struct MPContext *mpctx)
@@ -389,34 +453,20 @@ static int decode_image(struct MPContext *mpctx)
         return VD_EOF;
     }
 
+    if (d_video->queue)
+        return decode_image_async(mpctx);
+
     struct demux_packet *pkt;
     if (demux_read_packet_async(d_video->header, &pkt) == 0)
         return VD_WAIT;
-    if (pkt && pkt->pts != MP_NOPTS_VALUE)
-        pkt->pts += mpctx->video_offset;
-    if (pkt && pkt->dts != MP_NOPTS_VALUE)
-        pkt->dts += mpctx->video_offset;
-    if ((pkt && pkt->pts >= mpctx->hrseek_pts - .005) ||
-        d_video->has_broken_packet_pts ||
-        !mpctx->opts->hr_seek_framedrop)
-    {
-        mpctx->hrseek_framedrop = false;
-    }
-    bool hrseek = mpctx->hrseek_active && mpctx->video_status == STATUS_SYNCING;
-    int framedrop_type = hrseek && mpctx->hrseek_framedrop ?
-                         2 : check_framedrop(mpctx);
+    int framedrop_type = prepare_packet(mpctx, pkt);
     d_video->waiting_decoded_mpi =
         video_decode(d_video, pkt, framedrop_type);
     bool had_packet = !!pkt;
     talloc_free(pkt);
 
-    if (had_packet && !d_video->waiting_decoded_mpi &&
-        mpctx->video_status == STATUS_PLAYING &&
-        (mpctx->opts->frame_dropping & 2))
-    {
-        mpctx->dropped_frames_total++;
-        mpctx->dropped_frames++;
-    }
+    if (had_packet && !d_video->waiting_decoded_mpi)
+        add_dropped_frames(mpctx, 1);
 
     return had_packet ? VD_PROGRESS : VD_EOF;
 }
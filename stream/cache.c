@@ -32,6 +32,12 @@
 // the cache is active.
 #define CACHE_UPDATE_CONTROLS_TIME 2.0
 
+// Time in seconds the cache thread waits for a prefetch connection that is
+// still reading the range the cache thread needs next.
+#define CACHE_PREFETCH_WAIT_TIME 0.1
+
+#define MAX_PREFETCH_CONNECTIONS 16
+
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -59,6 +65,38 @@
 #include "common/common.h"
 
 
+enum prefetch_state {
+    PREFETCH_FREE = 0,      // worker has no job
+    PREFETCH_PENDING,       // job assigned, worker hasn't started it yet
+    PREFETCH_RUNNING,       // worker is reading (without holding the lock)
+    PREFETCH_DONE,          // buf contains len bytes starting at pos
+};
+
+// An additional connection to the source stream, which reads a single range
+// ahead of the main cache fill position. All fields are protected by the cache
+// mutex, except for stream, which is owned by the worker thread.
+struct prefetch_worker {
+    struct priv *cache;
+    pthread_t thread;
+    pthread_cond_t wakeup;
+    stream_t *stream;
+    bool terminate;
+    bool failed;
+    enum prefetch_state state;
+    int64_t pos;
+    int64_t len;
+    unsigned char *buf;     // prefetch_chunk bytes
+};
+
+// Data that was dropped from the ringbuffer on a seek. It is used to refill
+// the ringbuffer if the reader seeks back into it (e.g. after reading the index
+// at the end of a file), instead of reading the stream again.
+struct cache_range {
+    int64_t start, end;     // file positions of the range
+    unsigned char *data;    // end - start bytes
+    int64_t last_use;       // for LRU eviction
+};
+
 // Note: (struct priv*)(cache->priv)->cache == cache
 struct priv {
     pthread_t cache_thread;
@@ -93,6 +131,13 @@ struct priv {
                             // to the byte at max_filepos (must be wrapped by
                             // buffer_size)
 
+    // Disjoint ranges dropped from the ringbuffer
+    struct cache_range *ranges;
+    int num_ranges;
+    int64_t ranges_size;    // sum of all range sizes
+    int64_t ranges_max;     // maximum for ranges_size
+    int64_t ranges_use;     // LRU counter
+
     bool idle;              // cache thread has stopped reading
     int64_t reads;          // number of actual read attempts performed
 
@@ -111,6 +156,14 @@ struct priv {
     struct mp_tags *stream_metadata;
     double start_pts;
     bool has_avseek;
+    bool has_read_latency;
+    struct stream_read_latency read_latency;
+
+    // Prefetch connections (constant while the cache thread is running)
+    struct prefetch_worker *prefetch[MAX_PREFETCH_CONNECTIONS];
+    int num_prefetch;
+    int64_t prefetch_chunk;
+    struct mp_cancel *prefetch_cancel;
 };
 
 enum {
@@ -183,6 +236,293 @@ static size_t read_buffer(struct priv *s, unsigned char *dst,
     return read;
 }
 
+static void ranges_remove(struct priv *s, int index)
+{
+    s->ranges_size -= s->ranges[index].end - s->ranges[index].start;
+    free(s->ranges[index].data);
+    MP_TARRAY_REMOVE_AT(s->ranges, s->num_ranges, index);
+}
+
+static void ranges_drop_all(struct priv *s)
+{
+    while (s->num_ranges)
+        ranges_remove(s, s->num_ranges - 1);
+}
+
+// Evict least recently used ranges until the size limit is respected.
+static void ranges_evict(struct priv *s)
+{
+    while (s->num_ranges && s->ranges_size > s->ranges_max) {
+        int lru = 0;
+        for (int n = 1; n < s->num_ranges; n++) {
+            if (s->ranges[n].last_use < s->ranges[lru].last_use)
+                lru = n;
+        }
+        ranges_remove(s, lru);
+    }
+}
+
+static struct cache_range *ranges_find(struct priv *s, int64_t pos)
+{
+    for (int n = 0; n < s->num_ranges; n++) {
+        struct cache_range *r = &s->ranges[n];
+        if (pos >= r->start && pos < r->end)
+            return r;
+    }
+    return NULL;
+}
+
+// Save the ringbuffer contents before they are dropped. Overlapping or adjacent
+// ranges are merged into the new range.
+static void ranges_add_buffer(struct priv *s)
+{
+    int64_t end = s->max_filepos;
+    int64_t start = MPMAX(s->min_filepos, end - s->ranges_max);
+    if (start >= end)
+        return;
+
+    int64_t new_start = start, new_end = end;
+    for (int n = 0; n < s->num_ranges; n++) {
+        struct cache_range *r = &s->ranges[n];
+        if (r->end >= start && r->start <= end) {
+            new_start = MPMIN(new_start, r->start);
+            new_end = MPMAX(new_end, r->end);
+        }
+    }
+    // Merging must not exceed the limit; keep the data close to the end.
+    new_start = MPMAX(new_start, new_end - s->ranges_max);
+
+    unsigned char *data = malloc(new_end - new_start);
+    if (!data)
+        return;
+
+    for (int n = s->num_ranges - 1; n >= 0; n--) {
+        struct cache_range *r = &s->ranges[n];
+        if (r->end >= start && r->start <= end) {
+            int64_t a = MPMAX(r->start, new_start);
+            if (r->end > a)
+                memcpy(data + (a - new_start), r->data + (a - r->start), r->end - a);
+            ranges_remove(s, n);
+        }
+    }
+    start = MPMAX(start, new_start);
+    read_buffer(s, data + (start - new_start), end - start, start);
+
+    struct cache_range range = {
+        .start = new_start,
+        .end = new_end,
+        .data = data,
+        .last_use = ++s->ranges_use,
+    };
+    MP_TARRAY_APPEND(s, s->ranges, s->num_ranges, range);
+    s->ranges_size += new_end - new_start;
+    ranges_evict(s);
+
+    MP_VERBOSE(s, "Keeping range %"PRId64"-%"PRId64" (%d ranges, %"PRId64
+               " KiB).\n", new_start, new_end, s->num_ranges,
+               s->ranges_size / 1024);
+}
+
+// Copy up to len bytes at pos from a saved range to dst. Returns the number of
+// bytes copied.
+static int64_t ranges_read(struct priv *s, unsigned char *dst, int64_t pos,
+                           int64_t len)
+{
+    struct cache_range *r = ranges_find(s, pos);
+    if (!r)
+        return 0;
+    len = MPMIN(len, r->end - pos);
+    memcpy(dst, r->data + (pos - r->start), len);
+    r->last_use = ++s->ranges_use;
+    return len;
+}
+
+static void *prefetch_thread(void *arg)
+{
+    struct prefetch_worker *w = arg;
+    struct priv *s = w->cache;
+    mpthread_set_name("cache-prefetch");
+
+    pthread_mutex_lock(&s->mutex);
+    while (!w->terminate) {
+        if (w->state != PREFETCH_PENDING) {
+            pthread_cond_wait(&w->wakeup, &s->mutex);
+            continue;
+        }
+        w->state = PREFETCH_RUNNING;
+        int64_t pos = w->pos;
+        int64_t size = s->prefetch_chunk;
+        pthread_mutex_unlock(&s->mutex);
+
+        int len = -1;
+        if (!w->stream) {
+            w->stream = stream_create(s->cache->url, STREAM_READ,
+                                      s->prefetch_cancel, s->cache->global);
+        }
+        if (w->stream && stream_seek(w->stream, pos))
+            len = stream_read(w->stream, w->buf, size);
+
+        pthread_mutex_lock(&s->mutex);
+        if (len < 0) {
+            MP_WARN(s, "Prefetch connection failed, disabling it.\n");
+            w->failed = true;
+            w->state = PREFETCH_FREE;
+        } else {
+            w->len = len;
+            w->state = PREFETCH_DONE;
+        }
+        // The cache thread might be waiting for this range.
+        pthread_cond_broadcast(&s->wakeup);
+        if (w->failed)
+            break;
+    }
+    pthread_mutex_unlock(&s->mutex);
+
+    free_stream(w->stream);
+    w->stream = NULL;
+    return NULL;
+}
+
+static struct prefetch_worker *find_prefetch(struct priv *s, int64_t pos)
+{
+    for (int n = 0; n < s->num_prefetch; n++) {
+        struct prefetch_worker *w = s->prefetch[n];
+        if (w->state != PREFETCH_FREE && w->pos == pos)
+            return w;
+    }
+    return NULL;
+}
+
+// Runs in the cache thread, with the mutex held. Drop prefetched data that
+// can't be used anymore, and assign the chunks following the one containing
+// max_filepos to idle workers. fill_end is the file position up to which the
+// ringbuffer could take data without dropping data the reader still needs.
+static void prefetch_schedule(struct priv *s, int64_t fill_end)
+{
+    int64_t chunk = s->prefetch_chunk;
+    int64_t next = (s->max_filepos / chunk + 1) * chunk;
+
+    for (int n = 0; n < s->num_prefetch; n++) {
+        struct prefetch_worker *w = s->prefetch[n];
+        if ((w->state == PREFETCH_DONE || w->state == PREFETCH_PENDING) &&
+            (w->pos + chunk <= s->max_filepos || w->pos >= fill_end))
+            w->state = PREFETCH_FREE;
+    }
+
+    for (int i = 0; i < s->num_prefetch; i++) {
+        int64_t pos = next + i * chunk;
+        if (pos + chunk > fill_end || (s->stream_size >= 0 && pos >= s->stream_size))
+            break;
+        if (find_prefetch(s, pos) || ranges_find(s, pos))
+            continue;
+        for (int n = 0; n < s->num_prefetch; n++) {
+            struct prefetch_worker *w = s->prefetch[n];
+            if (w->state == PREFETCH_FREE && !w->failed) {
+                w->pos = pos;
+                w->len = 0;
+                w->state = PREFETCH_PENDING;
+                pthread_cond_signal(&w->wakeup);
+                break;
+            }
+        }
+    }
+}
+
+// Runs in the cache thread, with the mutex held. If a worker has fetched the
+// data at max_filepos, copy up to *space bytes of it to s->buffer[pos], set
+// *space to the amount copied and return it. Return 0 if the cache thread has
+// to read the data itself (*space is reduced to end at the next range a worker
+// is responsible for), or -1 if a worker is still busy reading the data.
+static int64_t prefetch_fill(struct priv *s, int64_t pos, int64_t *space,
+                             int64_t fill_end)
+{
+    int64_t chunk = s->prefetch_chunk;
+    int64_t start = s->max_filepos / chunk * chunk;
+
+    prefetch_schedule(s, fill_end);
+
+    struct prefetch_worker *w = find_prefetch(s, start);
+    if (w && w->state == PREFETCH_PENDING) {
+        // Not started yet - cheaper to read it with the main connection.
+        w->state = PREFETCH_FREE;
+        w = NULL;
+    }
+    if (w && w->state == PREFETCH_RUNNING)
+        return -1;
+    if (w && w->state == PREFETCH_DONE) {
+        int64_t offset = s->max_filepos - w->pos;
+        int64_t len = MPMIN(*space, w->len - offset);
+        if (len > 0) {
+            memcpy(&s->buffer[pos], w->buf + offset, len);
+            if (offset + len == w->len)
+                w->state = PREFETCH_FREE;
+            *space = len;
+            return len;
+        }
+        // Short read (EOF or error) - let the main connection handle it.
+        w->state = PREFETCH_FREE;
+    }
+
+    *space = MPMIN(*space, start + chunk - s->max_filepos);
+    return 0;
+}
+
+static void prefetch_uninit(struct priv *s)
+{
+    if (!s->num_prefetch)
+        return;
+    mp_cancel_trigger(s->prefetch_cancel);
+    pthread_mutex_lock(&s->mutex);
+    for (int n = 0; n < s->num_prefetch; n++) {
+        s->prefetch[n]->terminate = true;
+        pthread_cond_signal(&s->prefetch[n]->wakeup);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    for (int n = 0; n < s->num_prefetch; n++) {
+        struct prefetch_worker *w = s->prefetch[n];
+        pthread_join(w->thread, NULL);
+        pthread_cond_destroy(&w->wakeup);
+        free(w->buf);
+    }
+    s->num_prefetch = 0;
+}
+
+// Start count-1 additional connections. Failure is not fatal; the cache then
+// simply uses fewer connections.
+static void prefetch_init(struct priv *s, int count)
+{
+    stream_t *stream = s->stream;
+    // Streams wrapping other streams (like the file cache) and streams that
+    // are not plain byte streams (like DVD) can't be opened twice usefully.
+    if (count < 2 || !stream->seekable || s->stream_size <= 0 ||
+        stream->uncached_stream || stream->type != STREAMTYPE_GENERIC)
+        return;
+
+    s->prefetch_cancel = mp_cancel_new(s);
+    s->prefetch_chunk = MPCLAMP(s->buffer_size / (2 * count),
+                                FILL_LIMIT, 4 * 1024 * 1024);
+
+    for (int n = 0; n < MPMIN(count - 1, MAX_PREFETCH_CONNECTIONS); n++) {
+        struct prefetch_worker *w = talloc_zero(s, struct prefetch_worker);
+        w->cache = s;
+        w->buf = malloc(s->prefetch_chunk);
+        if (!w->buf)
+            break;
+        pthread_cond_init(&w->wakeup, NULL);
+        if (pthread_create(&w->thread, NULL, prefetch_thread, w) != 0) {
+            pthread_cond_destroy(&w->wakeup);
+            free(w->buf);
+            break;
+        }
+        s->prefetch[s->num_prefetch++] = w;
+    }
+
+    if (s->num_prefetch) {
+        MP_VERBOSE(s, "Using %d prefetch connections, %"PRId64" KiB chunks.\n",
+                   s->num_prefetch, s->prefetch_chunk / 1024);
+    }
+}
+
 // Runs in the cache thread.
 // Returns true if reading was attempted, and the mutex was shortly unlocked.
 static bool cache_fill(struct priv *s)
@@ -198,17 +538,10 @@ static bool cache_fill(struct priv *s)
         MP_VERBOSE(s, "Dropping cache at pos %"PRId64", "
                    "cached range: %"PRId64"-%"PRId64".\n", read,
                    s->min_filepos, s->max_filepos);
+        ranges_add_buffer(s);
         cache_drop_contents(s);
     }
 
-    if (stream_tell(s->stream) != s->max_filepos && s->seekable) {
-        MP_VERBOSE(s, "Seeking underlying stream: %"PRId64" -> %"PRId64"\n",
-                   stream_tell(s->stream), s->max_filepos);
-        stream_seek(s->stream, s->max_filepos);
-        if (stream_tell(s->stream) != s->max_filepos)
-            goto done;
-    }
-
     if (mp_cancel_test(s->cache->cancel))
         goto done;
 
@@ -238,6 +571,9 @@ static bool cache_fill(struct priv *s)
         return false;
     }
 
+    // file position up to which prefetch connections may read ahead
+    int64_t fill_end = s->max_filepos + space;
+
     // limit to end of buffer (without wrapping)
     if (pos + space >= s->buffer_size)
         space = s->buffer_size - pos;
@@ -245,11 +581,38 @@ static bool cache_fill(struct priv *s)
     // limit read size (or else would block and read the entire buffer in 1 call)
     space = FFMIN(space, s->stream->read_chunk);
 
+    // data that was already read can be copied from a saved range
+    int64_t prefetched = ranges_read(s, &s->buffer[pos], s->max_filepos, space);
+    if (prefetched > 0) {
+        space = prefetched;
+    } else if (s->num_prefetch) {
+        prefetched = prefetch_fill(s, pos, &space, fill_end);
+        if (prefetched < 0) {
+            struct timespec ts = mp_rel_time_to_timespec(CACHE_PREFETCH_WAIT_TIME);
+            pthread_cond_timedwait(&s->wakeup, &s->mutex, &ts);
+            return false;
+        }
+    }
+
     // back+newb+space <= buffer_size
     int64_t back2 = s->buffer_size - (space + newb); // max back size
     if (s->min_filepos < (read - back2))
         s->min_filepos = read - back2;
 
+    if (prefetched > 0) {
+        // the data was already copied into the buffer
+        len = prefetched;
+        goto advance;
+    }
+
+    if (stream_tell(s->stream) != s->max_filepos && s->seekable) {
+        MP_VERBOSE(s, "Seeking underlying stream: %"PRId64" -> %"PRId64"\n",
+                   stream_tell(s->stream), s->max_filepos);
+        stream_seek(s->stream, s->max_filepos);
+        if (stream_tell(s->stream) != s->max_filepos)
+            goto done;
+    }
+
     // The read call might take a long time and block, so drop the lock.
     pthread_mutex_unlock(&s->mutex);
     len = stream_read_partial(s->stream, &s->buffer[pos], space);
@@ -263,6 +626,7 @@ static bool cache_fill(struct priv *s)
             s->start_pts = pts;
     }
 
+advance:
     s->max_filepos += len;
     if (pos + len == s->buffer_size)
         s->offset += s->buffer_size; // wrap...
@@ -324,6 +688,8 @@ static int resize_cache(struct priv *s, int64_t size)
 
     s->buffer_size = buffer_size;
     s->back_size = buffer_size / 2;
+    s->ranges_max = buffer_size / 2;
+    ranges_evict(s);
     s->buffer = buffer;
     s->idle = false;
     s->eof = false;
@@ -352,6 +718,8 @@ static void update_cached_controls(struct priv *s)
     if (stream_control(s->stream, STREAM_CTRL_GET_SIZE, &i64) == STREAM_OK)
         s->stream_size = i64;
     s->has_avseek = stream_control(s->stream, STREAM_CTRL_HAS_AVSEEK, NULL) > 0;
+    s->has_read_latency = stream_control(s->stream, STREAM_CTRL_GET_READ_LATENCY,
+                                         &s->read_latency) == STREAM_OK;
 }
 
 // the core might call these every frame, so cache them...
@@ -362,9 +730,15 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
     case STREAM_CTRL_GET_CACHE_SIZE:
         *(int64_t *)arg = s->buffer_size;
         return STREAM_OK;
-    case STREAM_CTRL_GET_CACHE_FILL:
-        *(int64_t *)arg = s->max_filepos - s->read_filepos;
+    case STREAM_CTRL_GET_CACHE_FILL: {
+        // include saved ranges directly following the ringbuffer contents
+        int64_t end = s->max_filepos;
+        struct cache_range *r;
+        while ((r = ranges_find(s, end)))
+            end = r->end;
+        *(int64_t *)arg = end - s->read_filepos;
         return STREAM_OK;
+    }
     case STREAM_CTRL_GET_CACHE_IDLE:
         *(int *)arg = s->idle;
         return STREAM_OK;
@@ -384,6 +758,11 @@ static int cache_get_cached_control(stream_t *cache, int cmd, void *arg)
     }
     case STREAM_CTRL_HAS_AVSEEK:
         return s->has_avseek ? STREAM_OK : STREAM_UNSUPPORTED;
+    case STREAM_CTRL_GET_READ_LATENCY:
+        if (!s->has_read_latency)
+            return STREAM_UNSUPPORTED;
+        *(struct stream_read_latency *)arg = s->read_latency;
+        return STREAM_OK;
     case STREAM_CTRL_GET_METADATA: {
         if (s->stream_metadata) {
             ta_set_parent(s->stream_metadata, NULL);
@@ -444,6 +823,7 @@ static void cache_execute_control(struct priv *s)
         s->read_filepos = stream_tell(s->stream);
         s->control_flush = true;
         cache_drop_contents(s);
+        ranges_drop_all(s);
     }
 
     update_cached_controls(s);
@@ -594,6 +974,8 @@ static void cache_uninit(stream_t *cache)
         pthread_mutex_unlock(&s->mutex);
         pthread_join(s->cache_thread, NULL);
     }
+    prefetch_uninit(s);
+    ranges_drop_all(s);
     pthread_mutex_destroy(&s->mutex);
     pthread_cond_destroy(&s->wakeup);
     free(s->buffer);
@@ -650,6 +1032,9 @@ int stream_cache_init(stream_t *cache, stream_t *stream,
 
     s->seekable = stream->seekable;
 
+    s->stream_size = file_size;
+    prefetch_init(s, opts->connections);
+
     if (pthread_create(&s->cache_thread, NULL, cache_thread, s) != 0) {
         MP_ERR(s, "Starting cache thread failed.\n");
         return -1;
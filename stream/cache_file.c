@@ -29,12 +29,26 @@
 #define BLOCK_SIZE 1024LL
 #define BLOCK_ALIGN(p) ((p) & ~(BLOCK_SIZE - 1))
 
+// Unit of eviction if the stream is larger than the cache file.
+#define PAGE_SIZE (1024 * 1024LL)
+
 struct priv {
     struct stream *original;
     FILE *cache_file;
     uint8_t *block_bits;    // 1 bit for each BLOCK_SIZE, whether block was read
     int64_t size;           // currently known size
     int64_t max_size;       // max. size for block_bits and cache_file
+
+    // If the stream is larger than max_size, the cache file is split into
+    // slots of PAGE_SIZE, which are assigned to stream pages on demand, and
+    // the least recently used slot is reused if the file is full. Otherwise,
+    // num_slots is 0, and the file offset is the stream position.
+    int num_slots;
+    int64_t *slot_page;     // stream page stored in a slot (-1 if unused)
+    int64_t *slot_use;      // LRU counter of last access
+    int32_t *page_slot;     // slot containing a stream page (-1 if none)
+    int64_t num_pages;
+    int64_t use_counter;
 };
 
 static bool test_bit(struct priv *p, int64_t pos)
@@ -54,18 +68,50 @@ static void set_bit(struct priv *p, int64_t pos, bool bit)
     p->block_bits[block / 8] = (p->block_bits[block / 8] & ~m) | (bit ? m : 0);
 }
 
+// Return the position in the cache file for the stream position pos. With
+// slots, this might evict another page from the cache file.
+static int64_t map_pos(struct priv *p, int64_t pos)
+{
+    if (!p->num_slots)
+        return pos;
+    int64_t page = pos / PAGE_SIZE;
+    int slot = p->page_slot[page];
+    if (slot < 0) {
+        slot = 0;
+        for (int n = 0; n < p->num_slots; n++) {
+            if (p->slot_page[n] < 0) {
+                slot = n;
+                break;
+            }
+            if (p->slot_use[n] < p->slot_use[slot])
+                slot = n;
+        }
+        if (p->slot_page[slot] >= 0) {
+            p->page_slot[p->slot_page[slot]] = -1;
+            for (int64_t b = 0; b < PAGE_SIZE; b += BLOCK_SIZE)
+                set_bit(p, slot * PAGE_SIZE + b, 0);
+        }
+        p->slot_page[slot] = page;
+        p->page_slot[page] = slot;
+    }
+    p->slot_use[slot] = ++p->use_counter;
+    return slot * PAGE_SIZE + pos % PAGE_SIZE;
+}
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
     if (s->pos < 0)
         return -1;
-    if (s->pos >= p->max_size) {
+    if (p->num_slots && s->pos >= p->size)
+        return 0;
+    if (!p->num_slots && s->pos >= p->max_size) {
         if (stream_seek(p->original, s->pos) < 1)
             return -1;
         return stream_read(p->original, buffer, max_len);
     }
     // Size of file changes -> invalidate last block
-    if (s->pos >= p->size - BLOCK_SIZE) {
+    if (!p->num_slots && s->pos >= p->size - BLOCK_SIZE) {
         int64_t new_size = -1;
         stream_control(s, STREAM_CTRL_GET_SIZE, &new_size);
         if (p->size >= 0 && new_size != p->size)
@@ -73,7 +119,8 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
         p->size = MPMIN(p->max_size, new_size);
     }
     int64_t aligned = BLOCK_ALIGN(s->pos);
-    if (!test_bit(p, aligned)) {
+    int64_t file_pos = map_pos(p, aligned);
+    if (!test_bit(p, file_pos)) {
         char tmp[BLOCK_SIZE];
         stream_seek(p->original, aligned);
         int r = stream_read(p->original, tmp, BLOCK_SIZE);
@@ -85,13 +132,13 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
                 return -1;
             }
         }
-        if (fseeko(p->cache_file, aligned, SEEK_SET))
+        if (fseeko(p->cache_file, file_pos, SEEK_SET))
             return -1;
         if (fwrite(tmp, r, 1, p->cache_file) != 1)
             return -1;
-        set_bit(p, aligned, 1);
+        set_bit(p, file_pos, 1);
     }
-    if (fseeko(p->cache_file, s->pos, SEEK_SET))
+    if (fseeko(p->cache_file, file_pos + (s->pos - aligned), SEEK_SET))
         return -1;
     // align/limit to blocks
     max_len = MPMIN(max_len, BLOCK_SIZE - (s->pos % BLOCK_SIZE));
@@ -149,6 +196,23 @@ int stream_file_cache_init(stream_t *cache, stream_t *stream,
     // file_max can be INT_MAX, so this is at most about 256MB
     p->block_bits = talloc_zero_size(p, (p->max_size / BLOCK_SIZE + 1) / 8 + 1);
 
+    int64_t size = -1;
+    stream_control(stream, STREAM_CTRL_GET_SIZE, &size);
+    if (size > p->max_size && p->max_size >= 2 * PAGE_SIZE) {
+        p->size = size;
+        p->num_slots = p->max_size / PAGE_SIZE;
+        p->num_pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+        p->slot_page = talloc_array(p, int64_t, p->num_slots);
+        p->slot_use = talloc_zero_array(p, int64_t, p->num_slots);
+        p->page_slot = talloc_array(p, int32_t, p->num_pages);
+        for (int n = 0; n < p->num_slots; n++)
+            p->slot_page[n] = -1;
+        for (int64_t n = 0; n < p->num_pages; n++)
+            p->page_slot[n] = -1;
+        MP_VERBOSE(cache, "Stream larger than cache file, using %d slots.\n",
+                   p->num_slots);
+    }
+
     cache->seek = seek;
     cache->fill_buffer = fill_buffer;
     cache->control = control;
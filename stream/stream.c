@@ -495,7 +495,13 @@ static int stream_fill_buffer_by(stream_t *s, int64_t len)
 
 int stream_fill_buffer(stream_t *s)
 {
-    return stream_fill_buffer_by(s, STREAM_BUFFER_SIZE);
+    // Fill the buffer in large blocks to reduce the number of read calls and
+    // the per-call overhead. Uncached network streams might block until the
+    // full amount of data is available, so keep using small reads for them.
+    int len = STREAM_BUFFER_SIZE;
+    if (!s->streaming || s->uncached_stream)
+        len = s->read_chunk;
+    return stream_fill_buffer_by(s, len);
 }
 
 // Read between 1..buf_size bytes of data, return how much data has been read.
@@ -570,6 +576,47 @@ struct bstr stream_peek(stream_t *s, int len)
                   .len = FFMIN(len, s->buf_len - s->buf_pos)};
 }
 
+// Read len bytes, and return a pointer to the data. If the data is already in
+// the internal buffer, a pointer into the buffer is returned. Otherwise, if
+// the stream supports it (e.g. mmap'ed files), the returned pointer points
+// directly into the stream's backing memory, and the data is not copied at
+// all. Otherwise, the data is read into the internal buffer, which works for
+// up to STREAM_MAX_BUFFER_SIZE bytes only - for larger reads, an empty buffer
+// with start==NULL is returned, and the stream position is not changed.
+// Returns less than len bytes only on EOF.
+// The returned buffer becomes invalid on the next stream call, and you must
+// not write to it.
+struct bstr stream_read_borrow(stream_t *s, int len)
+{
+    assert(len >= 0);
+    if (s->buf_len - s->buf_pos >= len) {
+        bstr data = {&s->buffer[s->buf_pos], len};
+        s->buf_pos += len;
+        return data;
+    }
+    if (s->read_borrow) {
+        // Drop the rest of the buffer, and borrow from the current position.
+        int64_t end = s->pos;
+        s->pos = stream_tell(s);
+        void *data = NULL;
+        if (s->read_borrow(s, &data, len) == len) {
+            s->buf_pos = s->buf_len = 0;
+            s->eof = 0;
+            // The dropped part was passed to the capture when it was buffered.
+            int captured = end - s->pos;
+            stream_capture_write(s, (char *)data + captured, len - captured);
+            s->pos += len;
+            return (bstr){data, len};
+        }
+        s->pos = end;
+    }
+    if (len > STREAM_MAX_BUFFER_SIZE)
+        return (bstr){0};
+    bstr data = stream_peek(s, len);
+    s->buf_pos += data.len;
+    return data;
+}
+
 int stream_write_buffer(stream_t *s, unsigned char *buf, int len)
 {
     int rd;
@@ -78,6 +78,7 @@ enum stream_ctrl {
 
     // stream_rar.c
     STREAM_CTRL_GET_BASE_FILENAME,
+    STREAM_CTRL_GET_READ_LATENCY,       // struct stream_read_latency*
 
     // Certain network protocols
     STREAM_CTRL_RECONNECT,
@@ -138,6 +139,13 @@ struct stream_dvd_info_req {
 #define TV_COLOR_SATURATION     3
 #define TV_COLOR_CONTRAST       4
 
+// for STREAM_CTRL_GET_READ_LATENCY
+#define STREAM_READ_LATENCY_BUCKETS 5
+struct stream_read_latency {
+    // Number of reads that took <0.1ms, <1ms, <10ms, <100ms, and longer.
+    int64_t reads[STREAM_READ_LATENCY_BUCKETS];
+};
+
 // for STREAM_CTRL_AVSEEK
 struct stream_avseek {
     int stream_index;
@@ -166,6 +174,12 @@ typedef struct stream {
 
     // Read
     int (*fill_buffer)(struct stream *s, char *buffer, int max_len);
+    // Zero-copy read (optional): set *data to a pointer to the stream data at
+    // the current position (s->pos), and return the number of bytes that are
+    // available there (at most len). Must not change the position. The data
+    // must stay valid until the next call to any stream function.
+    // Return -1 if this is not possible at the current position.
+    int (*read_borrow)(struct stream *s, void **data, int len);
     // Write
     int (*write_buffer)(struct stream *s, char *buffer, int len);
     // Seek
@@ -252,6 +266,7 @@ bool stream_seek(stream_t *s, int64_t pos);
 int stream_read(stream_t *s, char *mem, int total);
 int stream_read_partial(stream_t *s, char *buf, int buf_size);
 struct bstr stream_peek(stream_t *s, int len);
+struct bstr stream_read_borrow(stream_t *s, int len);
 void stream_drop_buffers(stream_t *s);
 
 struct mpv_global;
@@ -28,14 +28,17 @@
 
 #ifndef __MINGW32__
 #include <poll.h>
+#include <sys/mman.h>
 #endif
 
 #include "osdep/io.h"
+#include "osdep/timer.h"
 
 #include "common/common.h"
 #include "common/msg.h"
 #include "stream.h"
 #include "options/m_option.h"
+#include "options/options.h"
 #include "options/path.h"
 
 #if HAVE_BSD_FSTATFS
@@ -57,15 +60,55 @@
 #endif
 #endif
 
+// Upper limits (in microseconds) of the read latency histogram buckets.
+static const int64_t latency_buckets[STREAM_READ_LATENCY_BUCKETS] =
+    {100, 1000, 10000, 100000, INT64_MAX};
+
 struct priv {
     int fd;
     bool close;
     bool regular;
+    // If not NULL, the file is mapped from offset 0 up to map_size.
+    char *map;
+    int64_t map_size;
+    // Readahead window size, and file position up to which the OS was asked
+    // to prefetch data.
+    int64_t readahead;
+    int64_t advised_pos;
+    // Number of read() calls per latency bucket.
+    struct stream_read_latency latency;
 };
 
+// Keep the OS reading asynchronously ahead of the read position. The next
+// window is requested when half of the previous one has been consumed, so
+// there is always at least one request in flight.
+static void advise_readahead(stream_t *s)
+{
+#ifdef POSIX_FADV_WILLNEED
+    struct priv *p = s->priv;
+    if (s->pos > p->advised_pos || s->pos < p->advised_pos - p->readahead)
+        p->advised_pos = s->pos; // seek
+    while (p->advised_pos - s->pos < p->readahead) {
+        int64_t len = p->readahead / 2;
+        posix_fadvise(p->fd, p->advised_pos, len, POSIX_FADV_WILLNEED);
+        p->advised_pos += len;
+    }
+#endif
+}
+
 static int fill_buffer(stream_t *s, char *buffer, int max_len)
 {
     struct priv *p = s->priv;
+    if (p->map) {
+        if (s->pos < p->map_size) {
+            int len = MPMIN(max_len, p->map_size - s->pos);
+            memcpy(buffer, p->map + s->pos, len);
+            return len;
+        }
+        // The file was appended to after mapping it; read the rest normally.
+        if (lseek(p->fd, s->pos, SEEK_SET) == (off_t)-1)
+            return -1;
+    }
 #ifndef __MINGW32__
     if (!p->regular) {
         int c = s->cancel ? mp_cancel_get_fd(s->cancel) : -1;
@@ -78,7 +121,19 @@ static int fill_buffer(stream_t *s, char *buffer, int max_len)
             return -1;
     }
 #endif
+    if (p->readahead)
+        advise_readahead(s);
+    int64_t start = p->regular ? mp_time_us() : 0;
     int r = read(p->fd, buffer, max_len);
+    if (p->regular) {
+        int64_t t = mp_time_us() - start;
+        for (int n = 0; n < STREAM_READ_LATENCY_BUCKETS; n++) {
+            if (t < latency_buckets[n]) {
+                p->latency.reads[n]++;
+                break;
+            }
+        }
+    }
     return (r <= 0) ? -1 : r;
 }
 
@@ -97,6 +152,15 @@ static int write_buffer(stream_t *s, char *buffer, int len)
     return len;
 }
 
+static int read_borrow(stream_t *s, void **data, int len)
+{
+    struct priv *p = s->priv;
+    if (s->pos >= p->map_size)
+        return -1;
+    *data = p->map + s->pos;
+    return MPMIN(len, p->map_size - s->pos);
+}
+
 static int seek(stream_t *s, int64_t newpos)
 {
     struct priv *p = s->priv;
@@ -116,17 +180,63 @@ static int control(stream_t *s, int cmd, void *arg)
         }
         break;
     }
+    case STREAM_CTRL_GET_READ_LATENCY:
+        if (!p->regular)
+            break;
+        *(struct stream_read_latency *)arg = p->latency;
+        return STREAM_OK;
     }
     return STREAM_UNSUPPORTED;
 }
 
+static void print_latency(stream_t *s)
+{
+    struct priv *p = s->priv;
+    int64_t *reads = p->latency.reads;
+    int64_t total = 0;
+    for (int n = 0; n < STREAM_READ_LATENCY_BUCKETS; n++)
+        total += reads[n];
+    if (!total)
+        return;
+    MP_VERBOSE(s, "Read latency of %"PRId64" reads: <0.1ms %"PRId64", "
+               "<1ms %"PRId64", <10ms %"PRId64", <100ms %"PRId64", "
+               "slower %"PRId64"\n", total, reads[0], reads[1], reads[2],
+               reads[3], reads[4]);
+}
+
 static void s_close(stream_t *s)
 {
     struct priv *p = s->priv;
+    print_latency(s);
+#ifndef __MINGW32__
+    if (p->map)
+        munmap(p->map, p->map_size);
+#endif
     if (p->close && p->fd >= 0)
         close(p->fd);
 }
 
+// Map the whole file into memory, so that reads don't need syscalls, and
+// demuxers can access the data without copying it (see read_borrow()).
+static void try_map_file(stream_t *stream, int64_t size)
+{
+#ifndef __MINGW32__
+    struct priv *p = stream->priv;
+    if (size <= 0 || (uint64_t)size > SIZE_MAX / 2)
+        return;
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, p->fd, 0);
+    if (map == MAP_FAILED) {
+        MP_VERBOSE(stream, "Could not mmap file: %s\n", mp_strerror(errno));
+        return;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    p->map = map;
+    p->map_size = size;
+    stream->read_borrow = read_borrow;
+    MP_VERBOSE(stream, "File mapped into memory.\n");
+#endif
+}
+
 // If url is a file:// URL, return the local filename, otherwise return NULL.
 char *mp_file_url_to_filename(void *talloc_ctx, bstr url)
 {
@@ -310,6 +420,21 @@ static int open_f(stream_t *stream)
     if (check_stream_network(fd))
         stream->streaming = true;
 
+    // Truncating a mapped file while it's being read causes SIGBUS, so this
+    // is enabled by the user only.
+    if (stream->opts && stream->opts->stream_mmap && priv->regular && !write &&
+        !stream->streaming && len != (off_t)-1)
+        try_map_file(stream, len);
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (stream->opts && stream->opts->stream_readahead && priv->regular &&
+        !write && !priv->map)
+    {
+        priv->readahead = stream->opts->stream_readahead * 1024LL;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+
     return STREAM_OK;
 }
 
@@ -34,6 +34,15 @@ static int fill_buffer(stream_t *s, char* buffer, int len)
     return len;
 }
 
+static int read_borrow(stream_t *s, void **data, int len)
+{
+    struct priv *p = s->priv;
+    if (s->pos < 0 || s->pos >= p->data.len)
+        return -1;
+    *data = p->data.start + s->pos;
+    return FFMIN(len, p->data.len - s->pos);
+}
+
 static int seek(stream_t *s, int64_t newpos)
 {
     return 1;
@@ -58,6 +67,7 @@ static int control(stream_t *s, int cmd, void *arg)
 static int open_f(stream_t *stream)
 {
     stream->fill_buffer = fill_buffer;
+    stream->read_borrow = read_borrow;
     stream->seek = seek;
     stream->seekable = true;
     stream->control = control;
@@ -19,7 +19,9 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 #include <inttypes.h>
+#include <pthread.h>
 
 #include <libswscale/swscale.h>
 #include <libavutil/common.h>
@@ -50,18 +52,50 @@ struct part {
     struct sub_cache *imgs;
 };
 
+// Composited libass overlay for one (swscale aligned) bounding box. All parts
+// overlapping the box are blended onto black once, which gives premultiplied
+// color in the target format. Drawing the box is then a single blend per pixel,
+// no matter how many glyphs, borders and shadows are stacked in it.
+struct ass_region {
+    struct mp_rect bb;
+    // Copy of the parts overlapping bb, and a checksum of each part's bitmap,
+    // to detect whether the region changed.
+    struct sub_bitmap *parts;
+    uint32_t *hashes;
+    int num_parts;
+    struct mp_image *color;     // premultiplied color (format ass_cache.imgfmt)
+    struct mp_image *alpha;     // Y8, size of the color's plane 0
+    struct mp_image *alpha_c;   // Y8, size of the chroma planes (4:2:0 only)
+};
+
+struct ass_cache {
+    bool valid;
+    int change_id;
+    // IMGFMT_420P, or what get_closest_y444_format() returns
+    int imgfmt, bits;
+    int w, h;
+    enum mp_csp colorspace;
+    enum mp_csp_levels levels;
+    struct ass_region **regions;
+    int num_regions;
+};
+
 struct mp_draw_sub_cache
 {
     struct part *parts[MAX_OSD_PARTS];
+    struct ass_cache *ass[MAX_OSD_PARTS];
     struct mp_image *upsample_img;
     struct mp_image upsample_temp;
+    // Per-row sums for blend_chroma_420()
+    uint32_t *sums;
+    int sums_size;
 };
 
 
 static struct part *get_cache(struct mp_draw_sub_cache *cache,
                               struct sub_bitmaps *sbs, struct mp_image *format);
-static bool get_sub_area(struct mp_rect bb, struct mp_image *temp,
-                         struct sub_bitmap *sb, struct mp_image *out_area,
+static bool get_sub_rect(struct mp_rect bb, struct mp_image *temp,
+                         struct sub_bitmap *sb, struct mp_rect *out_rc,
                          int *out_src_x, int *out_src_y);
 
 #define ACCURATE
@@ -74,8 +108,8 @@ static void blend_const16_alpha(void *dst, int dst_stride, uint16_t srcp,
     if (!srcamul)
         return;
     for (int y = 0; y < h; y++) {
-        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
-        uint8_t *srca_r = srca + srca_stride * y;
+        uint16_t *restrict dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
+        const uint8_t *restrict srca_r = srca + srca_stride * y;
         for (int x = 0; x < w; x++) {
             uint32_t srcap = srca_r[x];
 #ifdef CONDITIONAL
@@ -95,8 +129,8 @@ static void blend_const8_alpha(void *dst, int dst_stride, uint16_t srcp,
     if (!srcamul)
         return;
     for (int y = 0; y < h; y++) {
-        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
-        uint8_t *srca_r = srca + srca_stride * y;
+        uint8_t *restrict dst_r = (uint8_t *)dst + dst_stride * y;
+        const uint8_t *restrict srca_r = srca + srca_stride * y;
         for (int x = 0; x < w; x++) {
             uint32_t srcap = srca_r[x];
 #ifdef CONDITIONAL
@@ -132,9 +166,10 @@ static void blend_src16_alpha(void *dst, int dst_stride, void *src,
                               int w, int h)
 {
     for (int y = 0; y < h; y++) {
-        uint16_t *dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
-        uint16_t *src_r = (uint16_t *)((uint8_t *)src + src_stride * y);
-        uint8_t *srca_r = srca + srca_stride * y;
+        uint16_t *restrict dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
+        const uint16_t *restrict src_r =
+            (uint16_t *)((uint8_t *)src + src_stride * y);
+        const uint8_t *restrict srca_r = srca + srca_stride * y;
         for (int x = 0; x < w; x++) {
             uint32_t srcap = srca_r[x];
 #ifdef CONDITIONAL
@@ -151,11 +186,11 @@ static void blend_src8_alpha(void *dst, int dst_stride, void *src,
                              int w, int h)
 {
     for (int y = 0; y < h; y++) {
-        uint8_t *dst_r = (uint8_t *)dst + dst_stride * y;
-        uint8_t *src_r = (uint8_t *)src + src_stride * y;
-        uint8_t *srca_r = srca + srca_stride * y;
+        uint8_t *restrict dst_r = (uint8_t *)dst + dst_stride * y;
+        const uint8_t *restrict src_r = (uint8_t *)src + src_stride * y;
+        const uint8_t *restrict srca_r = srca + srca_stride * y;
         for (int x = 0; x < w; x++) {
-            uint16_t srcap = srca_r[x];
+            uint32_t srcap = srca_r[x];
 #ifdef CONDITIONAL
             if (!srcap)
                 continue;
@@ -182,31 +217,140 @@ static void blend_src_alpha(void *dst, int dst_stride, void *src,
     }
 }
 
+// Blend src with premultiplied color onto dst. (Unlike blend_src_alpha(),
+// which expects src not to be premultiplied.) max is the highest pixel value.
+static void blend_premul16_alpha(void *dst, int dst_stride, void *src,
+                                 int src_stride, uint8_t *srca, int srca_stride,
+                                 int w, int h, int max)
+{
+    for (int y = 0; y < h; y++) {
+        uint16_t *restrict dst_r = (uint16_t *)((uint8_t *)dst + dst_stride * y);
+        const uint16_t *restrict src_r =
+            (uint16_t *)((uint8_t *)src + src_stride * y);
+        const uint8_t *restrict srca_r = srca + srca_stride * y;
+        for (int x = 0; x < w; x++) {
+            uint32_t srcap = srca_r[x];
+            uint32_t v = src_r[x] + (dst_r[x] * (255 - srcap) + 127) / 255;
+            dst_r[x] = MPMIN(v, max);
+        }
+    }
+}
+
+static void blend_premul8_alpha(void *dst, int dst_stride, void *src,
+                                int src_stride, uint8_t *srca, int srca_stride,
+                                int w, int h)
+{
+    for (int y = 0; y < h; y++) {
+        uint8_t *restrict dst_r = (uint8_t *)dst + dst_stride * y;
+        const uint8_t *restrict src_r = (uint8_t *)src + src_stride * y;
+        const uint8_t *restrict srca_r = srca + srca_stride * y;
+        for (int x = 0; x < w; x++) {
+            uint32_t srcap = srca_r[x];
+            uint32_t v = src_r[x] + (dst_r[x] * (255 - srcap) + 127) / 255;
+            dst_r[x] = MPMIN(v, 255);
+        }
+    }
+}
+
+static void blend_premul_alpha(void *dst, int dst_stride, void *src,
+                               int src_stride, uint8_t *srca, int srca_stride,
+                               int w, int h, int bits)
+{
+    if (bits > 8) {
+        blend_premul16_alpha(dst, dst_stride, src, src_stride, srca,
+                             srca_stride, w, h, (1 << bits) - 1);
+    } else {
+        blend_premul8_alpha(dst, dst_stride, src, src_stride, srca,
+                            srca_stride, w, h);
+    }
+}
+
+// Blend onto the chroma planes of an 8 bit 4:2:0 image directly, instead of
+// upsampling the chroma to 4:4:4 for blending and downsampling it again. rc is
+// the destination rectangle in luma pixels, and alpha/src start at its top/left
+// corner. Each chroma pixel is blended with the average alpha and color of the
+// luma pixels it covers (pixels outside of rc count as transparent). The
+// chroma planes of the 4:4:4 image src are used as color. This saves the two
+// swscale passes over the bounding box, and blends a quarter of the chroma
+// pixels. test/bench/draw_bmp.c times it against the 4:4:4 round trip.
+static void blend_chroma_420(struct mp_draw_sub_cache *cache,
+                             struct mp_image *img, struct mp_rect rc,
+                             uint8_t *srca, int srca_stride,
+                             struct mp_image *src, int src_x, int src_y)
+{
+    int cx0 = rc.x0 >> 1, cx1 = (rc.x1 + 1) >> 1;
+    int cy0 = rc.y0 >> 1, cy1 = (rc.y1 + 1) >> 1;
+    int cw = cx1 - cx0;
+    if (cw < 1)
+        return;
+
+    if (cache->sums_size < cw * 3) {
+        talloc_free(cache->sums);
+        cache->sums = talloc_array(cache, uint32_t, cw * 3);
+        cache->sums_size = cw * 3;
+    }
+    uint32_t *asum = cache->sums;
+    uint32_t *csum[2] = {asum + cw, asum + cw * 2};
+
+    for (int cy = cy0; cy < cy1; cy++) {
+        memset(asum, 0, cw * 3 * sizeof(asum[0]));
+        for (int y = MPMAX(cy * 2, rc.y0); y < MPMIN(cy * 2 + 2, rc.y1); y++) {
+            const uint8_t *a_r = srca + (y - rc.y0) * srca_stride;
+            for (int x = rc.x0; x < rc.x1; x++)
+                asum[(x >> 1) - cx0] += a_r[x - rc.x0];
+            for (int p = 0; p < 2; p++) {
+                const uint8_t *s_r = src->planes[1 + p] + src_x +
+                                     (src_y + y - rc.y0) * src->stride[1 + p];
+                for (int x = rc.x0; x < rc.x1; x++)
+                    csum[p][(x >> 1) - cx0] += s_r[x - rc.x0] * a_r[x - rc.x0];
+            }
+        }
+        for (int p = 0; p < 2; p++) {
+            uint8_t *restrict d_r = img->planes[1 + p] +
+                                    cy * img->stride[1 + p] + cx0;
+            // sums of up to 4 pixels with color and alpha 0..255
+            const uint32_t *restrict c_r = csum[p];
+            for (int x = 0; x < cw; x++)
+                d_r[x] = (c_r[x] + d_r[x] * (1020 - asum[x]) + 510) / 1020;
+        }
+    }
+}
+
+// unpremultiply_table[a][v] = the unpremultiplied value of v with alpha a.
+// multiplied = separate * alpha / 255
+// separate = rint(multiplied * 255 / alpha)
+//          = floor(multiplied * 255 / alpha + 0.5)
+//          = floor((multiplied * 255 + 0.5 * alpha) / alpha)
+//          = floor((multiplied * 255 + floor(0.5 * alpha)) / alpha)
+static uint8_t unpremultiply_table[256][256];
+static pthread_once_t unpremultiply_once = PTHREAD_ONCE_INIT;
+
+static void init_unpremultiply_table(void)
+{
+    for (int a = 0; a < 256; a++) {
+        for (int v = 0; v < 256; v++) {
+            unpremultiply_table[a][v] =
+                a ? FFMIN(255, (v * 255 + a / 2) / a) : v;
+        }
+    }
+}
+
 static void unpremultiply_and_split_BGR32(struct mp_image *img,
                                           struct mp_image *alpha)
 {
+    pthread_once(&unpremultiply_once, init_unpremultiply_table);
+
     for (int y = 0; y < img->h; ++y) {
         uint32_t *irow = (uint32_t *) &img->planes[0][img->stride[0] * y];
         uint8_t *arow = &alpha->planes[0][alpha->stride[0] * y];
         for (int x = 0; x < img->w; ++x) {
             uint32_t pval = irow[x];
             uint8_t aval = (pval >> 24);
-            uint8_t rval = (pval >> 16) & 0xFF;
-            uint8_t gval = (pval >> 8) & 0xFF;
-            uint8_t bval = pval & 0xFF;
-            // multiplied = separate * alpha / 255
-            // separate = rint(multiplied * 255 / alpha)
-            //          = floor(multiplied * 255 / alpha + 0.5)
-            //          = floor((multiplied * 255 + 0.5 * alpha) / alpha)
-            //          = floor((multiplied * 255 + floor(0.5 * alpha)) / alpha)
-            int div = (int) aval;
-            int add = div / 2;
-            if (aval) {
-                rval = FFMIN(255, (rval * 255 + add) / div);
-                gval = FFMIN(255, (gval * 255 + add) / div);
-                bval = FFMIN(255, (bval * 255 + add) / div);
-                irow[x] = bval + (gval << 8) + (rval << 16) + (aval << 24);
-            }
+            const uint8_t *t = unpremultiply_table[aval];
+            uint8_t rval = t[(pval >> 16) & 0xFF];
+            uint8_t gval = t[(pval >> 8) & 0xFF];
+            uint8_t bval = t[pval & 0xFF];
+            irow[x] = bval + (gval << 8) + (rval << 16) + ((uint32_t)aval << 24);
             arow[x] = aval;
         }
     }
@@ -244,11 +388,17 @@ static void scale_sb_rgba(struct sub_bitmap *sb, struct mp_image *dst_format,
     *out_sba = sba;
 }
 
+// temp is either a 4:4:4 format, or IMGFMT_420P (blended directly).
 static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
                       struct mp_image *temp, int bits,
                       struct sub_bitmaps *sbs)
 {
-    struct part *part = get_cache(cache, sbs, temp);
+    bool direct_420 = temp->imgfmt == IMGFMT_420P;
+    struct mp_image format = *temp;
+    if (direct_420)
+        mp_image_setfmt(&format, IMGFMT_444P);
+
+    struct part *part = get_cache(cache, sbs, &format);
     assert(part);
 
     for (int i = 0; i < sbs->num_parts; ++i) {
@@ -257,75 +407,44 @@ static void draw_rgba(struct mp_draw_sub_cache *cache, struct mp_rect bb,
         if (sb->w < 1 || sb->h < 1)
             continue;
 
-        struct mp_image dst;
+        struct mp_rect rc;
         int src_x, src_y;
-        if (!get_sub_area(bb, temp, sb, &dst, &src_x, &src_y))
+        if (!get_sub_rect(bb, temp, sb, &rc, &src_x, &src_y))
             continue;
 
         struct mp_image *sbi = part->imgs[i].i;
         struct mp_image *sba = part->imgs[i].a;
 
         if (!(sbi && sba))
-            scale_sb_rgba(sb, temp, &sbi, &sba);
+            scale_sb_rgba(sb, &format, &sbi, &sba);
         // on OOM, skip drawing
         if (!(sbi && sba))
             continue;
 
-        int bytes = (bits + 7) / 8;
-        uint8_t *alpha_p = sba->planes[0] + src_y * sba->stride[0] + src_x;
-        for (int p = 0; p < (temp->num_planes > 2 ? 3 : 1); p++) {
-            void *src = sbi->planes[p] + src_y * sbi->stride[p] + src_x * bytes;
-            blend_src_alpha(dst.planes[p], dst.stride[p], src, sbi->stride[p],
-                            alpha_p, sba->stride[0], dst.w, dst.h, bytes);
-        }
-
         part->imgs[i].i = talloc_steal(part, sbi);
         part->imgs[i].a = talloc_steal(part, sba);
-    }
-}
 
-static void draw_ass(struct mp_draw_sub_cache *cache, struct mp_rect bb,
-                     struct mp_image *temp, int bits, struct sub_bitmaps *sbs)
-{
-    struct mp_csp_params cspar = MP_CSP_PARAMS_DEFAULTS;
-    mp_csp_set_image_params(&cspar, &temp->params);
-    cspar.levels_out = MP_CSP_LEVELS_PC; // RGB (libass.color)
-    cspar.int_bits_in = bits;
-    cspar.int_bits_out = 8;
-
-    struct mp_cmat yuv2rgb, rgb2yuv;
-    bool need_conv = temp->fmt.flags & MP_IMGFLAG_YUV;
-    if (need_conv) {
-        mp_get_yuv2rgb_coeffs(&cspar, &yuv2rgb);
-        mp_invert_yuv2rgb(&rgb2yuv, &yuv2rgb);
-    }
-
-    for (int i = 0; i < sbs->num_parts; ++i) {
-        struct sub_bitmap *sb = &sbs->parts[i];
+        uint8_t *alpha_p = sba->planes[0] + src_y * sba->stride[0] + src_x;
 
-        struct mp_image dst;
-        int src_x, src_y;
-        if (!get_sub_area(bb, temp, sb, &dst, &src_x, &src_y))
+        if (direct_420) {
+            blend_src8_alpha(temp->planes[0] + rc.y0 * temp->stride[0] + rc.x0,
+                             temp->stride[0],
+                             sbi->planes[0] + src_y * sbi->stride[0] + src_x,
+                             sbi->stride[0], alpha_p, sba->stride[0],
+                             rc.x1 - rc.x0, rc.y1 - rc.y0);
+            blend_chroma_420(cache, temp, rc, alpha_p, sba->stride[0],
+                             sbi, src_x, src_y);
             continue;
-
-        int r = (sb->libass.color >> 24) & 0xFF;
-        int g = (sb->libass.color >> 16) & 0xFF;
-        int b = (sb->libass.color >> 8) & 0xFF;
-        int a = 255 - (sb->libass.color & 0xFF);
-        int color_yuv[3] = {r, g, b};
-        if (need_conv) {
-            mp_map_int_color(&rgb2yuv, bits, color_yuv);
-        } else {
-            color_yuv[0] = g;
-            color_yuv[1] = b;
-            color_yuv[2] = r;
         }
 
+        struct mp_image dst = *temp;
+        mp_image_crop_rc(&dst, rc);
+
         int bytes = (bits + 7) / 8;
-        uint8_t *alpha_p = (uint8_t *)sb->bitmap + src_y * sb->stride + src_x;
         for (int p = 0; p < (temp->num_planes > 2 ? 3 : 1); p++) {
-            blend_const_alpha(dst.planes[p], dst.stride[p], color_yuv[p],
-                              alpha_p, sb->stride, a, dst.w, dst.h, bytes);
+            void *src = sbi->planes[p] + src_y * sbi->stride[p] + src_x * bytes;
+            blend_src_alpha(dst.planes[p], dst.stride[p], src, sbi->stride[p],
+                            alpha_p, sba->stride[0], dst.w, dst.h, bytes);
         }
     }
 }
@@ -426,9 +545,10 @@ static struct part *get_cache(struct mp_draw_sub_cache *cache,
     return part;
 }
 
-// Return area of intersection between target and sub-bitmap as cropped image
-static bool get_sub_area(struct mp_rect bb, struct mp_image *temp,
-                         struct sub_bitmap *sb, struct mp_image *out_area,
+// Return area of intersection between target and sub-bitmap as rectangle
+// relative to temp
+static bool get_sub_rect(struct mp_rect bb, struct mp_image *temp,
+                         struct sub_bitmap *sb, struct mp_rect *out_rc,
                          int *out_src_x, int *out_src_y)
 {
     // coordinates are relative to the bbox
@@ -440,8 +560,7 @@ static bool get_sub_area(struct mp_rect bb, struct mp_image *temp,
 
     *out_src_x = (dst.x0 - sb->x) + bb.x0;
     *out_src_y = (dst.y0 - sb->y) + bb.y0;
-    *out_area = *temp;
-    mp_image_crop_rc(out_area, dst);
+    *out_rc = dst;
 
     return true;
 }
@@ -526,6 +645,287 @@ static void chroma_down(struct mp_image *old_src, struct mp_image *temp)
     }
 }
 
+// Blend the libass bitmap sb onto black in the 4:4:4 image comp (which thus
+// gets premultiplied color), and accumulate its coverage in alpha. bb is the
+// position of comp on the screen.
+static void composite_ass_part(struct mp_image *comp, struct mp_image *alpha,
+                               struct mp_rect bb, int bits,
+                               struct mp_cmat *rgb2yuv, struct sub_bitmap *sb)
+{
+    struct mp_rect rc;
+    int src_x, src_y;
+    if (!get_sub_rect(bb, comp, sb, &rc, &src_x, &src_y))
+        return;
+
+    int r = (sb->libass.color >> 24) & 0xFF;
+    int g = (sb->libass.color >> 16) & 0xFF;
+    int b = (sb->libass.color >> 8) & 0xFF;
+    int a = 255 - (sb->libass.color & 0xFF);
+    int color_yuv[3] = {r, g, b};
+    if (rgb2yuv) {
+        mp_map_int_color(rgb2yuv, bits, color_yuv);
+    } else {
+        color_yuv[0] = g;
+        color_yuv[1] = b;
+        color_yuv[2] = r;
+    }
+
+    uint8_t *alpha_p = (uint8_t *)sb->bitmap + src_y * sb->stride + src_x;
+
+    struct mp_image dst = *comp;
+    mp_image_crop_rc(&dst, rc);
+
+    int bytes = (bits + 7) / 8;
+    for (int p = 0; p < (comp->num_planes > 2 ? 3 : 1); p++) {
+        blend_const_alpha(dst.planes[p], dst.stride[p], color_yuv[p],
+                          alpha_p, sb->stride, a, dst.w, dst.h, bytes);
+    }
+
+    struct mp_image dst_a = *alpha;
+    mp_image_crop_rc(&dst_a, rc);
+    blend_const8_alpha(dst_a.planes[0], dst_a.stride[0], 255, alpha_p,
+                       sb->stride, a, dst_a.w, dst_a.h);
+}
+
+// Turn the 4:4:4 color of r into 4:2:0, and add the 4:2:0 alpha. Each chroma
+// pixel gets the average of the 2x2 block it covers (pixels outside the image
+// count as transparent), like blend_chroma_420() does.
+static bool downsample_ass_region(struct ass_region *r)
+{
+    struct mp_image *src = r->color;
+    int w = src->w, h = src->h;
+    struct mp_image *color = mp_image_alloc(IMGFMT_420P, w, h);
+    struct mp_image *alpha_c = mp_image_alloc(IMGFMT_Y8, (w + 1) >> 1,
+                                              (h + 1) >> 1);
+    if (!color || !alpha_c) {
+        talloc_free(color);
+        talloc_free(alpha_c);
+        return false;
+    }
+
+    memcpy_pic(color->planes[0], src->planes[0], w, h, color->stride[0],
+               src->stride[0]);
+
+    for (int p = 0; p < 3; p++) {
+        // p == 0 is the alpha plane, 1 and 2 are the chroma planes
+        struct mp_image *s = p ? src : r->alpha;
+        struct mp_image *d = p ? color : alpha_c;
+        for (int cy = 0; cy < alpha_c->h; cy++) {
+            uint8_t *d_r = d->planes[p] + cy * d->stride[p];
+            for (int cx = 0; cx < alpha_c->w; cx++) {
+                int sum = 0;
+                for (int y = cy * 2; y < MPMIN(cy * 2 + 2, h); y++) {
+                    for (int x = cx * 2; x < MPMIN(cx * 2 + 2, w); x++)
+                        sum += s->planes[p][y * s->stride[p] + x];
+                }
+                d_r[cx] = (sum + 2) / 4;
+            }
+        }
+    }
+
+    talloc_free(r->color);
+    r->color = talloc_steal(r, color);
+    r->alpha_c = talloc_steal(r, alpha_c);
+    return true;
+}
+
+static struct ass_region *render_ass_region(struct ass_cache *ac,
+                                            struct mp_cmat *rgb2yuv,
+                                            struct mp_rect bb,
+                                            struct sub_bitmap *parts,
+                                            uint32_t *hashes,
+                                            int num_parts)
+{
+    int w = bb.x1 - bb.x0, h = bb.y1 - bb.y0;
+    bool direct_420 = ac->imgfmt == IMGFMT_420P;
+
+    struct ass_region *r = talloc_zero(ac, struct ass_region);
+    r->bb = bb;
+    r->parts = talloc_memdup(r, parts, num_parts * sizeof(parts[0]));
+    r->hashes = talloc_memdup(r, hashes, num_parts * sizeof(hashes[0]));
+    r->num_parts = num_parts;
+    r->color = mp_image_alloc(direct_420 ? IMGFMT_444P : ac->imgfmt, w, h);
+    r->alpha = mp_image_alloc(IMGFMT_Y8, w, h);
+    talloc_steal(r, r->color);
+    talloc_steal(r, r->alpha);
+    if (!r->color || !r->alpha)
+        goto error;
+
+    for (int p = 0; p < r->color->num_planes; p++) {
+        memset_pic(r->color->planes[p], 0,
+                   mp_image_plane_w(r->color, p) * r->color->fmt.bytes[p],
+                   mp_image_plane_h(r->color, p), r->color->stride[p]);
+    }
+    memset_pic(r->alpha->planes[0], 0, w, h, r->alpha->stride[0]);
+
+    for (int n = 0; n < num_parts; n++)
+        composite_ass_part(r->color, r->alpha, bb, ac->bits, rgb2yuv, &parts[n]);
+
+    if (direct_420 && !downsample_ass_region(r))
+        goto error;
+
+    return r;
+
+error:
+    talloc_free(r);
+    return NULL;
+}
+
+// FNV-1a over the visible pixels of a libass bitmap.
+static uint32_t hash_ass_part(struct sub_bitmap *part)
+{
+    uint32_t h = 2166136261u;
+    for (int y = 0; y < part->h; y++) {
+        uint8_t *row = (uint8_t *)part->bitmap + y * part->stride;
+        for (int x = 0; x < part->w; x++)
+            h = (h ^ row[x]) * 16777619u;
+    }
+    return h;
+}
+
+static bool ass_parts_equal(struct ass_region *r, struct sub_bitmap *parts,
+                            uint32_t *hashes, int num)
+{
+    if (r->num_parts != num)
+        return false;
+    for (int n = 0; n < num; n++) {
+        struct sub_bitmap *a = &r->parts[n], *b = &parts[n];
+        if (a->bitmap != b->bitmap || a->stride != b->stride ||
+            a->x != b->x || a->y != b->y || a->w != b->w || a->h != b->h ||
+            a->libass.color != b->libass.color || r->hashes[n] != hashes[n])
+            return false;
+    }
+    return true;
+}
+
+// Return the composited regions for sbs. If sbs->change_id is the same as on
+// the previous call, everything is reused as is. Otherwise, regions whose
+// bounding box and list of parts didn't change are reused, and only the others
+// are composited again. Parts are identified by their bitmap pointer, position
+// and color: libass keeps the bitmaps of unchanged glyphs in its cache, and
+// hands out the same pointers for them on every frame. Since libass can free
+// a bitmap and allocate a different one at the same address, a checksum of
+// the bitmap contents is compared as well.
+static struct ass_cache *get_ass_cache(struct mp_draw_sub_cache *cache,
+                                       struct sub_bitmaps *sbs,
+                                       struct mp_image *dst,
+                                       int format, int bits)
+{
+    struct ass_cache *ac = cache->ass[sbs->render_index];
+    if (ac && (ac->imgfmt != format || ac->bits != bits ||
+               ac->w != dst->w || ac->h != dst->h ||
+               ac->colorspace != dst->params.colorspace ||
+               ac->levels != dst->params.colorlevels))
+    {
+        talloc_free(ac);
+        ac = NULL;
+    }
+    if (!ac) {
+        ac = talloc_zero(cache, struct ass_cache);
+        *ac = (struct ass_cache) {
+            .imgfmt = format,
+            .bits = bits,
+            .w = dst->w,
+            .h = dst->h,
+            .colorspace = dst->params.colorspace,
+            .levels = dst->params.colorlevels,
+        };
+        cache->ass[sbs->render_index] = ac;
+    }
+
+    if (ac->valid && ac->change_id == sbs->change_id)
+        return ac;
+
+    struct mp_cmat rgb2yuv;
+    bool need_conv = mp_imgfmt_get_desc(format).flags & MP_IMGFLAG_YUV;
+    if (need_conv) {
+        struct mp_csp_params cspar = MP_CSP_PARAMS_DEFAULTS;
+        mp_csp_set_image_params(&cspar, &dst->params);
+        cspar.levels_out = MP_CSP_LEVELS_PC; // RGB (libass.color)
+        cspar.int_bits_in = bits;
+        cspar.int_bits_out = 8;
+        struct mp_cmat yuv2rgb;
+        mp_get_yuv2rgb_coeffs(&cspar, &yuv2rgb);
+        mp_invert_yuv2rgb(&rgb2yuv, &yuv2rgb);
+    }
+
+    struct mp_rect rc_list[MP_SUB_BB_LIST_MAX];
+    int num_rc = mp_get_sub_bb_list(sbs, rc_list, MP_SUB_BB_LIST_MAX);
+
+    struct ass_region **old = ac->regions;
+    int num_old = ac->num_regions;
+    ac->regions = talloc_zero_array(ac, struct ass_region *, num_rc);
+    ac->num_regions = 0;
+
+    struct sub_bitmap *parts = talloc_array(NULL, struct sub_bitmap,
+                                            sbs->num_parts);
+    uint32_t *all_hashes = talloc_array(parts, uint32_t, sbs->num_parts);
+    uint32_t *hashes = talloc_array(parts, uint32_t, sbs->num_parts);
+    for (int n = 0; n < sbs->num_parts; n++)
+        all_hashes[n] = hash_ass_part(&sbs->parts[n]);
+
+    for (int r = 0; r < num_rc; r++) {
+        struct mp_rect bb = rc_list[r];
+        if (!align_bbox_for_swscale(dst, &bb))
+            continue;
+
+        struct mp_image area = {0};
+        mp_image_set_size(&area, bb.x1 - bb.x0, bb.y1 - bb.y0);
+        int num_parts = 0;
+        for (int n = 0; n < sbs->num_parts; n++) {
+            struct mp_rect rc;
+            int src_x, src_y;
+            if (get_sub_rect(bb, &area, &sbs->parts[n], &rc, &src_x, &src_y)) {
+                hashes[num_parts] = all_hashes[n];
+                parts[num_parts++] = sbs->parts[n];
+            }
+        }
+
+        struct ass_region *region = NULL;
+        for (int n = 0; n < num_old; n++) {
+            struct ass_region *o = old[n];
+            if (o && o->bb.x0 == bb.x0 && o->bb.y0 == bb.y0 &&
+                o->bb.x1 == bb.x1 && o->bb.y1 == bb.y1 &&
+                ass_parts_equal(o, parts, hashes, num_parts))
+            {
+                region = o;
+                old[n] = NULL;
+                break;
+            }
+        }
+        if (!region)
+            region = render_ass_region(ac, need_conv ? &rgb2yuv : NULL, bb,
+                                       parts, hashes, num_parts);
+        // on OOM, skip region
+        if (region)
+            ac->regions[ac->num_regions++] = region;
+    }
+
+    for (int n = 0; n < num_old; n++)
+        talloc_free(old[n]);
+    talloc_free(old);
+    talloc_free(parts);
+
+    ac->change_id = sbs->change_id;
+    ac->valid = true;
+    return ac;
+}
+
+// temp is r->bb of the target image, either in 4:4:4 (see chroma_up()), or in
+// IMGFMT_420P if the region was composited for that.
+static void draw_ass_region(struct mp_image *temp, int bits,
+                            struct ass_region *r)
+{
+    for (int p = 0; p < (temp->num_planes > 2 ? 3 : 1); p++) {
+        struct mp_image *a = p && r->alpha_c ? r->alpha_c : r->alpha;
+        blend_premul_alpha(temp->planes[p], temp->stride[p],
+                           r->color->planes[p], r->color->stride[p],
+                           a->planes[0], a->stride[0],
+                           mp_image_plane_w(temp, p), mp_image_plane_h(temp, p),
+                           bits);
+    }
+}
+
 // cache: if not NULL, the function will set *cache to a talloc-allocated cache
 //        containing scaled versions of sbs contents - free the cache with
 //        talloc_free()
@@ -543,28 +943,58 @@ void mp_draw_sub_bitmaps(struct mp_draw_sub_cache **cache, struct mp_image *dst,
     int format, bits;
     get_closest_y444_format(dst->imgfmt, &format, &bits);
 
-    struct mp_rect rc_list[MP_SUB_BB_LIST_MAX];
-    int num_rc = mp_get_sub_bb_list(sbs, rc_list, MP_SUB_BB_LIST_MAX);
+    if (sbs->format == SUBBITMAP_LIBASS) {
+        // The most common case can be blended without chroma conversion.
+        bool direct_420 = dst->imgfmt == IMGFMT_420P;
+        struct ass_cache *ac = get_ass_cache(cache_, sbs, dst,
+                                             direct_420 ? IMGFMT_420P : format,
+                                             direct_420 ? 8 : bits);
+        for (int r = 0; r < ac->num_regions; r++) {
+            struct ass_region *region = ac->regions[r];
 
-    for (int r = 0; r < num_rc; r++) {
-        struct mp_rect bb = rc_list[r];
+            struct mp_image dst_region = *dst;
+            mp_image_crop_rc(&dst_region, region->bb);
 
-        if (!align_bbox_for_swscale(dst, &bb))
-            return;
+            if (direct_420) {
+                draw_ass_region(&dst_region, 8, region);
+                continue;
+            }
 
-        struct mp_image dst_region = *dst;
-        mp_image_crop_rc(&dst_region, bb);
-        struct mp_image *temp = chroma_up(cache_, format, &dst_region);
-        if (!temp)
-            continue; // on OOM, skip region
+            struct mp_image *temp = chroma_up(cache_, format, &dst_region);
+            if (!temp)
+                continue; // on OOM, skip region
 
-        if (sbs->format == SUBBITMAP_RGBA) {
-            draw_rgba(cache_, bb, temp, bits, sbs);
-        } else if (sbs->format == SUBBITMAP_LIBASS) {
-            draw_ass(cache_, bb, temp, bits, sbs);
+            draw_ass_region(temp, bits, region);
+
+            chroma_down(&dst_region, temp);
         }
+    } else if (sbs->format == SUBBITMAP_RGBA) {
+        struct mp_rect rc_list[MP_SUB_BB_LIST_MAX];
+        int num_rc = mp_get_sub_bb_list(sbs, rc_list, MP_SUB_BB_LIST_MAX);
+
+        for (int r = 0; r < num_rc; r++) {
+            struct mp_rect bb = rc_list[r];
 
-        chroma_down(&dst_region, temp);
+            if (!align_bbox_for_swscale(dst, &bb))
+                continue;
+
+            struct mp_image dst_region = *dst;
+            mp_image_crop_rc(&dst_region, bb);
+
+            // The most common case can be blended without chroma conversion.
+            if (dst->imgfmt == IMGFMT_420P) {
+                draw_rgba(cache_, bb, &dst_region, 8, sbs);
+                continue;
+            }
+
+            struct mp_image *temp = chroma_up(cache_, format, &dst_region);
+            if (!temp)
+                continue; // on OOM, skip region
+
+            draw_rgba(cache_, bb, temp, bits, sbs);
+
+            chroma_down(&dst_region, temp);
+        }
     }
 
     if (cache) {
@@ -0,0 +1,145 @@
+#include <string.h>
+
+#include "test_helpers.h"
+#include "audio/audio.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "audio/filter/af.h"
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "options/m_option.h"
+#include "options/options.h"
+#include "talloc.h"
+
+#define RATE 48000
+#define SECONDS 2
+
+struct chain {
+    const char *name;
+    struct m_obj_settings *filters;
+    int in_format, out_format;
+};
+
+static const struct chain chains[] = {
+    {"volume,pan", (struct m_obj_settings[]){
+        {"volume", NULL, (char *[]){"volumedb", "-6", NULL}},
+        {"pan", NULL, (char *[]){"channels", "2", "matrix",
+            "0.5,0,0,0.5,0.3,0.3,0.2,0.1,0.2,0.1,0.1,0.2,0.1,0.1,0,0.2", NULL}},
+        {0}},
+     AF_FORMAT_FLOATP, AF_FORMAT_S16},
+    {"drc,volume", (struct m_obj_settings[]){
+        {"drc", NULL, (char *[]){NULL}},
+        {"volume", NULL, (char *[]){"volumedb", "3", NULL}},
+        {0}},
+     AF_FORMAT_FLOAT, AF_FORMAT_S16},
+};
+
+static struct af_stream *create(const struct chain *c, int fuse)
+{
+    struct mpv_global *global = talloc_zero(NULL, struct mpv_global);
+    global->log = mp_null_log;
+    global->opts = talloc_zero(global, struct MPOpts);
+    global->opts->af_settings = c->filters;
+    global->opts->af_fuse = fuse;
+
+    struct af_stream *s = af_new(global);
+    talloc_steal(s, global);
+    struct mp_chmap chmap;
+    assert_true(mp_chmap_from_str(&chmap, bstr0("7.1")));
+    mp_audio_set_format(&s->input, c->in_format);
+    mp_audio_set_channels(&s->input, &chmap);
+    s->input.rate = RATE;
+    mp_audio_set_format(&s->output, c->out_format);
+    assert_int_equal(af_init(s), 0);
+    return s;
+}
+
+static struct mp_audio *make_frame(struct mp_audio *fmt, int64_t pos, int len)
+{
+    struct mp_audio *a = talloc_zero(NULL, struct mp_audio);
+    mp_audio_copy_config(a, fmt);
+    mp_audio_realloc(a, len);
+    a->samples = len;
+    for (int n = 0; n < len; n++) {
+        double t = (pos + n) / (double)RATE;
+        for (int c = 0; c < a->nch; c++) {
+            float v = 0.5 * sin(2 * M_PI * (220 + 110 * c) * t) *
+                      (0.5 + 0.5 * sin(2 * M_PI * 0.3 * t)) +
+                      0.05 * test_rnd_float();
+            if (af_fmt_is_planar(a->format)) {
+                ((float *)a->planes[c])[n] = v;
+            } else {
+                ((float *)a->planes[0])[n * a->nch + c] = v;
+            }
+        }
+    }
+    return a;
+}
+
+// Run SECONDS of audio through the chain, and append the output (which must
+// be interleaved s16) to out.
+static void run(struct af_stream *s, int16_t **out, int *out_len)
+{
+    test_rnd_seed(1);
+    int len = RATE / 20;
+    for (int64_t pos = 0; pos < RATE * SECONDS; pos += len) {
+        struct mp_audio *in = make_frame(&s->input, pos, len);
+        assert_true(af_filter_frame(s, in) >= 0);
+        struct mp_audio *o;
+        while ((o = af_read_output_frame(s))) {
+            assert_int_equal(o->format, AF_FORMAT_S16);
+            int num = o->samples * o->nch;
+            MP_TARRAY_GROW(NULL, *out, *out_len + num);
+            memcpy(*out + *out_len, o->planes[0], num * sizeof(int16_t));
+            *out_len += num;
+            talloc_free(o);
+        }
+    }
+}
+
+// Number of filters in the chain, without the dummy first and last filter.
+static int count_filters(struct af_stream *s)
+{
+    int num = 0;
+    for (struct af_instance *af = s->first->next; af != s->last; af = af->next)
+        num++;
+    return num;
+}
+
+// Merged filters must give the same result, except for rounding.
+static void test_fused_equal(void **state)
+{
+    for (int n = 0; n < MP_ARRAY_SIZE(chains); n++) {
+        int16_t *a = NULL, *b = NULL;
+        int a_len = 0, b_len = 0;
+
+        struct af_stream *s = create(&chains[n], 0);
+        run(s, &a, &a_len);
+        assert_int_equal(s->fused_frames, 0);
+        af_destroy(s);
+
+        // All filters must have been merged, including the inserted format
+        // conversions.
+        s = create(&chains[n], 1);
+        run(s, &b, &b_len);
+        assert_true(s->fused_frames > 0);
+        assert_int_equal(s->fused_ops, count_filters(s));
+        af_destroy(s);
+
+        assert_true(a_len > 0);
+        assert_int_equal(a_len, b_len);
+        for (int i = 0; i < a_len; i++)
+            assert_in_range(a[i] - b[i] + 1, 0, 2);
+
+        talloc_free(a);
+        talloc_free(b);
+    }
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_fused_equal),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,221 @@
+#include "test_helpers.h"
+#include "audio/audio.h"
+#include "audio/convert.h"
+#include "audio/format.h"
+#include "common/common.h"
+#include "osdep/endian.h"
+#include "talloc.h"
+
+#define LEN 1000
+
+static const int formats[] = {
+    AF_FORMAT_U8, AF_FORMAT_S16, AF_FORMAT_S24, AF_FORMAT_S32,
+    AF_FORMAT_FLOAT, AF_FORMAT_DOUBLE,
+    AF_FORMAT_U8P, AF_FORMAT_S16P, AF_FORMAT_S32P,
+    AF_FORMAT_FLOATP, AF_FORMAT_DOUBLEP,
+};
+
+static struct mp_audio *make_audio(void *ta_parent, int format, int nch,
+                                   int samples)
+{
+    struct mp_audio *a = talloc_zero(ta_parent, struct mp_audio);
+    mp_audio_set_format(a, format);
+    mp_audio_set_num_channels(a, nch);
+    a->rate = 48000;
+    a->samples = samples;
+    for (int n = 0; n < a->num_planes; n++)
+        a->planes[n] = talloc_zero_size(a, samples * a->sstride);
+    return a;
+}
+
+static void *sample_ptr(struct mp_audio *a, int ch, int i)
+{
+    if (af_fmt_is_planar(a->format))
+        return (char *)a->planes[ch] + i * a->bps;
+    return (char *)a->planes[0] + (i * a->nch + ch) * a->bps;
+}
+
+// Integer samples are scaled to [-1, 1), without going through convert.c.
+static double get_sample(struct mp_audio *a, int ch, int i)
+{
+    void *p = sample_ptr(a, ch, i);
+    switch (af_fmt_from_planar(a->format)) {
+    case AF_FORMAT_U8:      return (*(uint8_t *)p - 128) / 128.0;
+    case AF_FORMAT_S16:     return *(int16_t *)p / 32768.0;
+    case AF_FORMAT_S32:     return *(int32_t *)p / 2147483648.0;
+    case AF_FORMAT_FLOAT:   return *(float *)p;
+    case AF_FORMAT_DOUBLE:  return *(double *)p;
+    case AF_FORMAT_S24: {
+        const uint8_t *s = p;
+#if BYTE_ORDER == BIG_ENDIAN
+        uint32_t v = ((uint32_t)s[0] << 24) | (s[1] << 16) | (s[2] << 8);
+#else
+        uint32_t v = ((uint32_t)s[2] << 24) | (s[1] << 16) | (s[0] << 8);
+#endif
+        return (int32_t)v / 2147483648.0;
+    }
+    }
+    abort();
+}
+
+// Value of the smallest step of the format.
+static double get_lsb(int format)
+{
+    switch (af_fmt_from_planar(format)) {
+    case AF_FORMAT_U8:      return 1 / 128.0;
+    case AF_FORMAT_S16:     return 1 / 32768.0;
+    case AF_FORMAT_S24:     return 1 / 8388608.0;
+    case AF_FORMAT_S32:     return 1 / 2147483648.0;
+    }
+    return 1 / 16777216.0; // float precision
+}
+
+// Fill with random samples, which use the full precision of the format.
+static void fill_random(struct mp_audio *a)
+{
+    for (int i = 0; i < a->samples; i++) {
+        for (int c = 0; c < a->nch; c++) {
+            uint32_t v = ((uint32_t)test_rnd() << 17) ^ (test_rnd() << 2) ^
+                         test_rnd();
+            void *p = sample_ptr(a, c, i);
+            switch (af_fmt_from_planar(a->format)) {
+            case AF_FORMAT_U8:      *(uint8_t *)p = v; break;
+            case AF_FORMAT_S16:     *(int16_t *)p = v; break;
+            case AF_FORMAT_S24:     memcpy(p, &v, 3); break;
+            case AF_FORMAT_S32:     *(int32_t *)p = v; break;
+            case AF_FORMAT_FLOAT:
+                *(float *)p = (int32_t)v / 2147483648.0f;
+                break;
+            case AF_FORMAT_DOUBLE:
+                *(double *)p = (int32_t)v / 2147483648.0;
+                break;
+            }
+        }
+    }
+}
+
+// Every pair of formats, with offsets and lengths that aren't multiples of the
+// internal block sizes. Float to integer must round to nearest and clip,
+// integer to integer truncates.
+static void test_all_formats(void **state)
+{
+    void *ctx = talloc_new(NULL);
+    const int nch = 3, dst_offset = 5, src_offset = 7;
+    for (int s = 0; s < MP_ARRAY_SIZE(formats); s++) {
+        for (int d = 0; d < MP_ARRAY_SIZE(formats); d++) {
+            int sf = formats[s], df = formats[d];
+            assert_true(mp_audio_convert_supported(df, sf));
+            struct mp_audio *src = make_audio(ctx, sf, nch, LEN + src_offset);
+            struct mp_audio *dst = make_audio(ctx, df, nch, LEN + dst_offset);
+            fill_random(src);
+            mp_audio_convert(dst, dst_offset, src, src_offset, LEN);
+            // (S24 is converted from S32, and truncated.)
+            bool rounds = af_fmt_is_float(sf) && af_fmt_is_int(df) &&
+                          df != AF_FORMAT_S24;
+            double lsb = get_lsb(df);
+            for (int i = 0; i < LEN; i++) {
+                for (int c = 0; c < nch; c++) {
+                    double in = get_sample(src, c, i + src_offset);
+                    double out = get_sample(dst, c, i + dst_offset);
+                    if (rounds) {
+                        double ref = MPCLAMP(nearbyint(in / lsb) * lsb,
+                                             -1.0, 1.0 - lsb);
+                        assert_true(out == ref);
+                    } else {
+                        assert_true(fabs(out - in) < lsb);
+                    }
+                }
+            }
+        }
+    }
+    talloc_free(ctx);
+}
+
+static void test_clipping(void **state)
+{
+    static const float in[] = {1.0f, -1.0f, 2.0f, -2.0f, INFINITY, -INFINITY,
+                               0.5f / 32768, 1.5f / 32768, -0.5f / 32768};
+    static const int16_t out_s16[] = {32767, -32768, 32767, -32768, 32767,
+                                      -32768, 0, 2, 0};
+    static const int32_t out_s32[] = {INT32_MAX, INT32_MIN, INT32_MAX,
+                                      INT32_MIN, INT32_MAX, INT32_MIN,
+                                      1 << 15, 3 << 15, -(1 << 15)};
+    static const uint8_t out_u8[] = {255, 0, 255, 0, 255, 0, 128, 128, 128};
+    const int num = MP_ARRAY_SIZE(in);
+
+    void *ctx = talloc_new(NULL);
+    struct mp_audio *src = make_audio(ctx, AF_FORMAT_FLOAT, 1, num);
+    memcpy(src->planes[0], in, sizeof(in));
+
+    struct mp_audio *s16 = make_audio(ctx, AF_FORMAT_S16, 1, num);
+    mp_audio_convert(s16, 0, src, 0, num);
+    struct mp_audio *s32 = make_audio(ctx, AF_FORMAT_S32, 1, num);
+    mp_audio_convert(s32, 0, src, 0, num);
+    struct mp_audio *u8 = make_audio(ctx, AF_FORMAT_U8, 1, num);
+    mp_audio_convert(u8, 0, src, 0, num);
+
+    for (int i = 0; i < num; i++) {
+        assert_int_equal(((int16_t *)s16->planes[0])[i], out_s16[i]);
+        assert_int_equal(((int32_t *)s32->planes[0])[i], out_s32[i]);
+        assert_int_equal(((uint8_t *)u8->planes[0])[i], out_u8[i]);
+    }
+    talloc_free(ctx);
+}
+
+// Reordering, with NA channels (-1) and a different number of channels, as
+// used by af_lavrresample.
+static void test_reorder(void **state)
+{
+    static const int reorder[] = {2, -1, 0, 1};
+    void *ctx = talloc_new(NULL);
+    struct mp_audio *src = make_audio(ctx, AF_FORMAT_S16P, 3, LEN);
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < LEN; i++)
+            ((int16_t *)src->planes[c])[i] = c * 1000 + i;
+    }
+    int dst_formats[] = {AF_FORMAT_S16, AF_FORMAT_S32P, AF_FORMAT_U8,
+                         AF_FORMAT_FLOAT};
+    for (int f = 0; f < MP_ARRAY_SIZE(dst_formats); f++) {
+        struct mp_audio *dst = make_audio(ctx, dst_formats[f], 4, LEN);
+        fill_random(dst);
+        mp_audio_convert_reorder(dst, 0, src, 0, LEN, reorder);
+        for (int c = 0; c < 4; c++) {
+            for (int i = 0; i < LEN; i++) {
+                double ref = reorder[c] < 0 ? 0
+                           : get_sample(src, reorder[c], i);
+                assert_true(fabs(get_sample(dst, c, i) - ref) <
+                            get_lsb(dst->format));
+            }
+        }
+    }
+    talloc_free(ctx);
+}
+
+// Without conversion, this must behave like memmove() (mp_audio_copy() and
+// the audio buffer rely on it), and must not touch the data (spdif).
+static void test_copy(void **state)
+{
+    void *ctx = talloc_new(NULL);
+    struct mp_audio *a = make_audio(ctx, AF_FORMAT_S_AC3, 2, LEN);
+    uint8_t ref[LEN * 4];
+    for (int n = 0; n < LEN * 4; n++)
+        ref[n] = ((uint8_t *)a->planes[0])[n] = test_rnd();
+
+    mp_audio_convert(a, 0, a, 10, LEN - 10);
+    assert_true(memcmp(a->planes[0], ref + 10 * 4, (LEN - 10) * 4) == 0);
+
+    memcpy(a->planes[0], ref, sizeof(ref));
+    mp_audio_convert(a, 10, a, 0, LEN - 10);
+    assert_true(memcmp((char *)a->planes[0] + 10 * 4, ref, (LEN - 10) * 4) == 0);
+    talloc_free(ctx);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_all_formats),
+        cmocka_unit_test(test_clipping),
+        cmocka_unit_test(test_reorder),
+        cmocka_unit_test(test_copy),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
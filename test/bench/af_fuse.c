@@ -0,0 +1,141 @@
+// Time the filter chains of test/af_fuse.c with and without --af-fuse, and
+// estimate how much frame data they read and write.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test/test_rnd.h"
+#include "audio/audio.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "audio/filter/af.h"
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "options/m_option.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "talloc.h"
+
+#define RATE 48000
+#define SECONDS 20
+
+struct chain {
+    const char *name;
+    struct m_obj_settings *filters;
+    int in_format, out_format;
+};
+
+// Same as in test/af_fuse.c.
+static const struct chain chains[] = {
+    {"volume,pan", (struct m_obj_settings[]){
+        {"volume", NULL, (char *[]){"volumedb", "-6", NULL}},
+        {"pan", NULL, (char *[]){"channels", "2", "matrix",
+            "0.5,0,0,0.5,0.3,0.3,0.2,0.1,0.2,0.1,0.1,0.2,0.1,0.1,0,0.2", NULL}},
+        {0}},
+     AF_FORMAT_FLOATP, AF_FORMAT_S16},
+    {"drc,volume", (struct m_obj_settings[]){
+        {"drc", NULL, (char *[]){NULL}},
+        {"volume", NULL, (char *[]){"volumedb", "3", NULL}},
+        {0}},
+     AF_FORMAT_FLOAT, AF_FORMAT_S16},
+};
+
+static struct af_stream *create(const struct chain *c, int fuse)
+{
+    struct mpv_global *global = talloc_zero(NULL, struct mpv_global);
+    global->log = mp_null_log;
+    global->opts = talloc_zero(global, struct MPOpts);
+    global->opts->af_settings = c->filters;
+    global->opts->af_fuse = fuse;
+
+    struct af_stream *s = af_new(global);
+    talloc_steal(s, global);
+    struct mp_chmap chmap;
+    if (!mp_chmap_from_str(&chmap, bstr0("7.1")))
+        abort();
+    mp_audio_set_format(&s->input, c->in_format);
+    mp_audio_set_channels(&s->input, &chmap);
+    s->input.rate = RATE;
+    mp_audio_set_format(&s->output, c->out_format);
+    if (af_init(s) < 0)
+        abort();
+    return s;
+}
+
+static struct mp_audio *make_frame(struct mp_audio *fmt, int64_t pos, int len)
+{
+    struct mp_audio *a = talloc_zero(NULL, struct mp_audio);
+    mp_audio_copy_config(a, fmt);
+    mp_audio_realloc(a, len);
+    a->samples = len;
+    for (int n = 0; n < len; n++) {
+        double t = (pos + n) / (double)RATE;
+        for (int c = 0; c < a->nch; c++) {
+            float v = 0.5 * sin(2 * M_PI * (220 + 110 * c) * t) *
+                      (0.5 + 0.5 * sin(2 * M_PI * 0.3 * t)) +
+                      0.05 * test_rnd_float();
+            if (af_fmt_is_planar(a->format)) {
+                ((float *)a->planes[c])[n] = v;
+            } else {
+                ((float *)a->planes[0])[n * a->nch + c] = v;
+            }
+        }
+    }
+    return a;
+}
+
+// Run SECONDS of audio through the chain, and return the time spent filtering.
+static int64_t run(struct af_stream *s)
+{
+    test_rnd_seed(1);
+    int64_t time = 0;
+    int len = RATE / 20;
+    for (int64_t pos = 0; pos < RATE * SECONDS; pos += len) {
+        struct mp_audio *in = make_frame(&s->input, pos, len);
+        int64_t t = mp_time_us();
+        if (af_filter_frame(s, in) < 0)
+            abort();
+        struct mp_audio *o;
+        while ((o = af_read_output_frame(s)))
+            talloc_free(o);
+        time += mp_time_us() - t;
+    }
+    return time;
+}
+
+// Bytes of frame data read and written per sample (per channel) by the
+// chain, if each filter is run separately, or if all are merged.
+static int traffic(struct af_stream *s, bool fused)
+{
+    struct af_instance *first = s->first->next, *last = s->last->prev;
+    if (fused)
+        return first->fmt_in.bps * first->fmt_in.nch +
+               last->fmt_out.bps * last->fmt_out.nch;
+    int bytes = 0;
+    for (struct af_instance *af = first; af != s->last; af = af->next) {
+        bytes += af->fmt_in.bps * af->fmt_in.nch +
+                 af->fmt_out.bps * af->fmt_out.nch;
+    }
+    return bytes;
+}
+
+int main(void)
+{
+    mp_time_init();
+    for (int n = 0; n < MP_ARRAY_SIZE(chains); n++) {
+        for (int fuse = 0; fuse < 2; fuse++) {
+            struct af_stream *s = create(&chains[n], fuse);
+            int64_t t = run(s);
+            // Only count the chain as merged if it actually was.
+            bool fused = s->fused_frames > 0;
+            printf("%-12s %-8s %7.3f ms CPU, %6.2f MB memory traffic per "
+                   "second of audio\n", chains[n].name,
+                   fused ? "fused" : "separate", t / 1000.0 / SECONDS,
+                   traffic(s, fused) * (double)RATE / 1e6);
+            af_destroy(s);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+// CPU time of mp_audio_convert() for 1 second of 6 channel audio, for some
+// common conversions (decoder output to AO formats).
+
+#include <stdio.h>
+
+#include "test/test_rnd.h"
+#include "audio/audio.h"
+#include "audio/convert.h"
+#include "audio/format.h"
+#include "common/common.h"
+#include "osdep/timer.h"
+#include "talloc.h"
+
+#define RATE 48000
+#define NCH 6
+#define RUNS 50
+
+static struct mp_audio *make_audio(void *ta_parent, int format)
+{
+    struct mp_audio *a = talloc_zero(ta_parent, struct mp_audio);
+    mp_audio_set_format(a, format);
+    mp_audio_set_num_channels(a, NCH);
+    a->rate = RATE;
+    a->samples = RATE;
+    for (int n = 0; n < a->num_planes; n++)
+        a->planes[n] = talloc_zero_size(a, RATE * a->sstride);
+    return a;
+}
+
+int main(void)
+{
+    mp_time_init();
+    static const int conv[][2] = {
+        {AF_FORMAT_FLOATP,  AF_FORMAT_FLOAT},
+        {AF_FORMAT_FLOATP,  AF_FORMAT_S16},
+        {AF_FORMAT_FLOAT,   AF_FORMAT_S16},
+        {AF_FORMAT_FLOAT,   AF_FORMAT_S32},
+        {AF_FORMAT_S16P,    AF_FORMAT_S16},
+        {AF_FORMAT_S16,     AF_FORMAT_FLOAT},
+        {AF_FORMAT_S32P,    AF_FORMAT_S24},
+    };
+    static const int reorder[NCH] = {0, 1, 4, 5, 2, 3};
+    for (int r = 0; r < 2; r++) {
+        for (int c = 0; c < MP_ARRAY_SIZE(conv); c++) {
+            void *ctx = talloc_new(NULL);
+            struct mp_audio *src = make_audio(ctx, conv[c][0]);
+            struct mp_audio *dst = make_audio(ctx, conv[c][1]);
+            // Silence is fine for integer input; float input is clipped.
+            if (af_fmt_is_float(src->format)) {
+                for (int p = 0; p < src->num_planes; p++) {
+                    for (int n = 0; n < RATE * NCH / src->num_planes; n++)
+                        ((float *)src->planes[p])[n] = test_rnd_float() * 1.1;
+                }
+            }
+            int64_t t = mp_time_us();
+            for (int n = 0; n < RUNS; n++)
+                mp_audio_convert_reorder(dst, 0, src, 0, RATE, r ? reorder : NULL);
+            t = mp_time_us() - t;
+            printf("%-7s -> %-6s%s: %7.3f ms CPU per second of audio\n",
+                   af_fmt_to_str(src->format), af_fmt_to_str(dst->format),
+                   r ? " (reordered)" : "", t / 1000.0 / RUNS);
+            talloc_free(ctx);
+        }
+    }
+    return 0;
+}
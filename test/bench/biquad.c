@@ -0,0 +1,44 @@
+// CPU time of the biquad bank for 1 second of audio, per number of bands and
+// channels.
+
+#include <stdio.h>
+
+#include "test/test_rnd.h"
+#include "audio/filter/biquad.h"
+#include "common/common.h"
+#include "osdep/timer.h"
+#include "talloc.h"
+
+#define RATE 48000
+#define RUNS 10
+
+int main(void)
+{
+    mp_time_init();
+    static const int stages[] = {1, 10, 40};
+    static const int channels[] = {1, 2, 6, 8};
+    for (int s = 0; s < MP_ARRAY_SIZE(stages); s++) {
+        for (int c = 0; c < MP_ARRAY_SIZE(channels); c++) {
+            int num_stages = stages[s], nch = channels[c];
+            struct af_biquad_bank *b =
+                af_biquad_bank_create(NULL, num_stages, nch);
+            struct af_biquad bq;
+            af_biquad_design(&bq, AF_BIQUAD_PEAK, 0.02, 1, 3);
+            for (int i = 0; i < num_stages; i++) {
+                for (int ch = 0; ch < nch; ch++)
+                    af_biquad_bank_set(b, i, ch, &bq);
+            }
+            float *data = talloc_array(b, float, RATE * nch);
+            for (int n = 0; n < RATE * nch; n++)
+                data[n] = test_rnd_float() * 0.1;
+            int64_t t = mp_time_us();
+            for (int n = 0; n < RUNS; n++)
+                af_biquad_bank_process(b, data, RATE);
+            t = mp_time_us() - t;
+            printf("%2d bands, %d channels: %8.3f ms CPU per second of audio\n",
+                   num_stages, nch, t / 1000.0 / RUNS);
+            talloc_free(b);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+// CPU time for 1 second of stereo audio filtered with 1 second long impulse
+// responses (like binaural room impulse responses), per block size, and for
+// direct convolution of a short impulse response for comparison.
+
+#include <stdio.h>
+
+#include "test/test_rnd.h"
+#include "audio/filter/convolver.h"
+#include "common/common.h"
+#include "osdep/timer.h"
+#include "talloc.h"
+
+#define RATE 48000
+
+static void fill(float *p, int len)
+{
+    for (int n = 0; n < len; n++)
+        p[n] = test_rnd_float();
+}
+
+int main(void)
+{
+    mp_time_init();
+    for (int bits = 6; bits <= 12; bits += 2) {
+        int block = 1 << bits;
+        void *ctx = talloc_new(NULL);
+        struct af_convolver *c = af_convolver_create(ctx, bits, 2, 2);
+        float *ir = talloc_array(ctx, float, RATE);
+        fill(ir, RATE);
+        for (int i = 0; i < 2; i++) {
+            for (int o = 0; o < 2; o++)
+                af_convolver_set_ir(c, i, o, ir, RATE, 0.01);
+        }
+        float *buf[2] = {talloc_zero_array(ctx, float, block),
+                         talloc_zero_array(ctx, float, block)};
+        int64_t t = mp_time_us();
+        for (int pos = 0; pos < RATE; pos += block)
+            af_convolver_process(c, buf, buf);
+        t = mp_time_us() - t;
+        printf("block %5d: %8.3f ms CPU per second of audio\n", block,
+               t / 1000.0);
+        talloc_free(ctx);
+    }
+
+    int ir_len = 128;
+    float ir[128], *x = talloc_zero_array(NULL, float, RATE + ir_len);
+    fill(ir, ir_len);
+    fill(x, RATE + ir_len);
+    volatile float sink = 0;
+    int64_t t = mp_time_us();
+    for (int ch = 0; ch < 4; ch++) {
+        for (int n = 0; n < RATE; n++) {
+            float sum = 0;
+            for (int k = 0; k < ir_len; k++)
+                sum += ir[k] * x[n + k];
+            sink += sum;
+        }
+    }
+    t = mp_time_us() - t;
+    printf("direct, %d taps: %8.3f ms CPU per second of audio\n", ir_len,
+           t / 1000.0);
+    talloc_free(x);
+    return 0;
+}
@@ -0,0 +1,125 @@
+// Time subtitle blending on 4K frames: ASS karaoke-like (many small glyphs)
+// and scaled PGS-like (one large RGBA bitmap) subtitles, onto yuv420p (blended
+// directly) and yuv444p. This uses the public draw_bmp API only, so it can be
+// built against older trees to compare with the swscale 4:4:4 round trip.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test/test_rnd.h"
+#include "common/common.h"
+#include "osdep/timer.h"
+#include "sub/draw_bmp.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "talloc.h"
+
+#define W 3840
+#define H 2160
+#define RUNS 20
+
+static struct mp_image *make_image(int imgfmt)
+{
+    struct mp_image *img = mp_image_alloc(imgfmt, W, H);
+    if (!img)
+        abort();
+    for (int p = 0; p < img->num_planes; p++) {
+        for (int y = 0; y < mp_image_plane_h(img, p); y++) {
+            for (int x = 0; x < mp_image_plane_w(img, p); x++)
+                img->planes[p][y * img->stride[p] + x] = test_rnd() & 0xFF;
+        }
+    }
+    return img;
+}
+
+// Like make_ass() in test/draw_bmp.c, but with more glyphs on a 4K frame.
+static struct sub_bitmaps *make_ass(void *ta)
+{
+    struct sub_bitmaps *sbs = talloc_zero(ta, struct sub_bitmaps);
+    sbs->format = SUBBITMAP_LIBASS;
+    sbs->num_parts = 80;
+    sbs->parts = talloc_zero_array(sbs, struct sub_bitmap, sbs->num_parts);
+    for (int i = 0; i < sbs->num_parts; i++) {
+        struct sub_bitmap *sb = &sbs->parts[i];
+        sb->w = sb->dw = 61;
+        sb->h = sb->dh = 97;
+        sb->stride = 64;
+        sb->x = 301 + (i % 40) * 81;
+        sb->y = H - 400 + (i / 40) * 151;
+        sb->libass.color = (i & 1) ? 0xFF000000 : 0x00FFFF40;
+        uint8_t *bitmap = talloc_zero_size(sbs, sb->stride * sb->h);
+        for (int y = 0; y < sb->h; y++) {
+            for (int x = 0; x < sb->w; x++) {
+                int dx = x - sb->w / 2, dy = y - sb->h / 2;
+                int d = dx * dx + dy * dy;
+                bitmap[y * sb->stride + x] = d < 600 ? 255 : d < 1200 ? 128 : 0;
+            }
+        }
+        sb->bitmap = bitmap;
+    }
+    return sbs;
+}
+
+// Same as make_rgba() in test/draw_bmp.c.
+static struct sub_bitmaps *make_rgba(void *ta)
+{
+    struct sub_bitmaps *sbs = talloc_zero(ta, struct sub_bitmaps);
+    sbs->format = SUBBITMAP_RGBA;
+    sbs->scaled = true;
+    sbs->num_parts = 1;
+    sbs->parts = talloc_zero_array(sbs, struct sub_bitmap, 1);
+    struct sub_bitmap *sb = &sbs->parts[0];
+    sb->w = 1400;
+    sb->h = 160;
+    sb->dw = sb->w * 2;
+    sb->dh = sb->h * 2;
+    sb->x = (W - sb->dw) / 2 + 1;
+    sb->y = H - sb->dh - 101;
+    sb->stride = sb->w * 4;
+    uint32_t *bitmap = talloc_zero_size(sbs, sb->stride * sb->h);
+    for (int y = 0; y < sb->h; y++) {
+        for (int x = 0; x < sb->w; x++) {
+            uint32_t a = (x / 7 + y / 5) % 3 ? 255 : 96;
+            if ((x / 40) % 4 == 3)
+                a = 0;
+            uint32_t c = (x * 255 / sb->w) * a / 255;
+            bitmap[y * sb->w + x] = (a << 24) | (c << 16) | (a / 2 << 8) | a;
+        }
+    }
+    sb->bitmap = bitmap;
+    return sbs;
+}
+
+// If changing is set, change_id is different on every frame, like during
+// karaoke effects, so that nothing is reused by change_id alone.
+static void bench(const char *name, struct sub_bitmaps *sbs, int imgfmt,
+                  bool changing)
+{
+    struct mp_image *img = make_image(imgfmt);
+    struct mp_draw_sub_cache *cache = NULL;
+    int64_t t = mp_time_us();
+    for (int n = 0; n < RUNS; n++) {
+        sbs->change_id = changing ? n + 1 : 1;
+        mp_draw_sub_bitmaps(&cache, img, sbs);
+    }
+    t = mp_time_us() - t;
+    printf("%-24s %-8s %8.3f ms/frame\n", name, mp_imgfmt_to_name(imgfmt),
+           t / 1000.0 / RUNS);
+    talloc_free(cache);
+    talloc_free(img);
+}
+
+int main(void)
+{
+    void *ta = talloc_new(NULL);
+    mp_time_init();
+    static const int fmts[] = {IMGFMT_420P, IMGFMT_444P};
+    for (int n = 0; n < MP_ARRAY_SIZE(fmts); n++) {
+        bench("ass karaoke 4K", make_ass(ta), fmts[n], false);
+        bench("ass karaoke 4K changing", make_ass(ta), fmts[n], true);
+        bench("pgs 4K", make_rgba(ta), fmts[n], false);
+    }
+    talloc_free(ta);
+    return 0;
+}
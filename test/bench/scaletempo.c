@@ -0,0 +1,133 @@
+// Time af_scaletempo with the direct and the FFT overlap search, and with
+// fft=auto, to check the threshold in init_fft(). "auto" should be about as
+// fast as the faster of the two others in every row.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test/test_rnd.h"
+#include "audio/audio.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "audio/filter/af.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "osdep/timer.h"
+#include "talloc.h"
+
+extern const struct af_info af_info_scaletempo;
+
+#define RATE 48000
+#define SECONDS 10
+
+// Same as create() in test/scaletempo.c, except for the channel layout.
+static struct af_instance *create(char **args, int format, const char *layout,
+                                  double speed)
+{
+    const struct af_info *info = &af_info_scaletempo;
+    struct af_instance *af = talloc_zero(NULL, struct af_instance);
+    *af = (struct af_instance) {
+        .info = info,
+        .data = talloc_zero(af, struct mp_audio),
+        .log = mp_null_log,
+        .out_pool = mp_audio_pool_create(af),
+    };
+    struct m_obj_desc desc = {
+        .name = info->name,
+        .priv_size = info->priv_size,
+        .priv_defaults = info->priv_defaults,
+        .options = info->options,
+        .p = info,
+    };
+    struct m_config *config = m_config_from_obj_desc(af, mp_null_log, &desc);
+    if (m_config_set_obj_params(config, args) < 0)
+        abort();
+    af->priv = config->optstruct;
+    if (info->open(af) != AF_OK)
+        abort();
+
+    struct mp_audio in = {0};
+    struct mp_chmap chmap;
+    if (!mp_chmap_from_str(&chmap, bstr0(layout)))
+        abort();
+    mp_audio_set_format(&in, format);
+    mp_audio_set_channels(&in, &chmap);
+    in.rate = RATE;
+    if (af->control(af, AF_CONTROL_REINIT, &in) != AF_OK ||
+        af->control(af, AF_CONTROL_SET_PLAYBACK_SPEED, &speed) != AF_OK)
+        abort();
+    return af;
+}
+
+static struct mp_audio *make_frame(struct af_instance *af, int64_t pos, int len)
+{
+    struct mp_audio *a = talloc_zero(NULL, struct mp_audio);
+    mp_audio_copy_config(a, af->data);
+    mp_audio_realloc(a, len);
+    a->samples = len;
+    for (int n = 0; n < len; n++) {
+        double t = (pos + n) / (double)RATE;
+        for (int c = 0; c < a->nch; c++) {
+            double v = 0.3 * sin(2 * M_PI * (220 + 110 * c) * t) +
+                       0.2 * sin(2 * M_PI * 3.3 * t) * sin(2 * M_PI * 1250 * t) +
+                       0.1 * test_rnd_float();
+            if (a->format == AF_FORMAT_S16) {
+                ((int16_t *)a->planes[0])[n * a->nch + c] = v * 32767;
+            } else {
+                ((float *)a->planes[0])[n * a->nch + c] = v;
+            }
+        }
+    }
+    return a;
+}
+
+// Run SECONDS of audio through the filter, and return the time spent in it.
+static int64_t run(struct af_instance *af)
+{
+    test_rnd_seed(1);
+    int64_t time = 0;
+    int len = RATE / 10;
+    for (int64_t pos = 0; pos < RATE * SECONDS; pos += len) {
+        struct mp_audio *in = make_frame(af, pos, len);
+        int64_t t = mp_time_us();
+        if (af->filter_frame(af, in) < 0)
+            abort();
+        time += mp_time_us() - t;
+        for (int n = 0; n < af->num_out_queued; n++)
+            talloc_free(af->out_queued[n]);
+        af->num_out_queued = 0;
+    }
+    return time;
+}
+
+static void bench(const char *name, char **args, int format, const char *layout)
+{
+    const double speeds[] = {1.25, 1.5, 2.0, 3.0};
+    printf("%-12s %-7s", name, layout);
+    for (int n = 0; n < MP_ARRAY_SIZE(speeds); n++) {
+        struct af_instance *af = create(args, format, layout, speeds[n]);
+        int64_t t = run(af);
+        if (af->uninit)
+            af->uninit(af);
+        talloc_free(af);
+        printf("  %.2fx: %7.3f", speeds[n], t / 1000.0 / SECONDS);
+    }
+    printf("  ms per second of audio\n");
+}
+
+int main(void)
+{
+    mp_time_init();
+    static const char *const layouts[] = {"stereo", "5.1", "7.1"};
+    for (int n = 0; n < MP_ARRAY_SIZE(layouts); n++) {
+        const char *l = layouts[n];
+        bench("s16", (char *[]){NULL}, AF_FORMAT_S16, l);
+        bench("float", (char *[]){"fft", "no", NULL}, AF_FORMAT_FLOAT, l);
+        bench("float fft", (char *[]){"fft", "yes", NULL}, AF_FORMAT_FLOAT, l);
+        bench("float auto", (char *[]){"fft", "auto", NULL}, AF_FORMAT_FLOAT, l);
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include <complex.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include "audio/filter/biquad.h"
+#include "common/common.h"
+#include "talloc.h"
+
+#define NCH 3
+#define STAGES 12
+
+// |H| at freq (relative to the sample rate).
+static double response(const struct af_biquad *c, double freq)
+{
+    double complex z = cexp(-I * 2 * M_PI * freq);
+    return cabs((c->b0 + c->b1 * z + c->b2 * z * z) /
+                (1 + c->a1 * z + c->a2 * z * z));
+}
+
+static void test_design(void **state)
+{
+    struct af_biquad c;
+    double db = pow(10, 6 / 20.0);
+
+    af_biquad_design(&c, AF_BIQUAD_PEAK, 0.1, 1.4, 6);
+    assert_true(fabs(response(&c, 0.1) - db) < 1e-6);
+    assert_true(fabs(response(&c, 0) - 1) < 1e-6);
+
+    af_biquad_design(&c, AF_BIQUAD_LOWSHELF, 0.01, M_SQRT1_2, 6);
+    assert_true(fabs(response(&c, 0) - db) < 1e-6);
+    assert_true(fabs(response(&c, 0.5) - 1) < 1e-6);
+
+    af_biquad_design(&c, AF_BIQUAD_HIGHSHELF, 0.2, M_SQRT1_2, 6);
+    assert_true(fabs(response(&c, 0) - 1) < 1e-6);
+    assert_true(fabs(response(&c, 0.5) - db) < 1e-6);
+
+    af_biquad_design(&c, AF_BIQUAD_LOWPASS, 0.1, M_SQRT1_2, 0);
+    assert_true(fabs(response(&c, 0) - 1) < 1e-6);
+    assert_true(fabs(response(&c, 0.1) - M_SQRT1_2) < 1e-6);
+    assert_true(response(&c, 0.5) < 1e-6);
+
+    af_biquad_design(&c, AF_BIQUAD_HIGHPASS, 0.1, M_SQRT1_2, 0);
+    assert_true(response(&c, 0) < 1e-6);
+    assert_true(fabs(response(&c, 0.5) - 1) < 1e-6);
+
+    af_biquad_design(&c, AF_BIQUAD_BANDPASS, 0.1, 2, 0);
+    assert_true(fabs(response(&c, 0.1) - 1) < 1e-6);
+
+    af_biquad_design(&c, AF_BIQUAD_NOTCH, 0.1, 2, 0);
+    assert_true(response(&c, 0.1) < 1e-6);
+}
+
+// The pipelined bank must produce the same output as running the stages of
+// each channel one after another, delayed by af_biquad_bank_delay().
+static void test_cascade(void **state)
+{
+    int len = 4000;
+    void *ctx = talloc_new(NULL);
+    struct af_biquad c[STAGES][NCH];
+    struct af_biquad_bank *b = af_biquad_bank_create(ctx, STAGES, NCH);
+    for (int s = 0; s < STAGES; s++) {
+        for (int ch = 0; ch < NCH; ch++) {
+            af_biquad_design(&c[s][ch], (s + ch) % (AF_BIQUAD_NOTCH + 1),
+                             0.001 + (s * NCH + ch) * 0.01, 0.5 + s * 0.2,
+                             ch * 3 - 3);
+            af_biquad_bank_set(b, s, ch, &c[s][ch]);
+        }
+    }
+    int delay = af_biquad_bank_delay(b);
+    assert_int_equal(delay, STAGES - 1);
+
+    float *data = talloc_array(ctx, float, len * NCH);
+    double *ref = talloc_array(ctx, double, len * NCH);
+    for (int n = 0; n < len * NCH; n++)
+        ref[n] = data[n] = test_rnd_float() * 0.1;
+
+    for (int ch = 0; ch < NCH; ch++) {
+        for (int s = 0; s < STAGES; s++) {
+            double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+            struct af_biquad *f = &c[s][ch];
+            for (int n = 0; n < len; n++) {
+                double x = ref[n * NCH + ch];
+                double y = f->b0 * x + f->b1 * x1 + f->b2 * x2
+                         - f->a1 * y1 - f->a2 * y2;
+                x2 = x1; x1 = x;
+                y2 = y1; y1 = y;
+                ref[n * NCH + ch] = y;
+            }
+        }
+    }
+
+    // Process in uneven pieces to check that the state is carried over.
+    for (int pos = 0; pos < len;) {
+        int n = MPMIN(len - pos, 1 + pos % 333);
+        af_biquad_bank_process(b, data + pos * NCH, n);
+        pos += n;
+    }
+
+    for (int n = 0; n < delay * NCH; n++)
+        assert_true(data[n] == 0);
+    for (int n = 0; n < (len - delay) * NCH; n++)
+        assert_true(fabs(data[n + delay * NCH] - ref[n]) < 1e-5);
+
+    // After a reset, the old input must be gone.
+    af_biquad_bank_reset(b);
+    memset(data, 0, len * NCH * sizeof(float));
+    af_biquad_bank_process(b, data, len);
+    for (int n = 0; n < len * NCH; n++)
+        assert_true(data[n] == 0);
+
+    talloc_free(ctx);
+}
+
+// A decaying low frequency filter must reach exactly 0, instead of
+// producing denormal numbers for a long time. This must also work if the
+// data is passed in small blocks, like with small AO periods.
+static void test_denormals(void **state)
+{
+    int len = 48000 * 20;
+    struct af_biquad c;
+    af_biquad_design(&c, AF_BIQUAD_LOWSHELF, 0.0005, M_SQRT1_2, 6);
+    struct af_biquad_bank *b = af_biquad_bank_create(NULL, 1, 1);
+    af_biquad_bank_set(b, 0, 0, &c);
+    float *data = talloc_zero_array(b, float, len);
+    data[0] = 1;
+    for (int pos = 0; pos < len; pos += 128)
+        af_biquad_bank_process(b, data + pos, MPMIN(128, len - pos));
+    for (int n = 0; n < len; n++)
+        assert_true(data[n] == 0 || fabsf(data[n]) >= FLT_MIN);
+    assert_true(data[len - 1] == 0);
+    talloc_free(b);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_design),
+        cmocka_unit_test(test_cascade),
+        cmocka_unit_test(test_denormals),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,104 @@
+#include <math.h>
+#include <string.h>
+
+#include "test_helpers.h"
+#include "audio/filter/convolver.h"
+#include "common/common.h"
+#include "talloc.h"
+
+#define NUM_IN 3
+#define NUM_OUT 2
+
+static void fill(float *p, int len)
+{
+    for (int n = 0; n < len; n++)
+        p[n] = test_rnd_float();
+}
+
+// ir[i][o] (or NULL), direct time domain convolution.
+static void convolve_ref(float *in[NUM_IN], int len, float *ir[NUM_IN][NUM_OUT],
+                         int ir_len[NUM_IN][NUM_OUT], float *out[NUM_OUT])
+{
+    for (int o = 0; o < NUM_OUT; o++) {
+        for (int t = 0; t < len; t++) {
+            double sum = 0;
+            for (int i = 0; i < NUM_IN; i++) {
+                if (!ir[i][o])
+                    continue;
+                for (int k = 0; k < ir_len[i][o] && k <= t; k++)
+                    sum += ir[i][o][k] * in[i][t - k];
+            }
+            out[o][t] = sum;
+        }
+    }
+}
+
+static void test_equal(void **state)
+{
+    static const int ir_lens[] = {1, 17, 64, 200, 1000};
+    for (int bits = 4; bits <= 8; bits += 2) {
+        int block = 1 << bits;
+        int len = block * 20;
+        void *ctx = talloc_new(NULL);
+        float *in[NUM_IN], *out[NUM_OUT], *ref[NUM_OUT];
+        float *ir[NUM_IN][NUM_OUT] = {{0}};
+        int ir_len[NUM_IN][NUM_OUT] = {{0}};
+
+        struct af_convolver *c = af_convolver_create(ctx, bits, NUM_IN, NUM_OUT);
+        assert_non_null(c);
+        assert_int_equal(af_convolver_block_size(c), block);
+
+        for (int i = 0; i < NUM_IN; i++) {
+            in[i] = talloc_array(ctx, float, len);
+            fill(in[i], len);
+            for (int o = 0; o < NUM_OUT; o++) {
+                // Leave one pair unset.
+                if (i == 1 && o == 0)
+                    continue;
+                ir_len[i][o] = ir_lens[(i * NUM_OUT + o) % MP_ARRAY_SIZE(ir_lens)];
+                ir[i][o] = talloc_array(ctx, float, ir_len[i][o]);
+                fill(ir[i][o], ir_len[i][o]);
+                af_convolver_set_ir(c, i, o, ir[i][o], ir_len[i][o], 1);
+            }
+        }
+        for (int o = 0; o < NUM_OUT; o++) {
+            out[o] = talloc_array(ctx, float, len);
+            ref[o] = talloc_array(ctx, float, len);
+        }
+
+        for (int pos = 0; pos < len; pos += block) {
+            float *bin[NUM_IN], *bout[NUM_OUT];
+            for (int i = 0; i < NUM_IN; i++)
+                bin[i] = in[i] + pos;
+            for (int o = 0; o < NUM_OUT; o++)
+                bout[o] = out[o] + pos;
+            af_convolver_process(c, bin, bout);
+        }
+        convolve_ref(in, len, ir, ir_len, ref);
+
+        for (int o = 0; o < NUM_OUT; o++) {
+            for (int t = 0; t < len; t++)
+                assert_true(fabs(out[o][t] - ref[o][t]) < 1e-3);
+        }
+
+        // After a reset, the old input must be gone.
+        af_convolver_reset(c);
+        float *zero[NUM_IN];
+        for (int i = 0; i < NUM_IN; i++)
+            zero[i] = talloc_zero_array(ctx, float, block);
+        af_convolver_process(c, zero, out);
+        for (int o = 0; o < NUM_OUT; o++) {
+            for (int t = 0; t < block; t++)
+                assert_true(fabs(out[o][t]) < 1e-6);
+        }
+
+        talloc_free(ctx);
+    }
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_equal),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,51 @@
+#include <string.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "common/global.h"
+#include "common/msg.h"
+#include "demux/demux.h"
+#include "options/options.h"
+#include "osdep/timer.h"
+#include "stream/stream.h"
+#include "talloc.h"
+
+static const char edl[] = "# mpv EDL v0\nfile.mkv\n";
+
+static struct demuxer *open_file(struct mpv_global *global, const char *name)
+{
+    stream_t *s = open_memory_stream((void *)edl, strlen(edl));
+    s->url = talloc_strdup(s, name);
+    struct demuxer *demuxer = demux_open(s, NULL, global);
+    assert_non_null(demuxer);
+    assert_string_equal(demuxer->desc->name, "edl");
+    return demuxer;
+}
+
+// With --demuxer-fast-open, the demuxer that opened a file must be tried
+// first for the next file with the same extension and signature.
+static void test_probe_cache_hit(void **state)
+{
+    mp_time_init();
+    struct mpv_global *global = talloc_zero(NULL, struct mpv_global);
+    global->log = mp_null_log;
+    global->opts = talloc_zero(global, struct MPOpts);
+    global->opts->demuxer_fast_open = 1;
+
+    struct demuxer *a = open_file(global, "a.edl");
+    assert_false(a->probe_cache_hit);
+    free_demuxer_and_stream(a);
+
+    struct demuxer *b = open_file(global, "b.EDL");
+    assert_true(b->probe_cache_hit);
+    free_demuxer_and_stream(b);
+
+    talloc_free(global);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_probe_cache_hit),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
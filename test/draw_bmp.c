@@ -0,0 +1,186 @@
+#include <string.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "sub/draw_bmp.h"
+#include "video/img_format.h"
+#include "video/mp_image.h"
+#include "talloc.h"
+
+#define W 640
+#define H 360
+
+// Make a 4:2:0 image with random contents, and the same image in 4:4:4
+// (chroma upsampled with point sampling).
+static void make_images(struct mp_image **out_420, struct mp_image **out_444)
+{
+    struct mp_image *a = mp_image_alloc(IMGFMT_420P, W, H);
+    struct mp_image *b = mp_image_alloc(IMGFMT_444P, W, H);
+    assert_non_null(a);
+    assert_non_null(b);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++)
+            a->planes[0][y * a->stride[0] + x] = test_rnd() & 0xFF;
+        memcpy(b->planes[0] + y * b->stride[0], a->planes[0] + y * a->stride[0], W);
+    }
+    for (int p = 1; p < 3; p++) {
+        for (int y = 0; y < H / 2; y++) {
+            for (int x = 0; x < W / 2; x++) {
+                uint8_t v = test_rnd() & 0xFF;
+                a->planes[p][y * a->stride[p] + x] = v;
+                for (int n = 0; n < 4; n++)
+                    b->planes[p][(y * 2 + n / 2) * b->stride[p] + x * 2 + n % 2] = v;
+            }
+        }
+    }
+    *out_420 = a;
+    *out_444 = b;
+}
+
+// Something like a 2-line karaoke ASS event: many small glyph bitmaps with
+// soft edges, each with its own color.
+static struct sub_bitmaps *make_ass(void *ta)
+{
+    struct sub_bitmaps *sbs = talloc_zero(ta, struct sub_bitmaps);
+    sbs->format = SUBBITMAP_LIBASS;
+    sbs->num_parts = 16;
+    sbs->parts = talloc_zero_array(sbs, struct sub_bitmap, sbs->num_parts);
+    for (int i = 0; i < sbs->num_parts; i++) {
+        struct sub_bitmap *sb = &sbs->parts[i];
+        sb->w = sb->dw = 61;
+        sb->h = sb->dh = 97;
+        sb->stride = 64;
+        sb->x = 21 + (i % 8) * 71;
+        sb->y = H - 260 + (i / 8) * 131;
+        sb->libass.color = (i & 1) ? 0xFF000000 : 0x00FFFF40;
+        uint8_t *bitmap = talloc_zero_size(sbs, sb->stride * sb->h);
+        for (int y = 0; y < sb->h; y++) {
+            for (int x = 0; x < sb->w; x++) {
+                int dx = x - sb->w / 2, dy = y - sb->h / 2;
+                int d = dx * dx + dy * dy;
+                bitmap[y * sb->stride + x] = d < 600 ? 255 : d < 1200 ? 128 : 0;
+            }
+        }
+        sb->bitmap = bitmap;
+    }
+    return sbs;
+}
+
+// Something like a PGS subtitle: one large premultiplied RGBA bitmap, scaled
+// up 2x.
+static struct sub_bitmaps *make_rgba(void *ta)
+{
+    struct sub_bitmaps *sbs = talloc_zero(ta, struct sub_bitmaps);
+    sbs->format = SUBBITMAP_RGBA;
+    sbs->scaled = true;
+    sbs->num_parts = 1;
+    sbs->parts = talloc_zero_array(sbs, struct sub_bitmap, 1);
+    struct sub_bitmap *sb = &sbs->parts[0];
+    sb->w = 240;
+    sb->h = 60;
+    sb->dw = sb->w * 2;
+    sb->dh = sb->h * 2;
+    sb->x = (W - sb->dw) / 2 + 1;
+    sb->y = H - sb->dh - 101;
+    sb->stride = sb->w * 4;
+    uint32_t *bitmap = talloc_zero_size(sbs, sb->stride * sb->h);
+    for (int y = 0; y < sb->h; y++) {
+        for (int x = 0; x < sb->w; x++) {
+            uint32_t a = (x / 7 + y / 5) % 3 ? 255 : 96;
+            if ((x / 40) % 4 == 3)
+                a = 0;
+            uint32_t c = (x * 255 / sb->w) * a / 255;
+            bitmap[y * sb->w + x] = (a << 24) | (c << 16) | (a / 2 << 8) | a;
+        }
+    }
+    sb->bitmap = bitmap;
+    return sbs;
+}
+
+// Blending on 4:2:0 directly must give the same luma as blending on 4:4:4, and
+// about the average of the 4:4:4 chroma.
+static void check_blend(struct sub_bitmaps *sbs)
+{
+    struct mp_image *a, *b;
+    make_images(&a, &b);
+    mp_draw_sub_bitmaps(NULL, a, sbs);
+    mp_draw_sub_bitmaps(NULL, b, sbs);
+    for (int y = 0; y < H; y++) {
+        assert_memory_equal(a->planes[0] + y * a->stride[0],
+                            b->planes[0] + y * b->stride[0], W);
+    }
+    for (int p = 1; p < 3; p++) {
+        for (int y = 0; y < H / 2; y++) {
+            for (int x = 0; x < W / 2; x++) {
+                int sum = 0;
+                for (int n = 0; n < 4; n++)
+                    sum += b->planes[p][(y * 2 + n / 2) * b->stride[p] + x * 2 + n % 2];
+                int v = a->planes[p][y * a->stride[p] + x];
+                int ref = (sum + 2) / 4;
+                assert_in_range(v, MPMAX(ref - 2, 0), ref + 2);
+            }
+        }
+    }
+    talloc_free(a);
+    talloc_free(b);
+}
+
+static void test_blend_420_ass(void **state)
+{
+    void *ta = talloc_new(NULL);
+    check_blend(make_ass(ta));
+    talloc_free(ta);
+}
+
+static void test_blend_420_rgba(void **state)
+{
+    void *ta = talloc_new(NULL);
+    check_blend(make_rgba(ta));
+    talloc_free(ta);
+}
+
+// libass can free a bitmap and allocate a different one at the same address.
+// A cached region must be composited again in this case.
+static void test_ass_cache_same_pointer(void **state)
+{
+    void *ta = talloc_new(NULL);
+    struct sub_bitmaps *sbs = make_ass(ta);
+    struct mp_draw_sub_cache *cache = NULL;
+    struct mp_image *a, *b;
+    make_images(&a, &b);
+    struct mp_image *cached = mp_image_new_copy(a);
+    struct mp_image *ref = mp_image_new_copy(a);
+
+    sbs->change_id = 1;
+    mp_draw_sub_bitmaps(&cache, a, sbs);
+
+    struct sub_bitmap *sb = &sbs->parts[0];
+    memset((uint8_t *)sb->bitmap + sb->h / 2 * sb->stride, 0, sb->stride);
+    sbs->change_id = 2;
+    mp_draw_sub_bitmaps(&cache, cached, sbs);
+    mp_draw_sub_bitmaps(NULL, ref, sbs);
+
+    for (int p = 0; p < 3; p++) {
+        for (int y = 0; y < mp_image_plane_h(ref, p); y++) {
+            assert_memory_equal(cached->planes[p] + y * cached->stride[p],
+                                ref->planes[p] + y * ref->stride[p],
+                                mp_image_plane_w(ref, p));
+        }
+    }
+
+    talloc_free(cache);
+    talloc_free(cached);
+    talloc_free(ref);
+    talloc_free(a);
+    talloc_free(b);
+    talloc_free(ta);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_blend_420_ass),
+        cmocka_unit_test(test_blend_420_rgba),
+        cmocka_unit_test(test_ass_cache_same_pointer),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
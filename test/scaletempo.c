@@ -0,0 +1,138 @@
+#include <string.h>
+
+#include "test_helpers.h"
+#include "audio/audio.h"
+#include "audio/chmap.h"
+#include "audio/format.h"
+#include "audio/filter/af.h"
+#include "common/common.h"
+#include "common/msg.h"
+#include "options/m_config.h"
+#include "options/m_option.h"
+#include "talloc.h"
+
+extern const struct af_info af_info_scaletempo;
+
+#define RATE 48000
+#define SECONDS 2
+
+// Like af_create(), without a filter chain.
+static struct af_instance *create(char **args, int format, double speed)
+{
+    const struct af_info *info = &af_info_scaletempo;
+    struct af_instance *af = talloc_zero(NULL, struct af_instance);
+    *af = (struct af_instance) {
+        .info = info,
+        .data = talloc_zero(af, struct mp_audio),
+        .log = mp_null_log,
+        .out_pool = mp_audio_pool_create(af),
+    };
+    struct m_obj_desc desc = {
+        .name = info->name,
+        .priv_size = info->priv_size,
+        .priv_defaults = info->priv_defaults,
+        .options = info->options,
+        .p = info,
+    };
+    struct m_config *config = m_config_from_obj_desc(af, mp_null_log, &desc);
+    assert_true(m_config_set_obj_params(config, args) >= 0);
+    af->priv = config->optstruct;
+    assert_int_equal(info->open(af), AF_OK);
+
+    struct mp_audio in = {0};
+    struct mp_chmap chmap;
+    assert_true(mp_chmap_from_str(&chmap, bstr0("7.1")));
+    mp_audio_set_format(&in, format);
+    mp_audio_set_channels(&in, &chmap);
+    in.rate = RATE;
+    assert_int_equal(af->control(af, AF_CONTROL_REINIT, &in), AF_OK);
+    assert_int_equal(af->control(af, AF_CONTROL_SET_PLAYBACK_SPEED, &speed),
+                     AF_OK);
+    return af;
+}
+
+// Some tones plus noise, so that the overlap search has something to find.
+static struct mp_audio *make_frame(struct af_instance *af, int64_t pos, int len)
+{
+    struct mp_audio *a = talloc_zero(NULL, struct mp_audio);
+    mp_audio_copy_config(a, af->data);
+    mp_audio_realloc(a, len);
+    a->samples = len;
+    for (int n = 0; n < len; n++) {
+        double t = (pos + n) / (double)RATE;
+        for (int c = 0; c < a->nch; c++) {
+            double v = 0.3 * sin(2 * M_PI * (220 + 110 * c) * t) +
+                       0.2 * sin(2 * M_PI * 3.3 * t) * sin(2 * M_PI * 1250 * t) +
+                       0.1 * test_rnd_float();
+            if (a->format == AF_FORMAT_S16) {
+                ((int16_t *)a->planes[0])[n * a->nch + c] = v * 32767;
+            } else {
+                ((float *)a->planes[0])[n * a->nch + c] = v;
+            }
+        }
+    }
+    return a;
+}
+
+// Run SECONDS of audio through the filter, and append the output (which must
+// be float) to out.
+static void run(struct af_instance *af, float **out, int *out_len)
+{
+    test_rnd_seed(1);
+    int len = RATE / 10;
+    for (int64_t pos = 0; pos < RATE * SECONDS; pos += len) {
+        struct mp_audio *in = make_frame(af, pos, len);
+        assert_true(af->filter_frame(af, in) >= 0);
+        for (int n = 0; n < af->num_out_queued; n++) {
+            struct mp_audio *o = af->out_queued[n];
+            assert_int_equal(o->format, AF_FORMAT_FLOAT);
+            int num = o->samples * o->nch;
+            MP_TARRAY_GROW(NULL, *out, *out_len + num);
+            memcpy(*out + *out_len, o->planes[0], num * sizeof(float));
+            *out_len += num;
+            talloc_free(o);
+        }
+        af->num_out_queued = 0;
+    }
+}
+
+static void destroy(struct af_instance *af)
+{
+    if (af->uninit)
+        af->uninit(af);
+    talloc_free(af);
+}
+
+// The FFT correlation must find (nearly always) the same offsets as the
+// direct search.
+static void test_fft_equal(void **state)
+{
+    float *a = NULL, *b = NULL;
+    int a_len = 0, b_len = 0;
+
+    struct af_instance *af = create((char *[]){"fft", "no", NULL},
+                                    AF_FORMAT_FLOAT, 1.5);
+    run(af, &a, &a_len);
+    destroy(af);
+
+    af = create((char *[]){"fft", "yes", NULL}, AF_FORMAT_FLOAT, 1.5);
+    run(af, &b, &b_len);
+    destroy(af);
+
+    assert_true(a_len > 0);
+    assert_int_equal(a_len, b_len);
+    int diff = 0;
+    for (int n = 0; n < a_len; n++)
+        diff += fabs(a[n] - b[n]) > 1e-3;
+    assert_true(diff < a_len / 20);
+
+    talloc_free(a);
+    talloc_free(b);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_fft_equal),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
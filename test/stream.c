@@ -0,0 +1,62 @@
+#include <string.h>
+
+#include "test_helpers.h"
+#include "common/common.h"
+#include "demux/ebml.h"
+#include "stream/stream.h"
+#include "talloc.h"
+
+static void put_block(bstr *buf, int len, int fill)
+{
+    uint8_t hdr[] = {
+        MATROSKA_ID_SIMPLEBLOCK,
+        0x10 | (len >> 24), len >> 16, len >> 8, len,
+    };
+    bstr_xappend(NULL, buf, (bstr){hdr, sizeof(hdr)});
+    for (int n = 0; n < len; n++)
+        bstr_xappend(NULL, buf, (bstr){&(uint8_t){fill + n}, 1});
+}
+
+static bool in_buffer(stream_t *s, bstr data)
+{
+    return data.start >= s->buffer &&
+           data.start < s->buffer + STREAM_MAX_BUFFER_SIZE;
+}
+
+// Read SimpleBlocks the way demux_mkv does: the element header is read with
+// normal (buffered) reads, the block data with stream_read_borrow(). Blocks
+// that are entirely buffered are returned from the buffer, and all others
+// from the stream's memory, without copying.
+static void test_borrow_mkv_blocks(void **state)
+{
+    static const int lens[] = {1000, 1500 * 1000, 300, 2 * 1000 * 1000};
+    static const bool expect_buffered[] = {true, false, true, false};
+    bstr file = {0};
+    for (int n = 0; n < MP_ARRAY_SIZE(lens); n++)
+        put_block(&file, lens[n], n);
+    stream_t *s = open_memory_stream(file.start, file.len);
+
+    int64_t pos = 0;
+    for (int n = 0; n < MP_ARRAY_SIZE(lens); n++) {
+        assert_int_equal(ebml_read_id(s), MATROSKA_ID_SIMPLEBLOCK);
+        assert_int_equal(ebml_read_length(s), lens[n]);
+        pos += 5;
+        bstr data = stream_read_borrow(s, lens[n]);
+        assert_int_equal(data.len, lens[n]);
+        assert_true(in_buffer(s, data) == expect_buffered[n]);
+        assert_memory_equal(data.start, file.start + pos, lens[n]);
+        pos += lens[n];
+        assert_int_equal(stream_tell(s), pos);
+    }
+    assert_true(stream_read_borrow(s, 1).len == 0);
+
+    free_stream(s);
+    talloc_free(file.start);
+}
+
+int main(void) {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_borrow_mkv_blocks),
+    };
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -7,9 +7,12 @@
 #include <cmocka.h>
 
 #include <stdio.h>
+#include <stdint.h>
 #include <math.h>
 #include <float.h>
 
+#include "test_rnd.h"
+
 #define assert_double_equal(a, b) assert_true(fabs(a - b) <= DBL_EPSILON)
 
 #endif
@@ -0,0 +1,34 @@
+#ifndef MP_TEST_RND_H
+#define MP_TEST_RND_H
+
+#include <stdint.h>
+
+// Pseudo-random numbers for test data. Always the same sequence after
+// test_rnd_seed(), so that results are reproducible. This doesn't need
+// cmocka, so the programs in test/bench/ can use it too.
+static inline uint32_t *test_rnd_state(void)
+{
+    static uint32_t state = 1;
+    return &state;
+}
+
+static inline void test_rnd_seed(uint32_t seed)
+{
+    *test_rnd_state() = seed;
+}
+
+// Returns a number in [0, 0x7FFF].
+static inline unsigned test_rnd(void)
+{
+    uint32_t *state = test_rnd_state();
+    *state = *state * 1103515245 + 12345;
+    return (*state >> 16) & 0x7FFF;
+}
+
+// Returns a number in [-1, 1).
+static inline float test_rnd_float(void)
+{
+    return test_rnd() / 16384.0f - 1.0f;
+}
+
+#endif
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <pthread.h>
 
 #include "common/msg.h"
 
@@ -55,8 +56,72 @@ const vd_functions_t * const mpcodecs_vd_drivers[] = {
     NULL
 };
 
+// State for decoding in a separate thread (see video_start_decode_thread()).
+struct dec_queue {
+    pthread_t thread;
+    // Protects all fields below.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // Held by the decoder thread while it's inside the decoder. Everything
+    // else that touches the decoder must acquire it too.
+    pthread_mutex_t dec_lock;
+
+    void (*wakeup_cb)(void *ctx);
+    void *wakeup_cb_ctx;
+
+    int max_frames;
+
+    // Input: a single packet slot (the demuxer does all the buffering).
+    bool has_packet;
+    struct demux_packet *packet;
+    int drop_frame;
+    bool draining;      // NULL packet was queued; flush decoder
+
+    // Output
+    struct mp_image **frames;
+    int num_frames;
+    bool eof;           // decoder fully drained
+
+    int dropped;        // packets decoded with drop_frame set, without output
+    // Copy of dec_video.has_broken_packet_pts, which only the decoder thread
+    // may access.
+    int has_broken_packet_pts;
+    bool busy;          // decoder thread is inside video_decode()
+    bool terminate;
+};
+
+static int vd_control(struct dec_video *d_video, int cmd, void *arg)
+{
+    const struct vd_functions *vd = d_video->vd_driver;
+    if (vd)
+        return vd->control(d_video, cmd, arg);
+    return CONTROL_UNKNOWN;
+}
+
+// Must be called with q->lock held. Waits until the decoder thread is idle.
+static void queue_flush(struct dec_queue *q)
+{
+    while (q->busy)
+        pthread_cond_wait(&q->wakeup, &q->lock);
+    talloc_free(q->packet);
+    q->packet = NULL;
+    q->has_packet = false;
+    q->draining = false;
+    for (int n = 0; n < q->num_frames; n++)
+        talloc_free(q->frames[n]);
+    q->num_frames = 0;
+    q->eof = false;
+    q->dropped = 0;
+}
+
 void video_reset_decoding(struct dec_video *d_video)
 {
+    struct dec_queue *q = d_video->queue;
+    if (q) {
+        pthread_mutex_lock(&q->lock);
+        queue_flush(q);
+        pthread_mutex_unlock(&q->lock);
+    }
     video_vd_control(d_video, VDCTRL_RESET, NULL);
     if (d_video->vfilter && d_video->vfilter->initialized == 1)
         vf_seek_reset(d_video->vfilter);
@@ -73,10 +138,13 @@ void video_reset_decoding(struct dec_video *d_video)
 
 int video_vd_control(struct dec_video *d_video, int cmd, void *arg)
 {
-    const struct vd_functions *vd = d_video->vd_driver;
-    if (vd)
-        return vd->control(d_video, cmd, arg);
-    return CONTROL_UNKNOWN;
+    struct dec_queue *q = d_video->queue;
+    if (q)
+        pthread_mutex_lock(&q->dec_lock);
+    int r = vd_control(d_video, cmd, arg);
+    if (q)
+        pthread_mutex_unlock(&q->dec_lock);
+    return r;
 }
 
 int video_set_colors(struct dec_video *d_video, const char *item, int value)
@@ -114,8 +182,27 @@ int video_get_colors(struct dec_video *d_video, const char *item, int *value)
     return 0;
 }
 
+static void stop_decode_thread(struct dec_video *d_video)
+{
+    struct dec_queue *q = d_video->queue;
+    if (!q)
+        return;
+    pthread_mutex_lock(&q->lock);
+    q->terminate = true;
+    pthread_cond_broadcast(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+    pthread_join(q->thread, NULL);
+    queue_flush(q);
+    pthread_cond_destroy(&q->wakeup);
+    pthread_mutex_destroy(&q->lock);
+    pthread_mutex_destroy(&q->dec_lock);
+    talloc_free(q);
+    d_video->queue = NULL;
+}
+
 void video_uninit(struct dec_video *d_video)
 {
+    stop_decode_thread(d_video);
     mp_image_unrefp(&d_video->waiting_decoded_mpi);
     mp_image_unrefp(&d_video->cover_art_mpi);
     if (d_video->vd_driver) {
@@ -214,7 +301,7 @@ static void add_pts_to_sort(struct dec_video *d_video, double pts)
 {
     if (pts != MP_NOPTS_VALUE) {
         int delay = -1;
-        video_vd_control(d_video, VDCTRL_QUERY_UNSEEN_FRAMES, &delay);
+        vd_control(d_video, VDCTRL_QUERY_UNSEEN_FRAMES, &delay);
         if (delay >= 0 && delay < d_video->num_buffered_pts)
             d_video->num_buffered_pts = delay;
         if (d_video->num_buffered_pts ==
@@ -379,6 +466,176 @@ struct mp_image *video_decode(struct dec_video *d_video,
     return mpi;
 }
 
+static void *decode_thread(void *p)
+{
+    struct dec_video *d_video = p;
+    struct dec_queue *q = d_video->queue;
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->terminate) {
+        bool can_output = q->num_frames < q->max_frames;
+        if (!can_output || (!q->has_packet && (!q->draining || q->eof))) {
+            pthread_cond_wait(&q->wakeup, &q->lock);
+            continue;
+        }
+
+        struct demux_packet *pkt = q->packet;
+        int drop_frame = q->drop_frame;
+        q->packet = NULL;
+        q->has_packet = false;
+        q->busy = true;
+        pthread_mutex_unlock(&q->lock);
+
+        pthread_mutex_lock(&q->dec_lock);
+        struct mp_image *mpi = video_decode(d_video, pkt, drop_frame);
+        pthread_mutex_unlock(&q->dec_lock);
+
+        pthread_mutex_lock(&q->lock);
+        q->busy = false;
+        q->has_broken_packet_pts = d_video->has_broken_packet_pts;
+        if (mpi) {
+            MP_TARRAY_APPEND(q, q->frames, q->num_frames, mpi);
+        } else if (pkt) {
+            if (drop_frame)
+                q->dropped++;
+        } else {
+            q->eof = true;
+        }
+        talloc_free(pkt);
+        pthread_cond_broadcast(&q->wakeup);
+        pthread_mutex_unlock(&q->lock);
+
+        if (q->wakeup_cb)
+            q->wakeup_cb(q->wakeup_cb_ctx);
+
+        pthread_mutex_lock(&q->lock);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+// Move decoding to a separate thread, which decodes up to max_frames ahead.
+// After this, video_decode() must not be called anymore; use the
+// video_queue_*() functions instead. wakeup_cb is called from the decoder
+// thread whenever a frame was decoded or EOF was reached.
+bool video_start_decode_thread(struct dec_video *d_video, int max_frames,
+                               void (*wakeup_cb)(void *ctx), void *ctx)
+{
+    assert(!d_video->queue);
+    assert(max_frames > 0);
+
+    struct dec_queue *q = talloc_zero(NULL, struct dec_queue);
+    *q = (struct dec_queue){
+        .wakeup_cb = wakeup_cb,
+        .wakeup_cb_ctx = ctx,
+        .max_frames = max_frames,
+        .has_broken_packet_pts = d_video->has_broken_packet_pts,
+    };
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_mutex_init(&q->dec_lock, NULL);
+    pthread_cond_init(&q->wakeup, NULL);
+    d_video->queue = q;
+
+    if (pthread_create(&q->thread, NULL, decode_thread, d_video)) {
+        pthread_cond_destroy(&q->wakeup);
+        pthread_mutex_destroy(&q->lock);
+        pthread_mutex_destroy(&q->dec_lock);
+        talloc_free(q);
+        d_video->queue = NULL;
+        return false;
+    }
+
+    MP_VERBOSE(d_video, "Decoding in a separate thread (%d frames ahead).\n",
+               max_frames);
+    return true;
+}
+
+// Whether video_queue_packet() can be called.
+bool video_queue_wants_packet(struct dec_video *d_video)
+{
+    struct dec_queue *q = d_video->queue;
+    pthread_mutex_lock(&q->lock);
+    bool r = !q->has_packet && !q->draining && q->num_frames < q->max_frames;
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
+// Pass a packet to the decoder thread (takes ownership). pkt==NULL signals
+// EOF, after which the decoder is drained.
+void video_queue_packet(struct dec_video *d_video, struct demux_packet *pkt,
+                        int drop_frame)
+{
+    struct dec_queue *q = d_video->queue;
+    pthread_mutex_lock(&q->lock);
+    assert(!q->has_packet && !q->draining);
+    if (pkt) {
+        q->packet = pkt;
+        q->drop_frame = drop_frame;
+        q->has_packet = true;
+    } else {
+        q->draining = true;
+    }
+    pthread_cond_broadcast(&q->wakeup);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// Return a decoded frame in *out_mpi.
+// Returns: 1: got a frame, 0: nothing yet (wait for wakeup), -1: EOF
+int video_queue_get_frame(struct dec_video *d_video,
+                          struct mp_image **out_mpi)
+{
+    struct dec_queue *q = d_video->queue;
+    int r = 0;
+    *out_mpi = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->num_frames) {
+        *out_mpi = q->frames[0];
+        MP_TARRAY_REMOVE_AT(q->frames, q->num_frames, 0);
+        pthread_cond_broadcast(&q->wakeup);
+        r = 1;
+    } else if (q->eof) {
+        r = -1;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
+// Return and reset the number of frames skipped due to drop_frame.
+int video_queue_take_dropped(struct dec_video *d_video)
+{
+    struct dec_queue *q = d_video->queue;
+    pthread_mutex_lock(&q->lock);
+    int r = q->dropped;
+    q->dropped = 0;
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
+// Same as d_video->has_broken_packet_pts, but safe to call while the decoder
+// thread is running.
+bool video_has_broken_packet_pts(struct dec_video *d_video)
+{
+    struct dec_queue *q = d_video->queue;
+    if (!q)
+        return d_video->has_broken_packet_pts;
+    pthread_mutex_lock(&q->lock);
+    bool r = q->has_broken_packet_pts;
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
+// Number of decoded frames waiting in the queue, or -1 if not threaded.
+int video_queue_get_fill(struct dec_video *d_video)
+{
+    struct dec_queue *q = d_video->queue;
+    if (!q)
+        return -1;
+    pthread_mutex_lock(&q->lock);
+    int r = q->num_frames;
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
 int video_reconfig_filters(struct dec_video *d_video,
                            const struct mp_image_params *params)
 {
@@ -26,6 +26,7 @@
 
 struct mp_decoder_list;
 struct vo;
+struct dec_queue;
 
 struct dec_video {
     struct mp_log *log;
@@ -78,6 +79,9 @@ struct dec_video {
 
     // State used only by player/video.c
     double last_pts;
+
+    // Non-NULL if decoding runs in a separate thread
+    struct dec_queue *queue;
 };
 
 struct mp_decoder_list *video_decoder_list(void);
@@ -90,6 +94,17 @@ struct mp_image *video_decode(struct dec_video *d_video,
                               struct demux_packet *packet,
                               int drop_frame);
 
+bool video_start_decode_thread(struct dec_video *d_video, int max_frames,
+                               void (*wakeup_cb)(void *ctx), void *ctx);
+bool video_queue_wants_packet(struct dec_video *d_video);
+void video_queue_packet(struct dec_video *d_video, struct demux_packet *pkt,
+                        int drop_frame);
+int video_queue_get_frame(struct dec_video *d_video,
+                          struct mp_image **out_mpi);
+int video_queue_take_dropped(struct dec_video *d_video);
+int video_queue_get_fill(struct dec_video *d_video);
+bool video_has_broken_packet_pts(struct dec_video *d_video);
+
 int video_get_colors(struct dec_video *d_video, const char *item, int *value);
 int video_set_colors(struct dec_video *d_video, const char *item, int value);
 void video_reset_decoding(struct dec_video *d_video);
@@ -34,6 +34,7 @@
 #include "common/common.h"
 #include "common/av_common.h"
 #include "video/fmt-conversion.h"
+#include "video/image_alloc.h"
 #include "video/mp_image_pool.h"
 #include "video/hwdec.h"
 #include "gpu_memcpy_sse4.h"
@@ -257,6 +258,7 @@ static void copy_nv12_fallback(struct mp_image *dest, uint8_t *src_bits,
     buf.planes[1] = src_bits + src_pitch * surf_height;
     buf.stride[1] = src_pitch;
     mp_image_copy(dest, &buf);
+    mp_image_alloc_count_copy();
 }
 
 #pragma GCC push_options
@@ -41,6 +41,8 @@
 #include "video/img_format.h"
 #include "video/filter/vf.h"
 #include "video/decode/dec_video.h"
+#include "video/image_alloc.h"
+#include "video/out/vo.h"
 #include "demux/stheader.h"
 #include "demux/packet.h"
 #include "video/csputils.h"
@@ -59,6 +61,7 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
 static void uninit_avctx(struct dec_video *vd);
 
 static int get_buffer2_hwdec(AVCodecContext *avctx, AVFrame *pic, int flags);
+static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags);
 static enum AVPixelFormat get_format_hwdec(struct AVCodecContext *avctx,
                                            const enum AVPixelFormat *pix_fmt);
 
@@ -74,6 +77,7 @@ struct vd_lavc_params {
     int threads;
     int bitexact;
     int check_hw_profile;
+    int dr;
     char **avopts;
 };
 
@@ -101,6 +105,7 @@ const struct m_sub_options vd_lavc_conf = {
         OPT_INTRANGE("threads", threads, 0, 0, 16),
         OPT_FLAG("bitexact", bitexact, 0),
         OPT_FLAG("check-hw-profile", check_hw_profile, 0),
+        OPT_FLAG("dr", dr, 0),
         OPT_KEYVALUELIST("o", avopts, 0),
         {0}
     },
@@ -376,6 +381,12 @@ static void init_avctx(struct dec_video *vd, const char *decoder,
             goto error;
     } else {
         mp_set_avcodec_threads(vd->log, avctx, lavc_param->threads);
+        if (lavc_param->dr && vd->vo &&
+            (lavc_codec->capabilities & CODEC_CAP_DR1))
+        {
+            avctx->get_buffer2 = get_buffer2_direct;
+            avctx->thread_safe_callbacks = 1;
+        }
     }
 
     avctx->flags |= lavc_param->bitexact ? CODEC_FLAG_BITEXACT : 0;
@@ -598,6 +609,45 @@ static int get_buffer2_hwdec(AVCodecContext *avctx, AVFrame *pic, int flags)
     return 0;
 }
 
+// Let the decoder write into memory provided by the VO (e.g. shared memory
+// segments in vo_xv), so that decoded frames can be displayed without copying.
+// Falls back to normal allocation if the VO can't provide a suitable image,
+// for example before it was configured, or if filters change the format.
+static int get_buffer2_direct(AVCodecContext *avctx, AVFrame *pic, int flags)
+{
+    struct dec_video *vd = avctx->opaque;
+
+    int imgfmt = pixfmt2imgfmt(pic->format);
+    if (!imgfmt || IMGFMT_IS_HWACCEL(imgfmt))
+        return avcodec_default_get_buffer2(avctx, pic, flags);
+
+    // The decoder wants padding on the right and bottom, and aligned strides.
+    int w = pic->width;
+    int h = pic->height;
+    int linesize_align[AV_NUM_DATA_POINTERS] = {0};
+    avcodec_align_dimensions2(avctx, &w, &h, linesize_align);
+    int stride_align = 1;
+    for (int i = 0; i < AV_NUM_DATA_POINTERS; i++)
+        stride_align = MPMAX(stride_align, linesize_align[i]);
+
+    struct mp_image *img = vo_get_image(vd->vo, imgfmt, w, h, stride_align);
+    if (!img)
+        return avcodec_default_get_buffer2(avctx, pic, flags);
+
+    for (int i = 0; i < 4; i++) {
+        pic->data[i] = img->planes[i];
+        pic->linesize[i] = img->stride[i];
+    }
+    pic->buf[0] = av_buffer_create(NULL, 0, free_mpi, img, 0);
+    if (!pic->buf[0]) {
+        talloc_free(img);
+        return -1;
+    }
+
+    mp_image_alloc_count_direct();
+    return 0;
+}
+
 static int decode(struct dec_video *vd, struct demux_packet *packet,
                   int flags, struct mp_image **out_image)
 {
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <libavutil/common.h>
 #include <libavutil/mem.h>
@@ -32,7 +33,9 @@
 #include "options/m_config.h"
 
 #include "options/options.h"
+#include "misc/thread_pool.h"
 
+#include "video/image_alloc.h"
 #include "video/img_format.h"
 #include "video/mp_image.h"
 #include "video/mp_image_pool.h"
@@ -135,16 +138,59 @@ const struct m_obj_list vf_obj_list = {
     .description = "video filters",
 };
 
+// Pipelined mode (--vf-pipeline): each filter runs on its own thread, and the
+// functions called by the player only move frames between the stage queues.
+// The stage thread calls the filter callbacks; everything else that calls
+// into the filter (controls) must hold filter_lock.
+#define STAGE_QUEUE 2
+
+struct vf_stage {
+    pthread_t thread;
+    // Protects the fields below.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    // Held while filter callbacks are running.
+    pthread_mutex_t filter_lock;
+
+    // Input frames, not yet passed to the filter.
+    struct mp_image **in;
+    int num_in;
+    bool eof;           // flush the filter after all input was filtered
+    bool eof_done;      // flushing finished
+    bool busy;          // stage thread is calling the filter
+    int error;          // <0: filter failed (until reset)
+    bool terminate;
+
+    // Frames output by the filter, not yet moved to vf->out_queued.
+    struct mp_image **out;
+    int num_out;
+
+    // Frames added with vf_add_output_frame() during a filter call. Accessed
+    // by the stage thread only (or by anyone while it's not busy).
+    struct mp_image **pending;
+    int num_pending;
+};
+
+static int filter_control(struct vf_instance *vf, int cmd, void *arg)
+{
+    if (!vf->control)
+        return CONTROL_UNKNOWN;
+    if (vf->stage)
+        pthread_mutex_lock(&vf->stage->filter_lock);
+    int r = vf->control(vf, cmd, arg);
+    if (vf->stage)
+        pthread_mutex_unlock(&vf->stage->filter_lock);
+    return r;
+}
+
 // Try the cmd on each filter (starting with the first), and stop at the first
 // filter which does not return CONTROL_UNKNOWN for it.
 int vf_control_any(struct vf_chain *c, int cmd, void *arg)
 {
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
-        if (cur->control) {
-            int r = cur->control(cur, cmd, arg);
-            if (r != CONTROL_UNKNOWN)
-                return r;
-        }
+        int r = filter_control(cur, cmd, arg);
+        if (r != CONTROL_UNKNOWN)
+            return r;
     }
     return CONTROL_UNKNOWN;
 }
@@ -155,7 +201,7 @@ int vf_control_by_label(struct vf_chain *c,int cmd, void *arg, bstr label)
     struct vf_instance *cur = vf_find_by_label(c, label_str);
     talloc_free(label_str);
     if (cur) {
-        return cur->control ? cur->control(cur, cmd, arg) : CONTROL_NA;
+        return cur->control ? filter_control(cur, cmd, arg) : CONTROL_NA;
     } else {
         return CONTROL_UNKNOWN;
     }
@@ -163,10 +209,8 @@ int vf_control_by_label(struct vf_chain *c,int cmd, void *arg, bstr label)
 
 static void vf_control_all(struct vf_chain *c, int cmd, void *arg)
 {
-    for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
-        if (cur->control)
-            cur->control(cur, cmd, arg);
-    }
+    for (struct vf_instance *cur = c->first; cur; cur = cur->next)
+        filter_control(cur, cmd, arg);
 }
 
 static void vf_fix_img_params(struct mp_image *img, struct mp_image_params *p)
@@ -203,6 +247,41 @@ bool vf_make_out_image_writeable(struct vf_instance *vf, struct mp_image *img)
     return mp_image_pool_make_writeable(vf->out_pool, img);
 }
 
+struct slice_job {
+    void (*fn)(void *ctx, int y0, int y1);
+    void *ctx;
+    int h, slice_h;
+};
+
+static void run_slice(void *ctx, int n)
+{
+    struct slice_job *job = ctx;
+    int y0 = n * job->slice_h;
+    job->fn(job->ctx, y0, MPMIN(y0 + job->slice_h, job->h));
+}
+
+// Call fn(ctx, y0, y1) for row ranges [y0, y1) covering [0, h). If slice
+// threading is enabled (--vf-threads), the ranges are processed in parallel,
+// otherwise fn is called once with the full range. y0 is always a multiple
+// of align (e.g. 1 << chroma_ys), and fn must write only rows in its range.
+void vf_run_slices(struct vf_instance *vf, int h, int align,
+                   void (*fn)(void *ctx, int y0, int y1), void *ctx)
+{
+    struct mp_thread_pool *pool = vf->chain->slice_pool;
+    int slices = pool ? mp_thread_pool_get_threads(pool) : 1;
+    // Don't bother with tiny slices.
+    slices = MPMIN(slices, h / 16);
+    if (slices < 2) {
+        fn(ctx, 0, h);
+        return;
+    }
+    align = MPMAX(align, 1);
+    int slice_h = (h + slices - 1) / slices;
+    slice_h = (slice_h + align - 1) / align * align;
+    struct slice_job job = {fn, ctx, h, slice_h};
+    mp_thread_pool_run(pool, (h + slice_h - 1) / slice_h, run_slice, &job);
+}
+
 //============================================================================
 
 // The default callback assumes all formats are passed through.
@@ -251,6 +330,7 @@ static struct vf_instance *vf_open(struct vf_chain *c, const char *name,
         .out_pool = talloc_steal(vf, mp_image_pool_new(16)),
         .chain = c,
     };
+    mp_image_pool_set_hugepages(vf->out_pool, c->opts->video_hugepages);
     struct m_config *config = m_config_from_obj_desc(vf, vf->log, &desc);
     if (m_config_apply_defaults(config, name, c->opts->vf_defs) < 0)
         goto error;
@@ -341,12 +421,236 @@ void vf_add_output_frame(struct vf_instance *vf, struct mp_image *img)
 {
     if (img) {
         vf_fix_img_params(img, &vf->fmt_out);
-        MP_TARRAY_APPEND(vf, vf->out_queued, vf->num_out_queued, img);
+        if (vf->stage) {
+            struct vf_stage *st = vf->stage;
+            MP_TARRAY_APPEND(st, st->pending, st->num_pending, img);
+        } else {
+            MP_TARRAY_APPEND(vf, vf->out_queued, vf->num_out_queued, img);
+        }
+    }
+}
+
+static int filter_frame_now(struct vf_instance *vf, struct mp_image *img);
+
+static void *stage_thread(void *p)
+{
+    struct vf_instance *vf = p;
+    struct vf_stage *st = vf->stage;
+
+    pthread_mutex_lock(&st->lock);
+    while (!st->terminate) {
+        bool have_input = st->num_in > 0;
+        bool do_eof = !have_input && st->eof && !st->eof_done;
+        if (st->error < 0 || (!have_input && !do_eof)) {
+            pthread_cond_wait(&st->wakeup, &st->lock);
+            continue;
+        }
+
+        struct mp_image *img = NULL;
+        if (have_input) {
+            img = st->in[0];
+            MP_TARRAY_REMOVE_AT(st->in, st->num_in, 0);
+        }
+        st->busy = true;
+        pthread_mutex_unlock(&st->lock);
+
+        pthread_mutex_lock(&st->filter_lock);
+        int r = filter_frame_now(vf, img);
+        // Get all output the filter can produce without new input.
+        while (r >= 0 && vf->filter_out) {
+            int prev = st->num_pending;
+            r = vf->filter_out(vf);
+            if (r < 0)
+                MP_ERR(vf, "Error filtering frame.\n");
+            if (st->num_pending == prev)
+                break;
+        }
+        pthread_mutex_unlock(&st->filter_lock);
+
+        pthread_mutex_lock(&st->lock);
+        for (int n = 0; n < st->num_pending; n++)
+            MP_TARRAY_APPEND(st, st->out, st->num_out, st->pending[n]);
+        st->num_pending = 0;
+        if (r < 0)
+            st->error = r;
+        if (do_eof)
+            st->eof_done = true;
+        st->busy = false;
+        pthread_cond_broadcast(&st->wakeup);
+        pthread_mutex_unlock(&st->lock);
+
+        if (vf->chain->wakeup_callback)
+            vf->chain->wakeup_callback(vf->chain->wakeup_callback_ctx);
+
+        pthread_mutex_lock(&st->lock);
     }
+    pthread_mutex_unlock(&st->lock);
+    return NULL;
+}
+
+// Move frames output by the stage thread to vf->out_queued. Call with lock held.
+static void stage_read_output(struct vf_instance *vf)
+{
+    struct vf_stage *st = vf->stage;
+    for (int n = 0; n < st->num_out; n++)
+        MP_TARRAY_APPEND(vf, vf->out_queued, vf->num_out_queued, st->out[n]);
+    st->num_out = 0;
+}
+
+// Queue img (or EOF if img==NULL) for filtering on the stage thread. Blocks
+// if the input queue is full.
+static int stage_filter(struct vf_instance *vf, struct mp_image *img)
+{
+    struct vf_stage *st = vf->stage;
+    int r = 0;
+    pthread_mutex_lock(&st->lock);
+    while (1) {
+        stage_read_output(vf);
+        if (st->error < 0) {
+            talloc_free(img);
+            r = st->error;
+            break;
+        }
+        if (!img) {
+            if (!st->eof) {
+                st->eof = true;
+                st->eof_done = false;
+                pthread_cond_broadcast(&st->wakeup);
+            }
+            break;
+        }
+        // New input after EOF must wait until the flush is done.
+        if ((!st->eof || st->eof_done) && st->num_in < STAGE_QUEUE) {
+            st->eof = st->eof_done = false;
+            MP_TARRAY_APPEND(st, st->in, st->num_in, img);
+            pthread_cond_broadcast(&st->wakeup);
+            break;
+        }
+        pthread_cond_wait(&st->wakeup, &st->lock);
+    }
+    pthread_mutex_unlock(&st->lock);
+    return r;
+}
+
+// Return whether output is available. Like with filters that filter
+// asynchronously on their own (vf_vapoursynth), this waits for output if the
+// stage can't accept new input, or while it's flushing on EOF.
+static bool stage_has_output(struct vf_instance *vf)
+{
+    struct vf_stage *st = vf->stage;
+    pthread_mutex_lock(&st->lock);
+    while (1) {
+        stage_read_output(vf);
+        if (vf->num_out_queued || st->error < 0)
+            break;
+        if (!st->eof && st->num_in < STAGE_QUEUE)
+            break; // wants more input
+        if (st->eof && st->eof_done && !st->num_in && !st->busy)
+            break; // fully flushed
+        pthread_cond_wait(&st->wakeup, &st->lock);
+    }
+    pthread_mutex_unlock(&st->lock);
+    return vf->num_out_queued > 0;
+}
+
+static bool stage_needs_input(struct vf_instance *vf)
+{
+    struct vf_stage *st = vf->stage;
+    pthread_mutex_lock(&st->lock);
+    stage_read_output(vf);
+    bool r = !st->eof && st->error >= 0 && st->num_in < STAGE_QUEUE &&
+             vf->num_out_queued < STAGE_QUEUE;
+    pthread_mutex_unlock(&st->lock);
+    return r;
+}
+
+// Drop all queued frames and reset the EOF/error state.
+static void stage_flush(struct vf_instance *vf)
+{
+    struct vf_stage *st = vf->stage;
+    pthread_mutex_lock(&st->lock);
+    while (st->busy)
+        pthread_cond_wait(&st->wakeup, &st->lock);
+    for (int n = 0; n < st->num_in; n++)
+        talloc_free(st->in[n]);
+    st->num_in = 0;
+    for (int n = 0; n < st->num_out; n++)
+        talloc_free(st->out[n]);
+    st->num_out = 0;
+    for (int n = 0; n < st->num_pending; n++)
+        talloc_free(st->pending[n]);
+    st->num_pending = 0;
+    st->eof = st->eof_done = false;
+    st->error = 0;
+    pthread_mutex_unlock(&st->lock);
+}
+
+static void stage_destroy(struct vf_instance *vf)
+{
+    struct vf_stage *st = vf->stage;
+    if (!st)
+        return;
+    pthread_mutex_lock(&st->lock);
+    st->terminate = true;
+    pthread_cond_broadcast(&st->wakeup);
+    pthread_mutex_unlock(&st->lock);
+    pthread_join(st->thread, NULL);
+    stage_flush(vf);
+    pthread_cond_destroy(&st->wakeup);
+    pthread_mutex_destroy(&st->lock);
+    pthread_mutex_destroy(&st->filter_lock);
+    talloc_free(st);
+    vf->stage = NULL;
+}
+
+static void stage_create(struct vf_instance *vf)
+{
+    assert(!vf->stage);
+    struct vf_stage *st = talloc_zero(NULL, struct vf_stage);
+    pthread_mutex_init(&st->lock, NULL);
+    pthread_mutex_init(&st->filter_lock, NULL);
+    pthread_cond_init(&st->wakeup, NULL);
+    vf->stage = st;
+    if (pthread_create(&st->thread, NULL, stage_thread, vf)) {
+        pthread_cond_destroy(&st->wakeup);
+        pthread_mutex_destroy(&st->lock);
+        pthread_mutex_destroy(&st->filter_lock);
+        talloc_free(st);
+        vf->stage = NULL;
+    }
+}
+
+// Filters which already filter asynchronously, or which use hw decoding
+// surfaces (and thus the VO's hw context) stay synchronous.
+static bool can_pipeline(struct vf_instance *vf)
+{
+    return (vf->filter || vf->filter_ext) && !vf->needs_input &&
+           !IMGFMT_IS_HWACCEL(vf->fmt_in.imgfmt) &&
+           !IMGFMT_IS_HWACCEL(vf->fmt_out.imgfmt);
+}
+
+static void vf_start_pipeline(struct vf_chain *c)
+{
+    int num = 0;
+    for (struct vf_instance *vf = c->first; vf; vf = vf->next) {
+        if (can_pipeline(vf)) {
+            stage_create(vf);
+            num += !!vf->stage;
+        }
+    }
+    MP_VERBOSE(c, "Running %d filters in pipelined mode.\n", num);
+}
+
+static void vf_stop_pipeline(struct vf_chain *c)
+{
+    for (struct vf_instance *vf = c->first; vf; vf = vf->next)
+        stage_destroy(vf);
 }
 
 static bool vf_has_output_frame(struct vf_instance *vf)
 {
+    if (vf->stage)
+        return stage_has_output(vf);
     if (!vf->num_out_queued && vf->filter_out) {
         if (vf->filter_out(vf) < 0)
             MP_ERR(vf, "Error filtering frame.\n");
@@ -364,12 +668,8 @@ static struct mp_image *vf_dequeue_output_frame(struct vf_instance *vf)
     return res;
 }
 
-static int vf_do_filter(struct vf_instance *vf, struct mp_image *img)
+static int filter_frame_now(struct vf_instance *vf, struct mp_image *img)
 {
-    assert(vf->fmt_in.imgfmt);
-    if (img)
-        assert(mp_image_params_equal(&img->params, &vf->fmt_in));
-
     if (vf->filter_ext) {
         int r = vf->filter_ext(vf, img);
         if (r < 0)
@@ -385,6 +685,24 @@ static int vf_do_filter(struct vf_instance *vf, struct mp_image *img)
     }
 }
 
+static int vf_do_filter(struct vf_instance *vf, struct mp_image *img)
+{
+    assert(vf->fmt_in.imgfmt);
+    if (img)
+        assert(mp_image_params_equal(&img->params, &vf->fmt_in));
+
+    if (vf->stage)
+        return stage_filter(vf, img);
+    return filter_frame_now(vf, img);
+}
+
+static bool vf_filter_needs_input(struct vf_instance *vf)
+{
+    if (vf->stage)
+        return stage_needs_input(vf);
+    return vf->needs_input && vf->needs_input(vf);
+}
+
 // Input a frame into the filter chain. Ownership of img is transferred.
 // Return >= 0 on success, < 0 on failure (even if output frames were produced)
 int vf_filter_frame(struct vf_chain *c, struct mp_image *img)
@@ -463,7 +781,7 @@ int vf_needs_input(struct vf_chain *c)
 {
     struct vf_instance *prev = c->first;
     for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
-        while (cur->needs_input && cur->needs_input(cur)) {
+        while (vf_filter_needs_input(cur)) {
             // Get frames from preceding filters, or if there are none,
             // request new frames from decoder.
             int r = vf_output_frame_until(c, prev, false);
@@ -493,6 +811,10 @@ static void vf_chain_forget_frames(struct vf_chain *c)
 
 void vf_seek_reset(struct vf_chain *c)
 {
+    for (struct vf_instance *cur = c->first; cur; cur = cur->next) {
+        if (cur->stage)
+            stage_flush(cur);
+    }
     vf_control_all(c, VFCTRL_SEEK_RESET, NULL);
     vf_chain_forget_frames(c);
 }
@@ -612,6 +934,7 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params,
                 const struct mp_image_params *override_params)
 {
     int r = 0;
+    vf_stop_pipeline(c);
     vf_chain_forget_frames(c);
     for (struct vf_instance *vf = c->first; vf; ) {
         struct vf_instance *next = vf->next;
@@ -645,6 +968,8 @@ int vf_reconfig(struct vf_chain *c, const struct mp_image_params *params,
     if (r < 0) {
         c->input_params = c->override_params = c->output_params =
             (struct mp_image_params){0};
+    } else if (c->opts->vf_pipeline) {
+        vf_start_pipeline(c);
     }
     return r;
 }
@@ -662,6 +987,16 @@ struct vf_instance *vf_find_by_label(struct vf_chain *c, const char *label)
 
 static void vf_uninit_filter(vf_instance_t *vf)
 {
+    stage_destroy(vf);
+    if (vf->out_pool) {
+        struct mp_image_pool_stats st;
+        mp_image_pool_get_stats(vf->out_pool, &st);
+        if (st.hits || st.misses) {
+            MP_VERBOSE(vf, "Image pool: %lld reused, %lld allocated, "
+                       "%d images (%zu KiB) retained.\n", (long long)st.hits,
+                       (long long)st.misses, st.num_images, st.bytes / 1024);
+        }
+    }
     if (vf->uninit)
         vf->uninit(vf);
     vf_forget_frames(vf);
@@ -692,6 +1027,8 @@ struct vf_chain *vf_new(struct mpv_global *global)
         .log = mp_log_new(c, global->log, "!vf"),
         .global = global,
     };
+    if (c->opts->vf_threads > 1)
+        c->slice_pool = mp_thread_pool_create(c, c->opts->vf_threads);
     static const struct vf_info in = { .name = "in" };
     c->first = talloc(c, struct vf_instance);
     *c->first = (struct vf_instance) {
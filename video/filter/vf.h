@@ -27,6 +27,7 @@ struct MPOpts;
 struct mpv_global;
 struct vf_instance;
 struct vf_priv_s;
+struct vf_stage;
 struct m_obj_settings;
 
 typedef struct vf_info {
@@ -107,6 +108,9 @@ typedef struct vf_instance {
 
     struct vf_chain *chain;
     struct vf_instance *next;
+
+    // Set if the filter runs on its own thread (--vf-pipeline).
+    struct vf_stage *stage;
 } vf_instance_t;
 
 // A chain of video filters
@@ -133,6 +137,9 @@ struct vf_chain {
     // since they are supposed to call it from foreign threads.
     void (*wakeup_callback)(void *ctx);
     void *wakeup_callback_ctx;
+
+    // Used by vf_run_slices(); NULL if slice threading is disabled.
+    struct mp_thread_pool *slice_pool;
 };
 
 typedef struct vf_seteq {
@@ -173,6 +180,8 @@ void vf_print_filter_chain(struct vf_chain *c, int msglevel,
 
 // Filter internal API
 struct mp_image *vf_alloc_out_image(struct vf_instance *vf);
+void vf_run_slices(struct vf_instance *vf, int h, int align,
+                   void (*fn)(void *ctx, int y0, int y1), void *ctx);
 bool vf_make_out_image_writeable(struct vf_instance *vf, struct mp_image *img);
 void vf_add_output_frame(struct vf_instance *vf, struct mp_image *img);
 
@@ -69,10 +69,6 @@ typedef struct vf_priv_s {
   double        ggamma;
   double        bgamma;
 
-  unsigned      buf_w[3];
-  unsigned      buf_h[3];
-  unsigned char *buf[3];
-
   int gamma_i, contrast_i, brightness_i, saturation_i;
 
   double   par[8];
@@ -173,12 +169,37 @@ void apply_lut (eq2_param_t *par, unsigned char *dst, unsigned char *src,
   }
 }
 
-static struct mp_image *filter(struct vf_instance *vf, struct mp_image *src)
+struct slice_ctx {
+  vf_eq2_t *eq2;
+  struct mp_image *dst, *src;
+};
+
+// Process rows [y0, y1) (in luma rows) of all planes.
+static void filter_slice(void *ctx, int y0, int y1)
 {
-  vf_eq2_t      *eq2;
-  unsigned long img_n,img_c;
+  struct slice_ctx *s = ctx;
+  struct mp_image *src = s->src, *dst = s->dst;
+
+  for (int i = 0; i < src->num_planes; i++) {
+    int ys = src->fmt.ys[i];
+    int py0 = y0 >> ys;
+    int py1 = y1 >= src->h ? mp_image_plane_h(src, i) : y1 >> ys;
+    int w = mp_image_plane_w(src, i);
+    uint8_t *d = dst->planes[i] + py0 * dst->stride[i];
+    uint8_t *sp = src->planes[i] + py0 * src->stride[i];
+    eq2_param_t *par = i < 3 ? &s->eq2->param[i] : NULL;
+    if (par && par->adjust) {
+      par->adjust (par, d, sp, w, py1 - py0, dst->stride[i], src->stride[i]);
+    } else {
+      memcpy_pic (d, sp, (w * src->fmt.bpp[i] + 7) / 8, py1 - py0,
+                  dst->stride[i], src->stride[i]);
+    }
+  }
+}
 
-  eq2 = vf->priv;
+static struct mp_image *filter(struct vf_instance *vf, struct mp_image *src)
+{
+  vf_eq2_t *eq2 = vf->priv;
 
   bool skip = true;
   for (int i = 0; i < 3; i++)
@@ -187,37 +208,17 @@ static struct mp_image *filter(struct vf_instance *vf, struct mp_image *src)
   if (skip)
       return src;
 
-  if ((eq2->buf_w[0] != src->w) || (eq2->buf_h[0] != src->h)) {
-    eq2->buf_w[0] = src->w;
-    eq2->buf_h[0] = src->h;
-      eq2->buf_w[1] = eq2->buf_w[2] = src->w >> src->fmt.chroma_xs;
-      eq2->buf_h[1] = eq2->buf_h[2] = src->h >> src->fmt.chroma_ys;
-    img_n = eq2->buf_w[0]*eq2->buf_h[0];
-    if(src->num_planes>1){
-      img_c = eq2->buf_w[1]*eq2->buf_h[1];
-      eq2->buf[0] = realloc (eq2->buf[0], img_n + 2*img_c);
-      eq2->buf[1] = eq2->buf[0] + img_n;
-      eq2->buf[2] = eq2->buf[1] + img_c;
-    } else
-      eq2->buf[0] = realloc (eq2->buf[0], img_n);
-  }
-
-  struct mp_image dst = *src;
-
-  for (int i = 0; i < ((src->num_planes>1)?3:1); i++) {
-    if (eq2->param[i].adjust != NULL) {
-      dst.planes[i] = eq2->buf[i];
-      dst.stride[i] = eq2->buf_w[i];
-
-      eq2->param[i].adjust (&eq2->param[i], dst.planes[i], src->planes[i],
-        eq2->buf_w[i], eq2->buf_h[i], dst.stride[i], src->stride[i]);
-    }
+  // Build the LUTs before the slices access them concurrently.
+  for (int i = 0; i < 3; i++) {
+    if (eq2->param[i].adjust && !eq2->param[i].lut_clean)
+      create_lut (&eq2->param[i]);
   }
 
   struct mp_image *new = vf_alloc_out_image(vf);
   if (new) {
-    mp_image_copy(new, &dst);
-    mp_image_copy_attributes(new, &dst);
+    mp_image_copy_attributes(new, src);
+    struct slice_ctx ctx = {eq2, new, src};
+    vf_run_slices(vf, src->h, 1 << src->fmt.chroma_ys, filter_slice, &ctx);
   }
 
   talloc_free(src);
@@ -375,14 +376,6 @@ int query_format (vf_instance_t *vf, unsigned fmt)
   return 0;
 }
 
-static
-void uninit (vf_instance_t *vf)
-{
-  if (vf->priv != NULL) {
-    free (vf->priv->buf[0]);
-  }
-}
-
 static
 int vf_open(vf_instance_t *vf)
 {
@@ -393,16 +386,11 @@ int vf_open(vf_instance_t *vf)
   vf->control = control;
   vf->query_format = query_format;
   vf->filter = filter;
-  vf->uninit = uninit;
 
   eq2 = vf->priv;
   eq2->log = vf->log;
 
   for (i = 0; i < 3; i++) {
-    eq2->buf[i] = NULL;
-    eq2->buf_w[i] = 0;
-    eq2->buf_h[i] = 0;
-
     eq2->param[i].adjust = NULL;
     eq2->param[i].c = 1.0;
     eq2->param[i].b = 0.0;
@@ -36,6 +36,7 @@
 #include "options/path.h"
 
 #include "video/img_format.h"
+#include "video/image_alloc.h"
 #include "video/mp_image.h"
 #include "video/sws_utils.h"
 #include "vf.h"
@@ -500,6 +501,7 @@ static const VSFrameRef *VS_CC infiltGetFrame(int frameno, int activationReason,
             }
             struct mp_image vsframe = map_vs_frame(p, ret, true);
             mp_image_copy(&vsframe, img);
+            mp_image_alloc_count_copy();
             int res = 1e6;
             int dur = img->pts * res + 0.5;
             set_vs_frame_props(p, ret, img, dur, res);
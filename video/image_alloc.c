@@ -0,0 +1,239 @@
+/*
+ * This file is part of mpv.
+ *
+ * mpv is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * mpv is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with mpv.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "config.h"
+
+#if HAVE_POSIX
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "talloc.h"
+
+#include "common/common.h"
+#include "osdep/atomics.h"
+#include "video/mp_image.h"
+#include "video/mp_image_pool.h"
+
+#include "image_alloc.h"
+
+// Frame data is allocated with mmap(), rounded up to the hugepage size, and
+// prefaulted by the allocating thread. With the kernel's default first-touch
+// policy, this also places the pages on the NUMA node of the thread that
+// allocates (and writes) the frame, without needing libnuma.
+// THP_SIZE is the transparent hugepage size on the common platforms (x86,
+// ARM with 4K pages). MAP_HUGETLB uses the size from get_hugepage_size().
+#define THP_SIZE (2 * 1024 * 1024)
+#define PAGE_SIZE_MIN 4096
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct mp_image_alloc_stats alloc_stats;
+// Updated for every frame, so they're not protected by stats_lock.
+static atomic_ullong copies_count = ATOMIC_VAR_INIT(0);
+static atomic_ullong direct_count = ATOMIC_VAR_INIT(0);
+
+struct buffer {
+    void *ptr;
+    size_t size;
+};
+
+#if HAVE_POSIX
+
+static pthread_once_t hugepage_once = PTHREAD_ONCE_INIT;
+static size_t hugepage_size = THP_SIZE;
+
+// MAP_HUGETLB uses the system's default hugepage size, and the length passed
+// to munmap() must be a multiple of it. It's not always 2 MiB (it can be set
+// to 1 GiB on x86, and is different on ARM with 64K pages), so read it from
+// the kernel.
+static void init_hugepage_size(void)
+{
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (!f)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long kb;
+        if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+            size_t size = kb * 1024;
+            // MP_ALIGN_UP() requires a power of 2.
+            if (size >= PAGE_SIZE_MIN && !(size & (size - 1)))
+                hugepage_size = size;
+            break;
+        }
+    }
+    fclose(f);
+}
+
+static size_t get_hugepage_size(void)
+{
+    pthread_once(&hugepage_once, init_hugepage_size);
+    return hugepage_size;
+}
+
+static void free_buffer(void *arg)
+{
+    struct buffer *buf = arg;
+    munmap(buf->ptr, buf->size);
+    pthread_mutex_lock(&stats_lock);
+    alloc_stats.live_bytes -= buf->size;
+    pthread_mutex_unlock(&stats_lock);
+    talloc_free(buf);
+}
+
+static int64_t get_thread_faults(void)
+{
+#ifdef RUSAGE_THREAD
+    struct rusage ru;
+    if (getrusage(RUSAGE_THREAD, &ru) == 0)
+        return ru.ru_minflt + ru.ru_majflt;
+#endif
+    return 0;
+}
+
+// Map size bytes of memory aligned to THP_SIZE (so that the kernel can back all
+// of it with transparent hugepages).
+static void *map_aligned(size_t size)
+{
+    size_t map_size = size + THP_SIZE;
+    uint8_t *p = mmap(NULL, map_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    uint8_t *start = (uint8_t *)MP_ALIGN_UP((uintptr_t)p, THP_SIZE);
+    if (start > p)
+        munmap(p, start - p);
+    size_t tail = (p + map_size) - (start + size);
+    if (tail)
+        munmap(start + size, tail);
+    return start;
+}
+
+// buf->size is the size that was actually mapped, and is passed to munmap().
+static struct buffer *alloc_buffer(int mode, size_t min_size)
+{
+    size_t size = 0;
+    void *ptr = NULL;
+    bool huge = false;
+
+#ifdef MAP_HUGETLB
+    if (mode == MP_HUGEPAGES_EXPLICIT) {
+        size = MP_ALIGN_UP(min_size, get_hugepage_size());
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr == MAP_FAILED) {
+            ptr = NULL;
+        } else {
+            huge = true;
+        }
+    }
+#endif
+    if (!ptr) {
+        // Also used if no explicit hugepages are reserved.
+        size = MP_ALIGN_UP(min_size, THP_SIZE);
+        ptr = map_aligned(size);
+        if (!ptr)
+            return NULL;
+#ifdef MADV_HUGEPAGE
+        huge = madvise(ptr, size, MADV_HUGEPAGE) == 0;
+#endif
+    }
+
+    // Prefault, so that the page faults happen here, and not scattered over
+    // the first write to the frame.
+    int64_t faults = get_thread_faults();
+    for (size_t n = 0; n < size; n += PAGE_SIZE_MIN)
+        ((volatile uint8_t *)ptr)[n] = 0;
+    faults = get_thread_faults() - faults;
+
+    struct buffer *buf = talloc_ptrtype(NULL, buf);
+    *buf = (struct buffer){ .ptr = ptr, .size = size };
+
+    pthread_mutex_lock(&stats_lock);
+    alloc_stats.allocs++;
+    if (huge)
+        alloc_stats.huge_allocs++;
+    alloc_stats.faults += faults;
+    alloc_stats.live_bytes += size;
+    pthread_mutex_unlock(&stats_lock);
+
+    return buf;
+}
+
+// mp_image_allocator callback; ctx is the MP_HUGEPAGES_* mode.
+static struct mp_image *hugepage_image_alloc(void *ctx, int fmt, int w, int h)
+{
+    int mode = (intptr_t)ctx;
+
+    struct mp_image t = {0};
+    mp_image_set_size(&t, w, h);
+    mp_image_setfmt(&t, fmt);
+    size_t size = mp_image_plane_layout(&t, NULL);
+    if (!size)
+        return mp_image_alloc(fmt, w, h);
+
+    struct buffer *buf = alloc_buffer(mode, size);
+    if (!buf)
+        return mp_image_alloc(fmt, w, h);
+    mp_image_plane_layout(&t, buf->ptr);
+
+    return mp_image_new_custom_ref(&t, buf, free_buffer);
+}
+
+#endif /* HAVE_POSIX */
+
+// Make pool allocate frames with the given MP_HUGEPAGES_* mode. Does nothing
+// with MP_HUGEPAGES_NO, or on systems without mmap().
+void mp_image_pool_set_hugepages(struct mp_image_pool *pool, int mode)
+{
+#if HAVE_POSIX
+    if (mode != MP_HUGEPAGES_NO)
+        mp_image_pool_set_allocator(pool, hugepage_image_alloc,
+                                    (void *)(intptr_t)mode);
+#endif
+}
+
+void mp_image_alloc_get_stats(struct mp_image_alloc_stats *stats)
+{
+    pthread_mutex_lock(&stats_lock);
+    *stats = alloc_stats;
+    pthread_mutex_unlock(&stats_lock);
+    stats->copies = atomic_load(&copies_count);
+    stats->direct = atomic_load(&direct_count);
+}
+
+// Count a full frame copy. Used to check whether the path from the decoder to
+// the VO is really zero-copy. This is called where whole frames are copied
+// (e.g. mp_image_new_copy(), hwdec readback, VO uploads), not by
+// mp_image_copy(), which is also used for parts of images.
+void mp_image_alloc_count_copy(void)
+{
+    atomic_fetch_add(&copies_count, 1);
+}
+
+// Count a frame the decoder wrote directly into VO memory (see vo_get_image()).
+void mp_image_alloc_count_direct(void)
+{
+    atomic_fetch_add(&direct_count, 1);
+}
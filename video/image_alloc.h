@@ -0,0 +1,29 @@
+#ifndef MPV_IMAGE_ALLOC_H
+#define MPV_IMAGE_ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct mp_image_pool;
+
+enum {
+    MP_HUGEPAGES_NO = 0,
+    MP_HUGEPAGES_TRANSPARENT,   // madvise(MADV_HUGEPAGE)
+    MP_HUGEPAGES_EXPLICIT,      // MAP_HUGETLB, falls back to transparent
+};
+
+struct mp_image_alloc_stats {
+    uint64_t allocs;        // number of frame buffers allocated
+    uint64_t huge_allocs;   // number of them backed by hugepages
+    uint64_t faults;        // page faults caused by prefaulting
+    size_t live_bytes;      // memory currently allocated
+    uint64_t copies;        // number of full frame copies
+    uint64_t direct;        // frames decoded directly into VO memory
+};
+
+void mp_image_pool_set_hugepages(struct mp_image_pool *pool, int mode);
+void mp_image_alloc_get_stats(struct mp_image_alloc_stats *stats);
+void mp_image_alloc_count_copy(void);
+void mp_image_alloc_count_direct(void);
+
+#endif
@@ -31,6 +31,8 @@
 
 #include "talloc.h"
 
+#include "osdep/atomics.h"
+#include "image_alloc.h"
 #include "img_format.h"
 #include "mp_image.h"
 #include "sws_utils.h"
@@ -38,9 +40,16 @@
 
 #include "video/filter/vf.h"
 
+// The refcount is updated with atomic operations. Only if atomics are emulated
+// without compiler support, a global lock is needed.
+#if HAVE_ATOMICS
+#define refcount_lock() ((void)0)
+#define refcount_unlock() ((void)0)
+#else
 static pthread_mutex_t refcount_mutex = PTHREAD_MUTEX_INITIALIZER;
 #define refcount_lock() pthread_mutex_lock(&refcount_mutex)
 #define refcount_unlock() pthread_mutex_unlock(&refcount_mutex)
+#endif
 
 struct m_refcount {
     void *arg;
@@ -48,21 +57,21 @@ struct m_refcount {
     void (*free)(void *arg);
     bool (*ext_is_unique)(void *arg);
     // Native refcount (there may be additional references if .ext_* are set)
-    int refcount;
+    atomic_int refcount;
 };
 
 // Only for checking API usage
 static void m_refcount_destructor(void *ptr)
 {
     struct m_refcount *ref = ptr;
-    assert(ref->refcount == 0);
+    assert(atomic_load(&ref->refcount) == 0);
 }
 
 // Starts out with refcount==1, caller can set .arg and .free and .ext_*
 static struct m_refcount *m_refcount_new(void)
 {
     struct m_refcount *ref = talloc_ptrtype(NULL, ref);
-    *ref = (struct m_refcount) { .refcount = 1 };
+    *ref = (struct m_refcount) { .refcount = ATOMIC_VAR_INIT(1) };
     talloc_set_destructor(ref, m_refcount_destructor);
     return ref;
 }
@@ -70,7 +79,7 @@ static struct m_refcount *m_refcount_new(void)
 static void m_refcount_ref(struct m_refcount *ref)
 {
     refcount_lock();
-    ref->refcount++;
+    atomic_fetch_add(&ref->refcount, 1);
     refcount_unlock();
 }
 
@@ -78,9 +87,9 @@ static void m_refcount_unref(struct m_refcount *ref)
 {
     bool dead;
     refcount_lock();
-    assert(ref->refcount > 0);
-    ref->refcount--;
-    dead = ref->refcount == 0;
+    int old = atomic_fetch_add(&ref->refcount, -1);
+    assert(old > 0);
+    dead = old == 1;
     refcount_unlock();
 
     if (dead) {
@@ -94,7 +103,7 @@ static bool m_refcount_is_unique(struct m_refcount *ref)
 {
     bool nonunique;
     refcount_lock();
-    nonunique = ref->refcount > 1;
+    nonunique = atomic_load(&ref->refcount) > 1;
     refcount_unlock();
 
     if (nonunique)
@@ -104,12 +113,13 @@ static bool m_refcount_is_unique(struct m_refcount *ref)
     return true;
 }
 
-static bool mp_image_alloc_planes(struct mp_image *mpi)
+// Set the strides of mpi (format and size must be set) for storing all planes
+// in a single buffer, and return the size of that buffer. If data is not NULL,
+// also set the plane pointers into it. Returns 0 if mpi can't be allocated.
+size_t mp_image_plane_layout(struct mp_image *mpi, uint8_t *data)
 {
-    assert(!mpi->planes[0]);
-
     if (!mp_image_params_valid(&mpi->params) || mpi->fmt.flags & MP_IMGFLAG_HWACCEL)
-        return false;
+        return 0;
 
     // Note: for non-mod-2 4:2:0 YUV frames, we have to allocate an additional
     //       top/right border. This is needed for correct handling of such
@@ -129,14 +139,28 @@ static bool mp_image_alloc_planes(struct mp_image *mpi)
     for (int n = 0; n < MP_MAX_PLANES; n++)
         sum += plane_size[n];
 
-    uint8_t *data = av_malloc(FFMAX(sum, 1));
+    if (data) {
+        for (int n = 0; n < MP_MAX_PLANES; n++) {
+            mpi->planes[n] = plane_size[n] ? data : NULL;
+            data += plane_size[n];
+        }
+    }
+    return FFMAX(sum, 1);
+}
+
+static bool mp_image_alloc_planes(struct mp_image *mpi)
+{
+    assert(!mpi->planes[0]);
+
+    size_t size = mp_image_plane_layout(mpi, NULL);
+    if (!size)
+        return false;
+
+    uint8_t *data = av_malloc(size);
     if (!data)
         return false;
 
-    for (int n = 0; n < MP_MAX_PLANES; n++) {
-        mpi->planes[n] = plane_size[n] ? data : NULL;
-        data += plane_size[n];
-    }
+    mp_image_plane_layout(mpi, data);
     return true;
 }
 
@@ -214,6 +238,7 @@ struct mp_image *mp_image_new_copy(struct mp_image *img)
         return NULL;
     mp_image_copy(new, img);
     mp_image_copy_attributes(new, img);
+    mp_image_alloc_count_copy();
     return new;
 }
 
@@ -18,6 +18,7 @@
 #include "config.h"
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <pthread.h>
 #include <assert.h>
@@ -25,38 +26,62 @@
 #include "talloc.h"
 
 #include "common/common.h"
+#include "osdep/atomics.h"
+#include "video/image_alloc.h"
 #include "video/mp_image.h"
 
 #include "mp_image_pool.h"
 
+// The image state is updated with atomic operations. Only if atomics are
+// emulated without compiler support, a global lock is needed.
+#if HAVE_ATOMICS
+#define pool_lock() ((void)0)
+#define pool_unlock() ((void)0)
+#else
 static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
 #define pool_lock() pthread_mutex_lock(&pool_mutex)
 #define pool_unlock() pthread_mutex_unlock(&pool_mutex)
+#endif
 
 // Thread-safety: the pool itself is not thread-safe, but pool-allocated images
 // can be referenced and unreferenced from other threads. (As long as the image
-// destructors are thread-safe.)
+// destructors are thread-safe.) Other threads only ever clear the
+// IMAGE_REFERENCED flag of an image; everything else is accessed by the thread
+// owning the pool only, so there are no locks on the mp_image_pool_get() path.
+
+// All images with the same format and size.
+struct pool_bucket {
+    int fmt, w, h;
+    struct mp_image **images;
+    int num_images;
+};
 
 struct mp_image_pool {
     int max_count;
 
-    struct mp_image **images;
-    int num_images;
+    struct pool_bucket *buckets;
+    int num_buckets;
+    int num_images;             // sum of all buckets' num_images
 
     mp_image_allocator allocator;
     void *allocator_ctx;
 
     bool use_lru;
     unsigned int lru_counter;
+
+    struct mp_image_pool_stats stats;
 };
 
 // Used to gracefully handle the case when the pool is freed while image
 // references allocated from the image pool are still held by someone.
+#define IMAGE_REFERENCED 1      // outside mp_image reference exists
+#define IMAGE_POOL_ALIVE 2      // the mp_image_pool references this
+
 struct image_flags {
-    // If both of these are false, the image must be freed.
-    bool referenced;            // outside mp_image reference exists
-    bool pool_alive;            // the mp_image_pool references this
+    // IMAGE_* flags. If all of them are cleared, the image must be freed.
+    atomic_int state;
     unsigned int order;         // for LRU allocation (basically a timestamp)
+    size_t size;                // approximate size of the image data
 };
 
 static void image_pool_destructor(void *ptr)
@@ -77,19 +102,26 @@ struct mp_image_pool *mp_image_pool_new(int max_count)
 
 void mp_image_pool_clear(struct mp_image_pool *pool)
 {
-    for (int n = 0; n < pool->num_images; n++) {
-        struct mp_image *img = pool->images[n];
-        struct image_flags *it = img->priv;
-        bool referenced;
-        pool_lock();
-        assert(it->pool_alive);
-        it->pool_alive = false;
-        referenced = it->referenced;
-        pool_unlock();
-        if (!referenced)
-            talloc_free(img);
+    for (int b = 0; b < pool->num_buckets; b++) {
+        struct pool_bucket *bucket = &pool->buckets[b];
+        for (int n = 0; n < bucket->num_images; n++) {
+            struct mp_image *img = bucket->images[n];
+            struct image_flags *it = img->priv;
+            pool_lock();
+            int old = atomic_fetch_and(&it->state, ~IMAGE_POOL_ALIVE);
+            pool_unlock();
+            assert(old & IMAGE_POOL_ALIVE);
+            if (!(old & IMAGE_REFERENCED))
+                talloc_free(img);
+        }
+        talloc_free(bucket->images);
     }
+    talloc_free(pool->buckets);
+    pool->buckets = NULL;
+    pool->num_buckets = 0;
     pool->num_images = 0;
+    pool->stats.num_images = 0;
+    pool->stats.bytes = 0;
 }
 
 // This is the only function that is allowed to run in a different thread.
@@ -98,37 +130,48 @@ static void unref_image(void *ptr)
 {
     struct mp_image *img = ptr;
     struct image_flags *it = img->priv;
-    bool alive;
     pool_lock();
-    assert(it->referenced);
-    it->referenced = false;
-    alive = it->pool_alive;
+    int old = atomic_fetch_and(&it->state, ~IMAGE_REFERENCED);
     pool_unlock();
-    if (!alive)
+    assert(old & IMAGE_REFERENCED);
+    if (!(old & IMAGE_POOL_ALIVE))
         talloc_free(img);
 }
 
+static struct pool_bucket *find_bucket(struct mp_image_pool *pool, int fmt,
+                                       int w, int h)
+{
+    for (int n = 0; n < pool->num_buckets; n++) {
+        struct pool_bucket *bucket = &pool->buckets[n];
+        if (bucket->fmt == fmt && bucket->w == w && bucket->h == h)
+            return bucket;
+    }
+    return NULL;
+}
+
 // Return a new image of given format/size. Unlike mp_image_pool_get(), this
 // returns NULL if there is no free image of this format/size.
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h)
 {
+    struct pool_bucket *bucket = find_bucket(pool, fmt, w, h);
+    if (!bucket)
+        return NULL;
     struct mp_image *new = NULL;
     pool_lock();
-    for (int n = 0; n < pool->num_images; n++) {
-        struct mp_image *img = pool->images[n];
+    for (int n = 0; n < bucket->num_images; n++) {
+        struct mp_image *img = bucket->images[n];
         struct image_flags *img_it = img->priv;
-        assert(img_it->pool_alive);
-        if (!img_it->referenced) {
-            if (img->imgfmt == fmt && img->w == w && img->h == h) {
-                if (pool->use_lru) {
-                    struct image_flags *new_it = new ? new->priv : NULL;
-                    if (!new_it || new_it->order > img_it->order)
-                        new = img;
-                } else {
+        int state = atomic_load(&img_it->state);
+        assert(state & IMAGE_POOL_ALIVE);
+        if (!(state & IMAGE_REFERENCED)) {
+            if (pool->use_lru) {
+                struct image_flags *new_it = new ? new->priv : NULL;
+                if (!new_it || new_it->order > img_it->order)
                     new = img;
-                    break;
-                }
+            } else {
+                new = img;
+                break;
             }
         }
     }
@@ -136,12 +179,25 @@ struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
     if (!new)
         return NULL;
     struct image_flags *it = new->priv;
-    assert(!it->referenced && it->pool_alive);
-    it->referenced = true;
+    // Only the pool owner sets this flag, so nobody can have changed it.
+    pool_lock();
+    int old = atomic_fetch_or(&it->state, IMAGE_REFERENCED);
+    pool_unlock();
+    assert(old == IMAGE_POOL_ALIVE);
     it->order = ++pool->lru_counter;
     return mp_image_new_custom_ref(new, new, unref_image);
 }
 
+static size_t image_data_size(struct mp_image *img)
+{
+    if (img->fmt.flags & MP_IMGFLAG_HWACCEL)
+        return 0;
+    size_t size = 0;
+    for (int n = 0; n < img->num_planes; n++)
+        size += (size_t)abs(img->stride[n]) * mp_image_plane_h(img, n);
+    return size;
+}
+
 // Return a new image of given format/size. The only difference to
 // mp_image_alloc() is that there is a transparent mechanism to recycle image
 // data allocations through this pool.
@@ -154,23 +210,37 @@ struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
     if (!pool)
         return mp_image_alloc(fmt, w, h);
     struct mp_image *new = mp_image_pool_get_no_alloc(pool, fmt, w, h);
-    if (!new) {
-        if (pool->num_images >= pool->max_count)
-            mp_image_pool_clear(pool);
-        if (pool->allocator) {
-            new = pool->allocator(pool->allocator_ctx, fmt, w, h);
-        } else {
-            new = mp_image_alloc(fmt, w, h);
-        }
-        if (!new)
-            return NULL;
-        struct image_flags *it = talloc_ptrtype(new, it);
-        *it = (struct image_flags) { .pool_alive = true };
-        new->priv = it;
-        MP_TARRAY_APPEND(pool, pool->images, pool->num_images, new);
-        new = mp_image_pool_get_no_alloc(pool, fmt, w, h);
+    if (new) {
+        pool->stats.hits++;
+        return new;
     }
-    return new;
+    if (pool->num_images >= pool->max_count)
+        mp_image_pool_clear(pool);
+    if (pool->allocator) {
+        new = pool->allocator(pool->allocator_ctx, fmt, w, h);
+    } else {
+        new = mp_image_alloc(fmt, w, h);
+    }
+    if (!new)
+        return NULL;
+    pool->stats.misses++;
+    struct image_flags *it = talloc_ptrtype(new, it);
+    *it = (struct image_flags) {
+        .state = ATOMIC_VAR_INIT(IMAGE_POOL_ALIVE),
+        .size = image_data_size(new),
+    };
+    new->priv = it;
+    struct pool_bucket *bucket = find_bucket(pool, fmt, w, h);
+    if (!bucket) {
+        MP_TARRAY_APPEND(pool, pool->buckets, pool->num_buckets,
+                         (struct pool_bucket){ .fmt = fmt, .w = w, .h = h });
+        bucket = &pool->buckets[pool->num_buckets - 1];
+    }
+    MP_TARRAY_APPEND(pool, bucket->images, bucket->num_images, new);
+    pool->num_images++;
+    pool->stats.num_images = pool->num_images;
+    pool->stats.bytes += it->size;
+    return mp_image_pool_get_no_alloc(pool, fmt, w, h);
 }
 
 // Like mp_image_new_copy(), but allocate the image out of the pool.
@@ -183,6 +253,7 @@ struct mp_image *mp_image_pool_new_copy(struct mp_image_pool *pool,
     if (new) {
         mp_image_copy(new, img);
         mp_image_copy_attributes(new, img);
+        mp_image_alloc_count_copy();
     }
     return new;
 }
@@ -216,3 +287,9 @@ void mp_image_pool_set_lru(struct mp_image_pool *pool)
 {
     pool->use_lru = true;
 }
+
+void mp_image_pool_get_stats(struct mp_image_pool *pool,
+                             struct mp_image_pool_stats *stats)
+{
+    *stats = pool->stats;
+}
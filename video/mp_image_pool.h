@@ -2,15 +2,26 @@
 #define MPV_MP_IMAGE_POOL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 struct mp_image_pool;
 
+struct mp_image_pool_stats {
+    uint64_t hits;      // mp_image_pool_get() calls that reused an image
+    uint64_t misses;    // mp_image_pool_get() calls that allocated an image
+    int num_images;     // images currently owned by the pool
+    size_t bytes;       // approximate size of their data
+};
+
 struct mp_image_pool *mp_image_pool_new(int max_count);
 struct mp_image *mp_image_pool_get(struct mp_image_pool *pool, int fmt,
                                    int w, int h);
 void mp_image_pool_clear(struct mp_image_pool *pool);
 
 void mp_image_pool_set_lru(struct mp_image_pool *pool);
+void mp_image_pool_get_stats(struct mp_image_pool *pool,
+                             struct mp_image_pool_stats *stats);
 
 struct mp_image *mp_image_pool_get_no_alloc(struct mp_image_pool *pool, int fmt,
                                             int w, int h);
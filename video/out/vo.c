@@ -1012,6 +1012,16 @@ struct mp_image *vo_get_current_frame(struct vo *vo)
     return r;
 }
 
+// Allocate an image for direct rendering (see vo_driver.get_image). Can be
+// called from any thread. Returns NULL if the VO doesn't support it.
+struct mp_image *vo_get_image(struct vo *vo, int imgfmt, int w, int h,
+                              int stride_align)
+{
+    if (!vo->driver->get_image)
+        return NULL;
+    return vo->driver->get_image(vo, imgfmt, w, h, stride_align);
+}
+
 /*
  * lookup an integer in a table, table must have 0 as the last key
  * param: key key to search for
@@ -243,6 +243,20 @@ struct vo_driver {
     void (*wakeup)(struct vo *vo);
     int (*wait_events)(struct vo *vo, int64_t until_time_us);
 
+    /*
+     * Optional. Allocate an image the decoder can decode into directly, so
+     * that the VO can display it without copying. Like wakeup(), this is
+     * called from outside of the VO thread (the decoder's threads), and must
+     * be thread-safe.
+     * imgfmt, w, h: format and size of the image. w/h can be larger than the
+     *               configured video size (the decoder's padding).
+     * stride_align: all plane pointers and strides must be multiples of this
+     * returns: a refcounted image, or NULL if not possible (then the decoder
+     *          uses its own memory)
+     */
+    struct mp_image *(*get_image)(struct vo *vo, int imgfmt, int w, int h,
+                                  int stride_align);
+
     /*
      * Closes driver. Should restore the original state of the system.
      */
@@ -318,6 +332,8 @@ void vo_query_formats(struct vo *vo, uint8_t *list);
 void vo_event(struct vo *vo, int event);
 int vo_query_and_reset_events(struct vo *vo, int events);
 struct mp_image *vo_get_current_frame(struct vo *vo);
+struct mp_image *vo_get_image(struct vo *vo, int imgfmt, int w, int h,
+                              int stride_align);
 
 void vo_set_flip_queue_params(struct vo *vo, int64_t offset_us, bool vsync_timed);
 int64_t vo_get_vsync_interval(struct vo *vo);
@@ -33,6 +33,7 @@
 #include "vo.h"
 #include "video/csputils.h"
 #include "video/mp_image.h"
+#include "video/image_alloc.h"
 #include "video/img_format.h"
 #include "common/msg.h"
 #include "common/common.h"
@@ -1453,6 +1454,7 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
         goto done;
 
     mp_image_copy(&buffer, mpi);
+    mp_image_alloc_count_copy();
 
     d3d_unlock_video_objects(priv);
 
@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "common/common.h"
 #include "options/options.h"
 #include "video/fmt-conversion.h"
@@ -33,11 +34,19 @@
 
 #include "sub/osd.h"
 
+// A frame to encode.
+struct encode_item {
+    struct mp_image *img;   // NULL: flush the encoder
+    int64_t pts;            // in codec time base
+    int64_t ipts;           // in worst_time_base (for packets without pts)
+};
+
 struct priv {
     uint8_t *buffer;
     size_t buffer_size;
     AVStream *stream;
     int have_first_packet;
+    bool rawpicture;
 
     int harddup;
 
@@ -55,6 +64,18 @@ struct priv {
     int worst_time_base_is_stream;
 
     bool shutdown;
+
+    // Encoder thread (--oqueue). The thread owns the codec context, the
+    // buffer and have_first_packet while it's running.
+    bool threaded;
+    pthread_t thread;
+    pthread_mutex_t lock; // protects the fields below
+    pthread_cond_t wakeup;
+    struct encode_item *queue;
+    int num_queue;
+    int max_queue;
+    bool busy;
+    bool terminate;
 };
 
 static int preinit(struct vo *vo)
@@ -71,6 +92,7 @@ static int preinit(struct vo *vo)
 }
 
 static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi);
+static void stop_thread(struct vo *vo);
 static void uninit(struct vo *vo)
 {
     struct priv *vc = vo->priv;
@@ -86,9 +108,44 @@ static void uninit(struct vo *vo)
 
     pthread_mutex_unlock(&vo->encode_lavc_ctx->lock);
 
+    // Wait until the queued frames are encoded (needs the encode_lavc lock).
+    stop_thread(vo);
+
     vc->shutdown = true;
 }
 
+static void *encode_thread(void *p);
+
+static void start_thread(struct vo *vo)
+{
+    struct priv *vc = vo->priv;
+    pthread_mutex_init(&vc->lock, NULL);
+    pthread_cond_init(&vc->wakeup, NULL);
+    vc->max_queue = vo->encode_lavc_ctx->options->queue;
+    if (pthread_create(&vc->thread, NULL, encode_thread, vo)) {
+        pthread_cond_destroy(&vc->wakeup);
+        pthread_mutex_destroy(&vc->lock);
+        MP_WARN(vo, "could not start encoder thread\n");
+        return;
+    }
+    vc->threaded = true;
+}
+
+static void stop_thread(struct vo *vo)
+{
+    struct priv *vc = vo->priv;
+    if (!vc->threaded)
+        return;
+    pthread_mutex_lock(&vc->lock);
+    vc->terminate = true;
+    pthread_cond_broadcast(&vc->wakeup);
+    pthread_mutex_unlock(&vc->lock);
+    pthread_join(vc->thread, NULL);
+    pthread_cond_destroy(&vc->wakeup);
+    pthread_mutex_destroy(&vc->lock);
+    vc->threaded = false;
+}
+
 static int reconfig(struct vo *vo, struct mp_image_params *params, int flags)
 {
     struct priv *vc = vo->priv;
@@ -165,6 +222,9 @@ static int reconfig(struct vo *vo, struct mp_image_params *params, int flags)
     if (encode_lavc_open_codec(vo->encode_lavc_ctx, vc->stream) < 0)
         goto error;
 
+    vc->rawpicture =
+        encode_lavc_oformat_flags(vo->encode_lavc_ctx) & AVFMT_RAWPICTURE;
+
     vc->buffer_size = 6 * width * height + 200;
     if (vc->buffer_size < FF_MIN_BUFFER_SIZE)
         vc->buffer_size = FF_MIN_BUFFER_SIZE;
@@ -173,6 +233,11 @@ static int reconfig(struct vo *vo, struct mp_image_params *params, int flags)
 
     vc->buffer = talloc_size(vc, vc->buffer_size);
 
+    // With AVFMT_RAWPICTURE, packets point into the image, which would have
+    // to stay valid until the muxer thread wrote them.
+    if (vo->encode_lavc_ctx->options->queue > 0 && !vc->rawpicture)
+        start_thread(vo);
+
 done:
     pthread_mutex_unlock(&vo->encode_lavc_ctx->lock);
     return 0;
@@ -198,7 +263,9 @@ static int query_format(struct vo *vo, int format)
     return flags;
 }
 
-static void write_packet(struct vo *vo, int size, AVPacket *packet)
+// Must be called with the encode_lavc lock held.
+static void write_packet(struct vo *vo, int size, AVPacket *packet,
+                         int64_t ipts)
 {
     struct priv *vc = vo->priv;
 
@@ -208,6 +275,9 @@ static void write_packet(struct vo *vo, int size, AVPacket *packet)
     }
 
     if (size > 0) {
+        if (!vc->rawpicture)
+            encode_lavc_write_stats(vo->encode_lavc_ctx, vc->stream);
+
         packet->stream_index = vc->stream->index;
         if (packet->pts != AV_NOPTS_VALUE) {
             packet->pts = av_rescale_q(packet->pts,
@@ -215,7 +285,7 @@ static void write_packet(struct vo *vo, int size, AVPacket *packet)
                                        vc->stream->time_base);
         } else {
             MP_VERBOSE(vo, "codec did not provide pts\n");
-            packet->pts = av_rescale_q(vc->lastipts, vc->worst_time_base,
+            packet->pts = av_rescale_q(ipts, vc->worst_time_base,
                                        vc->stream->time_base);
         }
         if (packet->dts != AV_NOPTS_VALUE) {
@@ -253,7 +323,7 @@ static void write_packet(struct vo *vo, int size, AVPacket *packet)
 static int encode_video(struct vo *vo, AVFrame *frame, AVPacket *packet)
 {
     struct priv *vc = vo->priv;
-    if (encode_lavc_oformat_flags(vo->encode_lavc_ctx) & AVFMT_RAWPICTURE) {
+    if (vc->rawpicture) {
         if (!frame)
             return 0;
         memcpy(vc->buffer, frame, sizeof(AVPicture));
@@ -273,17 +343,112 @@ static int encode_video(struct vo *vo, AVFrame *frame, AVPacket *packet)
                    frame->pts * (double) vc->stream->codec->time_base.num /
                    (double) vc->stream->codec->time_base.den, size);
 
-        if (got_packet)
-            encode_lavc_write_stats(vo->encode_lavc_ctx, vc->stream);
         return size;
     }
 }
 
-static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
+// Encode item->img, or flush the encoder if it's NULL, and write the packets.
+// If threaded, this runs on the encoder thread, and the encode_lavc lock is
+// taken only for writing packets. Otherwise, the lock is already held.
+static void encode_item(struct vo *vo, struct encode_item *item)
 {
     struct priv *vc = vo->priv;
     struct encode_lavc_context *ectx = vo->encode_lavc_ctx;
+    AVFrame *frame = NULL;
     int size;
+
+    if (item->img) {
+        frame = av_frame_alloc();
+
+        frame->pts = item->pts;
+
+        enum AVPictureType savetype = frame->pict_type;
+        mp_image_copy_fields_to_av_frame(frame, item->img);
+        frame->pict_type = savetype;
+            // keep this at avcodec_get_frame_defaults default
+
+        frame->quality = vc->stream->codec->global_quality;
+    }
+
+    do {
+        AVPacket packet;
+        av_init_packet(&packet);
+        packet.data = vc->buffer;
+        packet.size = vc->buffer_size;
+        size = encode_video(vo, frame, &packet);
+        if (vc->threaded)
+            pthread_mutex_lock(&ectx->lock);
+        write_packet(vo, size, &packet, item->ipts);
+        if (vc->threaded)
+            pthread_mutex_unlock(&ectx->lock);
+    } while (!frame && size > 0);
+
+    av_frame_free(&frame);
+}
+
+static void *encode_thread(void *p)
+{
+    struct vo *vo = p;
+    struct priv *vc = vo->priv;
+
+    pthread_mutex_lock(&vc->lock);
+    while (1) {
+        if (vc->num_queue) {
+            struct encode_item item = vc->queue[0];
+            MP_TARRAY_REMOVE_AT(vc->queue, vc->num_queue, 0);
+            pthread_cond_broadcast(&vc->wakeup);
+            pthread_mutex_unlock(&vc->lock);
+
+            encode_item(vo, &item);
+            talloc_free(item.img);
+
+            pthread_mutex_lock(&vc->lock);
+            continue;
+        }
+        if (vc->terminate)
+            break;
+        pthread_cond_wait(&vc->wakeup, &vc->lock);
+    }
+    pthread_mutex_unlock(&vc->lock);
+    return NULL;
+}
+
+// Encode the given frame (or flush if img==NULL), either directly, or by
+// passing it to the encoder thread. Called with the encode_lavc lock held.
+static void queue_item(struct vo *vo, struct mp_image *img, int64_t pts,
+                       int64_t ipts)
+{
+    struct priv *vc = vo->priv;
+    struct encode_lavc_context *ectx = vo->encode_lavc_ctx;
+    struct encode_item item = { .pts = pts, .ipts = ipts };
+
+    if (!vc->threaded) {
+        item.img = img;
+        encode_item(vo, &item);
+        return;
+    }
+
+    if (img)
+        item.img = mp_image_new_ref(img);
+
+    pthread_mutex_lock(&vc->lock);
+    while (vc->num_queue >= vc->max_queue) {
+        // The encoder thread needs the encode_lavc lock to write packets.
+        pthread_mutex_unlock(&ectx->lock);
+        pthread_cond_wait(&vc->wakeup, &vc->lock);
+        pthread_mutex_unlock(&vc->lock);
+        pthread_mutex_lock(&ectx->lock);
+        pthread_mutex_lock(&vc->lock);
+    }
+    MP_TARRAY_APPEND(vc, vc->queue, vc->num_queue, item);
+    pthread_cond_broadcast(&vc->wakeup);
+    pthread_mutex_unlock(&vc->lock);
+}
+
+static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
+{
+    struct priv *vc = vo->priv;
+    struct encode_lavc_context *ectx = vo->encode_lavc_ctx;
     AVCodecContext *avc;
     int64_t frameipts;
     double nextpts;
@@ -412,7 +577,6 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
         // we have a valid image in lastimg
         while (vc->lastimg && vc->lastipts < frameipts) {
             int64_t thisduration = vc->harddup ? 1 : (frameipts - vc->lastipts);
-            AVPacket packet;
 
             // we will ONLY encode this frame if it can be encoded at at least
             // vc->mindeltapts after the last encoded frame!
@@ -424,28 +588,14 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
                 skipframes = 0;
 
             if (thisduration > skipframes) {
-                AVFrame *frame = av_frame_alloc();
-
                 // this is a nop, unless the worst time base is the STREAM time base
-                frame->pts = av_rescale_q(vc->lastipts + skipframes,
-                                          vc->worst_time_base, avc->time_base);
+                int64_t frame_pts = av_rescale_q(vc->lastipts + skipframes,
+                                                 vc->worst_time_base,
+                                                 avc->time_base);
 
-                enum AVPictureType savetype = frame->pict_type;
-                mp_image_copy_fields_to_av_frame(frame, vc->lastimg);
-                frame->pict_type = savetype;
-                    // keep this at avcodec_get_frame_defaults default
-
-                frame->quality = avc->global_quality;
-
-                av_init_packet(&packet);
-                packet.data = vc->buffer;
-                packet.size = vc->buffer_size;
-                size = encode_video(vo, frame, &packet);
-                write_packet(vo, size, &packet);
+                queue_item(vo, vc->lastimg, frame_pts, vc->lastipts);
                 ++vc->lastdisplaycount;
                 vc->lastencodedipts = vc->lastipts + skipframes;
-
-                av_frame_free(&frame);
             }
 
             vc->lastipts += thisduration;
@@ -454,14 +604,7 @@ static void draw_image_unlocked(struct vo *vo, mp_image_t *mpi)
 
     if (!mpi) {
         // finish encoding
-        do {
-            AVPacket packet;
-            av_init_packet(&packet);
-            packet.data = vc->buffer;
-            packet.size = vc->buffer_size;
-            size = encode_video(vo, NULL, &packet);
-            write_packet(vo, size, &packet);
-        } while (size > 0);
+        queue_item(vo, NULL, AV_NOPTS_VALUE, vc->lastipts);
     } else {
         if (frameipts >= vc->lastframeipts) {
             if (vc->lastframeipts != AV_NOPTS_VALUE && vc->lastdisplaycount != 1)
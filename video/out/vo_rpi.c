@@ -37,6 +37,7 @@
 #include "options/m_config.h"
 #include "vo.h"
 #include "video/mp_image.h"
+#include "video/image_alloc.h"
 #include "sub/osd.h"
 #include "sub/img_convert.h"
 
@@ -367,6 +368,7 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
         struct mp_image dmpi = {0};
         buffer->length = layout_buffer(&dmpi, buffer, vo->params);
         mp_image_copy(&dmpi, mpi);
+        mp_image_alloc_count_copy();
 
         talloc_free(mpi);
         mpi = new_ref;
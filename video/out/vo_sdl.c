@@ -41,6 +41,7 @@
 #include "sub/osd.h"
 
 #include "video/mp_image.h"
+#include "video/image_alloc.h"
 
 #include "win_state.h"
 #include "config.h"
@@ -905,6 +906,7 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
         }
 
         mp_image_copy(&texmpi, mpi);
+        mp_image_alloc_count_copy();
 
         SDL_UnlockTexture(vc->tex);
 
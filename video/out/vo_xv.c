@@ -23,6 +23,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <errno.h>
+#include <assert.h>
+#include <pthread.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 
@@ -51,6 +53,7 @@
 #include "sub/osd.h"
 #include "sub/draw_bmp.h"
 #include "video/csputils.h"
+#include "video/image_alloc.h"
 #include "options/m_option.h"
 #include "input/input.h"
 #include "osdep/timer.h"
@@ -94,9 +97,43 @@ struct xvctx {
 #if HAVE_SHM && HAVE_XEXT
     XShmSegmentInfo Shminfo[MAX_BUFFERS];
     int Shm_Warned_Slow;
+    struct dr_pool *dr_pool;
+    // Decoder frames recently passed to XvShmPutImage()
+    struct mp_image *dr_shown[MAX_BUFFERS];
+    int dr_index;
+    XvImage *dr_put;    // image to show on the next flip_page (or NULL)
 #endif
 };
 
+#if HAVE_SHM && HAVE_XEXT
+// Shared memory images handed out to the decoder with get_image(), so that
+// decoded frames can be passed to XvShmPutImage() without copying them. The
+// pool is referenced by the VO and by each buffer in use, because the decoder
+// can keep its frames after the VO is gone.
+struct dr_pool {
+    pthread_mutex_t lock;
+    int refcount;
+    Display *display;           // NULL once the VO is gone
+    int xv_port;
+    unsigned int xv_format;
+    int imgfmt, w, h;           // current VO configuration (imgfmt 0: none)
+    int generation;             // incremented on each reconfig
+    struct dr_buffer **buffers; // all buffers, used or not
+    int num_buffers;
+};
+
+struct dr_buffer {
+    struct dr_pool *pool;
+    XShmSegmentInfo shminfo;
+    XvImage *xvimage;           // NULL after the VO detached the segment
+    bool attached;
+    struct mp_image img;        // planes pointing into the segment
+    int stride_align;
+    int generation;
+    bool in_use;
+};
+#endif
+
 struct fmt_entry {
     int imgfmt;
     int fourcc;
@@ -112,6 +149,9 @@ static const struct fmt_entry fmt_table[] = {
 static bool allocate_xvimage(struct vo *, int);
 static void deallocate_xvimage(struct vo *vo, int foo);
 static struct mp_image get_xv_buffer(struct vo *vo, int buf_index);
+#if HAVE_SHM && HAVE_XEXT
+static void dr_pool_reconfig(struct vo *vo, int imgfmt, int w, int h);
+#endif
 
 static int find_xv_format(int imgfmt)
 {
@@ -429,6 +469,9 @@ static int reconfig(struct vo *vo, struct mp_image_params *params, int flags)
     int i;
 
     mp_image_unrefp(&ctx->original_image);
+#if HAVE_SHM && HAVE_XEXT
+    dr_pool_reconfig(vo, 0, 0, 0);
+#endif
 
     ctx->image_height = params->h;
     ctx->image_width  = params->w;
@@ -478,6 +521,13 @@ static int reconfig(struct vo *vo, struct mp_image_params *params, int flags)
     ctx->current_buf = 0;
     ctx->current_ip_buf = 0;
 
+#if HAVE_SHM && HAVE_XEXT
+    if (ctx->Shmem_Flag) {
+        dr_pool_reconfig(vo, ctx->image_format, ctx->image_width,
+                         ctx->image_height);
+    }
+#endif
+
     int is_709 = params->colorspace == MP_CSP_BT_709;
     xv_set_eq(vo, ctx->xv_port, "bt_709", is_709 * 200 - 100);
     read_xv_csp(vo);
@@ -591,6 +641,17 @@ static inline void put_xvimage(struct vo *vo, XvImage *xvi)
     }
 }
 
+static void set_xv_planes(struct mp_image *img, XvImage *xv_image,
+                          unsigned int xv_format)
+{
+    bool swapuv = xv_format == MP_FOURCC_YV12;
+    for (int n = 0; n < img->num_planes; n++) {
+        int sn = n > 0 &&  swapuv ? (n == 1 ? 2 : 1) : n;
+        img->planes[n] = xv_image->data + xv_image->offsets[sn];
+        img->stride[n] = xv_image->pitches[sn];
+    }
+}
+
 static struct mp_image get_xv_buffer(struct vo *vo, int buf_index)
 {
     struct xvctx *ctx = vo->priv;
@@ -599,13 +660,7 @@ static struct mp_image get_xv_buffer(struct vo *vo, int buf_index)
     struct mp_image img = {0};
     mp_image_set_size(&img, ctx->image_width, ctx->image_height);
     mp_image_setfmt(&img, ctx->image_format);
-
-    bool swapuv = ctx->xv_format == MP_FOURCC_YV12;
-    for (int n = 0; n < img.num_planes; n++) {
-        int sn = n > 0 &&  swapuv ? (n == 1 ? 2 : 1) : n;
-        img.planes[n] = xv_image->data + xv_image->offsets[sn];
-        img.stride[n] = xv_image->pitches[sn];
-    }
+    set_xv_planes(&img, xv_image, ctx->xv_format);
 
     if (vo->params) {
         struct mp_image_params params = *vo->params;
@@ -617,6 +672,250 @@ static struct mp_image get_xv_buffer(struct vo *vo, int buf_index)
     return img;
 }
 
+#if HAVE_SHM && HAVE_XEXT
+
+static void dr_pool_unref(struct dr_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    bool destroy = --pool->refcount == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (destroy) {
+        assert(!pool->num_buffers);
+        pthread_mutex_destroy(&pool->lock);
+        talloc_free(pool);
+    }
+}
+
+// Release the X side of the buffer. Must be called with pool->lock held, and
+// only while pool->display is valid.
+static void dr_buffer_detach(struct dr_pool *pool, struct dr_buffer *buf)
+{
+    if (buf->attached)
+        XShmDetach(pool->display, &buf->shminfo);
+    buf->attached = false;
+    if (buf->xvimage)
+        XFree(buf->xvimage);
+    buf->xvimage = NULL;
+}
+
+// Must be called with pool->lock held.
+static void dr_buffer_free(struct dr_pool *pool, struct dr_buffer *buf)
+{
+    if (pool->display)
+        dr_buffer_detach(pool, buf);
+    if (buf->shminfo.shmaddr)
+        shmdt(buf->shminfo.shmaddr);
+    for (int n = 0; n < pool->num_buffers; n++) {
+        if (pool->buffers[n] == buf) {
+            MP_TARRAY_REMOVE_AT(pool->buffers, pool->num_buffers, n);
+            break;
+        }
+    }
+    talloc_free(buf);
+}
+
+// Must be called with pool->lock held.
+static struct dr_buffer *dr_buffer_alloc(struct dr_pool *pool, int w, int h,
+                                         int stride_align)
+{
+    struct dr_buffer *buf = talloc_zero(NULL, struct dr_buffer);
+    buf->pool = pool;
+    buf->stride_align = stride_align;
+    buf->generation = pool->generation;
+    MP_TARRAY_APPEND(pool, pool->buffers, pool->num_buffers, buf);
+
+    // Chroma planes have half the width, and must be aligned as well.
+    buf->xvimage = (XvImage *) XvShmCreateImage(pool->display, pool->xv_port,
+                                                pool->xv_format, NULL,
+                                                FFALIGN(w, stride_align * 2),
+                                                h, &buf->shminfo);
+    if (!buf->xvimage)
+        goto error;
+
+    buf->shminfo.shmid = shmget(IPC_PRIVATE, buf->xvimage->data_size,
+                                IPC_CREAT | 0777);
+    if (buf->shminfo.shmid < 0)
+        goto error;
+    buf->shminfo.shmaddr = shmat(buf->shminfo.shmid, 0, 0);
+    if (buf->shminfo.shmaddr == (void *)-1) {
+        buf->shminfo.shmaddr = NULL;
+        shmctl(buf->shminfo.shmid, IPC_RMID, 0);
+        goto error;
+    }
+    buf->shminfo.readOnly = False;
+    buf->xvimage->data = buf->shminfo.shmaddr;
+    buf->attached = XShmAttach(pool->display, &buf->shminfo);
+    XSync(pool->display, False);
+    shmctl(buf->shminfo.shmid, IPC_RMID, 0);
+    if (!buf->attached)
+        goto error;
+
+    mp_image_setfmt(&buf->img, pool->imgfmt);
+    mp_image_set_size(&buf->img, w, h);
+    set_xv_planes(&buf->img, buf->xvimage, pool->xv_format);
+    for (int n = 0; n < buf->img.num_planes; n++) {
+        if (((uintptr_t)buf->img.planes[n] | buf->img.stride[n]) % stride_align)
+            goto error;
+    }
+
+    return buf;
+
+error:
+    dr_buffer_free(pool, buf);
+    return NULL;
+}
+
+// Called when the decoder (and everyone else) is done with the image.
+// Can be called from any thread.
+static void dr_buffer_release(void *arg)
+{
+    struct dr_buffer *buf = arg;
+    struct dr_pool *pool = buf->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    buf->in_use = false;
+    // Buffers of a previous configuration are never reused.
+    if (!pool->display || buf->generation != pool->generation)
+        dr_buffer_free(pool, buf);
+    pthread_mutex_unlock(&pool->lock);
+
+    dr_pool_unref(pool);
+}
+
+static struct mp_image *get_image(struct vo *vo, int imgfmt, int w, int h,
+                                  int stride_align)
+{
+    struct xvctx *ctx = vo->priv;
+    struct dr_pool *pool = ctx->dr_pool;
+    struct mp_image *res = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (!pool->imgfmt || imgfmt != pool->imgfmt || w < pool->w || h < pool->h)
+        goto done;
+
+    struct dr_buffer *buf = NULL;
+    for (int n = 0; n < pool->num_buffers; n++) {
+        struct dr_buffer *cur = pool->buffers[n];
+        if (!cur->in_use && cur->generation == pool->generation &&
+            cur->img.w == w && cur->img.h == h &&
+            cur->stride_align == stride_align)
+        {
+            buf = cur;
+            break;
+        }
+    }
+    if (!buf)
+        buf = dr_buffer_alloc(pool, w, h, stride_align);
+    if (!buf)
+        goto done;
+
+    res = mp_image_new_custom_ref(&buf->img, buf, dr_buffer_release);
+    if (res) {
+        buf->in_use = true;
+        pool->refcount++;
+    }
+
+done:
+    pthread_mutex_unlock(&pool->lock);
+    return res;
+}
+
+// Set the format the decoder's images must have; imgfmt=0 disables direct
+// rendering. Unused buffers of the previous configuration are freed.
+static void dr_pool_reconfig(struct vo *vo, int imgfmt, int w, int h)
+{
+    struct xvctx *ctx = vo->priv;
+    struct dr_pool *pool = ctx->dr_pool;
+
+    for (int n = 0; n < MAX_BUFFERS; n++)
+        mp_image_unrefp(&ctx->dr_shown[n]);
+    ctx->dr_put = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->xv_port = ctx->xv_port;
+    pool->xv_format = ctx->xv_format;
+    pool->imgfmt = imgfmt;
+    pool->w = w;
+    pool->h = h;
+    pool->generation++;
+    for (int n = pool->num_buffers - 1; n >= 0; n--) {
+        if (!pool->buffers[n]->in_use)
+            dr_buffer_free(pool, pool->buffers[n]);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void dr_pool_create(struct vo *vo)
+{
+    struct xvctx *ctx = vo->priv;
+    struct dr_pool *pool = talloc_zero(NULL, struct dr_pool);
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->refcount = 1;
+    pool->display = vo->x11->display;
+    ctx->dr_pool = pool;
+}
+
+static void dr_pool_destroy(struct vo *vo)
+{
+    struct xvctx *ctx = vo->priv;
+    struct dr_pool *pool = ctx->dr_pool;
+    if (!pool)
+        return;
+
+    dr_pool_reconfig(vo, 0, 0, 0);
+
+    // Buffers still used by the decoder lose their X side now, and are freed
+    // by the last dr_buffer_release().
+    pthread_mutex_lock(&pool->lock);
+    for (int n = 0; n < pool->num_buffers; n++)
+        dr_buffer_detach(pool, pool->buffers[n]);
+    pool->display = NULL;
+    pthread_mutex_unlock(&pool->lock);
+
+    dr_pool_unref(pool);
+    ctx->dr_pool = NULL;
+}
+
+// Return the buffer mpi was decoded into, if it can be shown directly.
+static struct dr_buffer *find_dr_buffer(struct vo *vo, struct mp_image *mpi)
+{
+    struct xvctx *ctx = vo->priv;
+    struct dr_pool *pool = ctx->dr_pool;
+    struct dr_buffer *res = NULL;
+    if (!mpi)
+        return NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    for (int n = 0; n < pool->num_buffers; n++) {
+        struct dr_buffer *buf = pool->buffers[n];
+        if (buf->in_use && buf->xvimage && buf->img.planes[0] == mpi->planes[0]
+            && buf->generation == pool->generation &&
+            mpi->imgfmt == pool->imgfmt)
+        {
+            res = buf;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return res;
+}
+
+static void osd_visible_cb(void *ctx, struct sub_bitmaps *imgs)
+{
+    *(bool *)ctx = true;
+}
+
+#else
+
+static struct mp_image *get_image(struct vo *vo, int imgfmt, int w, int h,
+                                  int stride_align)
+{
+    return NULL;
+}
+
+#endif /* HAVE_SHM && HAVE_XEXT */
+
 static void wait_for_completion(struct vo *vo, int max_outstanding)
 {
 #if HAVE_SHM && HAVE_XEXT
@@ -639,7 +938,12 @@ static void wait_for_completion(struct vo *vo, int max_outstanding)
 static void flip_page(struct vo *vo)
 {
     struct xvctx *ctx = vo->priv;
-    put_xvimage(vo, ctx->xvimage[ctx->current_buf]);
+    XvImage *xvi = ctx->xvimage[ctx->current_buf];
+#if HAVE_SHM && HAVE_XEXT
+    if (ctx->dr_put)
+        xvi = ctx->dr_put;
+#endif
+    put_xvimage(vo, xvi);
 
     /* remember the currently visible buffer */
     ctx->current_buf = (ctx->current_buf + 1) % ctx->num_buffers;
@@ -655,16 +959,40 @@ static void draw_image(struct vo *vo, mp_image_t *mpi)
 
     wait_for_completion(vo, ctx->num_buffers - 1);
 
+    struct mp_osd_res res = osd_res_from_image_params(vo->params);
+
+#if HAVE_SHM && HAVE_XEXT
+    ctx->dr_put = NULL;
+    struct dr_buffer *dr = find_dr_buffer(vo, mpi);
+    if (dr) {
+        // The OSD can't be drawn onto a frame the decoder might still use.
+        bool osd = false;
+        osd_draw(vo->osd, res, mpi->pts, 0, mp_draw_sub_formats,
+                 osd_visible_cb, &osd);
+        if (!osd) {
+            ctx->dr_put = dr->xvimage;
+            // Keep the frame referenced until XvShmPutImage() must have
+            // finished reading it (see wait_for_completion()).
+            ctx->dr_index = (ctx->dr_index + 1) % ctx->num_buffers;
+            mp_image_setrefp(&ctx->dr_shown[ctx->dr_index], mpi);
+            goto done;
+        }
+    }
+#endif
+
     struct mp_image xv_buffer = get_xv_buffer(vo, ctx->current_buf);
     if (mpi) {
         mp_image_copy(&xv_buffer, mpi);
+        mp_image_alloc_count_copy();
     } else {
         mp_image_clear(&xv_buffer, 0, 0, xv_buffer.w, xv_buffer.h);
     }
 
-    struct mp_osd_res res = osd_res_from_image_params(vo->params);
     osd_draw_on_image(vo->osd, res, mpi ? mpi->pts : 0, 0, &xv_buffer);
 
+#if HAVE_SHM && HAVE_XEXT
+done:
+#endif
     if (mpi != ctx->original_image) {
         talloc_free(ctx->original_image);
         ctx->original_image = mpi;
@@ -693,6 +1021,10 @@ static void uninit(struct vo *vo)
 
     talloc_free(ctx->original_image);
 
+#if HAVE_SHM && HAVE_XEXT
+    dr_pool_destroy(vo);
+#endif
+
     if (ctx->ai)
         XvFreeAdaptorInfo(ctx->ai);
     ctx->ai = NULL;
@@ -719,6 +1051,10 @@ static int preinit(struct vo *vo)
 
     struct vo_x11_state *x11 = vo->x11;
 
+#if HAVE_SHM && HAVE_XEXT
+    dr_pool_create(vo);
+#endif
+
     /* check for Xvideo extension */
     unsigned int ver, rel, req, ev, err;
     if (Success != XvQueryExtension(x11->display, &ver, &rel, &req, &ev, &err)) {
@@ -844,6 +1180,7 @@ const struct vo_driver video_out_xv = {
     .control = control,
     .draw_image = draw_image,
     .flip_page = flip_page,
+    .get_image = get_image,
     .uninit = uninit,
     .priv_size = sizeof(struct xvctx),
     .priv_defaults = &(const struct xvctx) {
@@ -505,6 +505,8 @@ int vo_x11_init(struct vo *vo)
 
     assert(!vo->x11);
 
+    // Must happen before any other Xlib call in the process (see client.h).
+    // Required by vo_xv's get_image(), which runs on the decoder threads.
     XInitThreads();
 
     struct vo_x11_state *x11 = talloc_ptrtype(NULL, x11);
@@ -34,6 +34,7 @@
 #include "csputils.h"
 #include "common/msg.h"
 #include "video/filter/vf.h"
+#include "misc/thread_pool.h"
 #include "osdep/endian.h"
 
 //global sws_flags from the command line
@@ -248,6 +249,99 @@ int mp_sws_reinit(struct mp_sws_context *ctx)
     return 1;
 }
 
+// Slices must start on a multiple of this (also keeps dither patterns intact).
+#define SLICE_ALIGN 16
+#define MAX_SLICES 64
+
+static bool filter_is_custom(struct SwsFilter *f)
+{
+    return f && ((f->lumV && f->lumV->length > 1) ||
+                 (f->chrV && f->chrV->length > 1) ||
+                 (f->lumH && f->lumH->length > 1) ||
+                 (f->chrH && f->chrH->length > 1));
+}
+
+// Return the number of slices the conversion can be split into (1 if it
+// can't be split). Splitting changes nothing about the output only if every
+// output row depends on the same input row, i.e. no vertical scaling, no
+// vertical chroma resampling, and no custom filters.
+static int get_num_slices(struct mp_sws_context *ctx, struct mp_image *dst,
+                          struct mp_image *src)
+{
+    if (!ctx->pool || src->h != dst->h)
+        return 1;
+    if (src->fmt.chroma_ys != dst->fmt.chroma_ys)
+        return 1;
+    if (src->fmt.chroma_ys && src->params.chroma_location !=
+                              dst->params.chroma_location)
+        return 1;
+    if ((src->fmt.flags | dst->fmt.flags) & MP_IMGFLAG_PAL)
+        return 1;
+    if (ctx->flags & SWS_SRC_V_CHR_DROP_MASK)
+        return 1;
+    if (filter_is_custom(ctx->src_filter) ||
+        filter_is_custom(ctx->dst_filter))
+        return 1;
+    int slices = MPMIN(mp_thread_pool_get_threads(ctx->pool), MAX_SLICES);
+    return MPMAX(MPMIN(slices, src->h / (SLICE_ALIGN * 4)), 1);
+}
+
+struct slice_job {
+    struct mp_sws_context *ctx;
+    struct mp_image *dst, *src;
+    int slice_h;
+    int res[MAX_SLICES];
+};
+
+static void scale_slice(void *ptr, int n)
+{
+    struct slice_job *job = ptr;
+    struct mp_sws_context *ctx = job->ctx;
+    struct mp_sws_context *sctx = ctx->slices[n];
+
+    sctx->log = ctx->log;
+    sctx->flags = ctx->flags & ~SWS_PRINT_INFO;
+    sctx->brightness = ctx->brightness;
+    sctx->contrast = ctx->contrast;
+    sctx->saturation = ctx->saturation;
+    sctx->params[0] = ctx->params[0];
+    sctx->params[1] = ctx->params[1];
+
+    int y0 = n * job->slice_h;
+    int y1 = MPMIN(y0 + job->slice_h, job->src->h);
+    struct mp_image src = *job->src, dst = *job->dst;
+    mp_image_crop(&src, 0, y0, src.w, y1);
+    mp_image_crop(&dst, 0, y0, dst.w, y1);
+    job->res[n] = mp_sws_scale(sctx, &dst, &src);
+}
+
+static int scale_slices(struct mp_sws_context *ctx, struct mp_image *dst,
+                        struct mp_image *src, int slices)
+{
+    int slice_h = (src->h + slices - 1) / slices;
+    slice_h = (slice_h + SLICE_ALIGN - 1) / SLICE_ALIGN * SLICE_ALIGN;
+    slices = (src->h + slice_h - 1) / slice_h;
+
+    if (ctx->num_slices != slices) {
+        for (int n = 0; n < ctx->num_slices; n++)
+            talloc_free(ctx->slices[n]);
+        ctx->slices = talloc_realloc(ctx, ctx->slices, struct mp_sws_context *,
+                                     slices);
+        for (int n = 0; n < slices; n++)
+            ctx->slices[n] = mp_sws_alloc(ctx);
+        ctx->num_slices = slices;
+    }
+
+    struct slice_job job = {ctx, dst, src, slice_h};
+    mp_thread_pool_run(ctx->pool, slices, scale_slice, &job);
+
+    for (int n = 0; n < slices; n++) {
+        if (job.res[n] < 0)
+            return job.res[n];
+    }
+    return 0;
+}
+
 // Scale from src to dst - if src/dst have different parameters from previous
 // calls, the context is reinitialized. Return error code. (It can fail if
 // reinitialization was necessary, and swscale returned an error.)
@@ -263,6 +357,10 @@ int mp_sws_scale(struct mp_sws_context *ctx, struct mp_image *dst,
         return r;
     }
 
+    int slices = get_num_slices(ctx, dst, src);
+    if (slices > 1)
+        return scale_slices(ctx, dst, src, slices);
+
     sws_scale(ctx->sws, (const uint8_t *const *) src->planes, src->stride,
               0, src->h, dst->planes, dst->stride);
     return 0;
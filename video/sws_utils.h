@@ -7,6 +7,7 @@
 
 struct mp_image;
 struct sws_opts;
+struct mp_thread_pool;
 
 // libswscale currently requires 16 bytes alignment for row pointers and
 // strides. Otherwise, it will print warnings and use slow codepaths.
@@ -48,6 +49,13 @@ struct mp_sws_context {
 
     // Contains parameters for which sws is valid
     struct mp_sws_context *cached;
+
+    // If set, conversions which don't scale vertically are split into
+    // horizontal slices, which are converted in parallel on this pool.
+    struct mp_thread_pool *pool;
+    // Per-slice contexts (internal)
+    struct mp_sws_context **slices;
+    int num_slices;
 };
 
 struct mp_sws_context *mp_sws_alloc(void *talloc_ctx);
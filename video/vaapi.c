@@ -23,6 +23,7 @@
 #include "osdep/threads.h"
 #include "mp_image.h"
 #include "img_format.h"
+#include "image_alloc.h"
 #include "mp_image_pool.h"
 
 bool check_va_status(struct mp_log *log, VAStatus status, const char *msg)
@@ -375,6 +376,7 @@ int va_surface_upload(struct mp_image *va_dst, struct mp_image *sw_src)
     if (!va_image_map(p->ctx, &p->image, &img))
         return -1;
     mp_image_copy(&img, sw_src);
+    mp_image_alloc_count_copy();
     va_image_unmap(p->ctx, &p->image);
 
     if (!p->is_derived) {
@@ -418,8 +420,10 @@ static struct mp_image *try_download(struct mp_image *src,
     struct mp_image tmp;
     if (va_image_map(p->ctx, image, &tmp)) {
         dst = mp_image_pool_get(pool, tmp.imgfmt, tmp.w, tmp.h);
-        if (dst)
+        if (dst) {
             mp_image_copy(dst, &tmp);
+            mp_image_alloc_count_copy();
+        }
         va_image_unmap(p->ctx, image);
     }
     mp_image_copy_attributes(dst, src);
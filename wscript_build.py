@@ -93,6 +93,7 @@ def build(ctx):
         ( "audio/audio_buffer.c" ),
         ( "audio/chmap.c" ),
         ( "audio/chmap_sel.c" ),
+        ( "audio/convert.c" ),
         ( "audio/fmt-conversion.c" ),
         ( "audio/format.c" ),
         ( "audio/mixer.c" ),
@@ -103,6 +104,7 @@ def build(ctx):
         ( "audio/filter/af_bs2b.c",              "libbs2b" ),
         ( "audio/filter/af_center.c" ),
         ( "audio/filter/af_channels.c" ),
+        ( "audio/filter/af_convolve.c" ),
         ( "audio/filter/af_delay.c" ),
         ( "audio/filter/af_drc.c" ),
         ( "audio/filter/af_dummy.c" ),
@@ -117,6 +119,7 @@ def build(ctx):
         ( "audio/filter/af_lavfi.c",             "libavfilter" ),
         ( "audio/filter/af_lavrresample.c" ),
         ( "audio/filter/af_pan.c" ),
+        ( "audio/filter/af_peq.c" ),
         ( "audio/filter/af_rubberband.c",        "rubberband" ),
         ( "audio/filter/af_scaletempo.c" ),
         ( "audio/filter/af_sinesuppress.c" ),
@@ -124,7 +127,10 @@ def build(ctx):
         ( "audio/filter/af_surround.c" ),
         ( "audio/filter/af_sweep.c" ),
         ( "audio/filter/af_volume.c" ),
+        ( "audio/filter/biquad.c" ),
+        ( "audio/filter/convolver.c" ),
         ( "audio/filter/filter.c" ),
+        ( "audio/filter/sample_op.c" ),
         ( "audio/filter/tools.c" ),
         ( "audio/filter/window.c" ),
         ( "audio/out/ao.c" ),
@@ -200,6 +206,7 @@ def build(ctx):
         ( "misc/json.c" ),
         ( "misc/ring.c" ),
         ( "misc/rendezvous.c" ),
+        ( "misc/thread_pool.c" ),
 
         ## Options
         ( "options/m_config.c" ),
@@ -280,6 +287,7 @@ def build(ctx):
         ## Video
         ( "video/csputils.c" ),
         ( "video/fmt-conversion.c" ),
+        ( "video/image_alloc.c" ),
         ( "video/image_writer.c" ),
         ( "video/img_format.c" ),
         ( "video/mp_image.c" ),
@@ -416,7 +424,8 @@ def build(ctx):
                 ctx.path.find_node('osdep/mpv.rc'),
                 ctx.path.find_node(node))
 
-    if ctx.dependency_satisfied('cplayer') or ctx.dependency_satisfied('test'):
+    if ctx.dependency_satisfied('cplayer') or ctx.dependency_satisfied('test') \
+            or ctx.dependency_satisfied('bench'):
         ctx(
             target       = "objects",
             source       = ctx.filtered_sources(sources),
@@ -462,6 +471,16 @@ def build(ctx):
                 features = "c cprogram",
             )
 
+    if ctx.dependency_satisfied('bench'):
+        for bench in ctx.path.ant_glob("test/bench/*.c"):
+            ctx(
+                target   = os.path.splitext(bench.srcpath())[0],
+                source   = bench.srcpath(),
+                use      = ctx.dependencies_use() + ['objects'],
+                includes = _all_includes(ctx),
+                features = "c cprogram",
+            )
+
     build_shared = ctx.dependency_satisfied('libmpv-shared')
     build_static = ctx.dependency_satisfied('libmpv-static')
     if build_shared or build_static: